@@ -25,6 +25,13 @@
         
 #include "cc/fs/file.h"
 
+#include "cc/b64.h"
+#include "cc/hash/sha256.h"
+#include "cc/macros.h"
+
+#include <stdio.h>  // snprintf
+#include <string.h> // memcpy
+
 /**
  * @brief Default constructor.
  *
@@ -33,7 +40,8 @@
 casper::hsm::API::API (const std::string& a_application)
     : application_(a_application)
 {
-    /* empty */
+    metrics_      = { /* slot_ */ 0, /* session_us_ */ 0, /* find_us_ */ 0, /* reused_ */ 0 };
+    link_failure_ = false;
 }
 
 /**
@@ -42,7 +50,8 @@ casper::hsm::API::API (const std::string& a_application)
 casper::hsm::API::API (const casper::hsm::API& a_api)
  : application_(a_api.application_)
 {
-    /* empty */
+    metrics_      = { /* slot_ */ a_api.metrics_.slot_, /* session_us_ */ 0, /* find_us_ */ 0, /* reused_ */ 0 };
+    link_failure_ = false;
 }
 
 /**
@@ -78,6 +87,87 @@ void casper::hsm::API::LoadSharedResources (const std::string& a_directory)
     );
 }
 
+/**
+ * @brief Check if HSM can be reached, re-establishing any required session.
+ *
+ * @note Default implementation does nothing, there's no link to check.
+ */
+void casper::hsm::API::Probe ()
+{
+    link_failure_ = false;
+}
+
+/**
+ * @brief Perform all one-time work required by the first operation, before it's requested.
+ *
+ * @note Default implementation does nothing, there's nothing to prepare.
+ */
+void casper::hsm::API::Warm ()
+{
+    link_failure_ = false;
+}
+
+// MARK: -
+
+/**
+ * @brief Sign raw data, without throwing.
+ *
+ * @note Default implementation relies on \link Sign \link, so it only avoids exceptions at the caller's side.
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_data      Data to be signed.
+ * @param a_length    Data length, in bytes.
+ * @param o_signature Signature bytes.
+ *
+ * @return Operation status.
+ */
+casper::hsm::API::Status casper::hsm::API::TrySign (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature) noexcept
+{
+    try {
+        Sign(a_key, a_data, a_length, o_signature);
+    } catch (...) {
+        return Status { "signing data", 0 };
+    }
+    return Status { nullptr, 0 };
+}
+
+/**
+ * @brief Sign a precomputed SHA256 digest, without throwing.
+ *
+ * @note Default implementation does not support it, backends that can sign a DigestInfo must override it.
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_digest    SHA256 of data to be signed.
+ * @param o_signature Signature bytes.
+ *
+ * @return Operation status.
+ */
+casper::hsm::API::Status casper::hsm::API::TrySignDigest (const std::string& /* a_key */, const unsigned char /* a_digest */[CASPER_HSM_API_SHA256_LEN], std::vector<unsigned char>& /* o_signature */) noexcept
+{
+    return Status { "signing digest ( not supported by backend )", 0 };
+}
+
+/**
+ * @brief Produce an error message for a failed operation.
+ *
+ * @param a_status Operation status.
+ *
+ * @return Error message, empty on success.
+ */
+std::string casper::hsm::API::Describe (const casper::hsm::API::Status& a_status)
+{
+    if ( true == Succeeded(a_status) ) {
+        return "";
+    }
+    char buffer[256];
+    if ( 0 != a_status.code_ ) {
+        snprintf(buffer, sizeof(buffer), "An error occurred while calling '%s' function: 0x%08lx!", a_status.where_, a_status.code_);
+    } else {
+        snprintf(buffer, sizeof(buffer), "An error occurred while %s!", a_status.where_);
+    }
+    return buffer;
+}
+
 // MARK: -
 
 /**
@@ -115,3 +205,53 @@ void casper::hsm::API::TryCall (const std::function<void()>& a_run, const std::f
         }
     }
 }
+
+/**
+ * @brief Set the appropriated signing data payload to be used with a PKCS #1 v1.5 RSA mechanism.
+ *
+ * @param a_hash  Base64-encoded hash value to be signed.
+ * @param o_bytes Bytes to be signed, ASN1 header + sha256 ( Base64-decoded a_hash value ).
+ */
+void casper::hsm::API::SetSigningBytes (const std::string& a_hash, unsigned char o_bytes[CASPER_HSM_API_ASN1_PLUS_SHA256_LEN]) const
+{
+    unsigned char* buffer = nullptr;
+    TryCall(/* a_run */
+            [this, &buffer, &a_hash, &o_bytes] () {
+                // ... calculate maximum base64 decode size and ensure a buffer for decoder ...
+                const size_t mds = ::cc::base64_rfc4648::decoded_max_size(a_hash.length());
+                buffer = new unsigned char[mds];
+                // ... decode 'has' from base64 ...
+                const size_t ds = ::cc::base64_rfc4648::decode(buffer, mds, a_hash.c_str(), a_hash.length());
+                // ... calculate SHA256 digest and join it with signature prefix ...
+                SetSigningBytes(buffer, ds, o_bytes);
+            },
+            /* a_cleanup */
+            [&buffer] () {
+                if ( nullptr != buffer ) {
+                    delete [] buffer;
+                    buffer = nullptr;
+                }
+            }
+    );
+    // ... sanity check ...
+    CC_ASSERT(nullptr == buffer);
+}
+
+/**
+ * @brief Set the appropriated signing data payload to be used with a PKCS #1 v1.5 RSA mechanism.
+ *
+ * @param a_data   Data to be signed.
+ * @param a_length Data length, in bytes.
+ * @param o_bytes  Bytes to be signed, ASN1 header + sha256 ( a_data ).
+ */
+void casper::hsm::API::SetSigningBytes (const unsigned char* a_data, const size_t a_length, unsigned char o_bytes[CASPER_HSM_API_ASN1_PLUS_SHA256_LEN]) const
+{
+    // ... calculate SHA256 digest ...
+    ::cc::hash::SHA256 sha256;
+    sha256.Initialize();
+    sha256.Update(a_data, a_length);
+    const unsigned char* const digest = sha256.Final();
+    // ... join SHA256 signature prefix and SHA56 digest ...
+    memcpy(o_bytes, ::cc::hash::SHA256::sk_signature_prefix_, ::cc::hash::SHA256::sk_signature_prefix_size_);
+    memcpy(o_bytes + ::cc::hash::SHA256::sk_signature_prefix_size_, digest, SHA256_DIGEST_LENGTH);
+}
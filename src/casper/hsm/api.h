@@ -29,6 +29,14 @@
 #include <string>
 #include <functional>
 #include <map>
+#include <vector>
+
+#include <stdint.h> // uint64_t
+
+/* 19 byte ASN1 header + sha256 ( 32 byte ) size */
+#define CASPER_HSM_API_ASN1_PLUS_SHA256_LEN ( 19 + 32 )
+/* sha256 digest size */
+#define CASPER_HSM_API_SHA256_LEN 32
 
 namespace casper
 {
@@ -43,6 +51,23 @@ namespace casper
         class API : public ::cc::NonCopyable, public ::cc::NonMovable
         {
             
+        public: // Data Type(s)
+            
+            typedef struct {
+                SlotID   slot_;       //!< Slot ID in use, 0 if not applicable.
+                uint64_t session_us_; //!< Time spent opening and logging in sessions, in microseconds.
+                uint64_t find_us_;    //!< Time spent looking up private keys, in microseconds.
+                size_t   reused_;     //!< Number of operations that were performed on an already open session.
+            } Metrics;
+            
+            /**
+             * @brief Result of an operation that does not throw, error text is only produced when requested - see \link Describe \link.
+             */
+            typedef struct {
+                const char*   where_; //!< Failed step ( static string ), nullptr on success.
+                unsigned long code_;  //!< Backend specific error code, 0 when not applicable.
+            } Status;
+            
         private: // Const Data
             
             const std::string application_;
@@ -51,6 +76,11 @@ namespace casper
             
             std::map<std::string, std::string> certificates_;
             
+        protected: // Data
+            
+            Metrics                            metrics_;
+            bool                               link_failure_;
+            
         public: // Constructor(s) / Destructor
             
             API () = delete;
@@ -62,25 +92,73 @@ namespace casper
             
             virtual void Load   () = 0;
             virtual void Sign   (const std::string& a_key, const std::string& a_hash, std::string& o_signature) = 0;
+            virtual void Sign   (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature) = 0;
             virtual void Unload () noexcept = 0;
 
         public: // Method(s) // Function(s)
 
             virtual void LoadSharedResources (const std::string& a_directory);
-
-        protected: // Method(s) // Function(s)
+            virtual void Probe               ();
+            virtual void Warm                ();
             
-            void TryCall (const std::function<void()>& a_run, const std::function<void()>& a_cleanup) const;
-        
-        protected: // Inline Method(s) // Function(s)
+        public: // Method(s) // Function(s) - hot path, no exceptions
+            
+            virtual Status TrySign       (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature) noexcept;
+            virtual Status TrySignDigest (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN], std::vector<unsigned char>& o_signature) noexcept;
+            
+        public: // Static Method(s) // Function(s)
+            
+            static std::string Describe (const Status& a_status);
+            
+        public: // Inline Method(s) // Function(s)
+            
+            /**
+             * @brief Reset metrics collected so far, slot is preserved.
+             */
+            inline void ResetMetrics ()
+            {
+                metrics_.session_us_ = 0;
+                metrics_.find_us_    = 0;
+                metrics_.reused_     = 0;
+            }
+            
+            /**
+             * @return R/O access to metrics collected since last \link ResetMetrics \link call.
+             */
+            inline const Metrics& metrics () const
+            {
+                return metrics_;
+            }
+            
+            /**
+             * @return True if provided status represents a success.
+             */
+            static inline bool Succeeded (const Status& a_status)
+            {
+                return ( nullptr == a_status.where_ );
+            }
+            
+            /**
+             * @return True if last operation failed because HSM could not be reached.
+             */
+            inline bool link_failure () const
+            {
+                return link_failure_;
+            }
             
             /**
              * @return R/O access to loaded certificates map.
              */
-            inline const std::map<std::string, std::string> certificates () const
+            inline const std::map<std::string, std::string>& certificates () const
             {
                 return certificates_;
             }
+
+        protected: // Method(s) // Function(s)
+            
+            void TryCall         (const std::function<void()>& a_run, const std::function<void()>& a_cleanup) const;
+            void SetSigningBytes (const std::string& a_hash, unsigned char o_bytes[CASPER_HSM_API_ASN1_PLUS_SHA256_LEN]) const;
+            void SetSigningBytes (const unsigned char* a_data, const size_t a_length, unsigned char o_bytes[CASPER_HSM_API_ASN1_PLUS_SHA256_LEN]) const;
             
         }; // end of class 'API'
         
@@ -0,0 +1,214 @@
+/**
+ * @file auditor.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/auditor.h"
+
+#include "casper/hsm/api.h" // casper::hsm::Exception
+
+#include <algorithm> // std::min
+#include <chrono>    // std::chrono
+
+#include <errno.h>
+#include <fcntl.h>     // open
+#include <string.h>    // memcpy, memset, strerror
+#include <sys/stat.h>  // fstat
+#include <unistd.h>    // write, fdatasync, close, getpid
+
+/**
+ * @brief Default constructor, opens ( or creates ) audit file and starts writer thread.
+ *
+ * @param a_config See \link Config \link.
+ */
+casper::hsm::Auditor::Auditor (const casper::hsm::Auditor::Config& a_config)
+    : config_(a_config), pid_(static_cast<uint32_t>(getpid())),
+      ring_(nullptr), mask_(0), head_(0), tail_(0), lost_(0), fd_(-1), stop_(false)
+{
+    // ... capacity must be a power of 2 ...
+    uint64_t capacity = 1;
+    while ( capacity < static_cast<uint64_t>(std::max(config_.capacity_, static_cast<size_t>(2))) ) {
+        capacity <<= 1;
+    }
+    mask_ = capacity - 1;
+    // ... open file ...
+    const std::string uri = config_.path_ + '.' + std::to_string(pid_);
+    fd_ = open(uri.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+    if ( -1 == fd_ ) {
+        throw ::casper::hsm::Exception("Unable to open audit file '%s': %s!", uri.c_str(), strerror(errno));
+    }
+    // ... new file? write header ...
+    struct stat st;
+    if ( 0 == fstat(fd_, &st) && 0 == st.st_size ) {
+        Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic_, CASPER_HSM_AUDITOR_MAGIC, sizeof(CASPER_HSM_AUDITOR_MAGIC));
+        header.version_     = CASPER_HSM_AUDITOR_VERSION;
+        header.record_size_ = static_cast<uint32_t>(sizeof(Record));
+        if ( false == Write(&header, sizeof(header)) ) {
+            const int error = errno;
+            close(fd_);
+            throw ::casper::hsm::Exception("Unable to write audit file '%s' header: %s!", uri.c_str(), strerror(error));
+        }
+    }
+    // ... ring ...
+    ring_ = new Record[capacity];
+    // ... start writer ...
+    thread_ = std::thread(&casper::hsm::Auditor::Loop, this);
+}
+
+/**
+ * @brief Destructor, pending records are written before returning.
+ */
+casper::hsm::Auditor::~Auditor ()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if ( true == thread_.joinable() ) {
+        thread_.join();
+    }
+    close(fd_);
+    delete [] ring_;
+}
+
+/**
+ * @brief Append a record, never blocks - must always be called by the same thread.
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_digest    SHA256 of signed data.
+ * @param a_requester Requester identification.
+ * @param a_status    Operation status.
+ *
+ * @return False if ring is full and record was lost.
+ */
+bool casper::hsm::Auditor::Append (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_AUDITOR_DIGEST_LEN], const std::string& a_requester,
+                                   const casper::hsm::Auditor::Status a_status) noexcept
+{
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    // ... full?
+    if ( head - tail_.load(std::memory_order_acquire) > mask_ ) {
+        lost_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    Record& record = ring_[head & mask_];
+    record.timestamp_us_     = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    record.pid_              = pid_;
+    record.status_           = static_cast<uint16_t>(a_status);
+    record.key_length_       = static_cast<uint8_t>(std::min(a_key.length(), sizeof(record.key_)));
+    record.requester_length_ = static_cast<uint8_t>(std::min(a_requester.length(), sizeof(record.requester_)));
+    record.lost_             = 0;
+    memcpy(record.digest_, a_digest, sizeof(record.digest_));
+    memcpy(record.key_, a_key.c_str(), record.key_length_);
+    memset(record.key_ + record.key_length_, 0, sizeof(record.key_) - record.key_length_);
+    memcpy(record.requester_, a_requester.c_str(), record.requester_length_);
+    memset(record.requester_ + record.requester_length_, 0, sizeof(record.requester_) - record.requester_length_);
+    // ... publish it ...
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+// MARK: -
+
+/**
+ * @brief Writer thread loop.
+ */
+void casper::hsm::Auditor::Loop ()
+{
+    bool stop = false;
+    while ( false == stop ) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait_for(lock, std::chrono::milliseconds(config_.flush_ms_), [this] { return stop_; });
+            stop = stop_;
+        }
+        Flush();
+    }
+}
+
+/**
+ * @brief Write all published records and sync file, once per batch.
+ */
+void casper::hsm::Auditor::Flush () noexcept
+{
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const uint64_t lost = lost_.exchange(0, std::memory_order_relaxed);
+    if ( head == tail && 0 == lost ) {
+        return;
+    }
+    // ... records that didn't fit first ...
+    if ( lost > 0 ) {
+        Record record;
+        memset(&record, 0, sizeof(record));
+        record.timestamp_us_ = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+        record.pid_          = pid_;
+        record.status_       = static_cast<uint16_t>(Status::Lost);
+        record.lost_         = static_cast<uint32_t>(std::min(lost, static_cast<uint64_t>(UINT32_MAX)));
+        (void)Write(&record, sizeof(record));
+    }
+    // ... ring might wrap, at most two contiguous chunks ...
+    uint64_t next = tail;
+    while ( next < head ) {
+        const uint64_t index = next & mask_;
+        const uint64_t count = std::min(head - next, mask_ + 1 - index);
+        if ( false == Write(&ring_[index], static_cast<size_t>(count) * sizeof(Record)) ) {
+            // ... reported with next batch ...
+            lost_.fetch_add(head - next, std::memory_order_relaxed);
+            break;
+        }
+        next += count;
+    }
+    // ... group sync ...
+#ifdef __APPLE__
+    (void)fsync(fd_);
+#else
+    (void)fdatasync(fd_);
+#endif
+    // ... release slots, even if write failed - producer can't wait for disk ...
+    tail_.store(head, std::memory_order_release);
+}
+
+/**
+ * @brief Write all bytes, retrying on partial writes and interruptions.
+ *
+ * @param a_data   Data to write.
+ * @param a_length Data length, in bytes.
+ *
+ * @return True on success, false otherwise ( errno is set ).
+ */
+bool casper::hsm::Auditor::Write (const void* a_data, const size_t a_length) noexcept
+{
+    const char* ptr       = static_cast<const char*>(a_data);
+    size_t      remaining = a_length;
+    while ( remaining > 0 ) {
+        const ssize_t written = write(fd_, ptr, remaining);
+        if ( -1 == written ) {
+            if ( EINTR == errno ) {
+                continue;
+            }
+            return false;
+        }
+        ptr       += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    return true;
+}
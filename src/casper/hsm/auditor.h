@@ -0,0 +1,146 @@
+/**
+ * @file auditor.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_AUDITOR_H_
+#define CASPER_HSM_AUDITOR_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <stdint.h> // uint64_t
+
+#define CASPER_HSM_AUDITOR_MAGIC         "CHSMAUD"
+#define CASPER_HSM_AUDITOR_VERSION       1
+#define CASPER_HSM_AUDITOR_DIGEST_LEN    32
+#define CASPER_HSM_AUDITOR_KEY_LEN       40
+#define CASPER_HSM_AUDITOR_REQUESTER_LEN 36
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief Signing operations audit log.
+         *
+         * Records are appended to a single producer / single consumer lock-free ring, a background thread
+         * writes them in batches and syncs the file once per batch. Appending never blocks: when the ring is
+         * full the record is counted as lost and a 'lost' record is written with the next batch.
+         *
+         * File is '<path>.<pid>', a \link Header \link followed by fixed size \link Record \link entries, host byte order.
+         */
+        class Auditor final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+        
+        public: // Data Type(s)
+            
+            typedef struct {
+                std::string path_;     //!< File path prefix, process ID is appended.
+                size_t      capacity_; //!< Ring capacity, in records, rounded up to a power of 2.
+                uint64_t    flush_ms_; //!< Maximum time a record waits in ring before being written.
+            } Config;
+            
+            enum class Status : uint16_t {
+                Signed = 0,
+                Failed,
+                Lost
+            };
+            
+            typedef struct {
+                char     magic_[8];    //!< CASPER_HSM_AUDITOR_MAGIC, '\0' terminated.
+                uint32_t version_;     //!< CASPER_HSM_AUDITOR_VERSION.
+                uint32_t record_size_; //!< sizeof(Record).
+            } Header;
+            
+            typedef struct {
+                uint64_t      timestamp_us_;                                //!< Wall clock, microseconds since epoch.
+                uint32_t      pid_;
+                uint16_t      status_;                                      //!< See \link Status \link.
+                uint8_t       key_length_;
+                uint8_t       requester_length_;
+                uint32_t      lost_;                                        //!< Number of lost records, only for Status::Lost.
+                unsigned char digest_[CASPER_HSM_AUDITOR_DIGEST_LEN];       //!< SHA256 of signed data.
+                char          key_[CASPER_HSM_AUDITOR_KEY_LEN];             //!< HSM private key token label, truncated.
+                char          requester_[CASPER_HSM_AUDITOR_REQUESTER_LEN]; //!< Requester, truncated.
+            } Record;
+        
+        private: // Const Data
+            
+            const Config                  config_;
+            const uint32_t                pid_;
+        
+        private: // Data
+            
+            Record*                       ring_;
+            uint64_t                      mask_;
+            std::atomic<uint64_t>         head_;           //!< Next slot to write, written by producer only.
+            char                          head_pad_[64];   //!< Keep producer and consumer indexes in different cache lines.
+            std::atomic<uint64_t>         tail_;           //!< Next slot to read, written by consumer only.
+            char                          tail_pad_[64];
+            std::atomic<uint64_t>         lost_;
+            int                           fd_;
+            std::mutex                    mutex_;
+            std::condition_variable       cv_;
+            bool                          stop_;
+            std::thread                   thread_;
+        
+        public: // Constructor(s) / Destructor
+            
+            Auditor () = delete;
+            Auditor (const Config& a_config);
+            virtual ~Auditor ();
+        
+        public: // Method(s) / Function(s)
+            
+            bool Append (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_AUDITOR_DIGEST_LEN], const std::string& a_requester, const Status a_status) noexcept;
+        
+        public: // Inline Method(s) / Function(s)
+            
+            /**
+             * @return Number of records lost because ring was full and not yet reported in file.
+             */
+            inline uint64_t lost () const
+            {
+                return lost_.load(std::memory_order_relaxed);
+            }
+        
+        private: // Method(s) / Function(s)
+            
+            void Loop  ();
+            void Flush () noexcept;
+            bool Write (const void* a_data, const size_t a_length) noexcept;
+        
+        }; // end of class 'Auditor'
+        
+        static_assert(128 == sizeof(Auditor::Record), "unexpected audit record size");
+    
+    } // end of namespace 'hsm'
+
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_AUDITOR_H_
@@ -0,0 +1,575 @@
+/**
+ * @file backend.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/backend.h"
+
+#include <algorithm> // std::max
+#include <chrono>    // std::chrono
+
+// MARK: -
+
+/**
+ * @brief Default constructor.
+ */
+casper::hsm::Backend::Backend ()
+    : api_(nullptr), factory_({ nullptr, nullptr }), prober_(nullptr), hedging_({ /* budget_ */ 0, /* min_samples_ */ 0 }), hedger_(nullptr),
+      verifier_threads_(0), verifier_(nullptr), chains_(nullptr), cms_(nullptr), statistics_(nullptr)
+{
+    /* empty */
+}
+
+/**
+ * @brief Destructor.
+ */
+casper::hsm::Backend::~Backend ()
+{
+    if ( nullptr != prober_ ) {
+        delete prober_;
+    }
+    if ( nullptr != hedger_ ) {
+        delete hedger_;
+    }
+    if ( nullptr != verifier_ ) {
+        delete verifier_;
+    }
+    if ( nullptr != chains_ ) {
+        delete chains_;
+    }
+    if ( nullptr != cms_ ) {
+        delete cms_;
+    }
+    if ( nullptr != statistics_ ) {
+        delete statistics_;
+    }
+    if ( nullptr != api_ ) {
+        api_->Unload();
+        delete api_;
+    }
+}
+
+// MARK: -
+
+/**
+ * @brief This method must ( and can only ) be called once to initialize HSM engine.
+ *
+ * @param a_share_dir Shared directory URI.
+ * @param a_factory   Function to call to create new instances when needed.
+ */
+void casper::hsm::Backend::Startup (const std::string& a_share_dir, Factory a_factory)
+{
+    // ... if already initialized ...
+    if ( nullptr != api_ ) {
+        // ... can't be initialized twice ...
+        throw std::runtime_error("HSM backend already initialized!");
+    }
+    // ... keep track of factory ...
+    share_dir_ = a_share_dir;
+    factory_   = a_factory;
+    // ... setup HSM session ...
+    api_ = factory_.new_();
+    api_->LoadSharedResources(share_dir_);
+    api_->Load();
+}
+
+/**
+ * @brief Recycle an API object.
+ */
+void casper::hsm::Backend::Recycle ()
+{
+    // ... if NOT initialized ...
+    if ( nullptr == api_ ) {
+        // ... nothing to recycle ...
+        return;
+    }
+    auto n = factory_.clone_(api_);
+    delete api_;
+    api_ = n;
+    api_->LoadSharedResources(share_dir_);
+    api_->Load();
+}
+
+/**
+ * @brief Call this no longer required to be alive.
+ */
+void casper::hsm::Backend::Shutdown ()
+{
+    // ... if NOT initialized ...
+    if ( nullptr == api_ ) {
+        // ... nothing to shutdown ...
+        return;
+    }
+    // ... probe and hedging threads first ...
+    if ( nullptr != prober_ ) {
+        delete prober_;
+        prober_ = nullptr;
+    }
+    if ( nullptr != hedger_ ) {
+        delete hedger_;
+        hedger_ = nullptr;
+    }
+    // ... certificates might change on next startup ...
+    if ( nullptr != verifier_ ) {
+        delete verifier_;
+        verifier_ = nullptr;
+    }
+    if ( nullptr != chains_ ) {
+        delete chains_;
+        chains_ = nullptr;
+    }
+    if ( nullptr != cms_ ) {
+        delete cms_;
+        cms_ = nullptr;
+    }
+    // ... can be reused ...
+    api_->Unload();
+    delete api_;
+    api_ = nullptr;
+}
+
+// MARK: -
+
+/**
+ * @brief Sign an hash.
+ *
+ * @param a_key         HSM private key token label.
+ * @param a_hash        Base64-encoded hash value to be signed.
+ * @param o_signature   Base64-encoded signature value.
+ */
+void casper::hsm::Backend::Sign (const std::string& a_key, const std::string& a_hash, std::string& o_signature)
+{
+    // ... if NOT initialized ...
+    if ( nullptr == api_ ) {
+        throw std::runtime_error("HSM backend NOT initialized!");
+    }
+    // ... circuit open? fail fast ...
+    if ( Breaker::State::Open == breaker_.state() ) {
+        throw ::casper::hsm::Exception("HSM slot %lu is unavailable: %s!", api_->metrics().slot_, "circuit is open");
+    }
+    try {
+        api_->Sign(a_key, a_hash, o_signature);
+    } catch (...) {
+        // ... only link failures count, any other error means HSM was reached ...
+        if ( true == api_->link_failure() ) {
+            breaker_.Failure();
+        } else {
+            breaker_.Success();
+        }
+        throw;
+    }
+    breaker_.Success();
+}
+
+/**
+ * @brief Sign raw data.
+ *
+ * @param a_key         HSM private key token label.
+ * @param a_data        Data to be signed.
+ * @param a_length      Data length, in bytes.
+ * @param o_signature   Signature bytes.
+ */
+void casper::hsm::Backend::Sign (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature)
+{
+    // ... if NOT initialized ...
+    if ( nullptr == api_ ) {
+        throw std::runtime_error("HSM backend NOT initialized!");
+    }
+    const API::Status status = TrySign(a_key, a_data, a_length, o_signature);
+    if ( false == API::Succeeded(status) ) {
+        throw ::casper::hsm::Exception("%s", API::Describe(status).c_str());
+    }
+}
+
+/**
+ * @brief Sign raw data, without throwing - error text, if needed, should be obtained with \link API::Describe \link.
+ *
+ * @param a_key         HSM private key token label.
+ * @param a_data        Data to be signed.
+ * @param a_length      Data length, in bytes.
+ * @param o_signature   Signature bytes.
+ *
+ * @return Operation status.
+ */
+casper::hsm::API::Status casper::hsm::Backend::TrySign (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature) noexcept
+{
+    return Dispatch(a_key, a_data, a_length, /* a_prehashed */ false, o_signature);
+}
+
+/**
+ * @brief Sign a precomputed SHA256 digest, without throwing - error text, if needed, should be obtained with \link API::Describe \link.
+ *
+ * @param a_key         HSM private key token label.
+ * @param a_digest      SHA256 of data to be signed.
+ * @param o_signature   Signature bytes.
+ *
+ * @return Operation status.
+ */
+casper::hsm::API::Status casper::hsm::Backend::TrySignDigest (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN], std::vector<unsigned char>& o_signature) noexcept
+{
+    return Dispatch(a_key, a_digest, CASPER_HSM_API_SHA256_LEN, /* a_prehashed */ true, o_signature);
+}
+
+/**
+ * @brief Reset current API metrics.
+ */
+void casper::hsm::Backend::ResetMetrics ()
+{
+    // ... if NOT initialized ...
+    if ( nullptr == api_ ) {
+        throw std::runtime_error("HSM backend NOT initialized!");
+    }
+    api_->ResetMetrics();
+}
+
+/**
+ * @return R/O access to current API metrics.
+ */
+const casper::hsm::API::Metrics& casper::hsm::Backend::metrics () const
+{
+    // ... if NOT initialized ...
+    if ( nullptr == api_ ) {
+        throw std::runtime_error("HSM backend NOT initialized!");
+    }
+    return api_->metrics();
+}
+
+/**
+ * @brief Perform all one-time work required by the first sign operation, before it's requested:
+ *        sessions are opened, logged in and keys handles are resolved, hedging lanes are started.
+ */
+void casper::hsm::Backend::Warm ()
+{
+    // ... if NOT initialized ...
+    if ( nullptr == api_ ) {
+        throw std::runtime_error("HSM backend NOT initialized!");
+    }
+    try {
+        api_->Warm();
+    } catch (...) {
+        if ( true == api_->link_failure() ) {
+            breaker_.Failure();
+        }
+        throw;
+    }
+    StartHedger();
+}
+
+// MARK: - Circuit Breaker
+
+/**
+ * @brief Set circuit breaker configuration, can be called before \link Startup \link.
+ *
+ * @param a_config See \link Breaker::Config \link.
+ */
+void casper::hsm::Backend::SetupBreaker (const casper::hsm::Breaker::Config& a_config)
+{
+    breaker_.Setup(a_config);
+}
+
+/**
+ * @brief Check if HSM work can be started, without waiting for any HSM call to fail.
+ *
+ * @return False when circuit is open.
+ */
+bool casper::hsm::Backend::Available ()
+{
+    return breaker_.Allow();
+}
+
+/**
+ * @brief When circuit is open and cooldown has elapsed, try to re-establish HSM session.
+ *
+ * @note Meant to be called periodically, in background: probe itself runs on \link Prober \link thread, this call
+ *       only submits it and collects the outcome of a previous one - it never blocks on HSM.
+ */
+void casper::hsm::Backend::Probe ()
+{
+    // ... if NOT initialized ...
+    if ( nullptr == api_ ) {
+        return;
+    }
+    // ... collect previous probe outcome, if any ...
+    if ( nullptr != prober_ ) {
+        std::string error;
+        switch ( prober_->Poll(error) ) {
+            case Prober::Result::Running:
+                return;
+            case Prober::Result::Succeeded:
+                // ... probe session is fresh, use it from now on ...
+                api_ = prober_->Exchange(api_);
+                breaker_.Success();
+                return;
+            case Prober::Result::Failed:
+                // ... a trial request might have closed circuit meanwhile ...
+                if ( Breaker::State::Closed != breaker_.state() ) {
+                    breaker_.Failure();
+                }
+                throw ::casper::hsm::Exception("%s", error.c_str());
+            default:
+                break;
+        }
+    }
+    // ... if NOT required ...
+    if ( false == breaker_.Probe() ) {
+        return;
+    }
+    // ... probe thread is started on first need ...
+    if ( nullptr == prober_ ) {
+        prober_ = new Prober(factory_.clone_(api_), share_dir_);
+    }
+    prober_->Submit();
+}
+
+/**
+ * @return Number of seconds after which HSM work can be retried, 0 if circuit is closed.
+ */
+uint64_t casper::hsm::Backend::retry_after () const
+{
+    const uint64_t remaining = breaker_.remaining();
+    if ( Breaker::State::Closed == breaker_.state() ) {
+        return 0;
+    }
+    return std::max(( remaining + 999 ) / 1000, static_cast<uint64_t>(1));
+}
+
+// MARK: - Hedging
+
+/**
+ * @brief Set hedging configuration, can be called before \link Startup \link.
+ *
+ * @param a_config See \link Hedger::Config \link, a 0% budget disables hedging.
+ */
+void casper::hsm::Backend::SetupHedging (const casper::hsm::Hedger::Config& a_config)
+{
+    // ... lanes will be restarted on next use ...
+    if ( nullptr != hedger_ ) {
+        delete hedger_;
+        hedger_ = nullptr;
+    }
+    hedging_ = a_config;
+}
+
+/**
+ * @return Number of hedged operations, since hedging lanes were started.
+ */
+uint64_t casper::hsm::Backend::hedged () const
+{
+    return ( nullptr != hedger_ ? hedger_->hedged() : 0 );
+}
+
+// MARK: - Statistics
+
+/**
+ * @brief Enable ( or disable ) statistics, can be called before \link Startup \link.
+ *
+ * @param a_state Shared state, already initialized - see \link Statistics::Initialize \link, nullptr to disable.
+ */
+void casper::hsm::Backend::SetupStatistics (casper::hsm::Statistics::State* a_state)
+{
+    if ( nullptr != statistics_ ) {
+        delete statistics_;
+        statistics_ = nullptr;
+    }
+    if ( nullptr != a_state ) {
+        statistics_ = new Statistics(*a_state);
+    }
+}
+
+// MARK: - Verification
+
+/**
+ * @brief Set number of helper threads used to verify signatures, can be called before \link Startup \link.
+ *
+ * @param a_threads Number of helper threads, 0 - calling thread only.
+ */
+void casper::hsm::Backend::SetupVerifier (const size_t a_threads)
+{
+    // ... will be restarted on next use ...
+    if ( nullptr != verifier_ ) {
+        delete verifier_;
+        verifier_ = nullptr;
+    }
+    verifier_threads_ = a_threads;
+}
+
+/**
+ * @brief Verify signatures locally, using loaded certificates - HSM is not used.
+ *
+ * @param a_items See \link Verifier::Verify \link.
+ */
+void casper::hsm::Backend::Verify (std::vector<casper::hsm::Verifier::Item>& a_items)
+{
+    // ... if NOT initialized ...
+    if ( nullptr == api_ ) {
+        throw std::runtime_error("HSM backend NOT initialized!");
+    }
+    // ... public keys are parsed on first use ...
+    if ( nullptr == verifier_ ) {
+        verifier_ = new Verifier(api_->certificates(), verifier_threads_);
+    }
+    verifier_->Verify(a_items);
+}
+
+// MARK: - Certificate Chains
+
+/**
+ * @brief Obtain a key certificate chain, already serialized as a JSON fragment.
+ *
+ * @param a_key HSM private key token label ( certificate name ).
+ *
+ * @return See \link Chains \link, 'null' if there's no certificate for the provided key.
+ */
+const std::string& casper::hsm::Backend::Chain (const std::string& a_key)
+{
+    // ... if NOT initialized ...
+    if ( nullptr == api_ ) {
+        throw std::runtime_error("HSM backend NOT initialized!");
+    }
+    // ... all chains are built and serialized on first use ...
+    if ( nullptr == chains_ ) {
+        chains_ = new Chains(api_->certificates());
+    }
+    return chains_->fragment(a_key);
+}
+
+/**
+ * @brief Obtain CMS SignedData assembler.
+ *
+ * @return See \link CMS \link, per key DER fragments are encoded on first use.
+ */
+const casper::hsm::CMS& casper::hsm::Backend::cms ()
+{
+    // ... if NOT initialized ...
+    if ( nullptr == api_ ) {
+        throw std::runtime_error("HSM backend NOT initialized!");
+    }
+    // ... all fragments are encoded on first use ...
+    if ( nullptr == cms_ ) {
+        cms_ = new CMS(api_->certificates());
+    }
+    return *cms_;
+}
+
+// MARK: -
+
+/**
+ * @brief Start hedging lanes, if enabled and not started yet.
+ */
+void casper::hsm::Backend::StartHedger ()
+{
+    if ( 0 == hedging_.budget_ || nullptr != hedger_ ) {
+        return;
+    }
+    hedger_ = new Hedger(hedging_, [this] () -> API* {
+        API* api = factory_.clone_(api_);
+        try {
+            api->LoadSharedResources(share_dir_);
+            api->Load();
+            api->Warm();
+        } catch (...) {
+            delete api;
+            throw;
+        }
+        return api;
+    });
+}
+
+/**
+ * @brief Perform a sign operation, accounting it in statistics - when enabled.
+ *
+ * @param a_key         HSM private key token label.
+ * @param a_data        Data to be signed, or it's SHA256 digest.
+ * @param a_length      Data length, in bytes.
+ * @param a_prehashed   True when data is a SHA256 digest.
+ * @param o_signature   Signature bytes.
+ *
+ * @return Operation status.
+ */
+casper::hsm::API::Status casper::hsm::Backend::Dispatch (const std::string& a_key, const unsigned char* a_data, const size_t a_length, const bool a_prehashed,
+                                                         std::vector<unsigned char>& o_signature) noexcept
+{
+    if ( nullptr == statistics_ ) {
+        return Route(a_key, a_data, a_length, a_prehashed, o_signature);
+    }
+    statistics_->Begin();
+    const auto        start  = std::chrono::steady_clock::now();
+    const API::Status status = Route(a_key, a_data, a_length, a_prehashed, o_signature);
+    statistics_->End(a_key, status.code_, API::Succeeded(status),
+                     static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+    return status;
+}
+
+/**
+ * @brief Route a sign operation to hedging lanes or API, keeping track of HSM link state.
+ *
+ * @param a_key         HSM private key token label.
+ * @param a_data        Data to be signed, or it's SHA256 digest.
+ * @param a_length      Data length, in bytes.
+ * @param a_prehashed   True when data is a SHA256 digest.
+ * @param o_signature   Signature bytes.
+ *
+ * @return Operation status.
+ */
+casper::hsm::API::Status casper::hsm::Backend::Route (const std::string& a_key, const unsigned char* a_data, const size_t a_length, const bool a_prehashed,
+                                                      std::vector<unsigned char>& o_signature) noexcept
+{
+    // ... if NOT initialized ...
+    if ( nullptr == api_ ) {
+        return API::Status { "signing data ( HSM backend NOT initialized )", 0 };
+    }
+    // ... circuit open? fail fast ...
+    if ( Breaker::State::Open == breaker_.state() ) {
+        return API::Status { "reaching HSM ( circuit is open )", 0 };
+    }
+    // ... hedging enabled? lanes are started on first use ( if not warmed ) ...
+    try {
+        StartHedger();
+    } catch (...) {
+        return API::Status { "starting hedging lanes", 0 };
+    }
+    API::Status status;
+    bool        link_failure;
+    if ( nullptr != hedger_ ) {
+        try {
+            status       = ( true == a_prehashed
+                            ? hedger_->TrySignDigest(a_key, a_data, o_signature)
+                            : hedger_->TrySign(a_key, a_data, a_length, o_signature)
+            );
+            link_failure = hedger_->link_failure();
+        } catch (...) {
+            // ... lanes synchronization failure, HSM state is unknown ...
+            return API::Status { "signing data ( hedging )", 0 };
+        }
+    } else {
+        status       = ( true == a_prehashed
+                        ? api_->TrySignDigest(a_key, a_data, o_signature)
+                        : api_->TrySign(a_key, a_data, a_length, o_signature)
+        );
+        link_failure = api_->link_failure();
+    }
+    // ... only link failures count, any other error means HSM was reached ...
+    if ( false == API::Succeeded(status) && true == link_failure ) {
+        breaker_.Failure();
+    } else {
+        breaker_.Success();
+    }
+    return status;
+}
+
@@ -0,0 +1,147 @@
+/**
+ * @file backend.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_BACKEND_H_
+#define CASPER_HSM_BACKEND_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include "casper/hsm/api.h"
+#include "casper/hsm/breaker.h"
+#include "casper/hsm/hedger.h"
+#include "casper/hsm/prober.h"
+#include "casper/hsm/statistics.h"
+#include "casper/hsm/verifier.h"
+#include "casper/hsm/chains.h"
+#include "casper/hsm/cms.h"
+
+#include <functional>
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief An HSM backend: API instance ( sessions ), circuit breaker, hedging lanes, verifier, certificate chains and CMS fragments.
+         *
+         * \link Singleton \link is the default one, named profiles each have their own - so one can't starve another.
+         */
+        class Backend : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+            
+        public: // Data Type(s)
+            
+            typedef struct {
+                std::function<::casper::hsm::API*()>                          new_;
+                std::function<::casper::hsm::API*(const ::casper::hsm::API*)> clone_;
+            } Factory;
+            
+        private: // Data
+            
+            std::string    share_dir_;
+            API*           api_;
+            Factory        factory_;
+            Breaker        breaker_;
+            Prober*        prober_;
+            Hedger::Config hedging_;
+            Hedger*        hedger_;
+            size_t         verifier_threads_;
+            Verifier*      verifier_;
+            Chains*        chains_;
+            CMS*           cms_;
+            Statistics*    statistics_;
+            
+        public: // Constructor(s) / Destructor
+            
+            Backend ();
+            virtual ~Backend ();
+            
+        public: // Method(s) / Function(s) - Oneshot call only!!!
+            
+            void Startup  (const std::string& a_share_dir, Factory a_factory);
+            void Recycle  ();
+            void Shutdown ();
+            void Sign     (const std::string& a_key, const std::string& a_hash, std::string& o_signature);
+            void Sign     (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature);
+            
+        public: // Method(s) / Function(s) - hot path, no exceptions
+            
+            API::Status TrySign       (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature) noexcept;
+            API::Status TrySignDigest (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN], std::vector<unsigned char>& o_signature) noexcept;
+            
+        public: // Method(s) / Function(s)
+            
+            void                Warm         ();
+            void                ResetMetrics ();
+            const API::Metrics& metrics      () const;
+            
+            void                SetupBreaker (const Breaker::Config& a_config);
+            bool                Available    ();
+            void                Probe        ();
+            uint64_t            retry_after  () const;
+            
+            void                SetupHedging (const Hedger::Config& a_config);
+            uint64_t            hedged       () const;
+            
+            void                SetupStatistics (Statistics::State* a_state);
+            
+            void                SetupVerifier (const size_t a_threads);
+            void                Verify        (std::vector<Verifier::Item>& a_items);
+            
+            const std::string&  Chain        (const std::string& a_key);
+            const CMS&          cms          ();
+            
+        public: // Inline Method(s) / Function(s)
+            
+            /**
+             * @return True if \link Startup \link was already called.
+             */
+            inline bool initialized () const
+            {
+                return ( nullptr != api_ );
+            }
+            
+            /**
+             * @return Shared statistics, nullptr if not enabled - see \link SetupStatistics \link.
+             */
+            inline Statistics* statistics () const
+            {
+                return statistics_;
+            }
+            
+        private: // Method(s) / Function(s)
+            
+            void        StartHedger ();
+            API::Status Dispatch    (const std::string& a_key, const unsigned char* a_data, const size_t a_length, const bool a_prehashed,
+                                     std::vector<unsigned char>& o_signature) noexcept;
+            API::Status Route       (const std::string& a_key, const unsigned char* a_data, const size_t a_length, const bool a_prehashed,
+                                     std::vector<unsigned char>& o_signature) noexcept;
+            
+        }; // end of class 'Backend'
+        
+    } // end of namespace 'hsm'
+    
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_BACKEND_H_
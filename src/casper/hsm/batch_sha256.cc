@@ -0,0 +1,419 @@
+/**
+ * @file batch_sha256.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/batch_sha256.h"
+
+#include <algorithm> // std::stable_sort
+#include <vector>
+
+#include <string.h> // memcpy, memset
+
+#if defined(__x86_64__) && ( defined(__GNUC__) || defined(__clang__) )
+  #define CASPER_HSM_BATCH_SHA256_X86 1
+  #include <cpuid.h>
+  #include <immintrin.h>
+#endif
+
+#define CASPER_HSM_BATCH_SHA256_LANES 8
+
+static const uint32_t sk_k_[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sk_h0_[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#define CASPER_HSM_BATCH_SHA256_ROTR(x, n) ( ( (x) >> (n) ) | ( (x) << ( 32 - (n) ) ) )
+
+/**
+ * @brief Hash a batch.
+ *
+ * @param a_jobs   Jobs, each one writes it's own digest.
+ * @param a_count  Number of jobs.
+ * @param a_engine Engine to use, \link Engine::Auto \link for the best one available ( an unavailable one falls back to scalar ).
+ */
+void casper::hsm::BatchSHA256::Run (casper::hsm::BatchSHA256::Job* a_jobs, const size_t a_count, const casper::hsm::BatchSHA256::Engine a_engine)
+{
+    Engine engine = ( Engine::Auto == a_engine ? BatchSHA256::engine() : a_engine );
+    // ... best engine does not imply others are supported ( e.g. SHA-NI without AVX2 ) ...
+    if ( false == Supported(engine) ) {
+        engine = Engine::Scalar;
+    }
+    if ( Engine::AVX2 != engine || a_count < CASPER_HSM_BATCH_SHA256_LANES ) {
+        for ( size_t idx = 0 ; idx < a_count ; ++idx ) {
+            Single(a_jobs[idx], ( Engine::AVX2 == engine ? Engine::Scalar : engine ));
+        }
+        return;
+    }
+    // ... lanes run in lockstep, so group jobs by number of padded blocks ( full + tail ) ...
+    std::vector<std::pair<size_t, Job*>> order;
+    order.reserve(a_count);
+    for ( size_t idx = 0 ; idx < a_count ; ++idx ) {
+        order.push_back(std::make_pair(( a_jobs[idx].length_ + 9 + 63 ) / 64, &a_jobs[idx]));
+    }
+    std::stable_sort(order.begin(), order.end(), [] (const std::pair<size_t, Job*>& a_lhs, const std::pair<size_t, Job*>& a_rhs) {
+        return a_lhs.first < a_rhs.first;
+    });
+    Job* lanes[CASPER_HSM_BATCH_SHA256_LANES];
+    size_t idx = 0;
+    while ( idx < order.size() ) {
+        size_t end = idx;
+        while ( end < order.size() && order[end].first == order[idx].first ) {
+            end++;
+        }
+        // ... full groups of equal size inputs ...
+        for ( ; idx + CASPER_HSM_BATCH_SHA256_LANES <= end ; idx += CASPER_HSM_BATCH_SHA256_LANES ) {
+            for ( size_t lane = 0 ; lane < CASPER_HSM_BATCH_SHA256_LANES ; ++lane ) {
+                lanes[lane] = order[idx + lane].second;
+            }
+            AVX2(lanes);
+        }
+        // ... leftovers, one by one ...
+        for ( ; idx < end ; ++idx ) {
+            Single(*order[idx].second, Engine::Scalar);
+        }
+    }
+}
+
+/**
+ * @return Best engine supported by this CPU.
+ */
+casper::hsm::BatchSHA256::Engine casper::hsm::BatchSHA256::engine ()
+{
+    if ( true == Supported(Engine::SHANI) ) {
+        return Engine::SHANI;
+    }
+    if ( true == Supported(Engine::AVX2) ) {
+        return Engine::AVX2;
+    }
+    return Engine::Scalar;
+}
+
+/**
+ * @brief Check if an engine can run on this CPU, features are detected once.
+ *
+ * @param a_engine Engine to check.
+ *
+ * @return True if so, \link Engine::Scalar \link is always supported.
+ */
+bool casper::hsm::BatchSHA256::Supported (const casper::hsm::BatchSHA256::Engine a_engine)
+{
+#ifdef CASPER_HSM_BATCH_SHA256_X86
+    static const bool sk_shani_ = [] () -> bool {
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if ( 0 == __get_cpuid(1, &eax, &ebx, &ecx, &edx) ) {
+            return false;
+        }
+        const bool sse41 = ( 0 != ( ecx & bit_SSE4_1 ) );
+        if ( 0 == __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) ) {
+            return false;
+        }
+        return ( true == sse41 && 0 != ( ebx & bit_SHA ) );
+    }();
+    // ... also checks OS support for YMM registers ...
+    static const bool sk_avx2_ = ( 0 != __builtin_cpu_supports("avx2") );
+    switch (a_engine) {
+        case Engine::SHANI:
+            return sk_shani_;
+        case Engine::AVX2:
+            return sk_avx2_;
+        case Engine::Scalar:
+            return true;
+        default:
+            return false;
+    }
+#else
+    return ( Engine::Scalar == a_engine );
+#endif
+}
+
+/**
+ * @return Engine name, for logging purposes.
+ */
+const char* casper::hsm::BatchSHA256::Name (const casper::hsm::BatchSHA256::Engine a_engine)
+{
+    switch (a_engine) {
+        case Engine::SHANI:
+            return "sha-ni";
+        case Engine::AVX2:
+            return "avx2";
+        case Engine::Scalar:
+            return "scalar";
+        default:
+            return Name(engine());
+    }
+}
+
+// MARK: -
+
+/**
+ * @brief Hash a single input.
+ *
+ * @param a_job    Job.
+ * @param a_engine \link Engine::SHANI \link or \link Engine::Scalar \link.
+ */
+void casper::hsm::BatchSHA256::Single (const casper::hsm::BatchSHA256::Job& a_job, const casper::hsm::BatchSHA256::Engine a_engine)
+{
+    unsigned char tail[128];
+    uint32_t      state[8];
+    memcpy(state, sk_h0_, sizeof(state));
+    const size_t full = a_job.length_ / 64;
+    const size_t rest = Pad(a_job, tail);
+    if ( Engine::SHANI == a_engine ) {
+        SHANI(state, a_job.data_, full);
+        SHANI(state, tail, rest);
+    } else {
+        Scalar(state, a_job.data_, full);
+        Scalar(state, tail, rest);
+    }
+    Finalize(state, a_job.digest_);
+}
+
+/**
+ * @brief Copy last partial block and append padding.
+ *
+ * @param a_job  Job.
+ * @param o_tail Last 1 or 2 blocks.
+ *
+ * @return Number of blocks written to \link o_tail \link.
+ */
+size_t casper::hsm::BatchSHA256::Pad (const casper::hsm::BatchSHA256::Job& a_job, unsigned char o_tail[128])
+{
+    const size_t   rest   = a_job.length_ % 64;
+    const size_t   blocks = ( rest + 9 > 64 ? 2 : 1 );
+    const uint64_t bits   = static_cast<uint64_t>(a_job.length_) * 8;
+    memset(o_tail, 0, blocks * 64);
+    if ( rest > 0 ) {
+        memcpy(o_tail, a_job.data_ + a_job.length_ - rest, rest);
+    }
+    o_tail[rest] = 0x80;
+    for ( size_t idx = 0 ; idx < 8 ; ++idx ) {
+        o_tail[blocks * 64 - 1 - idx] = static_cast<unsigned char>(bits >> ( idx * 8 ));
+    }
+    return blocks;
+}
+
+/**
+ * @brief Portable block compression.
+ *
+ * @param a_state  Hash state.
+ * @param a_data   Blocks.
+ * @param a_blocks Number of 64 bytes blocks.
+ */
+void casper::hsm::BatchSHA256::Scalar (uint32_t a_state[8], const unsigned char* a_data, size_t a_blocks)
+{
+    uint32_t w[64];
+    for ( ; a_blocks > 0 ; --a_blocks, a_data += 64 ) {
+        for ( size_t t = 0 ; t < 16 ; ++t ) {
+            w[t] = ( static_cast<uint32_t>(a_data[t * 4]) << 24 ) | ( static_cast<uint32_t>(a_data[t * 4 + 1]) << 16 )
+                 | ( static_cast<uint32_t>(a_data[t * 4 + 2]) << 8 ) | static_cast<uint32_t>(a_data[t * 4 + 3]);
+        }
+        for ( size_t t = 16 ; t < 64 ; ++t ) {
+            const uint32_t s0 = CASPER_HSM_BATCH_SHA256_ROTR(w[t - 15], 7) ^ CASPER_HSM_BATCH_SHA256_ROTR(w[t - 15], 18) ^ ( w[t - 15] >> 3 );
+            const uint32_t s1 = CASPER_HSM_BATCH_SHA256_ROTR(w[t - 2], 17) ^ CASPER_HSM_BATCH_SHA256_ROTR(w[t - 2], 19) ^ ( w[t - 2] >> 10 );
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+        uint32_t a = a_state[0], b = a_state[1], c = a_state[2], d = a_state[3];
+        uint32_t e = a_state[4], f = a_state[5], g = a_state[6], h = a_state[7];
+        for ( size_t t = 0 ; t < 64 ; ++t ) {
+            const uint32_t s1 = CASPER_HSM_BATCH_SHA256_ROTR(e, 6) ^ CASPER_HSM_BATCH_SHA256_ROTR(e, 11) ^ CASPER_HSM_BATCH_SHA256_ROTR(e, 25);
+            const uint32_t t1 = h + s1 + ( ( e & f ) ^ ( ~e & g ) ) + sk_k_[t] + w[t];
+            const uint32_t s0 = CASPER_HSM_BATCH_SHA256_ROTR(a, 2) ^ CASPER_HSM_BATCH_SHA256_ROTR(a, 13) ^ CASPER_HSM_BATCH_SHA256_ROTR(a, 22);
+            const uint32_t t2 = s0 + ( ( a & b ) ^ ( a & c ) ^ ( b & c ) );
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        a_state[0] += a; a_state[1] += b; a_state[2] += c; a_state[3] += d;
+        a_state[4] += e; a_state[5] += f; a_state[6] += g; a_state[7] += h;
+    }
+}
+
+#ifdef CASPER_HSM_BATCH_SHA256_X86
+
+/**
+ * @brief SHA-NI block compression.
+ *
+ * @param a_state  Hash state.
+ * @param a_data   Blocks.
+ * @param a_blocks Number of 64 bytes blocks.
+ */
+__attribute__((target("sha,sse4.1")))
+void casper::hsm::BatchSHA256::SHANI (uint32_t a_state[8], const unsigned char* a_data, size_t a_blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    // ... load state as ABEF / CDGH ...
+    __m128i tmp    = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&a_state[0])), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&a_state[4])), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+    __m128i w[4];
+    for ( ; a_blocks > 0 ; --a_blocks, a_data += 64 ) {
+        const __m128i abef = state0;
+        const __m128i cdgh = state1;
+        for ( size_t idx = 0 ; idx < 4 ; ++idx ) {
+            w[idx] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_data + idx * 16)), mask);
+        }
+        // ... 16 x 4 rounds, message schedule runs 3 groups ahead ...
+        for ( size_t idx = 0 ; idx < 16 ; ++idx ) {
+            __m128i msg = _mm_add_epi32(w[idx % 4], _mm_loadu_si128(reinterpret_cast<const __m128i*>(&sk_k_[idx * 4])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if ( idx >= 3 && idx <= 14 ) {
+                tmp                = _mm_alignr_epi8(w[idx % 4], w[( idx + 3 ) % 4], 4);
+                w[( idx + 1 ) % 4] = _mm_sha256msg2_epu32(_mm_add_epi32(w[( idx + 1 ) % 4], tmp), w[idx % 4]);
+            }
+            msg    = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            if ( idx >= 1 && idx <= 12 ) {
+                w[( idx + 3 ) % 4] = _mm_sha256msg1_epu32(w[( idx + 3 ) % 4], w[idx % 4]);
+            }
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+    // ... back to ABCD / EFGH ...
+    tmp    = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&a_state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&a_state[4]), state1);
+}
+
+#define CASPER_HSM_BATCH_SHA256_VROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+/**
+ * @brief AVX2 multi-buffer compression, one input per 32 bit lane.
+ *
+ * @param a_jobs \link CASPER_HSM_BATCH_SHA256_LANES \link jobs, all with the same number of padded blocks.
+ */
+__attribute__((target("avx2")))
+void casper::hsm::BatchSHA256::AVX2 (casper::hsm::BatchSHA256::Job* const* a_jobs)
+{
+    const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                          12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    // ... same number of blocks does not imply same split, e.g. 60 bytes is 0 + 2 and 64 bytes is 1 + 1 ...
+    unsigned char tails[CASPER_HSM_BATCH_SHA256_LANES][128];
+    size_t        full[CASPER_HSM_BATCH_SHA256_LANES];
+    size_t        total = 0;
+    for ( size_t lane = 0 ; lane < CASPER_HSM_BATCH_SHA256_LANES ; ++lane ) {
+        full[lane] = a_jobs[lane]->length_ / 64;
+        total      = full[lane] + Pad(*a_jobs[lane], tails[lane]);
+    }
+    __m256i state[8];
+    for ( size_t idx = 0 ; idx < 8 ; ++idx ) {
+        state[idx] = _mm256_set1_epi32(static_cast<int>(sk_h0_[idx]));
+    }
+    const unsigned char* blocks[CASPER_HSM_BATCH_SHA256_LANES];
+    __m256i              w[16];
+    for ( size_t block = 0 ; block < total ; ++block ) {
+        for ( size_t lane = 0 ; lane < CASPER_HSM_BATCH_SHA256_LANES ; ++lane ) {
+            blocks[lane] = ( block < full[lane] ? a_jobs[lane]->data_ + block * 64 : tails[lane] + ( block - full[lane] ) * 64 );
+        }
+        __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+        __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+        for ( size_t t = 0 ; t < 64 ; ++t ) {
+            __m256i wt;
+            if ( t < 16 ) {
+                uint32_t words[CASPER_HSM_BATCH_SHA256_LANES];
+                for ( size_t lane = 0 ; lane < CASPER_HSM_BATCH_SHA256_LANES ; ++lane ) {
+                    memcpy(&words[lane], blocks[lane] + t * 4, sizeof(uint32_t));
+                }
+                wt = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(words)), bswap);
+            } else {
+                const __m256i w15 = w[( t - 15 ) % 16];
+                const __m256i w2  = w[( t - 2 ) % 16];
+                const __m256i s0  = _mm256_xor_si256(_mm256_xor_si256(CASPER_HSM_BATCH_SHA256_VROTR(w15, 7), CASPER_HSM_BATCH_SHA256_VROTR(w15, 18)), _mm256_srli_epi32(w15, 3));
+                const __m256i s1  = _mm256_xor_si256(_mm256_xor_si256(CASPER_HSM_BATCH_SHA256_VROTR(w2, 17), CASPER_HSM_BATCH_SHA256_VROTR(w2, 19)), _mm256_srli_epi32(w2, 10));
+                wt = _mm256_add_epi32(_mm256_add_epi32(w[t % 16], s0), _mm256_add_epi32(w[( t - 7 ) % 16], s1));
+            }
+            w[t % 16] = wt;
+            const __m256i s1  = _mm256_xor_si256(_mm256_xor_si256(CASPER_HSM_BATCH_SHA256_VROTR(e, 6), CASPER_HSM_BATCH_SHA256_VROTR(e, 11)), CASPER_HSM_BATCH_SHA256_VROTR(e, 25));
+            const __m256i ch  = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            const __m256i t1  = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(ch, wt)), _mm256_set1_epi32(static_cast<int>(sk_k_[t])));
+            const __m256i s0  = _mm256_xor_si256(_mm256_xor_si256(CASPER_HSM_BATCH_SHA256_VROTR(a, 2), CASPER_HSM_BATCH_SHA256_VROTR(a, 13)), CASPER_HSM_BATCH_SHA256_VROTR(a, 22));
+            const __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+            h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+            d = c; c = b; b = a; a = _mm256_add_epi32(t1, _mm256_add_epi32(s0, maj));
+        }
+        state[0] = _mm256_add_epi32(state[0], a); state[1] = _mm256_add_epi32(state[1], b);
+        state[2] = _mm256_add_epi32(state[2], c); state[3] = _mm256_add_epi32(state[3], d);
+        state[4] = _mm256_add_epi32(state[4], e); state[5] = _mm256_add_epi32(state[5], f);
+        state[6] = _mm256_add_epi32(state[6], g); state[7] = _mm256_add_epi32(state[7], h);
+    }
+    // ... transpose back to one state per job ...
+    uint32_t words[8][CASPER_HSM_BATCH_SHA256_LANES];
+    for ( size_t idx = 0 ; idx < 8 ; ++idx ) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(words[idx]), state[idx]);
+    }
+    for ( size_t lane = 0 ; lane < CASPER_HSM_BATCH_SHA256_LANES ; ++lane ) {
+        uint32_t lane_state[8];
+        for ( size_t idx = 0 ; idx < 8 ; ++idx ) {
+            lane_state[idx] = words[idx][lane];
+        }
+        Finalize(lane_state, a_jobs[lane]->digest_);
+    }
+}
+
+#else
+
+/**
+ * @brief SHA-NI is not available on this architecture, see \link engine \link.
+ */
+void casper::hsm::BatchSHA256::SHANI (uint32_t a_state[8], const unsigned char* a_data, size_t a_blocks)
+{
+    Scalar(a_state, a_data, a_blocks);
+}
+
+/**
+ * @brief AVX2 is not available on this architecture, see \link engine \link.
+ */
+void casper::hsm::BatchSHA256::AVX2 (casper::hsm::BatchSHA256::Job* const* a_jobs)
+{
+    for ( size_t lane = 0 ; lane < CASPER_HSM_BATCH_SHA256_LANES ; ++lane ) {
+        Single(*a_jobs[lane], Engine::Scalar);
+    }
+}
+
+#endif // CASPER_HSM_BATCH_SHA256_X86
+
+/**
+ * @brief Write state as big endian digest.
+ *
+ * @param a_state  Hash state.
+ * @param o_digest \link CASPER_HSM_BATCH_SHA256_DIGEST_LEN \link bytes.
+ */
+void casper::hsm::BatchSHA256::Finalize (const uint32_t a_state[8], unsigned char* o_digest)
+{
+    for ( size_t idx = 0 ; idx < 8 ; ++idx ) {
+        o_digest[idx * 4    ] = static_cast<unsigned char>(a_state[idx] >> 24);
+        o_digest[idx * 4 + 1] = static_cast<unsigned char>(a_state[idx] >> 16);
+        o_digest[idx * 4 + 2] = static_cast<unsigned char>(a_state[idx] >> 8);
+        o_digest[idx * 4 + 3] = static_cast<unsigned char>(a_state[idx]);
+    }
+}
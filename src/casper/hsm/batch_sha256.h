@@ -0,0 +1,89 @@
+/**
+ * @file batch_sha256.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_BATCH_SHA256_H_
+#define CASPER_HSM_BATCH_SHA256_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t
+
+#define CASPER_HSM_BATCH_SHA256_DIGEST_LEN 32
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief SHA256 of many inputs at once, used to prepare batch signing data.
+         *
+         * Engine is selected once, at runtime: SHA-NI ( one input at a time, hardware rounds ), AVX2 ( 8 inputs
+         * with the same number of blocks per pass ) or scalar.
+         */
+        class BatchSHA256 final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+        
+        public: // Data Type(s)
+            
+            enum class Engine : uint8_t {
+                Auto = 0,
+                Scalar,
+                AVX2,
+                SHANI
+            };
+            
+            typedef struct {
+                const unsigned char* data_;   //!< Input.
+                size_t               length_; //!< Input length, in bytes.
+                unsigned char*       digest_; //!< Output, CASPER_HSM_BATCH_SHA256_DIGEST_LEN bytes.
+            } Job;
+        
+        public: // Constructor(s) / Destructor
+            
+            BatchSHA256 () = delete;
+        
+        public: // Static Method(s) / Function(s)
+            
+            static void        Run    (Job* a_jobs, const size_t a_count, const Engine a_engine = Engine::Auto);
+            static Engine      engine    ();
+            static bool        Supported (const Engine a_engine);
+            static const char* Name      (const Engine a_engine);
+        
+        private: // Static Method(s) / Function(s)
+            
+            static void   Single   (const Job& a_job, const Engine a_engine);
+            static size_t Pad      (const Job& a_job, unsigned char o_tail[128]);
+            static void   Scalar   (uint32_t a_state[8], const unsigned char* a_data, size_t a_blocks);
+            static void   SHANI    (uint32_t a_state[8], const unsigned char* a_data, size_t a_blocks);
+            static void   AVX2     (Job* const* a_jobs);
+            static void   Finalize (const uint32_t a_state[8], unsigned char* o_digest);
+        
+        }; // end of class 'BatchSHA256'
+    
+    } // end of namespace 'hsm'
+
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_BATCH_SHA256_H_
@@ -0,0 +1,131 @@
+/**
+ * @file breaker.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/breaker.h"
+
+/**
+ * @brief Default constructor, breaker is disabled until \link Setup \link is called.
+ */
+casper::hsm::Breaker::Breaker ()
+    : config_({ /* threshold_ */ 0, /* cooldown_ms_ */ 0 }), state_(State::Closed), failures_(0)
+{
+    /* empty */
+}
+
+/**
+ * @brief Destructor.
+ */
+casper::hsm::Breaker::~Breaker ()
+{
+    /* empty */
+}
+
+/**
+ * @brief Set configuration, circuit is closed.
+ *
+ * @param a_config See \link Config \link.
+ */
+void casper::hsm::Breaker::Setup (const casper::hsm::Breaker::Config& a_config)
+{
+    config_   = a_config;
+    state_    = State::Closed;
+    failures_ = 0;
+}
+
+/**
+ * @brief Check if an operation can be performed.
+ *
+ * @return True when circuit is closed or when this operation is the half-open trial.
+ */
+bool casper::hsm::Breaker::Allow ()
+{
+    if ( State::Closed == state_ ) {
+        return true;
+    }
+    // ... open or a trial is already running ( or was lost ) ...
+    if ( false == Elapsed() ) {
+        return false;
+    }
+    state_ = State::HalfOpen;
+    since_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+/**
+ * @brief Check if a background probe should be performed now.
+ *
+ * @return True if so, state is changed to half-open and caller must report probe outcome.
+ */
+bool casper::hsm::Breaker::Probe ()
+{
+    if ( State::Closed == state_ || false == Elapsed() ) {
+        return false;
+    }
+    state_ = State::HalfOpen;
+    since_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+/**
+ * @brief Report a successful operation, circuit is closed.
+ */
+void casper::hsm::Breaker::Success ()
+{
+    state_    = State::Closed;
+    failures_ = 0;
+}
+
+/**
+ * @brief Report a failed operation.
+ */
+void casper::hsm::Breaker::Failure ()
+{
+    if ( 0 == config_.threshold_ ) {
+        return;
+    }
+    failures_++;
+    if ( State::HalfOpen == state_ || failures_ >= config_.threshold_ ) {
+        state_ = State::Open;
+        since_ = std::chrono::steady_clock::now();
+    }
+}
+
+/**
+ * @return Number of milliseconds left until a new trial is allowed, 0 if circuit is closed.
+ */
+uint64_t casper::hsm::Breaker::remaining () const
+{
+    if ( State::Closed == state_ ) {
+        return 0;
+    }
+    const uint64_t elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since_).count());
+    return ( elapsed >= config_.cooldown_ms_ ? 0 : config_.cooldown_ms_ - elapsed );
+}
+
+// MARK: -
+
+/**
+ * @return True if cooldown period since last state change has elapsed.
+ */
+bool casper::hsm::Breaker::Elapsed () const
+{
+    return ( std::chrono::steady_clock::now() - since_ ) >= std::chrono::milliseconds(config_.cooldown_ms_);
+}
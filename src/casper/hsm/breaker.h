@@ -0,0 +1,103 @@
+/**
+ * @file breaker.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_BREAKER_H_
+#define CASPER_HSM_BREAKER_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <chrono>
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint*_t
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief Circuit breaker, not thread safe.
+         *
+         * Closed    - operations are allowed.
+         * Open      - after \link Config::threshold_ \link consecutive failures, operations are rejected.
+         * Half-open - after \link Config::cooldown_ms_ \link, a single trial ( or probe ) operation is allowed.
+         */
+        class Breaker final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+            
+        public: // Data Type(s)
+            
+            enum class State : uint8_t {
+                Closed = 0,
+                Open,
+                HalfOpen
+            };
+            
+            typedef struct {
+                size_t   threshold_;   //!< Number of consecutive failures that open the circuit, 0 - disabled.
+                uint64_t cooldown_ms_; //!< Time to wait before trying again, in milliseconds.
+            } Config;
+            
+        private: // Data
+            
+            Config                                config_;
+            State                                 state_;
+            size_t                                failures_;
+            std::chrono::steady_clock::time_point since_;
+            
+        public: // Constructor(s) / Destructor
+            
+            Breaker ();
+            virtual ~Breaker ();
+            
+        public: // Method(s) / Function(s)
+            
+            void     Setup     (const Config& a_config);
+            bool     Allow     ();
+            bool     Probe     ();
+            void     Success   ();
+            void     Failure   ();
+            uint64_t remaining () const;
+            
+        public: // Inline Method(s) / Function(s)
+            
+            /**
+             * @return Current state.
+             */
+            inline State state () const
+            {
+                return state_;
+            }
+            
+        private: // Method(s) / Function(s)
+            
+            bool Elapsed () const;
+            
+        }; // end of class 'Breaker'
+        
+    } // end of namespace 'hsm'
+    
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_BREAKER_H_
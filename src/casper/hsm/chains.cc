@@ -0,0 +1,143 @@
+/**
+ * @file chains.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/chains.h"
+
+#include "cc/b64.h"
+
+#include <vector>
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#define CASPER_HSM_CHAINS_MAX_DEPTH 8
+
+const std::string casper::hsm::Chains::sk_null_ = "null";
+
+/**
+ * @brief Default constructor, builds and serializes all chains.
+ *
+ * @param a_certificates Map of key name to PEM-encoded certificate file content, leaf certificate first.
+ */
+casper::hsm::Chains::Chains (const std::map<std::string, std::string>& a_certificates)
+{
+    std::vector<unsigned char> der;
+    Walk(a_certificates, [this, &der] (const std::string& a_key, const std::vector<X509*>& a_chain, const bool a_rooted) {
+        // ... serialize ...
+        std::string& fragment = fragments_[a_key];
+        for ( size_t idx = 0 ; idx < a_chain.size() ; ++idx ) {
+            const int length = i2d_X509(a_chain[idx], nullptr);
+            if ( length <= 0 ) {
+                fragment.clear();
+                break;
+            }
+            der.resize(static_cast<size_t>(length));
+            unsigned char* ptr = der.data();
+            i2d_X509(a_chain[idx], &ptr);
+            if ( 0 == idx ) {
+                fragment = "{\"signing\":\"" + ::cc::base64_rfc4648::encode(der.data(), der.size()) + "\",\"intermediates\":[";
+            } else if ( true == a_rooted && a_chain.size() - 1 == idx ) {
+                fragment += "],\"root\":\"" + ::cc::base64_rfc4648::encode(der.data(), der.size()) + "\"}";
+            } else {
+                fragment += ( idx > 1 ? ",\"" : "\"" ) + ::cc::base64_rfc4648::encode(der.data(), der.size()) + "\"";
+            }
+        }
+        if ( 0 == fragment.length() ) {
+            fragments_.erase(a_key);
+        } else if ( false == a_rooted ) {
+            fragment += "],\"root\":null}";
+        }
+    });
+}
+
+/**
+ * @brief Destructor.
+ */
+casper::hsm::Chains::~Chains ()
+{
+    /* empty */
+}
+
+// MARK: -
+
+/**
+ * @brief Build all chains, leaf certificate first.
+ *
+ * @param a_certificates Map of key name to PEM-encoded certificate file content, leaf certificate first.
+ * @param a_visitor      Function to call for each key chain, certificates are only valid during the call.
+ */
+void casper::hsm::Chains::Walk (const std::map<std::string, std::string>& a_certificates, const casper::hsm::Chains::Visitor& a_visitor)
+{
+    std::map<std::string, std::vector<X509*>> files;
+    std::vector<X509*>                        pool;
+    // ... parse all files, a file might carry a full chain ...
+    for ( auto it : a_certificates ) {
+        BIO* bio = BIO_new_mem_buf(it.second.c_str(), static_cast<int>(it.second.length()));
+        if ( nullptr == bio ) {
+            continue;
+        }
+        std::vector<X509*>& certificates = files[it.first];
+        X509* x509;
+        while ( nullptr != ( x509 = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr) ) ) {
+            certificates.push_back(x509);
+            pool.push_back(x509);
+        }
+        BIO_free(bio);
+    }
+    ERR_clear_error();
+    // ... build chains ...
+    std::vector<X509*> chain;
+    for ( auto it : files ) {
+        if ( 0 == it.second.size() ) {
+            continue;
+        }
+        // ... leaf, then issuers until a self-issued one ...
+        chain.clear();
+        chain.push_back(it.second[0]);
+        while ( chain.size() < CASPER_HSM_CHAINS_MAX_DEPTH && X509_V_OK != X509_check_issued(chain.back(), chain.back()) ) {
+            X509* issuer = nullptr;
+            for ( auto candidate : it.second ) {
+                if ( candidate != chain.back() && X509_V_OK == X509_check_issued(candidate, chain.back()) ) {
+                    issuer = candidate;
+                    break;
+                }
+            }
+            for ( size_t idx = 0 ; nullptr == issuer && idx < pool.size() ; ++idx ) {
+                if ( pool[idx] != chain.back() && X509_V_OK == X509_check_issued(pool[idx], chain.back()) ) {
+                    issuer = pool[idx];
+                }
+            }
+            if ( nullptr == issuer ) {
+                break;
+            }
+            chain.push_back(issuer);
+        }
+        a_visitor(it.first, chain, ( chain.size() > 1 && X509_V_OK == X509_check_issued(chain.back(), chain.back()) ));
+    }
+    ERR_clear_error();
+    // ... visitors copied what they need, certificates are no longer needed ...
+    for ( auto x509 : pool ) {
+        X509_free(x509);
+    }
+}
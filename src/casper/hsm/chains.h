@@ -0,0 +1,90 @@
+/**
+ * @file chains.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_CHAINS_H_
+#define CASPER_HSM_CHAINS_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <openssl/x509.h>
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief Pre-serialized certificate chains, one per key, so they can be embedded in responses without any work.
+         *
+         * Fragment format: { "signing": <base64 DER>, "intermediates": [<base64 DER>], "root": <base64 DER> | null }
+         *
+         * Chain is the content of the key certificate file, completed with issuers found in other certificate files.
+         */
+        class Chains final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+        
+        public: // Data Type(s)
+            
+            typedef std::function<void(const std::string& a_key, const std::vector<X509*>& a_chain, const bool a_rooted)> Visitor;
+        
+        private: // Static Const Data
+            
+            static const std::string sk_null_;
+        
+        private: // Data
+            
+            std::map<std::string, std::string> fragments_;
+        
+        public: // Constructor(s) / Destructor
+            
+            Chains () = delete;
+            Chains (const std::map<std::string, std::string>& a_certificates);
+            virtual ~Chains ();
+        
+        public: // Inline Method(s) / Function(s)
+            
+            /**
+             * @return JSON fragment for the provided key, 'null' if there's no chain for it.
+             */
+            inline const std::string& fragment (const std::string& a_key) const
+            {
+                const auto it = fragments_.find(a_key);
+                return ( fragments_.end() != it ? it->second : sk_null_ );
+            }
+        
+        public: // Static Method(s) / Function(s)
+            
+            static void Walk (const std::map<std::string, std::string>& a_certificates, const Visitor& a_visitor);
+        
+        }; // end of class 'Chains'
+    
+    } // end of namespace 'hsm'
+
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_CHAINS_H_
@@ -0,0 +1,299 @@
+/**
+ * @file cms.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/cms.h"
+
+#include "casper/hsm/chains.h"
+
+#include "cc/hash/sha256.h"
+
+#include <openssl/asn1.h>
+#include <openssl/err.h>
+#include <openssl/x509.h>
+
+#include <stdio.h>  // snprintf
+#include <string.h> // memcpy
+
+//
+// DER of fixed ASN.1 elements.
+//
+
+// ... id-signedData ...
+static const unsigned char s_signed_data_oid_[]       = { 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x07, 0x02 };
+// ... CMSVersion 1, issuerAndSerialNumber ...
+static const unsigned char s_version_[]               = { 0x02, 0x01, 0x01 };
+// ... SET OF DigestAlgorithmIdentifier { id-sha256 } ...
+static const unsigned char s_digest_algorithms_[]     = { 0x31, 0x0D, 0x30, 0x0B, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01 };
+// ... EncapsulatedContentInfo { id-data }, detached - no eContent ...
+static const unsigned char s_encap_content_info_[]    = { 0x30, 0x0B, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x07, 0x01 };
+// ... DigestAlgorithmIdentifier { id-sha256 } ...
+static const unsigned char s_digest_algorithm_[]      = { 0x30, 0x0B, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01 };
+// ... SignatureAlgorithmIdentifier { rsaEncryption, NULL } ...
+static const unsigned char s_signature_algorithm_[]   = { 0x30, 0x0D, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x01, 0x01, 0x05, 0x00 };
+// ... Attribute { id-contentType, SET { id-data } } ...
+static const unsigned char s_content_type_attribute_[] = {
+    0x30, 0x18, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x09, 0x03,
+    0x31, 0x0B, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x07, 0x01
+};
+// ... id-signingTime OID ...
+static const unsigned char s_signing_time_oid_[]      = { 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x09, 0x05 };
+// ... Attribute { id-messageDigest, SET { OCTET STRING ( 32 bytes follow ) } } ...
+static const unsigned char s_message_digest_prefix_[] = {
+    0x30, 0x2F, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x09, 0x04,
+    0x31, 0x22, 0x04, 0x20
+};
+// ... Attribute { id-aa-signingCertificateV2, SET { SigningCertificateV2 { SEQUENCE OF { ESSCertIDv2 { OCTET STRING ( 32 bytes follow ) } } } } } ...
+static const unsigned char s_signing_certificate_prefix_[] = {
+    0x30, 0x37, 0x06, 0x0B, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x09, 0x10, 0x02, 0x2F,
+    0x31, 0x28, 0x30, 0x26, 0x30, 0x24, 0x30, 0x22, 0x04, 0x20
+};
+
+/**
+ * @brief Default constructor, builds chains and encodes all per key DER fragments.
+ *
+ * @param a_certificates Map of key name to PEM-encoded certificate file content, leaf certificate first.
+ */
+casper::hsm::CMS::CMS (const std::map<std::string, std::string>& a_certificates)
+{
+    std::vector<unsigned char> der;
+    ::casper::hsm::Chains::Walk(a_certificates, [this, &der] (const std::string& a_key, const std::vector<X509*>& a_chain, const bool /* a_rooted */) {
+        Signer signer;
+        // ... certificates, whole chain ...
+        std::vector<unsigned char> certificates;
+        for ( size_t idx = 0 ; idx < a_chain.size() ; ++idx ) {
+            const int length = i2d_X509(a_chain[idx], nullptr);
+            if ( length <= 0 ) {
+                return;
+            }
+            der.resize(static_cast<size_t>(length));
+            unsigned char* ptr = der.data();
+            i2d_X509(a_chain[idx], &ptr);
+            Append(der.data(), der.size(), certificates);
+            // ... leaf ...
+            if ( 0 == idx ) {
+                // ... ESS certificate hash ...
+                ::cc::hash::SHA256 sha256;
+                sha256.Initialize();
+                sha256.Update(der.data(), der.size());
+                Append(s_signing_certificate_prefix_, sizeof(s_signing_certificate_prefix_), signer.signing_certificate_);
+                Append(sha256.Final(), CASPER_HSM_API_SHA256_LEN, signer.signing_certificate_);
+            }
+        }
+        Header(0xA0, certificates.size(), signer.certificates_);
+        Append(certificates.data(), certificates.size(), signer.certificates_);
+        // ... signer identifier, issuer name and serial number of leaf ...
+        X509_NAME*    issuer = X509_get_issuer_name(a_chain.front());
+        ASN1_INTEGER* serial = X509_get_serialNumber(a_chain.front());
+        const int     il     = i2d_X509_NAME(issuer, nullptr);
+        const int     sl     = i2d_ASN1_INTEGER(serial, nullptr);
+        if ( il <= 0 || sl <= 0 ) {
+            return;
+        }
+        Header(0x30, static_cast<size_t>(il + sl), signer.sid_);
+        const size_t offset = signer.sid_.size();
+        signer.sid_.resize(offset + static_cast<size_t>(il + sl));
+        unsigned char* ptr = signer.sid_.data() + offset;
+        i2d_X509_NAME(issuer, &ptr);
+        i2d_ASN1_INTEGER(serial, &ptr);
+        // ... done ...
+        signers_[a_key] = signer;
+    });
+    ERR_clear_error();
+}
+
+/**
+ * @brief Destructor.
+ */
+casper::hsm::CMS::~CMS ()
+{
+    /* empty */
+}
+
+// MARK: -
+
+/**
+ * @brief Encode signed attributes, as a SET OF Attribute - the value to be signed.
+ *
+ * Attributes are content type ( id-data ), signing time ( optional ), message digest and ESS signing certificate v2,
+ * already in DER SET OF order ( by encoded length ).
+ *
+ * @param a_key          HSM private key token label ( certificate name ).
+ * @param a_digest       Content SHA256.
+ * @param a_signing_time UTC signing time, 0 to omit it.
+ * @param o_attributes   DER encoded SET OF Attribute.
+ */
+void casper::hsm::CMS::Attributes (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN], const time_t a_signing_time,
+                                   std::vector<unsigned char>& o_attributes) const
+{
+    const Signer& signer = this->signer(a_key);
+    // ... signing time, UTCTime until 2049, GeneralizedTime after that - RFC 5652 11.3 ...
+    char   time[16];
+    size_t time_length = 0;
+    if ( 0 != a_signing_time ) {
+        struct tm tm;
+        if ( nullptr == gmtime_r(&a_signing_time, &tm) ) {
+            throw ::casper::hsm::Exception("Unable to build CMS signed attributes: %s!", "invalid signing time");
+        }
+        const int year = tm.tm_year + 1900;
+        if ( year >= 1950 && year < 2050 ) {
+            time_length = static_cast<size_t>(snprintf(time, sizeof(time), "%02d%02d%02d%02d%02d%02dZ",
+                                                       year % 100, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec));
+        } else {
+            time_length = static_cast<size_t>(snprintf(time, sizeof(time), "%04d%02d%02d%02d%02d%02dZ",
+                                                       year, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec));
+        }
+    }
+    const size_t time_value     = ( 0 != time_length ? Length(time_length) : 0 );
+    const size_t time_attribute = ( 0 != time_length ? Length(sizeof(s_signing_time_oid_) + Length(time_value)) : 0 );
+    // ... SET OF Attribute ...
+    o_attributes.clear();
+    Header(0x31, sizeof(s_content_type_attribute_) + time_attribute + sizeof(s_message_digest_prefix_) + CASPER_HSM_API_SHA256_LEN + signer.signing_certificate_.size(), o_attributes);
+    Append(s_content_type_attribute_, sizeof(s_content_type_attribute_), o_attributes);
+    if ( 0 != time_length ) {
+        Header(0x30, sizeof(s_signing_time_oid_) + Length(time_value), o_attributes);
+        Append(s_signing_time_oid_, sizeof(s_signing_time_oid_), o_attributes);
+        Header(0x31, time_value, o_attributes);
+        Header(( 13 == time_length ? 0x17 : 0x18 ), time_length, o_attributes);
+        Append(reinterpret_cast<const unsigned char*>(time), time_length, o_attributes);
+    }
+    Append(s_message_digest_prefix_, sizeof(s_message_digest_prefix_), o_attributes);
+    Append(a_digest, CASPER_HSM_API_SHA256_LEN, o_attributes);
+    Append(signer.signing_certificate_.data(), signer.signing_certificate_.size(), o_attributes);
+}
+
+/**
+ * @brief Assemble a detached SignedData, wrapped in a ContentInfo.
+ *
+ * @param a_key        HSM private key token label ( certificate name ).
+ * @param a_attributes Signed attributes, see \link Attributes \link.
+ * @param a_signature  PKCS #1 v1.5 RSA signature of \link a_attributes \link.
+ * @param o_der        DER encoded ContentInfo.
+ */
+void casper::hsm::CMS::SignedData (const std::string& a_key, const std::vector<unsigned char>& a_attributes, const std::vector<unsigned char>& a_signature,
+                                   std::vector<unsigned char>& o_der) const
+{
+    const Signer& signer = this->signer(a_key);
+    if ( 0 == a_attributes.size() || 0x31 != a_attributes[0] ) {
+        throw ::casper::hsm::Exception("Unable to build CMS signed data: %s!", "invalid signed attributes");
+    }
+    // ... lengths, inner first ...
+    const size_t signer_info  = sizeof(s_version_) + signer.sid_.size() + sizeof(s_digest_algorithm_) + a_attributes.size()
+                                + sizeof(s_signature_algorithm_) + Length(a_signature.size());
+    const size_t signer_infos = Length(signer_info);
+    const size_t signed_data  = sizeof(s_version_) + sizeof(s_digest_algorithms_) + sizeof(s_encap_content_info_) + signer.certificates_.size()
+                                + Length(signer_infos);
+    const size_t content      = Length(signed_data);
+    // ... ContentInfo ...
+    o_der.clear();
+    o_der.reserve(Length(sizeof(s_signed_data_oid_) + Length(content)));
+    Header(0x30, sizeof(s_signed_data_oid_) + Length(content), o_der);
+    Append(s_signed_data_oid_, sizeof(s_signed_data_oid_), o_der);
+    Header(0xA0, content, o_der);
+    // ... SignedData ...
+    Header(0x30, signed_data, o_der);
+    Append(s_version_, sizeof(s_version_), o_der);
+    Append(s_digest_algorithms_, sizeof(s_digest_algorithms_), o_der);
+    Append(s_encap_content_info_, sizeof(s_encap_content_info_), o_der);
+    Append(signer.certificates_.data(), signer.certificates_.size(), o_der);
+    // ... SignerInfos ...
+    Header(0x31, signer_infos, o_der);
+    Header(0x30, signer_info, o_der);
+    Append(s_version_, sizeof(s_version_), o_der);
+    Append(signer.sid_.data(), signer.sid_.size(), o_der);
+    Append(s_digest_algorithm_, sizeof(s_digest_algorithm_), o_der);
+    // ... signed attributes, SET OF retagged as [0] IMPLICIT ...
+    o_der.push_back(0xA0);
+    Append(a_attributes.data() + 1, a_attributes.size() - 1, o_der);
+    Append(s_signature_algorithm_, sizeof(s_signature_algorithm_), o_der);
+    Header(0x04, a_signature.size(), o_der);
+    Append(a_signature.data(), a_signature.size(), o_der);
+}
+
+// MARK: -
+
+/**
+ * @return Signer fragments for the provided key.
+ */
+const casper::hsm::CMS::Signer& casper::hsm::CMS::signer (const std::string& a_key) const
+{
+    const auto it = signers_.find(a_key);
+    if ( signers_.end() == it ) {
+        throw ::casper::hsm::Exception("Unable to build CMS: no certificate for key '%s'!", a_key.c_str());
+    }
+    return it->second;
+}
+
+// MARK: -
+
+/**
+ * @param a_length Content length, in bytes.
+ *
+ * @return Encoded length ( tag, length and content ), in bytes.
+ */
+size_t casper::hsm::CMS::Length (const size_t a_length)
+{
+    if ( a_length < 0x80 ) {
+        return 2 + a_length;
+    }
+    // ... long form, tag + 0x80 | n + n bytes ...
+    size_t header = 2;
+    for ( size_t length = a_length ; length > 0 ; length >>= 8 ) {
+        header++;
+    }
+    return header + a_length;
+}
+
+/**
+ * @brief Append a DER tag and length.
+ *
+ * @param a_tag    Tag.
+ * @param a_length Content length, in bytes.
+ * @param o_der    Buffer to append to.
+ */
+void casper::hsm::CMS::Header (const unsigned char a_tag, const size_t a_length, std::vector<unsigned char>& o_der)
+{
+    o_der.push_back(a_tag);
+    if ( a_length < 0x80 ) {
+        o_der.push_back(static_cast<unsigned char>(a_length));
+        return;
+    }
+    // ... long form ...
+    size_t bytes = 0;
+    for ( size_t length = a_length ; length > 0 ; length >>= 8 ) {
+        bytes++;
+    }
+    o_der.push_back(static_cast<unsigned char>(0x80 | bytes));
+    for ( size_t idx = bytes ; idx > 0 ; --idx ) {
+        o_der.push_back(static_cast<unsigned char>(( a_length >> ( 8 * ( idx - 1 ) ) ) & 0xFF));
+    }
+}
+
+/**
+ * @brief Append raw bytes.
+ *
+ * @param a_data   Data.
+ * @param a_length Data length, in bytes.
+ * @param o_der    Buffer to append to.
+ */
+void casper::hsm::CMS::Append (const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_der)
+{
+    o_der.insert(o_der.end(), a_data, a_data + a_length);
+}
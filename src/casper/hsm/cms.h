@@ -0,0 +1,102 @@
+/**
+ * @file cms.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_CMS_H_
+#define CASPER_HSM_CMS_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include "casper/hsm/api.h" // CASPER_HSM_API_SHA256_LEN
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <time.h> // time_t
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief Detached CMS ( RFC 5652 ) SignedData assembly, RSA PKCS #1 v1.5 with SHA256.
+         *
+         * Per key DER fragments - certificate chain, signer identifier and ESS signing certificate v2 attribute - are
+         * encoded once, so a response only costs the signed attributes, one HSM operation and a few copies.
+         */
+        class CMS final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+        
+        private: // Data Type(s)
+            
+            typedef struct {
+                std::vector<unsigned char> certificates_;        //!< [0] IMPLICIT SET OF Certificate, leaf first.
+                std::vector<unsigned char> sid_;                 //!< IssuerAndSerialNumber.
+                std::vector<unsigned char> signing_certificate_; //!< id-aa-signingCertificateV2 Attribute.
+            } Signer;
+        
+        private: // Data
+            
+            std::map<std::string, Signer> signers_;
+        
+        public: // Constructor(s) / Destructor
+            
+            CMS () = delete;
+            CMS (const std::map<std::string, std::string>& a_certificates);
+            virtual ~CMS ();
+        
+        public: // Method(s) / Function(s)
+            
+            void Attributes (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN], const time_t a_signing_time,
+                             std::vector<unsigned char>& o_attributes) const;
+            void SignedData (const std::string& a_key, const std::vector<unsigned char>& a_attributes, const std::vector<unsigned char>& a_signature,
+                             std::vector<unsigned char>& o_der) const;
+        
+        public: // Inline Method(s) / Function(s)
+            
+            /**
+             * @return True if a certificate is known for the provided key.
+             */
+            inline bool Knows (const std::string& a_key) const
+            {
+                return ( signers_.end() != signers_.find(a_key) );
+            }
+        
+        private: // Method(s) / Function(s)
+            
+            const Signer& signer (const std::string& a_key) const;
+        
+        private: // Static Method(s) / Function(s)
+            
+            static size_t Length (const size_t a_length);
+            static void   Header (const unsigned char a_tag, const size_t a_length, std::vector<unsigned char>& o_der);
+            static void   Append (const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_der);
+        
+        }; // end of class 'CMS'
+    
+    } // end of namespace 'hsm'
+
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_CMS_H_
@@ -31,6 +31,13 @@
 
 #include <fstream>  // std::ifstream
 
+#include <stdio.h> // fopen, fclose
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+
 /**
  * @brief Default constructor.
  *
@@ -126,6 +133,127 @@ void casper::hsm::fake::API::Sign (const std::string& a_key, const std::string&
     CC_ASSERT(nullptr == ua);
 }
 
+/**
+ * @brief Sign raw data.
+ *
+ * @param a_key         HSM private key token label.
+ * @param a_data        Data to be signed.
+ * @param a_length      Data length, in bytes.
+ * @param o_signature   Signature bytes.
+ */
+void casper::hsm::fake::API::Sign (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature)
+{
+    const Status status = TrySign(a_key, a_data, a_length, o_signature);
+    if ( false == Succeeded(status) ) {
+        throw ::casper::hsm::Exception("%s", Describe(status).c_str());
+    }
+}
+
+/**
+ * @brief Sign raw data, without throwing.
+ *
+ * @param a_key         HSM private key token label.
+ * @param a_data        Data to be signed.
+ * @param a_length      Data length, in bytes.
+ * @param o_signature   Signature bytes.
+ *
+ * @return Operation status.
+ */
+casper::hsm::API::Status casper::hsm::fake::API::TrySign (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature) noexcept
+{
+    // ... check if required certificate and configuration exist ...
+    if ( certificates().end() == certificates().find(a_key) ) {
+        return Status { "looking up certificate ( configuration error )", 0 };
+    }
+    const Json::Value& cfg = const_cast<const Json::Value&>(cfg_)[a_key];
+    if ( false == cfg.isObject() || false == cfg["key"].isString() || false == cfg["pwd"].isString() ) {
+        return Status { "looking up private key ( configuration error )", 0 };
+    }
+    // ... sign ( fake, performance is not a concern: base64 output is decoded ) ...
+    try {
+        const std::string signature = ::cc::crypto::RSA::SignSHA256(a_data, a_length, cfg["key"].asString(), ::cc::base64_rfc4648::decode<std::string>(cfg["pwd"].asString()), ::cc::crypto::RSA::SignOutputFormat::BASE64_RFC4648);
+        const size_t      mds       = ::cc::base64_rfc4648::decoded_max_size(signature.length());
+        o_signature.resize(mds);
+        o_signature.resize(::cc::base64_rfc4648::decode(o_signature.data(), mds, signature.c_str(), signature.length()));
+    } catch (...) {
+        return Status { "signing data", 0 };
+    }
+    return Status { nullptr, 0 };
+}
+
+/**
+ * @brief Sign a precomputed SHA256 digest, without throwing.
+ *
+ * @param a_key         HSM private key token label.
+ * @param a_digest      SHA256 of data to be signed.
+ * @param o_signature   Signature bytes.
+ *
+ * @return Operation status.
+ */
+casper::hsm::API::Status casper::hsm::fake::API::TrySignDigest (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN], std::vector<unsigned char>& o_signature) noexcept
+{
+    // ... check if required certificate and configuration exist ...
+    if ( certificates().end() == certificates().find(a_key) ) {
+        return Status { "looking up certificate ( configuration error )", 0 };
+    }
+    const Json::Value& cfg = const_cast<const Json::Value&>(cfg_)[a_key];
+    if ( false == cfg.isObject() || false == cfg["key"].isString() || false == cfg["pwd"].isString() ) {
+        return Status { "looking up private key ( configuration error )", 0 };
+    }
+    // ... load private key ( fake, performance is not a concern: it's loaded on every call ) ...
+    EVP_PKEY* pkey = nullptr;
+    try {
+        std::string uri = cfg["key"].asString();
+        if ( 0 == uri.compare(0, 7, "file://") ) {
+            uri = uri.substr(7);
+        }
+        const std::string pwd = ::cc::base64_rfc4648::decode<std::string>(cfg["pwd"].asString());
+        FILE* file = fopen(uri.c_str(), "r");
+        if ( nullptr != file ) {
+            pkey = PEM_read_PrivateKey(file, nullptr, nullptr, const_cast<char*>(pwd.c_str()));
+            fclose(file);
+        }
+    } catch (...) {
+        pkey = nullptr;
+    }
+    if ( nullptr == pkey ) {
+        ERR_clear_error();
+        return Status { "loading private key", 0 };
+    }
+    // ... sign DigestInfo ( PKCS #1 v1.5 ) ...
+    size_t        length = 0;
+    EVP_PKEY_CTX* ctx    = EVP_PKEY_CTX_new(pkey, nullptr);
+    bool          rv     = (
+        nullptr != ctx
+        &&
+        1 == EVP_PKEY_sign_init(ctx)
+        &&
+        1 == EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING)
+        &&
+        1 == EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha256())
+        &&
+        1 == EVP_PKEY_sign(ctx, nullptr, &length, a_digest, CASPER_HSM_API_SHA256_LEN)
+    );
+    if ( true == rv ) {
+        try {
+            o_signature.resize(length);
+            rv = ( 1 == EVP_PKEY_sign(ctx, o_signature.data(), &length, a_digest, CASPER_HSM_API_SHA256_LEN) );
+            o_signature.resize(length);
+        } catch (...) {
+            rv = false;
+        }
+    }
+    if ( nullptr != ctx ) {
+        EVP_PKEY_CTX_free(ctx);
+    }
+    EVP_PKEY_free(pkey);
+    if ( false == rv ) {
+        ERR_clear_error();
+        return Status { "signing digest", 0 };
+    }
+    return Status { nullptr, 0 };
+}
+
 /**
  * @brief Unload previously loaded shared library and functions, also close any open session.
  */
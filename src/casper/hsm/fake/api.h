@@ -56,8 +56,12 @@ namespace casper
                 
                 virtual void Load   ();
                 virtual void Sign   (const std::string& a_key, const std::string& a_hash, std::string& o_signature);
+                virtual void Sign   (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature);
                 virtual void Unload () noexcept;
                 
+                virtual Status TrySign       (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature) noexcept;
+                virtual Status TrySignDigest (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN], std::vector<unsigned char>& o_signature) noexcept;
+                
             }; // end of class 'API'
             
         } // end of namespace 'fake'
@@ -0,0 +1,309 @@
+/**
+ * @file hedger.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/hedger.h"
+
+#include <algorithm> // std::nth_element
+#include <chrono>    // std::chrono
+
+#define CASPER_HSM_HEDGER_MAX_KEYS 1024 // arbitrary
+
+/**
+ * @brief Default constructor.
+ *
+ * @param a_config  See \link Config \link.
+ * @param a_factory Function to call to create a loaded API instance per lane.
+ */
+casper::hsm::Hedger::Hedger (const casper::hsm::Hedger::Config& a_config, const casper::hsm::Hedger::Factory& a_factory)
+    : config_(a_config), stop_(false), signs_(0), hedged_(0), link_failure_(false)
+{
+    for ( auto& lane : lanes_ ) {
+        lane.api_          = nullptr;
+        lane.busy_         = false;
+        lane.pending_      = false;
+        lane.done_         = false;
+        lane.abandoned_    = false;
+        lane.status_       = { nullptr, 0 };
+        lane.link_failure_ = false;
+        lane.prehashed_    = false;
+    }
+    // ... one session per lane ...
+    try {
+        for ( auto& lane : lanes_ ) {
+            lane.api_ = a_factory();
+        }
+    } catch (...) {
+        for ( auto& lane : lanes_ ) {
+            if ( nullptr != lane.api_ ) {
+                lane.api_->Unload();
+                delete lane.api_;
+            }
+        }
+        throw;
+    }
+    // ... start lanes ...
+    for ( auto& lane : lanes_ ) {
+        lane.thread_ = std::thread(&casper::hsm::Hedger::Loop, this, std::ref(lane));
+    }
+}
+
+/**
+ * @brief Destructor, waits for running operations.
+ */
+casper::hsm::Hedger::~Hedger ()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for ( auto& lane : lanes_ ) {
+        if ( true == lane.thread_.joinable() ) {
+            lane.thread_.join();
+        }
+        lane.api_->Unload();
+        delete lane.api_;
+    }
+}
+
+/**
+ * @brief Sign raw data, hedging when it takes longer than usual.
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_data      Data to be signed.
+ * @param a_length    Data length, in bytes.
+ * @param o_signature Signature bytes.
+ *
+ * @return Operation status, from the winning lane.
+ */
+casper::hsm::API::Status casper::hsm::Hedger::TrySign (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature)
+{
+    return Hedge(a_key, a_data, a_length, /* a_prehashed */ false, o_signature);
+}
+
+/**
+ * @brief Sign a precomputed SHA256 digest, hedging when it takes longer than usual.
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_digest    SHA256 of data to be signed.
+ * @param o_signature Signature bytes.
+ *
+ * @return Operation status, from the winning lane.
+ */
+casper::hsm::API::Status casper::hsm::Hedger::TrySignDigest (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN], std::vector<unsigned char>& o_signature)
+{
+    return Hedge(a_key, a_digest, CASPER_HSM_API_SHA256_LEN, /* a_prehashed */ true, o_signature);
+}
+
+// MARK: -
+
+/**
+ * @brief Run a sign operation, hedging when it takes longer than usual.
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_data      Data to be signed, or it's SHA256 digest.
+ * @param a_length    Data length, in bytes.
+ * @param a_prehashed True when data is a SHA256 digest.
+ * @param o_signature Signature bytes.
+ *
+ * @return Operation status, from the winning lane.
+ */
+casper::hsm::API::Status casper::hsm::Hedger::Hedge (const std::string& a_key, const unsigned char* a_data, const size_t a_length, const bool a_prehashed,
+                                                     std::vector<unsigned char>& o_signature)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    
+    // ... a lane might still be busy with an abandoned operation ...
+    done_cv_.wait(lock, [this] { return nullptr != Free(); });
+    
+    Lane* primary = Free();
+    Submit(*primary, a_key, a_data, a_length, a_prehashed);
+    signs_++;
+    
+    // ... hedge if it takes longer than p95, within budget ...
+    Lane*          hedge = nullptr;
+    const uint64_t p95   = P95(a_key);
+    if ( p95 > 0 && false == done_cv_.wait_for(lock, std::chrono::microseconds(p95), [primary] { return primary->done_; }) ) {
+        if ( hedged_ * 100 < static_cast<uint64_t>(config_.budget_) * signs_ && nullptr != ( hedge = Free() ) ) {
+            Submit(*hedge, a_key, a_data, a_length, a_prehashed);
+            hedged_++;
+        }
+    }
+    
+    // ... first result wins ...
+    done_cv_.wait(lock, [primary, hedge] { return primary->done_ || ( nullptr != hedge && hedge->done_ ); });
+    Lane* winner = ( true == primary->done_ ? primary : hedge );
+    Lane* other  = ( winner == primary ? hedge : primary );
+    // ... unless it's a failure and there's still something to wait for ...
+    if ( false == API::Succeeded(winner->status_) && nullptr != other ) {
+        done_cv_.wait(lock, [other] { return other->done_; });
+        if ( true == API::Succeeded(other->status_) ) {
+            std::swap(winner, other);
+        }
+    }
+    
+    const API::Status status = winner->status_;
+    link_failure_ = ( false == API::Succeeded(status) && true == winner->link_failure_ );
+    if ( true == API::Succeeded(status) ) {
+        o_signature.swap(winner->signature_);
+    }
+    
+    Release(*winner);
+    if ( nullptr != other ) {
+        if ( true == other->done_ ) {
+            Release(*other);
+        } else {
+            other->abandoned_ = true;
+        }
+    }
+    
+    lock.unlock();
+    
+    return status;
+}
+
+/**
+ * @brief Lane thread loop.
+ *
+ * @param a_lane Lane to run.
+ */
+void casper::hsm::Hedger::Loop (casper::hsm::Hedger::Lane& a_lane)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for ( ;; ) {
+        work_cv_.wait(lock, [this, &a_lane] { return stop_ || a_lane.pending_; });
+        if ( true == stop_ ) {
+            return;
+        }
+        a_lane.pending_ = false;
+        // ... job data is not touched by others while lane is busy ...
+        lock.unlock();
+        const auto        start        = std::chrono::steady_clock::now();
+        const API::Status status       = ( true == a_lane.prehashed_
+                                          ? a_lane.api_->TrySignDigest(a_lane.key_, a_lane.data_.data(), a_lane.signature_)
+                                          : a_lane.api_->TrySign(a_lane.key_, a_lane.data_.data(), a_lane.data_.size(), a_lane.signature_)
+        );
+        const bool        link_failure = ( false == API::Succeeded(status) && true == a_lane.api_->link_failure() );
+        const uint64_t elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+        lock.lock();
+        // ... slow ( abandoned ) operations count too, otherwise p95 would be underestimated ...
+        if ( true == API::Succeeded(status) ) {
+            Record(a_lane.key_, elapsed);
+        }
+        a_lane.status_       = status;
+        a_lane.link_failure_ = link_failure;
+        if ( true == a_lane.abandoned_ ) {
+            Release(a_lane);
+        } else {
+            a_lane.done_ = true;
+            done_cv_.notify_all();
+        }
+    }
+}
+
+/**
+ * @return A lane that's not busy, nullptr if none, must be called with mutex locked.
+ */
+casper::hsm::Hedger::Lane* casper::hsm::Hedger::Free ()
+{
+    for ( auto& lane : lanes_ ) {
+        if ( false == lane.busy_ ) {
+            return &lane;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Submit a sign operation to a lane, must be called with mutex locked.
+ *
+ * @param a_lane      Lane that will perform the operation.
+ * @param a_key       HSM private key token label.
+ * @param a_data      Data to be signed, or it's SHA256 digest.
+ * @param a_length    Data length, in bytes.
+ * @param a_prehashed True when data is a SHA256 digest.
+ */
+void casper::hsm::Hedger::Submit (casper::hsm::Hedger::Lane& a_lane, const std::string& a_key, const unsigned char* a_data, const size_t a_length, const bool a_prehashed)
+{
+    a_lane.busy_      = true;
+    a_lane.pending_   = true;
+    a_lane.done_      = false;
+    a_lane.key_       = a_key;
+    a_lane.prehashed_ = a_prehashed;
+    a_lane.data_.assign(a_data, a_data + a_length);
+    work_cv_.notify_all();
+}
+
+/**
+ * @brief Mark a lane as free, must be called with mutex locked.
+ *
+ * @param a_lane Lane to release.
+ */
+void casper::hsm::Hedger::Release (casper::hsm::Hedger::Lane& a_lane)
+{
+    a_lane.busy_         = false;
+    a_lane.done_         = false;
+    a_lane.abandoned_    = false;
+    a_lane.status_       = { nullptr, 0 };
+    a_lane.link_failure_ = false;
+    done_cv_.notify_all();
+}
+
+/**
+ * @brief Keep track of a successful operation duration, must be called with mutex locked.
+ *
+ * @param a_key        HSM private key token label.
+ * @param a_elapsed_us Operation duration, in microseconds.
+ */
+void casper::hsm::Hedger::Record (const std::string& a_key, const uint64_t a_elapsed_us)
+{
+    // ... keep memory bounded ...
+    if ( samples_.size() >= CASPER_HSM_HEDGER_MAX_KEYS && samples_.end() == samples_.find(a_key) ) {
+        samples_.clear();
+    }
+    Samples& samples = samples_[a_key];
+    samples.values_[samples.next_] = a_elapsed_us;
+    samples.next_  = ( samples.next_ + 1 ) % CASPER_HSM_HEDGER_SAMPLES;
+    samples.count_ = std::min(samples.count_ + 1, static_cast<size_t>(CASPER_HSM_HEDGER_SAMPLES));
+    // ... refresh p95 every 8 samples ...
+    if ( 0 != ( samples.next_ % 8 ) ) {
+        return;
+    }
+    uint64_t values[CASPER_HSM_HEDGER_SAMPLES];
+    std::copy(samples.values_, samples.values_ + samples.count_, values);
+    const size_t nth = ( samples.count_ * 95 + 99 ) / 100 - 1;
+    std::nth_element(values, values + nth, values + samples.count_);
+    samples.p95_ = values[nth];
+}
+
+/**
+ * @return Observed p95 for a key, in microseconds, 0 if there are not enough samples yet.
+ *
+ * @param a_key HSM private key token label.
+ */
+uint64_t casper::hsm::Hedger::P95 (const std::string& a_key) const
+{
+    const auto it = samples_.find(a_key);
+    if ( samples_.end() == it || it->second.count_ < config_.min_samples_ ) {
+        return 0;
+    }
+    return it->second.p95_;
+}
@@ -0,0 +1,153 @@
+/**
+ * @file hedger.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_HEDGER_H_
+#define CASPER_HSM_HEDGER_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include "casper/hsm/api.h"
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h> // uint64_t
+
+#define CASPER_HSM_HEDGER_LANES   2
+#define CASPER_HSM_HEDGER_SAMPLES 64
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief Hedged signing: when an operation takes longer than the observed p95 for it's key,
+         *        the same operation is issued on another session and the first result wins.
+         *
+         * Each lane owns an API instance ( and so a session ) and a thread.
+         */
+        class Hedger final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+            
+        public: // Data Type(s)
+            
+            typedef struct {
+                size_t budget_;      //!< Maximum percentage of operations that can be hedged.
+                size_t min_samples_; //!< Minimum number of samples per key before hedging it.
+            } Config;
+            
+            typedef std::function<API*()> Factory;
+            
+        private: // Data Type(s)
+            
+            typedef struct {
+                uint64_t values_[CASPER_HSM_HEDGER_SAMPLES];
+                size_t   count_;
+                size_t   next_;
+                uint64_t p95_;
+            } Samples;
+            
+            typedef struct {
+                API*                       api_;
+                std::thread                thread_;
+                bool                       busy_;       //!< A job is pending or running.
+                bool                       pending_;    //!< A job was submitted but not yet picked by lane thread.
+                bool                       done_;       //!< Current job result is available.
+                bool                       abandoned_;  //!< Current job result is no longer wanted.
+                API::Status                status_;
+                bool                       link_failure_;
+                std::string                key_;
+                bool                       prehashed_;  //!< True when data_ is a SHA256 digest.
+                std::vector<unsigned char> data_;
+                std::vector<unsigned char> signature_;
+            } Lane;
+            
+        private: // Const Data
+            
+            const Config                   config_;
+            
+        private: // Data
+            
+            std::mutex                     mutex_;
+            std::condition_variable        work_cv_;
+            std::condition_variable        done_cv_;
+            bool                           stop_;
+            Lane                           lanes_[CASPER_HSM_HEDGER_LANES];
+            std::map<std::string, Samples> samples_;
+            uint64_t                       signs_;
+            uint64_t                       hedged_;
+            bool                           link_failure_;
+            
+        public: // Constructor(s) / Destructor
+            
+            Hedger () = delete;
+            Hedger (const Config& a_config, const Factory& a_factory);
+            virtual ~Hedger ();
+            
+        public: // Method(s) / Function(s)
+            
+            API::Status TrySign       (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature);
+            API::Status TrySignDigest (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN], std::vector<unsigned char>& o_signature);
+            
+        public: // Inline Method(s) / Function(s)
+            
+            /**
+             * @return Number of hedged operations.
+             */
+            inline uint64_t hedged () const
+            {
+                return hedged_;
+            }
+            
+            /**
+             * @return True if last operation failed because HSM could not be reached.
+             */
+            inline bool link_failure () const
+            {
+                return link_failure_;
+            }
+            
+        private: // Method(s) / Function(s)
+            
+            API::Status Hedge   (const std::string& a_key, const unsigned char* a_data, const size_t a_length, const bool a_prehashed,
+                                 std::vector<unsigned char>& o_signature);
+            void        Loop    (Lane& a_lane);
+            Lane*       Free    ();
+            void        Submit  (Lane& a_lane, const std::string& a_key, const unsigned char* a_data, const size_t a_length, const bool a_prehashed);
+            void        Release (Lane& a_lane);
+            void        Record  (const std::string& a_key, const uint64_t a_elapsed_us);
+            uint64_t    P95     (const std::string& a_key) const;
+            
+        }; // end of class 'Hedger'
+        
+    } // end of namespace 'hsm'
+    
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_HEDGER_H_
@@ -0,0 +1,151 @@
+/**
+ * @file limiter.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/limiter.h"
+
+#include <chrono> // std::chrono
+
+/**
+ * @brief Default constructor.
+ *
+ * @param a_state  Shared state, see \link Initialize \link.
+ * @param a_config Limiter configuration.
+ */
+casper::hsm::Limiter::Limiter (casper::hsm::Limiter::State& a_state, const casper::hsm::Limiter::Config& a_config)
+    : state_(a_state), config_(a_config)
+{
+    /* empty */
+}
+
+/**
+ * @brief Destructor.
+ */
+casper::hsm::Limiter::~Limiter ()
+{
+    /* empty */
+}
+
+/**
+ * @brief Try to start a new operation.
+ *
+ * @param a_class Operation priority class.
+ *
+ * @return True if operation can be performed, false if it should be rejected.
+ */
+bool casper::hsm::Limiter::TryAcquire (const casper::hsm::Limiter::Class a_class)
+{
+    // ... bulk operations can't take the share reserved for interactive ones ...
+    if ( Class::Bulk == a_class ) {
+        const uint32_t share = static_cast<uint32_t>(static_cast<double>(limit()) * ( 1.0 - config_.reserved_ ));
+        uint32_t       bulk  = state_.bulk_in_flight_.load(std::memory_order_relaxed);
+        do {
+            if ( bulk >= share ) {
+                state_.bulk_shed_.fetch_add(1, std::memory_order_relaxed);
+                state_.shed_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        } while ( false == state_.bulk_in_flight_.compare_exchange_weak(bulk, bulk + 1, std::memory_order_acquire, std::memory_order_relaxed) );
+    }
+    uint32_t in_flight = state_.in_flight_.load(std::memory_order_relaxed);
+    do {
+        if ( in_flight >= limit() ) {
+            if ( Class::Bulk == a_class ) {
+                state_.bulk_in_flight_.fetch_sub(1, std::memory_order_release);
+                state_.bulk_shed_.fetch_add(1, std::memory_order_relaxed);
+            }
+            state_.shed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    } while ( false == state_.in_flight_.compare_exchange_weak(in_flight, in_flight + 1, std::memory_order_acquire, std::memory_order_relaxed) );
+    return true;
+}
+
+/**
+ * @brief Signal that an operation has ended and adjust limit.
+ *
+ * @param a_class      Operation priority class, as provided to \link TryAcquire \link.
+ * @param a_latency_us Observed latency, in microseconds.
+ * @param a_failed     True if operation failed.
+ */
+void casper::hsm::Limiter::Release (const casper::hsm::Limiter::Class a_class, const uint64_t a_latency_us, const bool a_failed)
+{
+    Cancel(a_class);
+    
+    const uint64_t min   = static_cast<uint64_t>(config_.min_) * 1000;
+    const uint64_t max   = static_cast<uint64_t>(config_.max_) * 1000;
+    uint64_t       limit = state_.limit_.load(std::memory_order_relaxed);
+    
+    if ( true == a_failed || a_latency_us > config_.target_latency_us_ ) {
+        // ... multiplicative decrease, at most once per target latency window so a burst of slow samples counts once ...
+        const uint64_t now  = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        uint64_t       last = state_.last_decrease_us_.load(std::memory_order_relaxed);
+        if ( now - last < config_.target_latency_us_ || false == state_.last_decrease_us_.compare_exchange_strong(last, now, std::memory_order_relaxed) ) {
+            return;
+        }
+        uint64_t value;
+        do {
+            value = static_cast<uint64_t>(static_cast<double>(limit) * config_.backoff_);
+            if ( value < min ) {
+                value = min;
+            }
+        } while ( false == state_.limit_.compare_exchange_weak(limit, value, std::memory_order_relaxed) );
+    } else {
+        // ... additive increase, +1 per limit successful operations ...
+        uint64_t value;
+        do {
+            value = limit + ( 1000 * 1000 ) / ( limit > 0 ? limit : 1000 );
+            if ( value > max ) {
+                value = max;
+            }
+        } while ( false == state_.limit_.compare_exchange_weak(limit, value, std::memory_order_relaxed) );
+    }
+}
+
+/**
+ * @brief Signal that an operation has ended without an outcome, limit is not adjusted.
+ *
+ * @param a_class Operation priority class, as provided to \link TryAcquire \link.
+ */
+void casper::hsm::Limiter::Cancel (const casper::hsm::Limiter::Class a_class)
+{
+    if ( Class::Bulk == a_class ) {
+        state_.bulk_in_flight_.fetch_sub(1, std::memory_order_release);
+    }
+    state_.in_flight_.fetch_sub(1, std::memory_order_release);
+}
+
+// MARK: -
+
+/**
+ * @brief Initialize a shared state.
+ *
+ * @param a_state  State to initialize.
+ * @param a_config Limiter configuration.
+ */
+void casper::hsm::Limiter::Initialize (casper::hsm::Limiter::State& a_state, const casper::hsm::Limiter::Config& a_config)
+{
+    a_state.in_flight_.store(0);
+    a_state.bulk_in_flight_.store(0);
+    a_state.limit_.store(static_cast<uint64_t>(a_config.max_) * 1000);
+    a_state.last_decrease_us_.store(0);
+    a_state.shed_.store(0);
+    a_state.bulk_shed_.store(0);
+}
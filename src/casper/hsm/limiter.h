@@ -0,0 +1,110 @@
+/**
+ * @file limiter.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_LIMITER_H_
+#define CASPER_HSM_LIMITER_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <atomic>
+
+#include <stdint.h> // uint*_t
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief AIMD adaptive concurrency limiter.
+         *
+         * State is kept in a POD struct of lock-free atomics so it can be placed in memory shared by several processes.
+         */
+        class Limiter final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+            
+        public: // Data Type(s)
+            
+            enum class Class : uint8_t {
+                Interactive = 0, //!< May use the whole limit.
+                Bulk             //!< May only use the share of the limit that is not reserved for interactive operations.
+            };
+            
+            typedef struct {
+                uint32_t min_;                //!< Minimum number of outstanding operations.
+                uint32_t max_;                //!< Maximum number of outstanding operations.
+                uint64_t target_latency_us_;  //!< Latency above which the limit is decreased, in microseconds.
+                double   backoff_;            //!< Multiplicative decrease factor, ] 0, 1 [.
+                double   reserved_;           //!< Share of the limit reserved for interactive operations, [ 0, 1 [.
+            } Config;
+            
+            typedef struct {
+                std::atomic<uint32_t> in_flight_;        //!< Number of outstanding operations.
+                std::atomic<uint32_t> bulk_in_flight_;   //!< Number of outstanding bulk operations.
+                std::atomic<uint64_t> limit_;            //!< Current limit, in milli-units.
+                std::atomic<uint64_t> last_decrease_us_; //!< Monotonic time of last decrease, in microseconds.
+                std::atomic<uint64_t> shed_;             //!< Number of rejected operations.
+                std::atomic<uint64_t> bulk_shed_;        //!< Number of rejected bulk operations.
+            } State;
+            
+        private: // Refs
+            
+            State&       state_;
+            
+        private: // Const Data
+            
+            const Config config_;
+            
+        public: // Constructor(s) / Destructor
+            
+            Limiter () = delete;
+            Limiter (State& a_state, const Config& a_config);
+            virtual ~Limiter ();
+            
+        public: // Method(s) / Function(s)
+            
+            bool TryAcquire (const Class a_class);
+            void Release    (const Class a_class, const uint64_t a_latency_us, const bool a_failed);
+            void Cancel     (const Class a_class);
+            
+        public: // Static Method(s) / Function(s)
+            
+            static void Initialize (State& a_state, const Config& a_config);
+            
+        public: // Inline Method(s) / Function(s)
+            
+            /**
+             * @return Current limit.
+             */
+            inline uint32_t limit () const
+            {
+                return static_cast<uint32_t>(state_.limit_.load(std::memory_order_relaxed) / 1000);
+            }
+            
+        }; // end of class 'Limiter'
+        
+    } // end of namespace 'hsm'
+    
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_LIMITER_H_
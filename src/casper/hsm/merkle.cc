@@ -0,0 +1,203 @@
+/**
+ * @file merkle.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/merkle.h"
+
+#include "casper/hsm/api.h" // casper::hsm::Exception
+
+#include "cc/hash/sha256.h"
+
+#include <string.h> // memcpy, memcmp
+
+/**
+ * @brief Default constructor.
+ */
+casper::hsm::Merkle::Merkle ()
+{
+    /* empty */
+}
+
+/**
+ * @brief Destructor.
+ */
+casper::hsm::Merkle::~Merkle ()
+{
+    /* empty */
+}
+
+/**
+ * @brief Forget all leaves, allocated memory is kept.
+ */
+void casper::hsm::Merkle::Reset ()
+{
+    for ( auto& level : levels_ ) {
+        level.clear();
+    }
+    if ( 0 == levels_.size() ) {
+        levels_.resize(1);
+    }
+}
+
+/**
+ * @brief Add a leaf.
+ *
+ * @param a_data   Leaf data.
+ * @param a_length Data length, in bytes.
+ */
+void casper::hsm::Merkle::Add (const unsigned char* a_data, const size_t a_length)
+{
+    if ( 0 == levels_.size() ) {
+        levels_.resize(1);
+    }
+    levels_[0].resize(levels_[0].size() + 1);
+    Leaf(a_data, a_length, levels_[0].back());
+}
+
+/**
+ * @brief Build tree, must be called after all leaves were added and before \link Prove \link or \link root \link.
+ */
+void casper::hsm::Merkle::Build ()
+{
+    if ( 0 == levels_.size() || 0 == levels_[0].size() ) {
+        throw ::casper::hsm::Exception("Unable to build merkle tree: %s!", "no leaves");
+    }
+    size_t level = 0;
+    while ( levels_[level].size() > 1 ) {
+        if ( levels_.size() == level + 1 ) {
+            levels_.resize(level + 2);
+        }
+        const std::vector<Hash>& current = levels_[level];
+        std::vector<Hash>&       next    = levels_[level + 1];
+        next.resize(( current.size() + 1 ) / 2);
+        for ( size_t idx = 0 ; idx + 1 < current.size() ; idx += 2 ) {
+            Node(current[idx], current[idx + 1], next[idx / 2]);
+        }
+        // ... odd? promote last ...
+        if ( 1 == current.size() % 2 ) {
+            next.back() = current.back();
+        }
+        level++;
+    }
+    // ... forget upper levels from a previous, bigger, tree ...
+    for ( size_t idx = level + 1 ; idx < levels_.size() ; ++idx ) {
+        levels_[idx].clear();
+    }
+}
+
+/**
+ * @brief Obtain a leaf inclusion proof.
+ *
+ * @param a_index Leaf index.
+ * @param o_proof Sibling hashes, from leaf level up to root.
+ */
+void casper::hsm::Merkle::Prove (const size_t a_index, casper::hsm::Merkle::Proof& o_proof) const
+{
+    if ( 0 == levels_.size() || a_index >= levels_[0].size() ) {
+        throw ::casper::hsm::Exception("Unable to obtain merkle proof: %s!", "invalid index");
+    }
+    o_proof.clear();
+    size_t index = a_index;
+    for ( size_t level = 0 ; level < levels_.size() && levels_[level].size() > 1 ; ++level ) {
+        const std::vector<Hash>& current = levels_[level];
+        const size_t             sibling = ( 0 == index % 2 ? index + 1 : index - 1 );
+        // ... promoted node has no sibling ...
+        if ( sibling < current.size() ) {
+            o_proof.push_back({ /* left_ */ sibling < index, /* hash_ */ current[sibling] });
+        }
+        index /= 2;
+    }
+}
+
+/**
+ * @return Root hash, after \link Build \link.
+ */
+const casper::hsm::Merkle::Hash& casper::hsm::Merkle::root () const
+{
+    for ( auto it = levels_.rbegin() ; levels_.rend() != it ; ++it ) {
+        if ( 1 == it->size() ) {
+            return it->front();
+        }
+    }
+    throw ::casper::hsm::Exception("Unable to obtain merkle root: %s!", "tree not built");
+}
+
+// MARK: -
+
+/**
+ * @brief Verify a leaf inclusion proof.
+ *
+ * @param a_data   Leaf data.
+ * @param a_length Data length, in bytes.
+ * @param a_proof  Inclusion proof, see \link Prove \link.
+ * @param a_root   Expected root hash ( signed value ).
+ *
+ * @return True if leaf is included in tree with the provided root.
+ */
+bool casper::hsm::Merkle::Verify (const unsigned char* a_data, const size_t a_length, const casper::hsm::Merkle::Proof& a_proof, const unsigned char a_root[CASPER_HSM_MERKLE_HASH_LEN])
+{
+    Hash hash;
+    Hash tmp;
+    Leaf(a_data, a_length, hash);
+    for ( auto& step : a_proof ) {
+        if ( true == step.left_ ) {
+            Node(step.hash_, hash, tmp);
+        } else {
+            Node(hash, step.hash_, tmp);
+        }
+        hash = tmp;
+    }
+    return ( 0 == memcmp(hash.bytes_, a_root, CASPER_HSM_MERKLE_HASH_LEN) );
+}
+
+/**
+ * @brief Calculate a leaf hash.
+ *
+ * @param a_data   Leaf data.
+ * @param a_length Data length, in bytes.
+ * @param o_hash   SHA256(0x00 || data).
+ */
+void casper::hsm::Merkle::Leaf (const unsigned char* a_data, const size_t a_length, casper::hsm::Merkle::Hash& o_hash)
+{
+    const unsigned char prefix = 0x00;
+    ::cc::hash::SHA256 sha256;
+    sha256.Initialize();
+    sha256.Update(&prefix, sizeof(prefix));
+    sha256.Update(a_data, a_length);
+    memcpy(o_hash.bytes_, sha256.Final(), CASPER_HSM_MERKLE_HASH_LEN);
+}
+
+/**
+ * @brief Calculate a node hash.
+ *
+ * @param a_left  Left child hash.
+ * @param a_right Right child hash.
+ * @param o_hash  SHA256(0x01 || left || right).
+ */
+void casper::hsm::Merkle::Node (const casper::hsm::Merkle::Hash& a_left, const casper::hsm::Merkle::Hash& a_right, casper::hsm::Merkle::Hash& o_hash)
+{
+    const unsigned char prefix = 0x01;
+    ::cc::hash::SHA256 sha256;
+    sha256.Initialize();
+    sha256.Update(&prefix, sizeof(prefix));
+    sha256.Update(a_left.bytes_, sizeof(a_left.bytes_));
+    sha256.Update(a_right.bytes_, sizeof(a_right.bytes_));
+    memcpy(o_hash.bytes_, sha256.Final(), CASPER_HSM_MERKLE_HASH_LEN);
+}
@@ -0,0 +1,94 @@
+/**
+ * @file merkle.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_MERKLE_H_
+#define CASPER_HSM_MERKLE_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <vector>
+
+#include <stddef.h> // size_t
+
+#define CASPER_HSM_MERKLE_HASH_LEN 32
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief SHA256 Merkle tree, so a batch can be signed with a single HSM operation ( root ).
+         *
+         * Leaf hash is SHA256(0x00 || data), node hash is SHA256(0x01 || left || right) - as in RFC 6962 - so
+         * a leaf can't be presented as a node. A level with an odd number of nodes promotes the last one unchanged.
+         */
+        class Merkle final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+        
+        public: // Data Type(s)
+            
+            typedef struct {
+                unsigned char bytes_[CASPER_HSM_MERKLE_HASH_LEN];
+            } Hash;
+            
+            typedef struct {
+                bool left_; //!< True when sibling is the left node.
+                Hash hash_; //!< Sibling hash.
+            } Step;
+            
+            typedef std::vector<Step> Proof;
+        
+        private: // Data
+            
+            std::vector<std::vector<Hash>> levels_;
+        
+        public: // Constructor(s) / Destructor
+            
+            Merkle ();
+            virtual ~Merkle ();
+        
+        public: // Method(s) / Function(s)
+            
+            void        Reset ();
+            void        Add   (const unsigned char* a_data, const size_t a_length);
+            void        Build ();
+            void        Prove (const size_t a_index, Proof& o_proof) const;
+            const Hash& root  () const;
+        
+        public: // Static Method(s) / Function(s)
+            
+            static bool Verify (const unsigned char* a_data, const size_t a_length, const Proof& a_proof, const unsigned char a_root[CASPER_HSM_MERKLE_HASH_LEN]);
+        
+        private: // Static Method(s) / Function(s)
+            
+            static void Leaf (const unsigned char* a_data, const size_t a_length, Hash& o_hash);
+            static void Node (const Hash& a_left, const Hash& a_right, Hash& o_hash);
+        
+        }; // end of class 'Merkle'
+    
+    } // end of namespace 'hsm'
+
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_MERKLE_H_
@@ -0,0 +1,144 @@
+/**
+ * @file prober.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/prober.h"
+
+/**
+ * @brief Default constructor.
+ *
+ * @param a_api       API instance to probe with, ownership is taken.
+ * @param a_share_dir Shared directory URI, loaded by probe thread before first probe.
+ */
+casper::hsm::Prober::Prober (casper::hsm::API* a_api, const std::string& a_share_dir)
+    : share_dir_(a_share_dir), api_(a_api), loaded_(false), stop_(false), pending_(false), result_(Result::Idle)
+{
+    thread_ = std::thread(&casper::hsm::Prober::Loop, this);
+}
+
+/**
+ * @brief Destructor, waits for running probe.
+ */
+casper::hsm::Prober::~Prober ()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if ( true == thread_.joinable() ) {
+        thread_.join();
+    }
+    api_->Unload();
+    delete api_;
+}
+
+/**
+ * @brief Ask probe thread to check if HSM can be reached, without waiting for it.
+ *
+ * @return False if a probe is already running or it's outcome was not polled yet.
+ */
+bool casper::hsm::Prober::Submit ()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if ( Result::Idle != result_.load() ) {
+            return false;
+        }
+        result_.store(Result::Running);
+        pending_ = true;
+    }
+    cv_.notify_all();
+    return true;
+}
+
+/**
+ * @brief Collect last probe outcome, a finished one is reported only once.
+ *
+ * @param o_error Set to error message when probe failed.
+ *
+ * @return See \link Result \link.
+ */
+casper::hsm::Prober::Result casper::hsm::Prober::Poll (std::string& o_error)
+{
+    const Result result = result_.load();
+    if ( Result::Succeeded != result && Result::Failed != result ) {
+        return result;
+    }
+    // ... thread is done with it's data ...
+    if ( Result::Failed == result ) {
+        o_error = error_;
+    }
+    result_.store(Result::Idle);
+    return result;
+}
+
+/**
+ * @brief Exchange probe API instance - after a successful probe it's session is fresh.
+ *
+ * @param a_api API instance to probe with from now on, ownership is taken.
+ *
+ * @return Previous API instance, ownership is transferred to caller.
+ *
+ * @note Must not be called while a probe is running.
+ */
+casper::hsm::API* casper::hsm::Prober::Exchange (casper::hsm::API* a_api)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if ( Result::Running == result_.load() ) {
+        throw ::casper::hsm::Exception("%s", "Can't exchange API instance while probe is running!");
+    }
+    API* api = api_;
+    api_     = a_api;
+    loaded_  = true; // ... caller's instance is already loaded ...
+    return api;
+}
+
+/**
+ * @brief Probe thread loop.
+ */
+void casper::hsm::Prober::Loop ()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for ( ;; ) {
+        cv_.wait(lock, [this] { return stop_ || pending_; });
+        if ( true == stop_ ) {
+            return;
+        }
+        pending_ = false;
+        // ... api_ is not touched by others while running ...
+        lock.unlock();
+        std::string error;
+        try {
+            if ( false == loaded_ ) {
+                api_->LoadSharedResources(share_dir_);
+                loaded_ = true;
+            }
+            api_->Probe();
+        } catch (const std::exception& a_exception) {
+            error = a_exception.what();
+        } catch (...) {
+            error = "Unknown error while probing HSM!";
+        }
+        lock.lock();
+        error_ = error;
+        result_.store(true == error.empty() ? Result::Succeeded : Result::Failed);
+    }
+}
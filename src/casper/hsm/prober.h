@@ -0,0 +1,97 @@
+/**
+ * @file prober.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_PROBER_H_
+#define CASPER_HSM_PROBER_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include "casper/hsm/api.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief Circuit breaker probes, performed by a dedicated thread on it's own API instance ( and so session ).
+         *
+         * Caller only submits probes and polls for their outcome, so it never waits for an HSM ( or it's client library ) timeout.
+         */
+        class Prober final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+            
+        public: // Data Type(s)
+            
+            enum class Result : uint8_t {
+                Idle = 0,
+                Running,
+                Succeeded,
+                Failed
+            };
+            
+        private: // Const Data
+            
+            const std::string       share_dir_;
+            
+        private: // Data
+            
+            API*                    api_;
+            bool                    loaded_;   //!< True when api_ shared resources are loaded.
+            std::thread             thread_;
+            std::mutex              mutex_;
+            std::condition_variable cv_;
+            bool                    stop_;
+            bool                    pending_;
+            std::atomic<Result>     result_;
+            std::string             error_;
+            
+        public: // Constructor(s) / Destructor
+            
+            Prober () = delete;
+            Prober (API* a_api, const std::string& a_share_dir);
+            virtual ~Prober ();
+            
+        public: // Method(s) / Function(s)
+            
+            bool   Submit   ();
+            Result Poll     (std::string& o_error);
+            API*   Exchange (API* a_api);
+            
+        private: // Method(s) / Function(s)
+            
+            void Loop ();
+            
+        }; // end of class 'Prober'
+        
+    } // end of namespace 'hsm'
+    
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_PROBER_H_
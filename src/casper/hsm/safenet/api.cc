@@ -33,6 +33,7 @@
 #include <string.h> // memcpy, memset
 
 #include <fstream>  // std::ifstream
+#include <chrono>   // std::chrono
 
 #include "ed.h"
 
@@ -57,6 +58,7 @@ casper::hsm::safenet::API::API (const std::string& a_application, const CK_SLOT_
     sfnt_functions_ = nullptr;
 #endif
     session_        = CK_INVALID_HANDLE;
+    metrics_.slot_  = slot_id_;
     memset(dpin_, 0, CASPER_HSM_API_MAX_PIN_SIZE);
     const auto tmp = _edd(a_pin);
     if ( tmp.length() > 0 && tmp.length() <= CASPER_HSM_API_MAX_PIN_SIZE ) {
@@ -125,8 +127,12 @@ void casper::hsm::safenet::API::Load ()
     if ( CKR_OK != ( rv = C_GetFunctionList(&p11_functions_) ) ) {
         throw ::casper::hsm::Exception("An error occurred while %s: 0x%08lx!", "load functions list", rv);
     }
-    // ... initialize library ...
-    if ( CKR_OK != ( rv = p11_functions_->C_Initialize(NULL_PTR) ) ) {
+    // ... initialize library, sessions might be used by several threads ( hedging ) ...
+    CK_C_INITIALIZE_ARGS args;
+    memset(&args, 0, sizeof(args));
+    args.flags = CKF_OS_LOCKING_OK;
+    // ... other instances ( e.g. hedging lanes ) might have already done it ...
+    if ( CKR_OK != ( rv = p11_functions_->C_Initialize(&args) ) && CKR_CRYPTOKI_ALREADY_INITIALIZED != rv ) {
         throw ::casper::hsm::Exception("An error occurred while %s: 0x%08lx!", "initialize functions", rv);
     }
 #if defined(CASPER_HSM_API_ENABLE_SFNT_FUNCTIONS)
@@ -195,120 +201,237 @@ void casper::hsm::safenet::API::Reset () noexcept
  */
 void casper::hsm::safenet::API::Sign (const std::string& a_key, const std::string& a_hash, std::string& o_signature)
 {
-    CK_BYTE* signature_bytes = NULL_PTR;
     // ... reset reusable data ...
     Reset();
+    // ... prepare data to sign ...
+    SetSigningBytes(a_hash, signing_data_);
+    // ... sign it ...
+    const Status status = SignSigningData(a_key, signature_);
+    if ( false == Succeeded(status) ) {
+        throw ::casper::hsm::Exception("%s", Describe(status).c_str());
+    }
+    // ... encode signature ...
+    o_signature = ::cc::base64_rfc4648::encode(signature_.data(), signature_.size());
+}
+
+/**
+ * @brief Sign raw data.
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_data      Data to be signed.
+ * @param a_length    Data length, in bytes.
+ * @param o_signature Signature bytes.
+ */
+void casper::hsm::safenet::API::Sign (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature)
+{
+    const Status status = TrySign(a_key, a_data, a_length, o_signature);
+    if ( false == Succeeded(status) ) {
+        throw ::casper::hsm::Exception("%s", Describe(status).c_str());
+    }
+}
+
+/**
+ * @brief Sign raw data, without throwing.
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_data      Data to be signed.
+ * @param a_length    Data length, in bytes.
+ * @param o_signature Signature bytes.
+ *
+ * @return Operation status.
+ */
+casper::hsm::API::Status casper::hsm::safenet::API::TrySign (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature) noexcept
+{
+    // ... reset reusable data ...
+    Reset();
+    // ... prepare data to sign ...
+    SetSigningBytes(a_data, a_length, signing_data_);
+    // ... sign it ...
+    return SignSigningData(a_key, o_signature);
+}
+
+/**
+ * @brief Sign a precomputed SHA256 digest, without throwing.
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_digest    SHA256 of data to be signed.
+ * @param o_signature Signature bytes.
+ *
+ * @return Operation status.
+ */
+casper::hsm::API::Status casper::hsm::safenet::API::TrySignDigest (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN], std::vector<unsigned char>& o_signature) noexcept
+{
+    // ... reset reusable data ( ASN1 header ) ...
+    Reset();
+    // ... prepare data to sign, digest was already calculated ...
+    memcpy(signing_data_ + ::cc::hash::SHA256::sk_signature_prefix_size_, a_digest, CASPER_HSM_API_SHA256_LEN);
+    // ... sign it ...
+    return SignSigningData(a_key, o_signature);
+}
+
+/**
+ * @brief Sign previously prepared signing data.
+ *
+ * @param a_key       HSM private key token label.
+ * @param o_signature Signature bytes.
+ *
+ * @return Operation status.
+ */
+casper::hsm::API::Status casper::hsm::safenet::API::SignSigningData (const std::string& a_key, std::vector<unsigned char>& o_signature) noexcept
+{
+    link_failure_ = false;
     // ... sanity check - we can't afford to pass invalid PIN values due to invalid size ...
     if ( false == vpin_ || 0 == lpin_ ) {
-        throw ::casper::hsm::Exception("Configuration error: %s!", "invalid PIN");
-    }    
-    // ... perform request ...
-    TryCall(/* a_run */
-            [this, &a_key, &a_hash, &o_signature, &signature_bytes] () {
-                
-                CK_RV rv = CKR_TOKEN_NOT_PRESENT;
-                
-                casper::hsm::safenet::API::NoExceptionCallResult osr = OpenSession();
-                if ( CKR_OK != osr.rv_ ) {
-                    throw ::casper::hsm::Exception("An error occurred while calling '%s' function: 0x%08lx!", osr.where_, osr.rv_);
-                }
-                
-                CK_MECHANISM_INFO info;
-                if ( CKR_OK != ( rv = p11_functions_->C_GetMechanismInfo(slot_id_, CKM_SHA256_RSA_PKCS, &info) ) ) {
-                    throw ::casper::hsm::Exception("An error occurred while calling '%s' function: 0x%08lx!", "C_GetMechanismInfo", rv);
-                }
-                
-                CK_OBJECT_HANDLE key = CK_INVALID_HANDLE;
-                const NoExceptionCallResult find_rv = FindPrivateKey(session_, a_key.c_str(), key);
-                if ( CKR_OK != find_rv.rv_ ) {
-                    throw ::casper::hsm::Exception("An error occurred while calling '%s' function: 0x%08lx!", "FindPrivateKey", rv);
-                }
+        return Status { "validating PIN ( configuration error )", 0 };
+    }
+    // ... session ...
+    if ( CK_INVALID_HANDLE != session_ && true == reuse_session_ ) {
+        metrics_.reused_++;
+    }
+    const auto session_start = std::chrono::steady_clock::now();
+    const NoExceptionCallResult osr = OpenSession();
+    metrics_.session_us_ += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - session_start).count());
+    if ( CKR_OK != osr.rv_ ) {
+        return Finish(a_key, osr.where_, osr.rv_);
+    }
+    
+    CK_RV rv;
+    CK_MECHANISM_INFO info;
+    if ( CKR_OK != ( rv = p11_functions_->C_GetMechanismInfo(slot_id_, CKM_SHA256_RSA_PKCS, &info) ) ) {
+        return Finish(a_key, "C_GetMechanismInfo", rv);
+    }
+    
+    CK_OBJECT_HANDLE key = CK_INVALID_HANDLE;
+    const auto find_start = std::chrono::steady_clock::now();
+    const NoExceptionCallResult find_rv = ResolveKey(a_key, key);
+    metrics_.find_us_ += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - find_start).count());
+    if ( CKR_OK != find_rv.rv_ ) {
+        return Finish(a_key, "FindPrivateKey", find_rv.rv_);
+    }
 
-                //
-                // 2.1.14 PKCS #1 v1.5 RSA signature with MD2, MD5, SHA-1, SHA-256, SHA-384, SHA-512, RIPE-MD 128 or RIPE-MD 160
-                //
-                // Likewise, the PKCS #1 v1.5 RSA signature with SHA-256, SHA-384, and SHA-512 mechanisms, denoted CKM_SHA256_RSA_PKCS, CKM_SHA384_RSA_PKCS, and CKM_SHA512_RSA_PKCS respectively,
-                // perform the same operations using the SHA-256, SHA-384 and SHA-512 hash functions with the object identifiers sha256WithRSAEncryption, sha384WithRSAEncryption and sha512WithRSAEncryption respectively.
-                
-                // 2.1.6 PKCS #1 v1.5 RSA
-                // The PKCS #1 v1.5 RSA mechanism, denoted CKM_RSA_PKCS, is a multi-purpose mechanism based on the RSA public-key cryptosystem and the block formats initially defined in PKCS #1 v1.5.
-                // It supports single-part encryption and decryption; single-part signatures and verification with and without message recovery; key wrapping; and key unwrapping.
-                // This mechanism corresponds only to the part of PKCS #1 v1.5 that involves RSA;
-                // it does not compute a message digest or a DigestInfo encoding as specified for the md2withRSAEncryption and md5withRSAEncryption algorithms in PKCS #1 v1.5 .
-                //
-                
-                // Using 2.1.6 PKCS #1 v1.5 RSA - CKM_RSA_PKCS.
-                
-                SetSigningBytes(a_hash, signing_data_);
-                
-                CK_MECHANISM mechanism = { /* mechanism */ CKM_RSA_PKCS, /* pParameter */ NULL_PTR, /* usParameterLen */ 0 };
-                if ( CKR_OK != ( rv = p11_functions_->C_SignInit(session_, &mechanism, key) ) ) {
-                    throw ::casper::hsm::Exception("An error occurred while calling '%s' function: 0x%08lx!", "C_SignInit", rv);
-                }
-                
-                CK_ULONG signature_length = 0;
-                
-                if ( CKR_OK != ( rv = p11_functions_->C_Sign(session_, signing_data_, sizeof(signing_data_), NULL_PTR, &signature_length) ) ) {
-                    throw ::casper::hsm::Exception("An error occurred while calling '%s' function: 0x%08lx!", "C_Sign ( to obain signature length )", rv);
-                }
-                // ... prepare signature buffer  ...
-                signature_bytes = (CK_BYTE*)calloc(signature_length, 1);
-                // ... sign ...
-                if ( CKR_OK != ( rv = p11_functions_->C_Sign(session_, signing_data_, sizeof(signing_data_), signature_bytes, &signature_length) ) ) {
-                    throw ::casper::hsm::Exception("An error occurred while calling '%s' function: 0x%08lx!", "C_Sign ( to sign data )", rv);
-                }
-                o_signature = ::cc::base64_rfc4648::encode(signature_bytes, static_cast<size_t>(signature_length));
-            },
-            /* a_cleanup */
-            [this, &signature_bytes] () {
-                // ...
-                if ( NULL_PTR != signature_bytes ) {
-                    free(signature_bytes);
-                    signature_bytes = nullptr;
-                }
-                // ...
-                CloseSession();
-            }
-    );
-    // ... sanity check ...
-    CC_ASSERT(nullptr == signature_bytes);
+    //
+    // 2.1.14 PKCS #1 v1.5 RSA signature with MD2, MD5, SHA-1, SHA-256, SHA-384, SHA-512, RIPE-MD 128 or RIPE-MD 160
+    //
+    // Likewise, the PKCS #1 v1.5 RSA signature with SHA-256, SHA-384, and SHA-512 mechanisms, denoted CKM_SHA256_RSA_PKCS, CKM_SHA384_RSA_PKCS, and CKM_SHA512_RSA_PKCS respectively,
+    // perform the same operations using the SHA-256, SHA-384 and SHA-512 hash functions with the object identifiers sha256WithRSAEncryption, sha384WithRSAEncryption and sha512WithRSAEncryption respectively.
+    
+    // 2.1.6 PKCS #1 v1.5 RSA
+    // The PKCS #1 v1.5 RSA mechanism, denoted CKM_RSA_PKCS, is a multi-purpose mechanism based on the RSA public-key cryptosystem and the block formats initially defined in PKCS #1 v1.5.
+    // It supports single-part encryption and decryption; single-part signatures and verification with and without message recovery; key wrapping; and key unwrapping.
+    // This mechanism corresponds only to the part of PKCS #1 v1.5 that involves RSA;
+    // it does not compute a message digest or a DigestInfo encoding as specified for the md2withRSAEncryption and md5withRSAEncryption algorithms in PKCS #1 v1.5 .
+    //
+    
+    // Using 2.1.6 PKCS #1 v1.5 RSA - CKM_RSA_PKCS.
+    
+    CK_MECHANISM mechanism = { /* mechanism */ CKM_RSA_PKCS, /* pParameter */ NULL_PTR, /* usParameterLen */ 0 };
+    if ( CKR_OK != ( rv = p11_functions_->C_SignInit(session_, &mechanism, key) ) ) {
+        return Finish(a_key, "C_SignInit", rv);
+    }
+    
+    CK_ULONG signature_length = 0;
+    
+    if ( CKR_OK != ( rv = p11_functions_->C_Sign(session_, signing_data_, sizeof(signing_data_), NULL_PTR, &signature_length) ) ) {
+        return Finish(a_key, "C_Sign ( to obain signature length )", rv);
+    }
+    // ... prepare signature buffer ( capacity is kept between calls, so it won't allocate once warmed up ) ...
+    try {
+        o_signature.resize(static_cast<size_t>(signature_length));
+    } catch (...) {
+        return Finish(a_key, "std::vector::resize", CKR_HOST_MEMORY);
+    }
+    // ... sign ...
+    if ( CKR_OK != ( rv = p11_functions_->C_Sign(session_, signing_data_, sizeof(signing_data_), o_signature.data(), &signature_length) ) ) {
+        return Finish(a_key, "C_Sign ( to sign data )", rv);
+    }
+    o_signature.resize(static_cast<size_t>(signature_length));
+    // ... done ...
+    return Finish(a_key, nullptr, CKR_OK);
 }
 
 /**
- * @brief Set the appropriated signing data payload to be used with CKM_RSA_PKCS mechanism.
+ * @brief Sign operation epilogue, keeps track of link state and session.
+ *
+ * @param a_key   HSM private key token label.
+ * @param a_where Failed function name, nullptr on success.
+ * @param a_rv    Last PKCS #11 result.
  *
- * @param a_hash  Base64-encoded hash value to be signed.
- * @param o_bytes Bytes to be signed, ASN1 header + sha256 ( Base64-decoded a_hash value ).
+ * @return Operation status.
  */
-void casper::hsm::safenet::API::SetSigningBytes (const std::string& a_hash, CK_BYTE o_bytes[CASPER_HSM_API_ASN1_PLUS_SHA256_LEN]) const
+casper::hsm::API::Status casper::hsm::safenet::API::Finish (const std::string& a_key, const char* const a_where, const CK_RV a_rv) noexcept
 {
-    unsigned char* buffer = nullptr;
-    TryCall(/* a_run */
-            [&buffer, &a_hash, &o_bytes] () {
-                // ... calculate maximum base64 decode size and ensure a buffer for decoder ...
-                const size_t mds = ::cc::base64_rfc4648::decoded_max_size(a_hash.length());
-                buffer = new unsigned char[mds];
-                // ... decode 'has' from base64 ...
-                const size_t ds = ::cc::base64_rfc4648::decode(buffer, mds, a_hash.c_str(), a_hash.length());
-                // ... calculate SHA256 digest ...
-                ::cc::hash::SHA256 sha256;
-                sha256.Initialize();
-                sha256.Update(buffer, ds);
-                const unsigned char* const digest = sha256.Final();
-                // ... join SHA256 signature prefix and SHA56 digest ...
-                memcpy(o_bytes, ::cc::hash::SHA256::sk_signature_prefix_, ::cc::hash::SHA256::sk_signature_prefix_size_);
-                memcpy(o_bytes + ::cc::hash::SHA256::sk_signature_prefix_size_, digest, SHA256_DIGEST_LENGTH);
-            },
-            /* a_cleanup */
-            [&buffer] () {
-                if ( nullptr != buffer ) {
-                    delete [] buffer;
-                    buffer = nullptr;
-                }
-            }
-    );
-    // ... sanity check ...
-    CC_ASSERT(nullptr == buffer);
+    // ... keep track of link state ...
+    link_failure_ = IsLinkFailure(a_rv);
+    // ... keep session ( and resolved keys ) only if it will be reused and it's still healthy ...
+    if ( false == reuse_session_ || true == IsSessionFailure(a_rv) ) {
+        CloseSession();
+    } else if ( CKR_KEY_HANDLE_INVALID == a_rv || CKR_OBJECT_HANDLE_INVALID == a_rv ) {
+        // ... stale key handle, only that one must be resolved again ...
+        keys_.erase(a_key);
+    }
+    return Status { a_where, static_cast<unsigned long>(a_rv) };
+}
+
+/**
+ * @brief Check if HSM can be reached, a new session is opened and logged in.
+ */
+void casper::hsm::safenet::API::Probe ()
+{
+    link_failure_ = false;
+    // ... ensure library is loaded ...
+    Load();
+    // ... discard current session, it might be stale ...
+    CloseSession();
+    // ... re-establish it ...
+    const NoExceptionCallResult osr = OpenSession();
+    if ( CKR_OK != osr.rv_ ) {
+        link_failure_ = IsLinkFailure(osr.rv_);
+        throw ::casper::hsm::Exception("An error occurred while calling '%s' function: 0x%08lx!", osr.where_, osr.rv_);
+    }
+    CK_MECHANISM_INFO info;
+    const CK_RV rv = p11_functions_->C_GetMechanismInfo(slot_id_, CKM_SHA256_RSA_PKCS, &info);
+    if ( CKR_OK != rv ) {
+        link_failure_ = IsLinkFailure(rv);
+        CloseSession();
+        throw ::casper::hsm::Exception("An error occurred while calling '%s' function: 0x%08lx!", "C_GetMechanismInfo", rv);
+    }
+    // ... keep it only if it will be reused ...
+    if ( false == reuse_session_ ) {
+        CloseSession();
+    }
+}
+
+/**
+ * @brief Perform all one-time work required by the first sign operation: library is loaded, a session is opened
+ *        and logged in and private keys handles for all loaded certificates are resolved.
+ *
+ * @note Keys that can't be found are skipped, sign operation for those will report the error.
+ */
+void casper::hsm::safenet::API::Warm ()
+{
+    link_failure_ = false;
+    // ... ensure library is loaded ...
+    Load();
+    // ... ensure a logged in session ...
+    const NoExceptionCallResult osr = OpenSession();
+    if ( CKR_OK != osr.rv_ ) {
+        link_failure_ = IsLinkFailure(osr.rv_);
+        throw ::casper::hsm::Exception("An error occurred while calling '%s' function: 0x%08lx!", osr.where_, osr.rv_);
+    }
+    // ... resolve all known keys ...
+    CK_OBJECT_HANDLE key;
+    for ( auto it : certificates() ) {
+        const NoExceptionCallResult rkr = ResolveKey(it.first, key);
+        if ( CKR_OK != rkr.rv_ && true == IsLinkFailure(rkr.rv_) ) {
+            link_failure_ = true;
+            CloseSession();
+            throw ::casper::hsm::Exception("An error occurred while calling '%s' function: 0x%08lx!", rkr.where_, rkr.rv_);
+        }
+    }
+    // ... keep it only if it will be reused ...
+    if ( false == reuse_session_ ) {
+        CloseSession();
+    }
 }
 
 /**
@@ -363,10 +486,42 @@ casper::hsm::safenet::API::NoExceptionCallResult casper::hsm::safenet::API::Clos
         // ... reset ...
         session_ = CK_INVALID_HANDLE;
     }
+    // ... resolved keys handles are only guaranteed while logged in ...
+    keys_.clear();
     // ... done ...
     return NoExceptionCallResult { CKR_OK != rv ? "C_CloseSession" : nullptr, rv };
 }
 
+/**
+ * @brief Resolve a private key handle, using current session and keeping it for as long as session is kept.
+ *
+ * @param a_key HSM private key token label.
+ * @param o_key HSM private key object handle.
+ *
+ * @return Call result, see \link HSM::NoExceptionCallResult \link.
+ */
+casper::hsm::safenet::API::NoExceptionCallResult casper::hsm::safenet::API::ResolveKey (const std::string& a_key, CK_OBJECT_HANDLE& o_key) noexcept
+{
+    // ... already resolved?
+    const auto it = keys_.find(a_key);
+    if ( keys_.end() != it ) {
+        o_key = it->second;
+        // ... done, cached ...
+        return NoExceptionCallResult { nullptr, CKR_OK };
+    }
+    // ... find it ...
+    const NoExceptionCallResult rv = FindPrivateKey(session_, a_key, o_key);
+    if ( CKR_OK == rv.rv_ ) {
+        try {
+            keys_[a_key] = o_key;
+        } catch (...) {
+            // ... not cached, it will be searched again next time ...
+        }
+    }
+    // ... done ...
+    return rv;
+}
+
 /**
  * @brief Find a private key via HSM token label - using HSM client library.
  *
@@ -484,3 +639,53 @@ casper::hsm::safenet::API::NoExceptionCallResult casper::hsm::safenet::API::GetO
     // ... done ...
     return NoExceptionCallResult { nullptr, rv };
 }
+
+// MARK: -
+
+/**
+ * @brief Check if a PKCS #11 result means that HSM could not be reached or that the session was lost.
+ *
+ * @param a_rv PKCS #11 result.
+ *
+ * @return True if so.
+ */
+bool casper::hsm::safenet::API::IsLinkFailure (const CK_RV a_rv) noexcept
+{
+    switch (a_rv) {
+        case CKR_GENERAL_ERROR:
+        case CKR_FUNCTION_FAILED:
+        case CKR_DEVICE_ERROR:
+        case CKR_DEVICE_MEMORY:
+        case CKR_DEVICE_REMOVED:
+        case CKR_SESSION_CLOSED:
+        case CKR_SESSION_HANDLE_INVALID:
+        case CKR_TOKEN_NOT_PRESENT:
+        case CKR_TOKEN_NOT_RECOGNIZED:
+        case CKR_CRYPTOKI_NOT_INITIALIZED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Check if a PKCS #11 result means that current session can't be reused.
+ *
+ * @param a_rv PKCS #11 result.
+ *
+ * @return True if so, other errors ( e.g. an unknown key ) leave session and resolved keys untouched.
+ */
+bool casper::hsm::safenet::API::IsSessionFailure (const CK_RV a_rv) noexcept
+{
+    if ( true == IsLinkFailure(a_rv) ) {
+        return true;
+    }
+    switch (a_rv) {
+        case CKR_USER_NOT_LOGGED_IN:
+        case CKR_OPERATION_ACTIVE:
+        case CKR_HOST_MEMORY:
+            return true;
+        default:
+            return false;
+    }
+}
@@ -25,8 +25,6 @@
 
 #include "cryptoki_v2.h"
 
-/* 19 byte ASN1 header + sha256 ( 32 byte ) size */
-#define CASPER_HSM_API_ASN1_PLUS_SHA256_LEN 19 + 32
 #undef  CASPER_HSM_API_ENABLE_SFNT_FUNCTIONS
 #define CASPER_HSM_API_MAX_PIN_SIZE          64 // defined by client library
 
@@ -68,7 +66,9 @@ namespace casper
 
             private: // Data
                 
-                CK_BYTE signing_data_[CASPER_HSM_API_ASN1_PLUS_SHA256_LEN];
+                CK_BYTE                                 signing_data_[CASPER_HSM_API_ASN1_PLUS_SHA256_LEN];
+                std::vector<CK_BYTE>                    signature_;
+                std::map<std::string, CK_OBJECT_HANDLE> keys_;      //!< Private keys handles, resolved while current session is kept.
                 
             public: // Constructor(s) / Destructor
                 
@@ -82,20 +82,32 @@ namespace casper
                 
                 virtual void Load   ();
                 virtual void Sign   (const std::string& a_key, const std::string& a_hash, std::string& o_signature);
+                virtual void Sign   (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature);
                 virtual void Unload () noexcept;
+                virtual void Probe  ();
+                virtual void Warm   ();
+                
+                virtual Status TrySign       (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature) noexcept;
+                virtual Status TrySignDigest (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN], std::vector<unsigned char>& o_signature) noexcept;
             
             private: // Method(s) // Function(s)
                 
-                void Reset () noexcept;
-
-                void SetSigningBytes (const std::string& a_hash, CK_BYTE o_bytes[CASPER_HSM_API_ASN1_PLUS_SHA256_LEN]) const;
+                void   Reset           () noexcept;
+                Status SignSigningData (const std::string& a_key, std::vector<unsigned char>& o_signature) noexcept;
+                Status Finish          (const std::string& a_key, const char* const a_where, const CK_RV a_rv) noexcept;
 
                 NoExceptionCallResult OpenSession  () noexcept;
                 NoExceptionCallResult CloseSession () noexcept;
                 
                 NoExceptionCallResult FindPrivateKey (const CK_SESSION_HANDLE& a_session, const std::string& a_name, CK_OBJECT_HANDLE& o_key) const noexcept;
+                NoExceptionCallResult ResolveKey     (const std::string& a_name, CK_OBJECT_HANDLE& o_key) noexcept;
                 NoExceptionCallResult GetObjectLabel (const CK_SESSION_HANDLE& a_session, const CK_OBJECT_HANDLE& a_object, std::string& o_value) const noexcept;
                 
+            private: // Static Method(s) // Function(s)
+                
+                static bool IsLinkFailure    (const CK_RV a_rv) noexcept;
+                static bool IsSessionFailure (const CK_RV a_rv) noexcept;
+                
             }; // end of class 'API'
             
         } // end of namespace 'safenet'
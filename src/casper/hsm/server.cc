@@ -0,0 +1,357 @@
+/**
+ * @file server.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/server.h"
+
+#include "casper/hsm/singleton.h"
+
+#include <errno.h>
+#include <fcntl.h>      // fcntl
+#include <poll.h>       // poll
+#include <string.h>     // memcpy, memset, strerror
+#include <sys/socket.h> // socket, bind, listen, accept, send, recv
+#include <sys/stat.h>   // chmod
+#include <sys/un.h>     // sockaddr_un
+#include <unistd.h>     // close, unlink
+
+#define CASPER_HSM_SERVER_READ_CHUNK    65536
+#define CASPER_HSM_SERVER_MAX_PENDING   ( 4 * 1024 * 1024 ) // bytes waiting to be sent before connection stops being read
+#define CASPER_HSM_SERVER_POLL_TIMEOUT  250                 // milliseconds, how often 'running' is checked
+
+#ifdef MSG_NOSIGNAL
+    #define CASPER_HSM_SERVER_SEND_FLAGS MSG_NOSIGNAL
+#else
+    #define CASPER_HSM_SERVER_SEND_FLAGS 0
+#endif
+
+/**
+ * @brief Default constructor.
+ *
+ * @param a_config See \link Config \link.
+ */
+casper::hsm::Server::Server (const casper::hsm::Server::Config& a_config)
+    : config_(a_config), fd_(-1)
+{
+    /* empty */
+}
+
+/**
+ * @brief Destructor, closes all connections and removes socket file.
+ */
+casper::hsm::Server::~Server ()
+{
+    for ( auto& connection : connections_ ) {
+        close(connection.fd_);
+    }
+    if ( -1 != fd_ ) {
+        close(fd_);
+        unlink(config_.path_.c_str());
+    }
+}
+
+/**
+ * @brief Create, bind and listen on socket.
+ */
+void casper::hsm::Server::Start ()
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    if ( config_.path_.length() >= sizeof(address.sun_path) ) {
+        throw ::casper::hsm::Exception("Invalid socket path '%s': %s!", config_.path_.c_str(), "too long");
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, config_.path_.c_str(), config_.path_.length());
+    // ... replace stale socket ...
+    (void)unlink(config_.path_.c_str());
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ( -1 == fd_ ) {
+        throw ::casper::hsm::Exception("An error occurred while calling '%s' function: %s!", "socket", strerror(errno));
+    }
+    if ( -1 == fcntl(fd_, F_SETFD, FD_CLOEXEC) || -1 == fcntl(fd_, F_SETFL, O_NONBLOCK)
+        || -1 == bind(fd_, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address))
+        || -1 == chmod(config_.path_.c_str(), 0660)
+        || -1 == listen(fd_, config_.backlog_) ) {
+        const int error = errno;
+        close(fd_);
+        fd_ = -1;
+        throw ::casper::hsm::Exception("Unable to listen on '%s': %s!", config_.path_.c_str(), strerror(error));
+    }
+}
+
+/**
+ * @brief Serve requests.
+ *
+ * @param a_running Function called periodically, serving stops when it returns false.
+ */
+void casper::hsm::Server::Run (const std::function<bool()>& a_running)
+{
+    std::vector<struct pollfd> fds;
+    while ( true == a_running() ) {
+        // ... listen socket first ...
+        fds.resize(1 + connections_.size());
+        fds[0] = { fd_, POLLIN, 0 };
+        size_t idx = 1;
+        for ( auto& connection : connections_ ) {
+            short events = 0;
+            if ( false == connection.eof_ && connection.out_.size() - connection.out_offset_ < CASPER_HSM_SERVER_MAX_PENDING ) {
+                events |= POLLIN;
+            }
+            if ( connection.out_offset_ < connection.out_.size() ) {
+                events |= POLLOUT;
+            }
+            fds[idx++] = { connection.fd_, events, 0 };
+        }
+        // ... wait ...
+        const int rv = poll(fds.data(), static_cast<nfds_t>(fds.size()), CASPER_HSM_SERVER_POLL_TIMEOUT);
+        if ( -1 == rv ) {
+            if ( EINTR == errno ) {
+                continue;
+            }
+            throw ::casper::hsm::Exception("An error occurred while calling '%s' function: %s!", "poll", strerror(errno));
+        }
+        if ( 0 == rv ) {
+            continue;
+        }
+        // ... connections ...
+        idx = 1;
+        for ( auto& connection : connections_ ) {
+            const short revents = fds[idx++].revents;
+            if ( false == connection.eof_ && 0 != ( revents & ( POLLIN | POLLHUP | POLLERR ) ) ) {
+                Read(connection);
+                Process(connection);
+            }
+            if ( false == connection.closed_ && connection.out_offset_ < connection.out_.size() ) {
+                Write(connection);
+            }
+            // ... peer is done writing, close after responding to all frames it sent ...
+            if ( true == connection.eof_ && connection.out_offset_ >= connection.out_.size() ) {
+                connection.closed_ = true;
+            }
+        }
+        connections_.remove_if([] (const Connection& a_connection) {
+            if ( true == a_connection.closed_ ) {
+                close(a_connection.fd_);
+                return true;
+            }
+            return false;
+        });
+        // ... new connections ...
+        if ( 0 != ( fds[0].revents & POLLIN ) ) {
+            Accept();
+        }
+    }
+}
+
+// MARK: -
+
+/**
+ * @brief Accept all pending connections.
+ */
+void casper::hsm::Server::Accept ()
+{
+    while ( true ) {
+        const int fd = accept(fd_, nullptr, nullptr);
+        if ( -1 == fd ) {
+            // ... EAGAIN or an aborted connection, nothing else to do ...
+            return;
+        }
+        if ( -1 == fcntl(fd, F_SETFD, FD_CLOEXEC) || -1 == fcntl(fd, F_SETFL, O_NONBLOCK) ) {
+            close(fd);
+            continue;
+        }
+#ifdef SO_NOSIGPIPE
+        const int one = 1;
+        (void)setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        // ... requester, for audit purposes ...
+        std::string requester = "uds";
+#ifdef SO_PEERCRED
+        struct ucred credentials;
+        socklen_t    length = sizeof(credentials);
+        if ( 0 == getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) ) {
+            requester += ":uid=" + std::to_string(credentials.uid);
+        }
+#endif
+        connections_.push_back({
+            /* fd_         */ fd,
+            /* requester_  */ requester,
+            /* in_         */ std::vector<unsigned char>(CASPER_HSM_SERVER_READ_CHUNK),
+            /* in_length_  */ 0,
+            /* out_        */ {},
+            /* out_offset_ */ 0,
+            /* eof_        */ false,
+            /* closed_     */ false
+        });
+    }
+}
+
+/**
+ * @brief Read all available bytes.
+ *
+ * @param a_connection Connection to read from.
+ */
+void casper::hsm::Server::Read (casper::hsm::Server::Connection& a_connection)
+{
+    while ( true ) {
+        if ( a_connection.in_.size() - a_connection.in_length_ < CASPER_HSM_SERVER_READ_CHUNK ) {
+            a_connection.in_.resize(a_connection.in_length_ + CASPER_HSM_SERVER_READ_CHUNK);
+        }
+        const ssize_t received = recv(a_connection.fd_, a_connection.in_.data() + a_connection.in_length_, a_connection.in_.size() - a_connection.in_length_, 0);
+        if ( received > 0 ) {
+            a_connection.in_length_ += static_cast<size_t>(received);
+            // ... enough for a full frame? process it first, poll is level triggered ...
+            if ( a_connection.in_length_ > config_.max_frame_ ) {
+                return;
+            }
+            continue;
+        }
+        if ( -1 == received && EINTR == errno ) {
+            continue;
+        }
+        if ( 0 == received ) {
+            // ... peer shut down its side ( or is gone ), frames already received must still be answered ...
+            a_connection.eof_ = true;
+        } else if ( EAGAIN != errno && EWOULDBLOCK != errno ) {
+            // ... peer is gone ...
+            a_connection.closed_ = true;
+        }
+        return;
+    }
+}
+
+/**
+ * @brief Process all complete request frames.
+ *
+ * @param a_connection Connection to process.
+ */
+void casper::hsm::Server::Process (casper::hsm::Server::Connection& a_connection)
+{
+    size_t offset = 0;
+    while ( false == a_connection.closed_ && a_connection.in_length_ - offset >= sizeof(RequestHeader) ) {
+        RequestHeader header;
+        memcpy(&header, a_connection.in_.data() + offset, sizeof(header));
+        // ... sanity check ...
+        if ( header.length_ < sizeof(header) - sizeof(header.length_) || header.length_ > config_.max_frame_ ) {
+            // ... can't resync, drop connection ...
+            a_connection.closed_ = true;
+            break;
+        }
+        // ... complete?
+        const size_t frame = sizeof(header.length_) + header.length_;
+        if ( a_connection.in_length_ - offset < frame ) {
+            break;
+        }
+        const unsigned char* payload = a_connection.in_.data() + offset + sizeof(header);
+        const size_t         length  = frame - sizeof(header);
+        offset += frame;
+        // ... handle it ...
+        switch ( static_cast<Op>(header.op_) ) {
+            case Op::Ping:
+                Respond(a_connection, header.id_, Status::Ok, nullptr, 0);
+                break;
+            case Op::Sign:
+            {
+                if ( 0 == header.key_length_ || header.key_length_ > length ) {
+                    const char* const message = "invalid key length";
+                    Respond(a_connection, header.id_, Status::BadRequest, reinterpret_cast<const unsigned char*>(message), strlen(message));
+                    break;
+                }
+                key_.assign(reinterpret_cast<const char*>(payload), header.key_length_);
+                const unsigned char* data        = payload + header.key_length_;
+                const size_t         data_length = length - header.key_length_;
+                // ... no exceptions on the way, error text is only produced when responding ...
+                const ::casper::hsm::API::Status status = ::casper::hsm::Singleton::GetInstance().TrySign(key_, data, data_length, signature_);
+                if ( false == ::casper::hsm::API::Succeeded(status) ) {
+                    const std::string message = ::casper::hsm::API::Describe(status);
+                    ::casper::hsm::Singleton::GetInstance().Audit(key_, data, data_length, a_connection.requester_, /* a_signed */ false);
+                    Respond(a_connection, header.id_, Status::Error, reinterpret_cast<const unsigned char*>(message.c_str()), message.length());
+                    break;
+                }
+                ::casper::hsm::Singleton::GetInstance().Audit(key_, data, data_length, a_connection.requester_, /* a_signed */ true);
+                Respond(a_connection, header.id_, Status::Ok, signature_.data(), signature_.size());
+                break;
+            }
+            default:
+            {
+                const char* const message = "unsupported operation";
+                Respond(a_connection, header.id_, Status::BadRequest, reinterpret_cast<const unsigned char*>(message), strlen(message));
+                break;
+            }
+        }
+    }
+    // ... keep incomplete frame ...
+    if ( offset > 0 ) {
+        memmove(a_connection.in_.data(), a_connection.in_.data() + offset, a_connection.in_length_ - offset);
+        a_connection.in_length_ -= offset;
+    }
+}
+
+/**
+ * @brief Write as many pending bytes as possible.
+ *
+ * @param a_connection Connection to write to.
+ */
+void casper::hsm::Server::Write (casper::hsm::Server::Connection& a_connection)
+{
+    while ( a_connection.out_offset_ < a_connection.out_.size() ) {
+        const ssize_t sent = send(a_connection.fd_, a_connection.out_.data() + a_connection.out_offset_, a_connection.out_.size() - a_connection.out_offset_, CASPER_HSM_SERVER_SEND_FLAGS);
+        if ( sent > 0 ) {
+            a_connection.out_offset_ += static_cast<size_t>(sent);
+            continue;
+        }
+        if ( -1 == sent && EINTR == errno ) {
+            continue;
+        }
+        if ( -1 == sent && ( EAGAIN == errno || EWOULDBLOCK == errno ) ) {
+            return;
+        }
+        a_connection.closed_ = true;
+        return;
+    }
+    // ... all sent, buffer capacity is kept ...
+    a_connection.out_.clear();
+    a_connection.out_offset_ = 0;
+}
+
+/**
+ * @brief Queue a response frame.
+ *
+ * @param a_connection Connection to respond to.
+ * @param a_id         Request ID.
+ * @param a_status     See \link Status \link.
+ * @param a_data       Payload.
+ * @param a_length     Payload length, in bytes.
+ */
+void casper::hsm::Server::Respond (casper::hsm::Server::Connection& a_connection, const uint32_t a_id, const casper::hsm::Server::Status a_status,
+                                   const unsigned char* a_data, const size_t a_length)
+{
+    ResponseHeader header;
+    memset(&header, 0, sizeof(header));
+    header.length_ = static_cast<uint32_t>(sizeof(header) - sizeof(header.length_) + a_length);
+    header.id_     = a_id;
+    header.status_ = static_cast<uint8_t>(a_status);
+    const size_t offset = a_connection.out_.size();
+    a_connection.out_.resize(offset + sizeof(header) + a_length);
+    memcpy(a_connection.out_.data() + offset, &header, sizeof(header));
+    if ( a_length > 0 ) {
+        memcpy(a_connection.out_.data() + offset + sizeof(header), a_data, a_length);
+    }
+}
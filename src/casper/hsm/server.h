@@ -0,0 +1,141 @@
+/**
+ * @file server.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_SERVER_H_
+#define CASPER_HSM_SERVER_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <functional>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <stdint.h> // uint32_t
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief Unix domain socket signing frontend, for co-located callers.
+         *
+         * Protocol is binary, host byte order and pipelined: a client can send any number of requests without
+         * waiting for responses, responses are sent in the same order and carry the request ID.
+         *
+         * Request:  \link RequestHeader \link, key bytes, data bytes.
+         * Response: \link ResponseHeader \link, signature bytes ( Status::Ok ) or error message.
+         *
+         * Frame length field does not include itself. Single threaded, \link Singleton \link must be started.
+         */
+        class Server final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+        
+        public: // Data Type(s)
+            
+            typedef struct {
+                std::string path_;      //!< Socket URI, an existing file is replaced.
+                int         backlog_;
+                uint32_t    max_frame_; //!< Maximum request frame length, in bytes.
+            } Config;
+            
+            enum class Op : uint8_t {
+                Ping = 0,
+                Sign        //!< PKCS #1 v1.5 RSA, SHA256 of data is signed.
+            };
+            
+            enum class Status : uint8_t {
+                Ok = 0,
+                Error,
+                BadRequest
+            };
+            
+            typedef struct {
+                uint32_t length_;     //!< Frame length, excluding this field.
+                uint32_t id_;         //!< Caller's request ID, echoed in response.
+                uint8_t  op_;         //!< See \link Op \link.
+                uint8_t  key_length_;
+                uint16_t reserved_;
+            } RequestHeader;
+            
+            typedef struct {
+                uint32_t length_;     //!< Frame length, excluding this field.
+                uint32_t id_;
+                uint8_t  status_;     //!< See \link Status \link.
+                uint8_t  reserved_[3];
+            } ResponseHeader;
+        
+        private: // Data Type(s)
+            
+            typedef struct {
+                int                        fd_;
+                std::string                requester_;
+                std::vector<unsigned char> in_;
+                size_t                     in_length_;
+                std::vector<unsigned char> out_;
+                size_t                     out_offset_;
+                bool                       eof_;
+                bool                       closed_;
+            } Connection;
+        
+        private: // Const Data
+            
+            const Config                   config_;
+        
+        private: // Data
+            
+            int                            fd_;
+            std::list<Connection>          connections_;
+            std::string                    key_;
+            std::vector<unsigned char>     signature_;
+        
+        public: // Constructor(s) / Destructor
+            
+            Server () = delete;
+            Server (const Config& a_config);
+            virtual ~Server ();
+        
+        public: // Method(s) / Function(s)
+            
+            void Start ();
+            void Run   (const std::function<bool()>& a_running);
+        
+        private: // Method(s) / Function(s)
+            
+            void Accept  ();
+            void Read    (Connection& a_connection);
+            void Process (Connection& a_connection);
+            void Write   (Connection& a_connection);
+            void Respond (Connection& a_connection, const uint32_t a_id, const Status a_status, const unsigned char* a_data, const size_t a_length);
+        
+        }; // end of class 'Server'
+        
+        static_assert(12 == sizeof(Server::RequestHeader) , "unexpected request header size");
+        static_assert(12 == sizeof(Server::ResponseHeader), "unexpected response header size");
+    
+    } // end of namespace 'hsm'
+
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_SERVER_H_
@@ -21,6 +21,8 @@
 
 #include "casper/hsm/singleton.h"
 
+#include "cc/hash/sha256.h"
+
 // MARK: -
 
 /**
@@ -29,8 +31,8 @@
 casper::hsm::Initializer::Initializer (casper::hsm::Singleton& a_instance)
     : cc::Initializer<Singleton>(a_instance)
 {
-    instance_.api_     = nullptr;
-    instance_.factory_ = { nullptr, nullptr };
+    instance_.auditor_ = nullptr;
+    instance_.tracer_  = nullptr;
 }
 
 /**
@@ -38,84 +40,211 @@ casper::hsm::Initializer::Initializer (casper::hsm::Singleton& a_instance)
  */
 casper::hsm::Initializer::~Initializer ()
 {
-    if ( nullptr != instance_.api_ ) {
-        instance_.api_->Unload();
-        delete instance_.api_;
+    for ( auto it : instance_.profiles_ ) {
+        delete it.second;
+    }
+    if ( nullptr != instance_.auditor_ ) {
+        delete instance_.auditor_;
+    }
+    if ( nullptr != instance_.tracer_ ) {
+        delete instance_.tracer_;
     }
 }
 
 // MARK: -
 
 /**
- * @brief This method must ( and can only ) be called once to initialize HSM engine.
+ * @brief Call this no longer required to be alive, all profiles are shutdown.
+ */
+void casper::hsm::Singleton::Shutdown ()
+{
+    // ... named profiles first ...
+    for ( auto it : profiles_ ) {
+        it.second->Shutdown();
+    }
+    // ... pending audit and trace records ...
+    StopAuditor();
+    StopTracer();
+    // ... default profile ...
+    Backend::Shutdown();
+}
+
+// MARK: - Profiles
+
+/**
+ * @brief Register a named profile, with it's own backend - must be called before any worker thread uses \link Profile \link.
+ *
+ * @param a_name Profile name, must not be empty.
+ *
+ * @return Profile backend, not started - see \link Backend::Startup \link.
+ */
+casper::hsm::Backend& casper::hsm::Singleton::Register (const std::string& a_name)
+{
+    if ( 0 == a_name.length() ) {
+        throw ::casper::hsm::Exception("Unable to register HSM profile: %s!", "name is empty");
+    }
+    const auto it = profiles_.find(a_name);
+    if ( profiles_.end() != it ) {
+        return *it->second;
+    }
+    Backend* backend = new Backend();
+    profiles_[a_name] = backend;
+    return *backend;
+}
+
+/**
+ * @brief Obtain a profile backend.
  *
- * @param a_share_dir Shared directory URI.
- * @param a_factory   Function to call to create new instances when needed.
+ * @param a_name Profile name, empty for default profile.
+ *
+ * @return Profile backend.
  */
-void casper::hsm::Singleton::Startup (const std::string& a_share_dir, Factory a_factory)
+casper::hsm::Backend& casper::hsm::Singleton::Profile (const std::string& a_name)
 {
-    // ... if already initialized ...
-    if ( nullptr != api_ ) {
-        // ... can't be initialized twice ...
-        throw std::runtime_error("HSM API singleton already initialized!");
+    Backend* backend = Find(a_name);
+    if ( nullptr == backend ) {
+        throw ::casper::hsm::Exception("HSM profile '%s' is NOT registered!", a_name.c_str());
     }
-    // ... keep track of factory ...
-    share_dir_ = a_share_dir;
-    factory_   = a_factory;
-    // ... setup HSM session ...
-    api_ = factory_.new_();
-    api_->LoadSharedResources(share_dir_);
-    api_->Load();
+    return *backend;
 }
 
 /**
- * @brief Recycle an API object.
+ * @brief Look up a profile backend, without throwing - for request handlers.
+ *
+ * @param a_name Profile name, empty for default profile.
+ *
+ * @return Profile backend, nullptr if it's not registered.
  */
-void casper::hsm::Singleton::Recycle ()
+casper::hsm::Backend* casper::hsm::Singleton::Find (const std::string& a_name) noexcept
 {
-    // ... if NOT initialized ...
-    if ( nullptr == api_ ) {
-        // ... nothing to recycle ...
+    if ( 0 == a_name.length() ) {
+        return this;
+    }
+    const auto it = profiles_.find(a_name);
+    return ( profiles_.end() != it ? it->second : nullptr );
+}
+
+// MARK: - Audit
+
+/**
+ * @brief Start ( or restart ) signing operations audit log, can be called before \link Startup \link.
+ *
+ * @param a_config See \link Auditor::Config \link.
+ */
+void casper::hsm::Singleton::StartAuditor (const casper::hsm::Auditor::Config& a_config)
+{
+    StopAuditor();
+    auditor_ = new Auditor(a_config);
+}
+
+/**
+ * @brief Stop signing operations audit log, pending records are written.
+ */
+void casper::hsm::Singleton::StopAuditor ()
+{
+    if ( nullptr != auditor_ ) {
+        delete auditor_;
+        auditor_ = nullptr;
+    }
+}
+
+/**
+ * @brief Record a signing operation, if audit log is enabled.
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_data      Signed data.
+ * @param a_length    Data length, in bytes.
+ * @param a_requester Requester identification.
+ * @param a_signed    False if operation failed.
+ */
+void casper::hsm::Singleton::Audit (const std::string& a_key, const unsigned char* a_data, const size_t a_length,
+                                    const std::string& a_requester, const bool a_signed) noexcept
+{
+    if ( nullptr == auditor_ ) {
         return;
     }
-    auto n = factory_.clone_(api_);
-    delete api_;
-    api_ = n;
-    api_->LoadSharedResources(share_dir_);
-    api_->Load();
+    ::cc::hash::SHA256 sha256;
+    sha256.Initialize();
+    sha256.Update(a_data, a_length);
+    AuditDigest(a_key, sha256.Final(), a_requester, a_signed);
 }
 
 /**
- * @brief Call this no longer required to be alive.
+ * @brief Record a signing operation, if audit log is enabled, when signed data SHA256 is already known.
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_digest    SHA256 of signed data.
+ * @param a_requester Requester identification.
+ * @param a_signed    False if operation failed.
  */
-void casper::hsm::Singleton::Shutdown ()
+void casper::hsm::Singleton::AuditDigest (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN],
+                                          const std::string& a_requester, const bool a_signed) noexcept
 {
-    // ... if NOT initialized ...
-    if ( nullptr == api_ ) {
-        // ... nothing to shutdown ...
+    if ( nullptr == auditor_ ) {
         return;
     }
-    // ... can be reused ...
-    api_->Unload();
-    delete api_;
-    api_ = nullptr;
+    (void)auditor_->Append(a_key, a_digest, a_requester, ( true == a_signed ? Auditor::Status::Signed : Auditor::Status::Failed ));
 }
 
-// MARK: -
+// MARK: - Trace
 
 /**
- * @brief Sign an hash.
+ * @brief Start ( or restart ) request shapes trace, can be called before \link Startup \link.
  *
- * @param a_key         HSM private key token label.
- * @param a_hash        Base64-encoded hash value to be signed.
- * @param o_signature   Base64-encoded signature value.
+ * @param a_config See \link Tracer::Config \link.
+ */
+void casper::hsm::Singleton::StartTracer (const casper::hsm::Tracer::Config& a_config)
+{
+    StopTracer();
+    tracer_ = new Tracer(a_config);
+}
+
+/**
+ * @brief Stop request shapes trace, pending records are written.
  */
-void casper::hsm::Singleton::Sign (const std::string& a_key, const std::string& a_hash, std::string& o_signature)
+void casper::hsm::Singleton::StopTracer ()
 {
-    // ... if NOT initialized ...
-    if ( nullptr == api_ ) {
-        throw std::runtime_error("HSM API singleton NOT initialized!");
+    if ( nullptr != tracer_ ) {
+        delete tracer_;
+        tracer_ = nullptr;
     }
-    api_->Sign(a_key, a_hash, o_signature);
 }
-   
+
+/**
+ * @brief Write buffered request shapes, if trace is enabled - see \link Tracer::Flush \link.
+ */
+void casper::hsm::Singleton::FlushTracer () noexcept
+{
+    if ( nullptr != tracer_ ) {
+        tracer_->Flush();
+    }
+}
+
+/**
+ * @brief Record a request shape, in trace and statistics - when enabled.
+ *
+ * @param a_key          HSM private key token label.
+ * @param a_count        Number of hashes ( or items ) in request.
+ * @param a_bytes        Request body length, in bytes.
+ * @param a_content_type Request content type.
+ * @param a_flags        Request options, see \link Tracer::Flags \link.
+ */
+void casper::hsm::Singleton::Observe (const std::string& a_key, const size_t a_count, const size_t a_bytes,
+                                      const casper::hsm::Tracer::ContentType a_content_type, const uint8_t a_flags) noexcept
+{
+    Statistics* statistics = this->statistics();
+    if ( nullptr != statistics ) {
+        statistics->Request(( 0 != ( a_flags & Tracer::Flags::Verify )
+                              ? Statistics::Kind::Verify
+                              : ( 0 != ( a_flags & Tracer::Flags::CMS )
+                                  ? Statistics::Kind::CMS
+                                  : static_cast<Statistics::Kind>(static_cast<uint8_t>(a_content_type))
+                              )
+                            ), a_count);
+    }
+    if ( nullptr != tracer_ ) {
+        tracer_->Append(a_key, a_count, a_bytes, a_content_type, a_flags);
+    }
+}
+
+
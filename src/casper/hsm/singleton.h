@@ -24,7 +24,11 @@
 
 #include "cc/singleton.h"
 
-#include "casper/hsm/api.h"
+#include "casper/hsm/backend.h"
+#include "casper/hsm/auditor.h"
+#include "casper/hsm/tracer.h"
+
+#include <map>
 
 namespace casper
 {
@@ -45,28 +49,51 @@ namespace casper
     }; // end of class 'Initializer'
     
     // ---- //
-    class Singleton final : public cc::Singleton<Singleton, Initializer>
+    class Singleton final : public cc::Singleton<Singleton, Initializer>, public Backend
     {
         
         friend class Initializer;
-        
-        typedef struct {
-            std::function<::casper::hsm::API*()>                          new_;
-            std::function<::casper::hsm::API*(const ::casper::hsm::API*)> clone_;
-        } Factory;
             
         private: // Data
             
-            std::string share_dir_;
-            API*        api_;
-            Factory     factory_;
+            Auditor*                        auditor_;
+            Tracer*                         tracer_;
+            std::map<std::string, Backend*> profiles_;
             
         public: // Method(s) / Function(s) - Oneshot call only!!!
             
-            void Startup  (const std::string& a_share_dir, Factory a_factory);
-            void Recycle  ();
             void Shutdown ();
-            void Sign     (const std::string& a_key, const std::string& a_hash, std::string& o_signature);
+            
+        public: // Method(s) / Function(s) - Profiles
+            
+            Backend&            Register     (const std::string& a_name);
+            Backend&            Profile      (const std::string& a_name);
+            Backend*            Find         (const std::string& a_name) noexcept;
+            
+        public: // Method(s) / Function(s)
+            
+            void                StartAuditor (const Auditor::Config& a_config);
+            void                StopAuditor  ();
+            void                Audit        (const std::string& a_key, const unsigned char* a_data, const size_t a_length,
+                                              const std::string& a_requester, const bool a_signed) noexcept;
+            void                AuditDigest  (const std::string& a_key, const unsigned char a_digest[CASPER_HSM_API_SHA256_LEN],
+                                              const std::string& a_requester, const bool a_signed) noexcept;
+            
+            void                StartTracer  (const Tracer::Config& a_config);
+            void                StopTracer   ();
+            void                FlushTracer  () noexcept;
+            void                Observe      (const std::string& a_key, const size_t a_count, const size_t a_bytes,
+                                              const Tracer::ContentType a_content_type, const uint8_t a_flags) noexcept;
+            
+        public: // Inline Method(s) / Function(s)
+            
+            /**
+             * @return R/O access to named profiles, default one ( this ) is not included.
+             */
+            inline const std::map<std::string, Backend*>& profiles () const
+            {
+                return profiles_;
+            }
             
         }; // end of class 'Singleton'
         
@@ -0,0 +1,368 @@
+/**
+ * @file statistics.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/statistics.h"
+
+#include <stdio.h>  // snprintf
+#include <string.h> // memcpy, memcmp
+
+#define CASPER_HSM_STATISTICS_MAX_SPINS 1024 // a key slot being claimed by a process that died is skipped
+
+static const uint64_t    s_batch_bounds_  [] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+static const char* const s_batch_labels_  [] = { "1", "2", "5", "10", "20", "50", "100", "200", "500", "1000" };
+static const uint64_t    s_latency_bounds_[] = { 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000 };
+static const char* const s_latency_labels_[] = { "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "0.5", "1.0", "2.5", "5.0" };
+static const char* const s_kinds_         [] = { "json", "binary", "raw", "verify", "cms" };
+
+static_assert(sizeof(s_batch_bounds_) / sizeof(s_batch_bounds_[0]) < CASPER_HSM_STATISTICS_MAX_BUCKETS, "too many batch buckets");
+static_assert(sizeof(s_latency_bounds_) / sizeof(s_latency_bounds_[0]) < CASPER_HSM_STATISTICS_MAX_BUCKETS, "too many latency buckets");
+static_assert(sizeof(s_kinds_) / sizeof(s_kinds_[0]) == static_cast<size_t>(casper::hsm::Statistics::Kind::Max), "missing kind label");
+
+/**
+ * @brief Default constructor.
+ *
+ * @param a_state Shared state, see \link Initialize \link.
+ */
+casper::hsm::Statistics::Statistics (casper::hsm::Statistics::State& a_state)
+    : state_(a_state)
+{
+    /* empty */
+}
+
+/**
+ * @brief Destructor.
+ */
+casper::hsm::Statistics::~Statistics ()
+{
+    /* empty */
+}
+
+/**
+ * @brief Account a request.
+ *
+ * @param a_kind  Request kind.
+ * @param a_count Number of hashes ( or items ) in request.
+ */
+void casper::hsm::Statistics::Request (const casper::hsm::Statistics::Kind a_kind, const size_t a_count) noexcept
+{
+    if ( a_kind >= Kind::Max ) {
+        return;
+    }
+    state_.requests_[static_cast<size_t>(a_kind)].fetch_add(1, std::memory_order_relaxed);
+    Observe(state_.batch_, s_batch_bounds_, sizeof(s_batch_bounds_) / sizeof(s_batch_bounds_[0]), static_cast<uint64_t>(a_count));
+}
+
+/**
+ * @brief Signal that a sign operation has started.
+ */
+void casper::hsm::Statistics::Begin () noexcept
+{
+    state_.in_flight_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Signal that a sign operation, started with \link Begin \link, has ended.
+ *
+ * @param a_key        HSM private key token label.
+ * @param a_code       Backend specific error code, 0 when not applicable.
+ * @param a_succeeded  True if a signature was produced.
+ * @param a_latency_us Operation latency, in microseconds.
+ */
+void casper::hsm::Statistics::End (const std::string& a_key, const unsigned long a_code, const bool a_succeeded, const uint64_t a_latency_us) noexcept
+{
+    state_.in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    Observe(state_.latency_, s_latency_bounds_, sizeof(s_latency_bounds_) / sizeof(s_latency_bounds_[0]), a_latency_us);
+    
+    // ... only a signature proves key exists, so junk labels can't exhaust the table ...
+    Key* key = Slot(a_key, /* a_claim */ a_succeeded);
+    if ( true == a_succeeded ) {
+        state_.signatures_.fetch_add(1, std::memory_order_relaxed);
+        ( nullptr != key ? key->signatures_ : state_.other_key_signatures_ ).fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ( nullptr != key ? key->errors_ : state_.other_key_errors_ ).fetch_add(1, std::memory_order_relaxed);
+    
+    // ... by backend error code ...
+    if ( 0 == a_code ) {
+        state_.no_code_errors_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    const uint64_t code = static_cast<uint64_t>(a_code);
+    for ( size_t idx = 0 ; idx < CASPER_HSM_STATISTICS_MAX_CODES ; ++idx ) {
+        uint64_t current = state_.codes_[idx].code_.load(std::memory_order_acquire);
+        if ( 0 == current && true == state_.codes_[idx].code_.compare_exchange_strong(current, code, std::memory_order_acq_rel) ) {
+            current = code;
+        }
+        if ( code == current ) {
+            state_.codes_[idx].count_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    state_.other_code_errors_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Render all counters and histograms.
+ *
+ * @param o_text OpenMetrics text exposition, terminated by '# EOF'.
+ */
+void casper::hsm::Statistics::Render (std::string& o_text) const
+{
+    char buffer[32];
+    
+    o_text.clear();
+    o_text.reserve(8192);
+    
+    // ... requests ...
+    o_text += "# TYPE casper_hsm_requests counter\n# HELP casper_hsm_requests Requests handled, per type.\n";
+    for ( size_t idx = 0 ; idx < static_cast<size_t>(Kind::Max) ; ++idx ) {
+        o_text += "casper_hsm_requests_total{type=\"";
+        o_text += s_kinds_[idx];
+        o_text += "\"} ";
+        o_text += std::to_string(state_.requests_[idx].load(std::memory_order_relaxed));
+        o_text += '\n';
+    }
+    Render("casper_hsm_request_items", state_.batch_, s_batch_labels_, sizeof(s_batch_labels_) / sizeof(s_batch_labels_[0]), 1.0, o_text);
+    
+    // ... sign operations ...
+    o_text += "# TYPE casper_hsm_in_flight gauge\n# HELP casper_hsm_in_flight Outstanding sign operations.\ncasper_hsm_in_flight ";
+    o_text += std::to_string(state_.in_flight_.load(std::memory_order_relaxed));
+    o_text += "\n# TYPE casper_hsm_signatures counter\n# HELP casper_hsm_signatures Signatures produced.\ncasper_hsm_signatures_total ";
+    o_text += std::to_string(state_.signatures_.load(std::memory_order_relaxed));
+    o_text += "\n# TYPE casper_hsm_sign_errors counter\n# HELP casper_hsm_sign_errors Failed sign operations, per backend error code.\n";
+    for ( size_t idx = 0 ; idx < CASPER_HSM_STATISTICS_MAX_CODES ; ++idx ) {
+        const uint64_t code = state_.codes_[idx].code_.load(std::memory_order_acquire);
+        if ( 0 == code ) {
+            break;
+        }
+        snprintf(buffer, sizeof(buffer), "0x%08llX", static_cast<unsigned long long>(code));
+        o_text += "casper_hsm_sign_errors_total{code=\"";
+        o_text += buffer;
+        o_text += "\"} ";
+        o_text += std::to_string(state_.codes_[idx].count_.load(std::memory_order_relaxed));
+        o_text += '\n';
+    }
+    o_text += "casper_hsm_sign_errors_total{code=\"none\"} ";
+    o_text += std::to_string(state_.no_code_errors_.load(std::memory_order_relaxed));
+    o_text += "\ncasper_hsm_sign_errors_total{code=\"other\"} ";
+    o_text += std::to_string(state_.other_code_errors_.load(std::memory_order_relaxed));
+    o_text += '\n';
+    Render("casper_hsm_sign_latency_seconds", state_.latency_, s_latency_labels_, sizeof(s_latency_labels_) / sizeof(s_latency_labels_[0]), 0.000001, o_text);
+    
+    // ... per key ...
+    for ( int errors = 0 ; errors <= 1 ; ++errors ) {
+        const char* const name = ( 0 == errors ? "casper_hsm_key_signatures" : "casper_hsm_key_errors" );
+        o_text += "# TYPE ";
+        o_text += name;
+        o_text += " counter\n# HELP ";
+        o_text += name;
+        o_text += ( 0 == errors ? " Signatures produced, per key.\n" : " Failed sign operations, per key.\n" );
+        for ( size_t idx = 0 ; idx < CASPER_HSM_STATISTICS_MAX_KEYS ; ++idx ) {
+            const Key& key = state_.keys_[idx];
+            if ( 2 != key.state_.load(std::memory_order_acquire) ) {
+                continue;
+            }
+            o_text += name;
+            o_text += "_total{key=\"";
+            Escape(key.name_, key.length_, o_text);
+            o_text += "\"} ";
+            o_text += std::to_string(( 0 == errors ? key.signatures_ : key.errors_ ).load(std::memory_order_relaxed));
+            o_text += '\n';
+        }
+        o_text += name;
+        o_text += "_total{key=\"(other)\"} ";
+        o_text += std::to_string(( 0 == errors ? state_.other_key_signatures_ : state_.other_key_errors_ ).load(std::memory_order_relaxed));
+        o_text += '\n';
+    }
+    
+    o_text += "# EOF\n";
+}
+
+// MARK: -
+
+/**
+ * @brief Reset a shared state, must be called once - before any \link Statistics \link instance uses it.
+ *
+ * @param a_state State to reset.
+ */
+void casper::hsm::Statistics::Initialize (casper::hsm::Statistics::State& a_state)
+{
+    for ( auto& requests : a_state.requests_ ) {
+        requests.store(0, std::memory_order_relaxed);
+    }
+    for ( Histogram* histogram : { &a_state.batch_, &a_state.latency_ } ) {
+        for ( auto& bucket : histogram->buckets_ ) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        histogram->sum_.store(0, std::memory_order_relaxed);
+    }
+    a_state.in_flight_.store(0, std::memory_order_relaxed);
+    a_state.signatures_.store(0, std::memory_order_relaxed);
+    for ( auto& code : a_state.codes_ ) {
+        code.code_.store(0, std::memory_order_relaxed);
+        code.count_.store(0, std::memory_order_relaxed);
+    }
+    a_state.no_code_errors_.store(0, std::memory_order_relaxed);
+    a_state.other_code_errors_.store(0, std::memory_order_relaxed);
+    for ( auto& key : a_state.keys_ ) {
+        key.state_.store(0, std::memory_order_relaxed);
+        key.length_ = 0;
+        key.signatures_.store(0, std::memory_order_relaxed);
+        key.errors_.store(0, std::memory_order_relaxed);
+    }
+    a_state.other_key_signatures_.store(0, std::memory_order_relaxed);
+    a_state.other_key_errors_.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+// MARK: -
+
+/**
+ * @brief Find, or claim, a key slot.
+ *
+ * @param a_key   HSM private key token label.
+ * @param a_claim When false, a slot is only looked up - never claimed.
+ *
+ * @return Key slot, nullptr if not found, table is full or key is too long.
+ */
+casper::hsm::Statistics::Key* casper::hsm::Statistics::Slot (const std::string& a_key, const bool a_claim) noexcept
+{
+    if ( 0 == a_key.length() || a_key.length() > CASPER_HSM_STATISTICS_KEY_LEN ) {
+        return nullptr;
+    }
+    // ... FNV-1a, open addressing ...
+    uint32_t hash = 2166136261u;
+    for ( const char c : a_key ) {
+        hash = ( hash ^ static_cast<uint8_t>(c) ) * 16777619u;
+    }
+    for ( size_t probe = 0 ; probe < CASPER_HSM_STATISTICS_MAX_KEYS ; ++probe ) {
+        Key&     key   = state_.keys_[( hash + probe ) % CASPER_HSM_STATISTICS_MAX_KEYS];
+        uint32_t state = key.state_.load(std::memory_order_acquire);
+        // ... slots are never released, a free one ends the probe sequence ...
+        if ( 0 == state && false == a_claim ) {
+            return nullptr;
+        }
+        if ( 0 == state && true == key.state_.compare_exchange_strong(state, 1, std::memory_order_acquire) ) {
+            memcpy(key.name_, a_key.c_str(), a_key.length());
+            key.length_ = static_cast<uint32_t>(a_key.length());
+            key.state_.store(2, std::memory_order_release);
+            return &key;
+        }
+        // ... being claimed by someone else, name is written right after ...
+        for ( size_t spins = 0 ; 1 == state && spins < CASPER_HSM_STATISTICS_MAX_SPINS ; ++spins ) {
+            state = key.state_.load(std::memory_order_acquire);
+        }
+        if ( 2 == state && a_key.length() == key.length_ && 0 == memcmp(key.name_, a_key.c_str(), a_key.length()) ) {
+            return &key;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Add a value to an histogram.
+ *
+ * @param a_histogram Histogram to update.
+ * @param a_bounds    Buckets upper bounds, inclusive.
+ * @param a_count     Number of bounds, '+Inf' bucket excluded.
+ * @param a_value     Observed value.
+ */
+void casper::hsm::Statistics::Observe (casper::hsm::Statistics::Histogram& a_histogram, const uint64_t* a_bounds, const size_t a_count, const uint64_t a_value) noexcept
+{
+    size_t idx = 0;
+    while ( idx < a_count && a_value > a_bounds[idx] ) {
+        idx++;
+    }
+    a_histogram.buckets_[idx].fetch_add(1, std::memory_order_relaxed);
+    a_histogram.sum_.fetch_add(a_value, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Render an histogram.
+ *
+ * @param a_name      Metric family name.
+ * @param a_histogram Histogram to render.
+ * @param a_labels    Buckets upper bounds, as 'le' label values.
+ * @param a_count     Number of bounds, '+Inf' bucket excluded.
+ * @param a_scale     Factor applied to sum.
+ * @param o_text      Text to append to.
+ */
+void casper::hsm::Statistics::Render (const char* const a_name, const casper::hsm::Statistics::Histogram& a_histogram, const char* const* a_labels, const size_t a_count,
+                                      const double a_scale, std::string& o_text)
+{
+    char buffer[64];
+    
+    o_text += "# TYPE ";
+    o_text += a_name;
+    o_text += " histogram\n";
+    // ... count is taken from buckets, so '+Inf' bucket and count always match ...
+    uint64_t count = 0;
+    for ( size_t idx = 0 ; idx <= a_count ; ++idx ) {
+        count += a_histogram.buckets_[idx].load(std::memory_order_relaxed);
+        o_text += a_name;
+        o_text += "_bucket{le=\"";
+        o_text += ( idx < a_count ? a_labels[idx] : "+Inf" );
+        o_text += "\"} ";
+        o_text += std::to_string(count);
+        o_text += '\n';
+    }
+    const uint64_t sum = a_histogram.sum_.load(std::memory_order_relaxed);
+    if ( 1.0 == a_scale ) {
+        snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(sum));
+    } else {
+        snprintf(buffer, sizeof(buffer), "%.6f", static_cast<double>(sum) * a_scale);
+    }
+    o_text += a_name;
+    o_text += "_sum ";
+    o_text += buffer;
+    o_text += '\n';
+    o_text += a_name;
+    o_text += "_count ";
+    o_text += std::to_string(count);
+    o_text += '\n';
+}
+
+/**
+ * @brief Append a label value, escaped.
+ *
+ * @param a_value  Value to escape.
+ * @param a_length Value length, in bytes.
+ * @param o_text   Text to append to.
+ */
+void casper::hsm::Statistics::Escape (const char* const a_value, const size_t a_length, std::string& o_text)
+{
+    for ( size_t idx = 0 ; idx < a_length ; ++idx ) {
+        switch ( a_value[idx] ) {
+            case '\\':
+                o_text += "\\\\";
+                break;
+            case '"':
+                o_text += "\\\"";
+                break;
+            case '\n':
+                o_text += "\\n";
+                break;
+            default:
+                o_text += a_value[idx];
+                break;
+        }
+    }
+}
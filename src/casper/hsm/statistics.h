@@ -0,0 +1,136 @@
+/**
+ * @file statistics.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_STATISTICS_H_
+#define CASPER_HSM_STATISTICS_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <atomic>
+#include <string>
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint*_t
+
+#define CASPER_HSM_STATISTICS_MAX_BUCKETS 16
+#define CASPER_HSM_STATISTICS_MAX_CODES   32
+#define CASPER_HSM_STATISTICS_MAX_KEYS    64
+#define CASPER_HSM_STATISTICS_KEY_LEN     40
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief Request and signature counters and histograms, rendered as OpenMetrics text.
+         *
+         * State is kept in a POD struct of lock-free atomics so it can be placed in memory shared by several processes,
+         * error codes and keys are kept in fixed size tables - what doesn't fit is accounted as 'other', as are keys that
+         * never produced a signature ( so unknown labels can't take slots ).
+         */
+        class Statistics final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+            
+        public: // Data Type(s)
+            
+            enum class Kind : uint8_t {
+                JSON = 0,
+                Binary,
+                Raw,
+                Verify,
+                CMS,
+                Max
+            };
+            
+            typedef struct {
+                std::atomic<uint64_t> buckets_[CASPER_HSM_STATISTICS_MAX_BUCKETS]; //!< Per bucket ( not cumulative ) count, last used one is '+Inf'.
+                std::atomic<uint64_t> sum_;                                        //!< Sum of all observed values, count is the sum of all buckets.
+            } Histogram;
+            
+            typedef struct {
+                std::atomic<uint64_t> code_;  //!< Backend error code, 0 - free slot.
+                std::atomic<uint64_t> count_;
+            } Code;
+            
+            typedef struct {
+                std::atomic<uint32_t> state_;                              //!< 0 - free, 1 - being claimed, 2 - ready.
+                uint32_t              length_;
+                char                  name_[CASPER_HSM_STATISTICS_KEY_LEN]; //!< HSM private key token label, written once when claimed.
+                std::atomic<uint64_t> signatures_;
+                std::atomic<uint64_t> errors_;
+            } Key;
+            
+            typedef struct {
+                std::atomic<uint64_t> requests_[static_cast<size_t>(Kind::Max)]; //!< Number of requests, per kind.
+                Histogram             batch_;                                     //!< Number of hashes ( or items ) per request.
+                std::atomic<int64_t>  in_flight_;                                 //!< Number of outstanding sign operations.
+                std::atomic<uint64_t> signatures_;                                //!< Number of successful sign operations.
+                Histogram             latency_;                                   //!< Sign operations latency, in microseconds.
+                Code                  codes_[CASPER_HSM_STATISTICS_MAX_CODES];    //!< Failed sign operations, per backend error code.
+                std::atomic<uint64_t> no_code_errors_;                            //!< Failed sign operations without a backend error code.
+                std::atomic<uint64_t> other_code_errors_;                         //!< Failed sign operations that did not fit in \link codes_ \link.
+                Key                   keys_[CASPER_HSM_STATISTICS_MAX_KEYS];      //!< Sign operations, per key.
+                std::atomic<uint64_t> other_key_signatures_;                      //!< Successful sign operations that did not fit in \link keys_ \link.
+                std::atomic<uint64_t> other_key_errors_;                          //!< Failed sign operations that did not fit in \link keys_ \link.
+            } State;
+            
+        private: // Refs
+            
+            State& state_;
+            
+        public: // Constructor(s) / Destructor
+            
+            Statistics () = delete;
+            Statistics (State& a_state);
+            virtual ~Statistics ();
+            
+        public: // Method(s) / Function(s)
+            
+            void Request (const Kind a_kind, const size_t a_count) noexcept;
+            void Begin   () noexcept;
+            void End     (const std::string& a_key, const unsigned long a_code, const bool a_succeeded, const uint64_t a_latency_us) noexcept;
+            void Render  (std::string& o_text) const;
+            
+        public: // Static Method(s) / Function(s)
+            
+            static void Initialize (State& a_state);
+            
+        private: // Method(s) / Function(s)
+            
+            Key* Slot (const std::string& a_key, const bool a_claim) noexcept;
+            
+        private: // Static Method(s) / Function(s)
+            
+            static void Observe (Histogram& a_histogram, const uint64_t* a_bounds, const size_t a_count, const uint64_t a_value) noexcept;
+            static void Render  (const char* const a_name, const Histogram& a_histogram, const char* const* a_labels, const size_t a_count,
+                                 const double a_scale, std::string& o_text);
+            static void Escape  (const char* const a_value, const size_t a_length, std::string& o_text);
+            
+        }; // end of class 'Statistics'
+        
+    } // end of namespace 'hsm'
+    
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_STATISTICS_H_
@@ -0,0 +1,170 @@
+/**
+ * @file main.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// Known-answer tests for multi-buffer SHA256 engines, checked against OpenSSL.
+//
+// Usage: casper-hsm-batch-sha256-test
+//
+// Every engine is exercised, unsupported ones must fall back, exit status is 0 when all pass.
+//
+
+#include "casper/hsm/batch_sha256.h"
+
+#include <algorithm> // std::reverse
+#include <utility>   // std::make_pair
+#include <vector>
+
+#include <stdio.h>  // fprintf
+#include <string.h> // memcmp, strcmp, strlen
+
+#include <openssl/evp.h>
+
+#ifdef __APPLE__
+#pragma mark - Helpers
+#endif
+
+static size_t s_failures_ = 0;
+
+#define CASPER_HSM_TEST_CHECK(a_condition, ...) \
+    do { \
+        if ( !(a_condition) ) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            s_failures_++; \
+        } \
+    } while (0)
+
+/**
+ * @brief Reference SHA256.
+ *
+ * @param a_data   Input.
+ * @param a_length Input length, in bytes.
+ * @param o_digest Output, CASPER_HSM_BATCH_SHA256_DIGEST_LEN bytes.
+ */
+static void Reference (const unsigned char* a_data, const size_t a_length, unsigned char* o_digest)
+{
+    unsigned int length = 0;
+    EVP_Digest(a_data, a_length, o_digest, &length, EVP_sha256(), nullptr);
+}
+
+/**
+ * @brief Hash a batch with an engine and compare all digests against reference ones.
+ *
+ * @param a_inputs Inputs.
+ * @param a_engine Engine to use.
+ */
+static void Check (const std::vector<std::vector<unsigned char>>& a_inputs, const ::casper::hsm::BatchSHA256::Engine a_engine)
+{
+    std::vector<::casper::hsm::BatchSHA256::Job> jobs(a_inputs.size());
+    std::vector<unsigned char>                   digests(a_inputs.size() * CASPER_HSM_BATCH_SHA256_DIGEST_LEN);
+    for ( size_t idx = 0 ; idx < a_inputs.size() ; ++idx ) {
+        jobs[idx] = { a_inputs[idx].data(), a_inputs[idx].size(), digests.data() + idx * CASPER_HSM_BATCH_SHA256_DIGEST_LEN };
+    }
+    ::casper::hsm::BatchSHA256::Run(jobs.data(), jobs.size(), a_engine);
+    unsigned char expected[CASPER_HSM_BATCH_SHA256_DIGEST_LEN];
+    for ( size_t idx = 0 ; idx < a_inputs.size() ; ++idx ) {
+        Reference(a_inputs[idx].data(), a_inputs[idx].size(), expected);
+        CASPER_HSM_TEST_CHECK(0 == memcmp(expected, jobs[idx].digest_, CASPER_HSM_BATCH_SHA256_DIGEST_LEN),
+                              "%s engine, job %zu of %zu, %zu byte(s)", ::casper::hsm::BatchSHA256::Name(a_engine), idx, a_inputs.size(), a_inputs[idx].size());
+    }
+}
+
+#ifdef __APPLE__
+#pragma mark - Main
+#endif
+
+int main (int /* a_argc */, char** /* a_argv */)
+{
+    static const ::casper::hsm::BatchSHA256::Engine k_engines_[] = {
+        ::casper::hsm::BatchSHA256::Engine::Auto,
+        ::casper::hsm::BatchSHA256::Engine::Scalar,
+        ::casper::hsm::BatchSHA256::Engine::AVX2,
+        ::casper::hsm::BatchSHA256::Engine::SHANI
+    };
+    
+    fprintf(stdout, "batch_sha256: best engine is %s\n", ::casper::hsm::BatchSHA256::Name(::casper::hsm::BatchSHA256::engine()));
+    
+    // ... FIPS 180-2 vectors ...
+    {
+        static const struct {
+            const char* input_;
+            const char* digest_;
+        } k_vectors_[] = {
+            { "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+            { "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+            { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" }
+        };
+        for ( auto engine : k_engines_ ) {
+            for ( auto& vector : k_vectors_ ) {
+                unsigned char                   digest[CASPER_HSM_BATCH_SHA256_DIGEST_LEN];
+                ::casper::hsm::BatchSHA256::Job job = { reinterpret_cast<const unsigned char*>(vector.input_), strlen(vector.input_), digest };
+                ::casper::hsm::BatchSHA256::Run(&job, 1, engine);
+                char hex[CASPER_HSM_BATCH_SHA256_DIGEST_LEN * 2 + 1];
+                for ( size_t idx = 0 ; idx < CASPER_HSM_BATCH_SHA256_DIGEST_LEN ; ++idx ) {
+                    snprintf(hex + idx * 2, 3, "%02x", digest[idx]);
+                }
+                CASPER_HSM_TEST_CHECK(0 == strcmp(hex, vector.digest_), "%s engine, '%s'", ::casper::hsm::BatchSHA256::Name(engine), vector.input_);
+            }
+        }
+    }
+    
+    // ... every length around padding and block boundaries, batches smaller and larger than lane count, mixed lengths ...
+    std::vector<unsigned char> pool(1024);
+    uint32_t                   seed = 0x9e3779b9;
+    for ( auto& byte : pool ) {
+        seed = seed * 1664525 + 1013904223;
+        byte = static_cast<unsigned char>(seed >> 24);
+    }
+    std::vector<std::vector<unsigned char>> inputs;
+    for ( size_t length = 0 ; length <= 300 ; ++length ) {
+        inputs.push_back(std::vector<unsigned char>(pool.begin() + static_cast<long>(length % 64), pool.begin() + static_cast<long>(length % 64 + length)));
+    }
+    for ( auto engine : k_engines_ ) {
+        // ... one by one ...
+        for ( size_t idx = 0 ; idx < inputs.size() ; ++idx ) {
+            Check(std::vector<std::vector<unsigned char>>(inputs.begin() + static_cast<long>(idx), inputs.begin() + static_cast<long>(idx + 1)), engine);
+        }
+        // ... partial, exact and multiple lanes, same length ...
+        for ( size_t count : { 7, 8, 9, 16, 33 } ) {
+            Check(std::vector<std::vector<unsigned char>>(count, inputs[100]), engine);
+        }
+        // ... same number of padded blocks, different full / tail split ( 60 is 0 + 2, 64 is 1 + 1, 120 is 1 + 2, 128 is 2 + 1 ) ...
+        for ( auto& pair : { std::make_pair(60, 64), std::make_pair(120, 128) } ) {
+            std::vector<std::vector<unsigned char>> mixed;
+            for ( size_t idx = 0 ; idx < 4 ; ++idx ) {
+                mixed.push_back(inputs[static_cast<size_t>(pair.first)]);
+            }
+            for ( size_t idx = 0 ; idx < 4 ; ++idx ) {
+                mixed.push_back(inputs[static_cast<size_t>(pair.second)]);
+            }
+            Check(mixed, engine);
+            std::reverse(mixed.begin(), mixed.end());
+            Check(mixed, engine);
+        }
+        // ... all lengths at once ...
+        Check(inputs, engine);
+    }
+    
+    fprintf(stdout, "batch_sha256: %s ( %zu failure(s) )\n", 0 == s_failures_ ? "OK" : "FAILED", s_failures_);
+    return ( 0 == s_failures_ ? 0 : -1 );
+}
@@ -0,0 +1,278 @@
+/**
+ * @file main.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// Detached CMS SignedData encoder tests, checked with OpenSSL CMS verification.
+//
+// Usage: casper-hsm-cms-test [<directory>]
+//
+// A throwaway CA and signer are generated, HSM is replaced by the signer private key. When a directory is provided,
+// 'ca.pem', 'document.txt' and 'signature.der' are written there so the same result can be checked with:
+//
+//   openssl cms -verify -binary -inform DER -in signature.der -content document.txt -CAfile ca.pem -purpose any
+//
+// Exit status is 0 when all pass.
+//
+
+#include "casper/hsm/cms.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdio.h>  // fprintf, fopen, fwrite, fclose
+#include <string.h> // memcmp
+#include <time.h>   // time
+
+#include <openssl/bio.h>
+#include <openssl/cms.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#ifdef __APPLE__
+#pragma mark - Helpers
+#endif
+
+static size_t s_failures_ = 0;
+
+#define CASPER_HSM_TEST_CHECK(a_condition, ...) \
+    do { \
+        if ( !(a_condition) ) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            s_failures_++; \
+        } \
+    } while (0)
+
+/**
+ * @return A new RSA 2048 private key.
+ */
+static EVP_PKEY* Key ()
+{
+    EVP_PKEY*     key = nullptr;
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    if ( nullptr == ctx || EVP_PKEY_keygen_init(ctx) <= 0 || EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048) <= 0 || EVP_PKEY_keygen(ctx, &key) <= 0 ) {
+        key = nullptr;
+    }
+    EVP_PKEY_CTX_free(ctx);
+    return key;
+}
+
+/**
+ * @brief Issue a certificate.
+ *
+ * @param a_name       Subject common name.
+ * @param a_serial     Serial number.
+ * @param a_key        Subject key.
+ * @param a_issuer     Issuer certificate, nullptr for a self-signed one.
+ * @param a_issuer_key Issuer key.
+ *
+ * @return A new certificate.
+ */
+static X509* Certificate (const char* const a_name, const long a_serial, EVP_PKEY* a_key, X509* a_issuer, EVP_PKEY* a_issuer_key)
+{
+    X509* certificate = X509_new();
+    X509_set_version(certificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), a_serial);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), -60);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), 60 * 60);
+    X509_set_pubkey(certificate, a_key);
+    X509_NAME* name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>(a_name), -1, -1, 0);
+    X509_set_issuer_name(certificate, ( nullptr != a_issuer ? X509_get_subject_name(a_issuer) : name ));
+    X509V3_CTX ctx;
+    X509V3_set_ctx(&ctx, ( nullptr != a_issuer ? a_issuer : certificate ), certificate, nullptr, nullptr, 0);
+    X509_EXTENSION* extension = X509V3_EXT_conf_nid(nullptr, &ctx, NID_basic_constraints, ( nullptr != a_issuer ? "critical,CA:FALSE" : "critical,CA:TRUE" ));
+    X509_add_ext(certificate, extension, -1);
+    X509_EXTENSION_free(extension);
+    X509_sign(certificate, a_issuer_key, EVP_sha256());
+    return certificate;
+}
+
+/**
+ * @return PEM encoded certificate.
+ */
+static std::string PEM (X509* a_certificate)
+{
+    BIO* bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_X509(bio, a_certificate);
+    char*             data   = nullptr;
+    const long        length = BIO_get_mem_data(bio, &data);
+    const std::string pem    = std::string(data, static_cast<size_t>(length));
+    BIO_free(bio);
+    return pem;
+}
+
+/**
+ * @brief Sign data, as HSM would - RSA PKCS #1 v1.5 with SHA256.
+ *
+ * @param a_key       Private key.
+ * @param a_data      Data to sign.
+ * @param o_signature Signature bytes.
+ */
+static void Sign (EVP_PKEY* a_key, const std::vector<unsigned char>& a_data, std::vector<unsigned char>& o_signature)
+{
+    EVP_MD_CTX* ctx    = EVP_MD_CTX_new();
+    size_t      length = 0;
+    EVP_DigestSignInit(ctx, nullptr, EVP_sha256(), nullptr, a_key);
+    EVP_DigestSign(ctx, nullptr, &length, a_data.data(), a_data.size());
+    o_signature.resize(length);
+    EVP_DigestSign(ctx, o_signature.data(), &length, a_data.data(), a_data.size());
+    o_signature.resize(length);
+    EVP_MD_CTX_free(ctx);
+}
+
+/**
+ * @brief Verify a detached SignedData, as 'openssl cms -verify -binary -purpose any' does.
+ *
+ * @param a_der      DER encoded ContentInfo.
+ * @param a_document Signed document.
+ * @param a_ca       Trusted CA certificate.
+ * @param o_certs    Number of certificates embedded in SignedData.
+ *
+ * @return True if signature is valid.
+ */
+static bool Verify (const std::vector<unsigned char>& a_der, const std::string& a_document, X509* a_ca, int& o_certs)
+{
+    const unsigned char* ptr = a_der.data();
+    CMS_ContentInfo*     cms = d2i_CMS_ContentInfo(nullptr, &ptr, static_cast<long>(a_der.size()));
+    o_certs = -1;
+    if ( nullptr == cms || ptr != a_der.data() + a_der.size() ) {
+        CMS_ContentInfo_free(cms);
+        return false;
+    }
+    STACK_OF(X509)* certs = CMS_get1_certs(cms);
+    o_certs = ( nullptr != certs ? sk_X509_num(certs) : 0 );
+    sk_X509_pop_free(certs, X509_free);
+    X509_STORE* store = X509_STORE_new();
+    X509_STORE_add_cert(store, a_ca);
+    X509_STORE_set_purpose(store, X509_PURPOSE_ANY);
+    BIO* content = BIO_new_mem_buf(a_document.data(), static_cast<int>(a_document.length()));
+    const bool verified = ( 1 == CMS_verify(cms, nullptr, store, content, nullptr, CMS_BINARY) );
+    BIO_free(content);
+    X509_STORE_free(store);
+    CMS_ContentInfo_free(cms);
+    ERR_clear_error();
+    return verified;
+}
+
+/**
+ * @brief Write a file.
+ */
+static void Write (const std::string& a_uri, const void* a_data, const size_t a_length)
+{
+    FILE* file = fopen(a_uri.c_str(), "wb");
+    if ( nullptr == file ) {
+        fprintf(stderr, "unable to write '%s'\n", a_uri.c_str());
+        return;
+    }
+    fwrite(a_data, 1, a_length, file);
+    fclose(file);
+}
+
+#ifdef __APPLE__
+#pragma mark - Main
+#endif
+
+int main (int a_argc, char** a_argv)
+{
+    EVP_PKEY* ca_key     = Key();
+    EVP_PKEY* signer_key = Key();
+    EVP_PKEY* other_key  = Key();
+    if ( nullptr == ca_key || nullptr == signer_key || nullptr == other_key ) {
+        fprintf(stderr, "unable to generate keys\n");
+        return -1;
+    }
+    X509* ca     = Certificate("casper-hsm test ca", 1, ca_key, nullptr, ca_key);
+    X509* signer = Certificate("casper-hsm test signer", 4096, signer_key, ca, ca_key);
+    
+    const ::casper::hsm::CMS cms({ { "signer", PEM(signer) }, { "ca", PEM(ca) } });
+    CASPER_HSM_TEST_CHECK(true == cms.Knows("signer"), "signer is known");
+    CASPER_HSM_TEST_CHECK(false == cms.Knows("unknown"), "unknown key is not known");
+    
+    // ... small and large documents, content length encoding changes at 128 and 256 bytes ...
+    for ( size_t size : { 0, 1, 127, 128, 255, 256, 65536 } ) {
+        std::string document(size, '\0');
+        for ( size_t idx = 0 ; idx < size ; ++idx ) {
+            document[idx] = static_cast<char>(( idx * 31 + 7 ) & 0xFF);
+        }
+        unsigned char digest[CASPER_HSM_API_SHA256_LEN];
+        unsigned int  length = 0;
+        EVP_Digest(document.data(), document.length(), digest, &length, EVP_sha256(), nullptr);
+        
+        std::vector<unsigned char> attributes;
+        std::vector<unsigned char> signature;
+        std::vector<unsigned char> der;
+        cms.Attributes("signer", digest, time(nullptr), attributes);
+        Sign(signer_key, attributes, signature);
+        cms.SignedData("signer", attributes, signature, der);
+        
+        int certs = 0;
+        CASPER_HSM_TEST_CHECK(true == Verify(der, document, ca, certs), "%zu byte(s) document verifies", size);
+        CASPER_HSM_TEST_CHECK(2 == certs, "%zu byte(s) document, whole chain is embedded", size);
+        
+        // ... tampered content ...
+        std::string tampered = document + "x";
+        CASPER_HSM_TEST_CHECK(false == Verify(der, tampered, ca, certs), "%zu byte(s) document, tampered content is rejected", size);
+        
+        // ... signature by another key ...
+        std::vector<unsigned char> forged;
+        Sign(other_key, attributes, signature);
+        cms.SignedData("signer", attributes, signature, forged);
+        CASPER_HSM_TEST_CHECK(false == Verify(forged, document, ca, certs), "%zu byte(s) document, foreign signature is rejected", size);
+        
+        // ... keep one for 'openssl cms -verify' ...
+        if ( a_argc > 1 && 128 == size ) {
+            const std::string directory = a_argv[1];
+            const std::string ca_pem    = PEM(ca);
+            Write(directory + "/ca.pem", ca_pem.data(), ca_pem.length());
+            Write(directory + "/document.txt", document.data(), document.length());
+            Write(directory + "/signature.der", der.data(), der.size());
+        }
+    }
+    
+    // ... unknown key ...
+    {
+        unsigned char              digest[CASPER_HSM_API_SHA256_LEN] = { 0 };
+        std::vector<unsigned char> attributes;
+        bool                       thrown = false;
+        try {
+            cms.Attributes("unknown", digest, time(nullptr), attributes);
+        } catch (...) {
+            thrown = true;
+        }
+        CASPER_HSM_TEST_CHECK(true == thrown, "unknown key is rejected");
+    }
+    
+    X509_free(signer);
+    X509_free(ca);
+    EVP_PKEY_free(other_key);
+    EVP_PKEY_free(signer_key);
+    EVP_PKEY_free(ca_key);
+    
+    fprintf(stdout, "cms: %s ( %zu failure(s) )\n", 0 == s_failures_ ? "OK" : "FAILED", s_failures_);
+    return ( 0 == s_failures_ ? 0 : -1 );
+}
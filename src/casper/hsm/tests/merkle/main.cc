@@ -0,0 +1,205 @@
+/**
+ * @file main.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// RFC 6962 known-answer tests for merkle roots and inclusion proofs.
+//
+// Usage: casper-hsm-merkle-test
+//
+// Vectors are the ones used by certificate transparency reference implementations, exit status is 0 when all pass.
+//
+
+#include "casper/hsm/merkle.h"
+
+#include <string>
+#include <vector>
+
+#include <stdio.h>  // fprintf
+#include <string.h> // memcmp, strlen
+
+#ifdef __APPLE__
+#pragma mark - Helpers
+#endif
+
+static size_t s_failures_ = 0;
+
+#define CASPER_HSM_TEST_CHECK(a_condition, ...) \
+    do { \
+        if ( !(a_condition) ) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            s_failures_++; \
+        } \
+    } while (0)
+
+/**
+ * @brief Decode an hex string.
+ *
+ * @param a_hex Hex string.
+ *
+ * @return Decoded bytes.
+ */
+static std::vector<unsigned char> Unhex (const char* const a_hex)
+{
+    std::vector<unsigned char> bytes;
+    const size_t length = strlen(a_hex);
+    for ( size_t idx = 0 ; idx + 1 < length ; idx += 2 ) {
+        unsigned int byte = 0;
+        sscanf(a_hex + idx, "%2x", &byte);
+        bytes.push_back(static_cast<unsigned char>(byte));
+    }
+    return bytes;
+}
+
+/**
+ * @brief Build a tree with first N test leaves.
+ *
+ * @param a_leaves Test leaves.
+ * @param a_count  Number of leaves to add.
+ * @param o_tree   Tree to build.
+ */
+static void Build (const std::vector<std::vector<unsigned char>>& a_leaves, const size_t a_count, ::casper::hsm::Merkle& o_tree)
+{
+    o_tree.Reset();
+    for ( size_t idx = 0 ; idx < a_count ; ++idx ) {
+        o_tree.Add(a_leaves[idx].data(), a_leaves[idx].size());
+    }
+    o_tree.Build();
+}
+
+#ifdef __APPLE__
+#pragma mark - Main
+#endif
+
+int main (int /* a_argc */, char** /* a_argv */)
+{
+    static const char* const k_leaves_[] = {
+        "", "00", "10", "2021", "3031", "40414243", "5051525354555657", "606162636465666768696a6b6c6d6e6f"
+    };
+    // ... RFC 6962 MTH(D[0:n]), n = 1...8 ...
+    static const char* const k_roots_[] = {
+        "6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d",
+        "fac54203e7cc696cf0dfcb42c92a1d9dbaf70ad9e621f4bd8d98662f00e3c125",
+        "aeb6bcfe274b70a14fb067a5e5578264db0fa9b51af5e0ba159158f329e06e77",
+        "d37ee418976dd95753c1c73862b9398fa2a2cf9b4ff0fdfe8b30cd95209614b7",
+        "4e3bbb1f7b478dcfe71fb631631519a3bca12c9aefca1612bfce4c13a86264d4",
+        "76e67dadbcdf1e10e1b74ddc608abd2f98dfb16fbce75277b5232a127f2087ef",
+        "ddb89be403809e325750d3d263cd78929c2942b7942a34b77e122c9594a74c8c",
+        "5dc9da79a70659a9ad559cb701ded9a2ab9d823aad2f4960cfe370eff4604328"
+    };
+    // ... RFC 6962 PATH(m, D[0:n]), from leaf level up to root ...
+    static const struct {
+        size_t      index_;
+        size_t      size_;
+        size_t      length_;
+        bool        left_[3];
+        const char* hash_[3];
+    } k_proofs_[] = {
+        { 0, 1, 0, { false, false, false }, { nullptr, nullptr, nullptr } },
+        { 0, 8, 3, { false, false, false }, {
+            "96a296d224f285c67bee93c30f8a309157f0daa35dc5b87e410b78630a09cfc7",
+            "5f083f0a1a33ca076a95279832580db3e0ef4584bdff1f54c8a360f50de3031e",
+            "6b47aaf29ee3c2af9af889bc1fb9254dabd31177f16232dd6aab035ca39bf6e4"
+        } },
+        { 5, 8, 3, { true, false, true }, {
+            "bc1a0643b12e4d2d7c77918f44e0f4f79a838b6cf9ec5b5c283e1f4d88599e6b",
+            "ca854ea128ed050b41b35ffc1b87b8eb2bde461e9e3b5596ece6b9d5975a0ae0",
+            "d37ee418976dd95753c1c73862b9398fa2a2cf9b4ff0fdfe8b30cd95209614b7"
+        } },
+        { 2, 3, 1, { true, false, false }, {
+            "fac54203e7cc696cf0dfcb42c92a1d9dbaf70ad9e621f4bd8d98662f00e3c125", nullptr, nullptr
+        } },
+        { 4, 5, 1, { true, false, false }, {
+            "d37ee418976dd95753c1c73862b9398fa2a2cf9b4ff0fdfe8b30cd95209614b7", nullptr, nullptr
+        } },
+        { 3, 7, 3, { true, true, false }, {
+            "0298d122906dcfc10892cb53a73992fc5b9f493ea4c9badb27b791b4127a7fe7",
+            "fac54203e7cc696cf0dfcb42c92a1d9dbaf70ad9e621f4bd8d98662f00e3c125",
+            "837dbb152e9b079010717e84e865da4ebc0fa198a806d59d31bf15accef22d0e"
+        } },
+        { 6, 7, 2, { true, true, false }, {
+            "0ebc5d3437fbe2db158b9f126a1d118e308181031d0a949f8dededebc558ef6a",
+            "d37ee418976dd95753c1c73862b9398fa2a2cf9b4ff0fdfe8b30cd95209614b7", nullptr
+        } }
+    };
+    
+    std::vector<std::vector<unsigned char>> leaves;
+    for ( auto leaf : k_leaves_ ) {
+        leaves.push_back(Unhex(leaf));
+    }
+    
+    ::casper::hsm::Merkle        tree;
+    ::casper::hsm::Merkle::Proof proof;
+    
+    // ... roots ...
+    for ( size_t size = 1 ; size <= leaves.size() ; ++size ) {
+        Build(leaves, size, tree);
+        const std::vector<unsigned char> expected = Unhex(k_roots_[size - 1]);
+        CASPER_HSM_TEST_CHECK(0 == memcmp(tree.root().bytes_, expected.data(), CASPER_HSM_MERKLE_HASH_LEN), "root of %zu leaves", size);
+    }
+    
+    // ... known proofs ...
+    for ( auto& vector : k_proofs_ ) {
+        Build(leaves, vector.size_, tree);
+        tree.Prove(vector.index_, proof);
+        CASPER_HSM_TEST_CHECK(vector.length_ == proof.size(), "proof length of leaf %zu of %zu", vector.index_, vector.size_);
+        for ( size_t idx = 0 ; idx < vector.length_ && idx < proof.size() ; ++idx ) {
+            const std::vector<unsigned char> expected = Unhex(vector.hash_[idx]);
+            CASPER_HSM_TEST_CHECK(vector.left_[idx] == proof[idx].left_, "proof step %zu side of leaf %zu of %zu", idx, vector.index_, vector.size_);
+            CASPER_HSM_TEST_CHECK(0 == memcmp(proof[idx].hash_.bytes_, expected.data(), CASPER_HSM_MERKLE_HASH_LEN),
+                                  "proof step %zu hash of leaf %zu of %zu", idx, vector.index_, vector.size_);
+        }
+    }
+    
+    // ... every proof verifies against it's root, and only for it's own leaf ...
+    for ( size_t size = 1 ; size <= leaves.size() ; ++size ) {
+        Build(leaves, size, tree);
+        for ( size_t index = 0 ; index < size ; ++index ) {
+            tree.Prove(index, proof);
+            CASPER_HSM_TEST_CHECK(true == ::casper::hsm::Merkle::Verify(leaves[index].data(), leaves[index].size(), proof, tree.root().bytes_),
+                                  "verify leaf %zu of %zu", index, size);
+            const size_t other = ( index + 1 ) % size;
+            if ( other != index ) {
+                CASPER_HSM_TEST_CHECK(false == ::casper::hsm::Merkle::Verify(leaves[other].data(), leaves[other].size(), proof, tree.root().bytes_),
+                                      "verify leaf %zu with proof of leaf %zu of %zu", other, index, size);
+            }
+        }
+    }
+    
+    // ... a node can't be presented as a leaf ( second preimage ) ...
+    {
+        std::vector<unsigned char> forged;
+        for ( size_t idx = 0 ; idx < 2 ; ++idx ) {
+            ::casper::hsm::Merkle single;
+            single.Reset();
+            single.Add(leaves[idx].data(), leaves[idx].size());
+            single.Build();
+            forged.insert(forged.end(), single.root().bytes_, single.root().bytes_ + CASPER_HSM_MERKLE_HASH_LEN);
+        }
+        Build(leaves, 2, tree);
+        proof.clear();
+        CASPER_HSM_TEST_CHECK(false == ::casper::hsm::Merkle::Verify(forged.data(), forged.size(), proof, tree.root().bytes_), "second preimage");
+    }
+    
+    fprintf(stdout, "merkle: %s ( %zu failure(s) )\n", 0 == s_failures_ ? "OK" : "FAILED", s_failures_);
+    return ( 0 == s_failures_ ? 0 : -1 );
+}
@@ -0,0 +1,168 @@
+/**
+ * @file main.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// Decode signing operations audit log files, one tab separated line per record:
+//
+// <timestamp> <pid> <status> <key> <requester> <sha256 digest ( hex ) | lost count>
+//
+// Usage: casper-hsm-audit <file> [<file>...]
+//
+
+#include "casper/hsm/auditor.h"
+
+#include <stdio.h>  // fprintf, fopen, fread
+#include <string.h> // strncmp
+#include <time.h>   // gmtime_r, strftime
+
+#ifdef __APPLE__
+#pragma mark - Helpers
+#endif
+
+namespace casper
+{
+
+    namespace hsm
+    {
+
+        namespace audit
+        {
+
+            /**
+             * @brief Print a record.
+             *
+             * @param a_record Record to print.
+             */
+            static void Print (const ::casper::hsm::Auditor::Record& a_record)
+            {
+                const time_t seconds = static_cast<time_t>(a_record.timestamp_us_ / 1000000);
+                struct tm    tm;
+                char         timestamp[32];
+                gmtime_r(&seconds, &tm);
+                strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &tm);
+
+                const char* status;
+                switch ( static_cast<::casper::hsm::Auditor::Status>(a_record.status_) ) {
+                    case ::casper::hsm::Auditor::Status::Signed:
+                        status = "signed";
+                        break;
+                    case ::casper::hsm::Auditor::Status::Failed:
+                        status = "failed";
+                        break;
+                    case ::casper::hsm::Auditor::Status::Lost:
+                        status = "lost";
+                        break;
+                    default:
+                        status = "?";
+                        break;
+                }
+
+                fprintf(stdout, "%s.%06uZ\t%u\t%s\t%.*s\t%.*s\t",
+                        timestamp, static_cast<unsigned>(a_record.timestamp_us_ % 1000000),
+                        static_cast<unsigned>(a_record.pid_), status,
+                        static_cast<int>(a_record.key_length_), a_record.key_,
+                        static_cast<int>(a_record.requester_length_), a_record.requester_
+                );
+                if ( static_cast<uint16_t>(::casper::hsm::Auditor::Status::Lost) == a_record.status_ ) {
+                    fprintf(stdout, "%u\n", static_cast<unsigned>(a_record.lost_));
+                } else {
+                    for ( size_t idx = 0 ; idx < sizeof(a_record.digest_) ; ++idx ) {
+                        fprintf(stdout, "%02x", static_cast<unsigned>(a_record.digest_[idx]));
+                    }
+                    fprintf(stdout, "\n");
+                }
+            }
+
+            /**
+             * @brief Decode an audit file.
+             *
+             * @param a_uri File URI.
+             *
+             * @return True on success, false otherwise.
+             */
+            static bool Decode (const char* const a_uri)
+            {
+                FILE* file = fopen(a_uri, "rb");
+                if ( nullptr == file ) {
+                    fprintf(stderr, "%s: unable to open file\n", a_uri);
+                    return false;
+                }
+
+                ::casper::hsm::Auditor::Header header;
+                if ( 1 != fread(&header, sizeof(header), 1, file)
+                    || 0 != strncmp(header.magic_, CASPER_HSM_AUDITOR_MAGIC, sizeof(header.magic_)) ) {
+                    fprintf(stderr, "%s: not an audit file\n", a_uri);
+                    fclose(file);
+                    return false;
+                }
+                if ( CASPER_HSM_AUDITOR_VERSION != header.version_ || sizeof(::casper::hsm::Auditor::Record) != header.record_size_ ) {
+                    fprintf(stderr, "%s: unsupported version %u, record size %u\n", a_uri, static_cast<unsigned>(header.version_), static_cast<unsigned>(header.record_size_));
+                    fclose(file);
+                    return false;
+                }
+
+                ::casper::hsm::Auditor::Record record;
+                size_t                         count     = 0;
+                bool                           truncated = false;
+                while ( true ) {
+                    const size_t read = fread(&record, 1, sizeof(record), file);
+                    if ( sizeof(record) != read ) {
+                        // ... a record still being written or a damaged file ...
+                        truncated = ( read > 0 );
+                        break;
+                    }
+                    Print(record);
+                    count++;
+                }
+                if ( true == truncated ) {
+                    fprintf(stderr, "%s: last record is incomplete, %zu record(s) decoded\n", a_uri, count);
+                }
+
+                fclose(file);
+                return ( false == truncated );
+            }
+
+        } // end of namespace 'audit'
+
+    } // end of namespace 'hsm'
+
+} // end of namespace 'casper'
+
+#ifdef __APPLE__
+#pragma mark - Main
+#endif
+
+int main (int a_argc, char** a_argv)
+{
+    if ( a_argc < 2 ) {
+        fprintf(stderr, "Usage: %s <file> [<file>...]\n", a_argv[0]);
+        return -1;
+    }
+
+    int rv = 0;
+    for ( int idx = 1 ; idx < a_argc ; ++idx ) {
+        if ( false == ::casper::hsm::audit::Decode(a_argv[idx]) ) {
+            rv = -1;
+        }
+    }
+
+    return rv;
+}
@@ -0,0 +1,263 @@
+/**
+ * @file main.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// Micro benchmarks for the per-signature CPU path ( everything but the HSM round trip ).
+//
+// Usage: casper-hsm-bench [<iterations>]
+//
+
+#include "casper/hsm/api.h"
+
+#include "cc/b64.h"
+#include "cc/easy/json.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <vector>
+
+#include <stdio.h>  // fprintf
+#include <stdlib.h> // malloc, free, strtoul
+
+#ifdef __APPLE__
+#pragma mark - Allocation Tracking
+#endif
+
+static std::atomic<size_t> s_allocs_ { 0 };
+static std::atomic<size_t> s_bytes_  { 0 };
+
+void* operator new (size_t a_size)
+{
+    s_allocs_.fetch_add(1, std::memory_order_relaxed);
+    s_bytes_.fetch_add(a_size, std::memory_order_relaxed);
+    void* ptr = malloc(0 != a_size ? a_size : 1);
+    if ( nullptr == ptr ) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[] (size_t a_size)
+{
+    return operator new(a_size);
+}
+
+void operator delete (void* a_ptr) noexcept
+{
+    free(a_ptr);
+}
+
+void operator delete[] (void* a_ptr) noexcept
+{
+    free(a_ptr);
+}
+
+void operator delete (void* a_ptr, size_t) noexcept
+{
+    free(a_ptr);
+}
+
+void operator delete[] (void* a_ptr, size_t) noexcept
+{
+    free(a_ptr);
+}
+
+#ifdef __APPLE__
+#pragma mark - Helpers
+#endif
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        namespace bench
+        {
+        
+            /**
+             * @brief A 'no HSM' API, exposes protected CPU path helpers.
+             */
+            class API final : public ::casper::hsm::API
+            {
+                
+            public: // Constructor(s) / Destructor
+                
+                API () : ::casper::hsm::API("casper-hsm-bench") {}
+                virtual ~API() {}
+                
+            public: // Method(s) // Function(s) - ::casper::hsm::API
+                
+                virtual void Load   () {}
+                virtual void Sign   (const std::string&, const std::string&, std::string&) {}
+                virtual void Sign   (const std::string&, const unsigned char*, const size_t, std::vector<unsigned char>&) {}
+                virtual void Unload () noexcept {}
+                
+            public: // Method(s) // Function(s)
+                
+                using ::casper::hsm::API::TryCall;
+                using ::casper::hsm::API::SetSigningBytes;
+                
+            }; // end of class 'API'
+            
+            /**
+             * @brief Run a benchmark and report it's results.
+             *
+             * @param a_name       Benchmark name.
+             * @param a_batch      Number of operations per iteration ( hashes per request ).
+             * @param a_iterations Number of iterations.
+             * @param a_function   Function to benchmark, one call == one iteration.
+             */
+            static void Run (const char* const a_name, const size_t a_batch, const size_t a_iterations, const std::function<void()>& a_function)
+            {
+                // ... warm up ...
+                a_function();
+                // ... measure ...
+                const size_t allocs = s_allocs_.load(std::memory_order_relaxed);
+                const size_t bytes  = s_bytes_.load(std::memory_order_relaxed);
+                const auto   start  = std::chrono::steady_clock::now();
+                for ( size_t idx = 0 ; idx < a_iterations ; ++idx ) {
+                    a_function();
+                }
+                const auto   end    = std::chrono::steady_clock::now();
+                // ... per operation ...
+                const double ops = static_cast<double>(a_batch * a_iterations);
+                const double ns  = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+                fprintf(stdout, "%-24s %6zu %12.1f ns/op %10.2f allocs/op %12.1f B/op\n",
+                        a_name, a_batch,
+                        ns / ops,
+                        static_cast<double>(s_allocs_.load(std::memory_order_relaxed) - allocs) / ops,
+                        static_cast<double>(s_bytes_.load(std::memory_order_relaxed) - bytes) / ops
+                );
+                fflush(stdout);
+            }
+            
+        } // end of namespace 'bench'
+        
+    } // end of namespace 'hsm'
+    
+} // end of namespace 'casper'
+
+#ifdef __APPLE__
+#pragma mark - Main
+#endif
+
+int main (int a_argc, char** a_argv)
+{
+    const size_t              iterations = ( a_argc > 1 ? static_cast<size_t>(strtoul(a_argv[1], nullptr, 10)) : 1000 );
+    const std::vector<size_t> batches    = { 1, 10, 100, 1000 };
+    
+    ::casper::hsm::bench::API api;
+
+    // ... a 'realistic' input: a base64-encoded 32 bytes hash ...
+    unsigned char raw_hash[32];
+    for ( size_t idx = 0 ; idx < sizeof(raw_hash) ; ++idx ) {
+        raw_hash[idx] = static_cast<unsigned char>(idx * 7 + 3);
+    }
+    const std::string hash = ::cc::base64_rfc4648::encode(raw_hash, sizeof(raw_hash));
+    
+    // ... a 'realistic' output: a 2048 bits RSA signature ...
+    unsigned char raw_signature[256];
+    for ( size_t idx = 0 ; idx < sizeof(raw_signature) ; ++idx ) {
+        raw_signature[idx] = static_cast<unsigned char>(idx * 13 + 1);
+    }
+    const std::string signature = ::cc::base64_rfc4648::encode(raw_signature, sizeof(raw_signature));
+    
+    fprintf(stdout, "%-24s %6s %15s %20s %15s\n", "benchmark", "batch", "time", "allocations", "bytes");
+
+    for ( auto batch : batches ) {
+        
+        const size_t n = std::max(static_cast<size_t>(1), iterations / batch);
+        
+        // ... base64 decode + SHA256 + DigestInfo ...
+        unsigned char signing_bytes[CASPER_HSM_API_ASN1_PLUS_SHA256_LEN];
+        ::casper::hsm::bench::Run("SetSigningBytes", batch, n, [&api, &hash, &signing_bytes, batch] () {
+            for ( size_t idx = 0 ; idx < batch ; ++idx ) {
+                api.SetSigningBytes(hash, signing_bytes);
+            }
+        });
+        
+        // ... std::function plumbing, same captures as safenet::API::Sign ...
+        ::casper::hsm::bench::Run("TryCall", batch, n, [&api, &hash, &signature, batch] () {
+            std::string key;
+            std::string out;
+            unsigned char* bytes = nullptr;
+            for ( size_t idx = 0 ; idx < batch ; ++idx ) {
+                api.TryCall(/* a_run */
+                            [&api, &key, &hash, &out, &bytes] () {
+                                (void)api; (void)key; (void)hash; (void)out; (void)bytes;
+                            },
+                            /* a_cleanup */
+                            [&api, &bytes] () {
+                                (void)api; (void)bytes;
+                            }
+                );
+            }
+        });
+        
+        // ... signature base64 encode ...
+        ::casper::hsm::bench::Run("base64 encode", batch, n, [&raw_signature, batch] () {
+            std::string out;
+            for ( size_t idx = 0 ; idx < batch ; ++idx ) {
+                out = ::cc::base64_rfc4648::encode(raw_signature, sizeof(raw_signature));
+            }
+        });
+        
+        // ... Module::Run request parsing ...
+        std::string body = "{\"key\":\"bench\",\"hash\":[";
+        for ( size_t idx = 0 ; idx < batch ; ++idx ) {
+            if ( idx > 0 ) {
+                body += ',';
+            }
+            body += '"' + hash + '"';
+        }
+        body += "]}";
+        ::casper::hsm::bench::Run("Module::Run parse", batch, n, [&body] () {
+            const ::cc::easy::JSON<::cc::Exception> json;
+            Json::Value                             request;
+            Json::Value                             hashes;
+            json.Parse(body, request);
+            const std::string key = json.Get(request, "key" , Json::ValueType::stringValue, /* a_default */ nullptr).asString();
+            hashes = json.Get(request, "hash", { Json::ValueType::stringValue, Json::ValueType::arrayValue }, &Json::Value::null);
+            for ( Json::ArrayIndex idx = 0 ; idx < hashes.size() ; ++idx ) {
+                const std::string value = hashes[idx].asString();
+                (void)value;
+            }
+        });
+        
+        // ... Module::Run response serialization ...
+        ::casper::hsm::bench::Run("Module::Run serialize", batch, n, [&signature, batch] () {
+            Json::Value response = Json::Value(Json::ValueType::objectValue);
+            response["signatures"] = Json::Value(Json::ValueType::arrayValue);
+            for ( size_t idx = 0 ; idx < batch ; ++idx ) {
+                response["signatures"].append(Json::Value(signature));
+            }
+            Json::FastWriter fw; fw.omitEndingLineFeed();
+            const std::string out = fw.write(response);
+            (void)out;
+        });
+        
+    }
+
+    return 0;
+}
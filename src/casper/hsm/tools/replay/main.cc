@@ -0,0 +1,609 @@
+/**
+ * @file main.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// Replay request shapes traces ( see casper/hsm/tracer.h ) against an HSM API backend or a running nginx.
+//
+// Usage: casper-hsm-replay [-s <speed>] [-c <concurrency>] <target> <trace> [<trace>...]
+//
+//  -s <speed>       : time scale, 1 - original speed, 2 - twice as fast, 0 - as fast as possible ( default 1 ).
+//  -c <concurrency> : number of workers, each one with it's own API instance or connection ( default 8 ).
+//
+// Targets:
+//
+//  -u <url>                     : nginx sign location, http://<host>:<port>/<path>.
+//  -r <url>                     : nginx raw document signing location ( optional ).
+//  -v <url>                     : nginx verification location ( optional ).
+//  -m <url>                     : nginx CMS signed data location ( optional ).
+//  -a <share dir> <slot> <pin>  : HSM API backend.
+//  -a <share dir> <fake config> : HSM API backend ( macOS ).
+//
+// Traces from several workers are merged by timestamp. Payloads are random, only shapes are replayed.
+// Records without a matching target ( e.g. verification records without -v ) are skipped.
+//
+
+#include "casper/hsm/tracer.h"
+
+#ifdef __APPLE__
+  #include "casper/hsm/fake/api.h"
+#else
+    #include "casper/hsm/safenet/api.h"
+#endif
+
+#include "cc/b64.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <netdb.h>      // getaddrinfo
+#include <stdio.h>      // fprintf
+#include <stdlib.h>     // strtod, strtoul
+#include <string.h>     // strncmp, strerror
+#include <sys/socket.h> // socket, connect
+#include <unistd.h>     // close, getopt, read, write
+
+#ifdef __APPLE__
+#pragma mark - Targets
+#endif
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        namespace replay
+        {
+            
+            /**
+             * @brief Replay target, one per worker - not thread safe.
+             */
+            class Target
+            {
+                
+            public: // Constructor(s) / Destructor
+                
+                virtual ~Target () {}
+                
+            public: // Method(s) / Function(s)
+                
+                /**
+                 * @brief Replay a request shape.
+                 *
+                 * @param a_record Request shape.
+                 * @param a_random Payload generator.
+                 * @param o_error  Error message, when request failed.
+                 *
+                 * @return -1 if record was skipped, 0 if request failed, 1 on success.
+                 */
+                virtual int Run (const ::casper::hsm::Tracer::Record& a_record, std::mt19937& a_random, std::string& o_error) = 0;
+                
+            }; // end of class 'Target'
+            
+            /**
+             * @brief Fill a buffer with random bytes.
+             *
+             * @param a_random Generator.
+             * @param o_data   Buffer to fill.
+             * @param a_length Number of bytes.
+             */
+            static void Random (std::mt19937& a_random, unsigned char* o_data, const size_t a_length)
+            {
+                for ( size_t idx = 0 ; idx < a_length ; ++idx ) {
+                    o_data[idx] = static_cast<unsigned char>(a_random() & 0xFF);
+                }
+            }
+            
+            /**
+             * @brief HSM API backend target, signatures are performed as the module would.
+             */
+            class APITarget final : public Target
+            {
+                
+            private: // Data
+                
+                ::casper::hsm::API*        api_;
+                std::vector<unsigned char> data_;
+                std::vector<unsigned char> signature_;
+                
+            public: // Constructor(s) / Destructor
+                
+                APITarget (::casper::hsm::API* a_api)
+                    : api_(a_api)
+                {
+                    data_.resize(32);
+                }
+                
+                virtual ~APITarget ()
+                {
+                    api_->Unload();
+                    delete api_;
+                }
+                
+            public: // Method(s) / Function(s)
+                
+                virtual int Run (const ::casper::hsm::Tracer::Record& a_record, std::mt19937& a_random, std::string& o_error)
+                {
+                    // ... no HSM operation ...
+                    if ( 0 != ( a_record.flags_ & ::casper::hsm::Tracer::Flags::Verify ) ) {
+                        return -1;
+                    }
+                    const std::string key   = std::string(a_record.key_, a_record.key_length_);
+                    // ... merkle and raw: one operation per request ...
+                    const size_t      count = ( 0 != ( a_record.flags_ & ::casper::hsm::Tracer::Flags::Merkle )
+                                                || static_cast<uint8_t>(::casper::hsm::Tracer::ContentType::Raw) == a_record.content_type_
+                                                ? 1 : static_cast<size_t>(a_record.count_)
+                    );
+                    for ( size_t idx = 0 ; idx < count ; ++idx ) {
+                        Random(a_random, data_.data(), data_.size());
+                        const ::casper::hsm::API::Status status = api_->TrySign(key, data_.data(), data_.size(), signature_);
+                        if ( false == ::casper::hsm::API::Succeeded(status) ) {
+                            o_error = ::casper::hsm::API::Describe(status);
+                            return 0;
+                        }
+                    }
+                    return 1;
+                }
+                
+            }; // end of class 'APITarget'
+            
+            /**
+             * @brief nginx target, one HTTP/1.1 connection per request ( 'Connection: close' ).
+             */
+            class HTTPTarget final : public Target
+            {
+                
+            public: // Data Type(s)
+                
+                typedef struct {
+                    std::string host_;
+                    std::string port_;
+                    std::string path_;
+                } URL;
+                
+            private: // Const Data
+                
+                const URL sign_;
+                const URL raw_;
+                const URL verify_;
+                const URL cms_;
+                
+            private: // Data
+                
+                std::string                body_;
+                std::vector<unsigned char> data_;
+                
+            public: // Constructor(s) / Destructor
+                
+                HTTPTarget (const URL& a_sign, const URL& a_raw, const URL& a_verify, const URL& a_cms)
+                    : sign_(a_sign), raw_(a_raw), verify_(a_verify), cms_(a_cms)
+                {
+                    /* empty */
+                }
+                
+                virtual ~HTTPTarget ()
+                {
+                    /* empty */
+                }
+                
+            public: // Method(s) / Function(s)
+                
+                virtual int Run (const ::casper::hsm::Tracer::Record& a_record, std::mt19937& a_random, std::string& o_error)
+                {
+                    const std::string key = std::string(a_record.key_, a_record.key_length_);
+                    std::string       headers;
+                    const URL*        url;
+                    unsigned char     hash[32];
+                    body_.clear();
+                    if ( 0 != ( a_record.flags_ & ::casper::hsm::Tracer::Flags::Verify ) ) {
+                        // ... random signatures, all results will be 'false' but the work is the same ...
+                        url = &verify_;
+                        body_ = "{\"items\":[";
+                        data_.resize(256);
+                        for ( uint32_t idx = 0 ; idx < a_record.count_ ; ++idx ) {
+                            Random(a_random, hash, sizeof(hash));
+                            Random(a_random, data_.data(), data_.size());
+                            body_ += ( idx > 0 ? ",{\"key\":\"" : "{\"key\":\"" ) + key + "\",\"digest\":\"" + ::cc::base64_rfc4648::encode(hash, sizeof(hash))
+                                   + "\",\"signature\":\"" + ::cc::base64_rfc4648::encode(data_.data(), data_.size()) + "\"}";
+                        }
+                        body_ += "]}";
+                        headers = "Content-Type: application/json\r\n";
+                    } else if ( 0 != ( a_record.flags_ & ::casper::hsm::Tracer::Flags::CMS ) ) {
+                        url = &cms_;
+                        Random(a_random, hash, sizeof(hash));
+                        body_ = "{\"key\":\"" + key + "\",\"digest\":\"" + ::cc::base64_rfc4648::encode(hash, sizeof(hash)) + "\"}";
+                        headers = "Content-Type: application/json\r\n";
+                    } else if ( static_cast<uint8_t>(::casper::hsm::Tracer::ContentType::Raw) == a_record.content_type_ ) {
+                        url = &raw_;
+                        data_.resize(static_cast<size_t>(a_record.bytes_));
+                        Random(a_random, data_.data(), data_.size());
+                        body_.assign(reinterpret_cast<const char*>(data_.data()), data_.size());
+                        headers = "Content-Type: application/octet-stream\r\nX-Casper-HSM-Key: " + key + "\r\n";
+                    } else if ( static_cast<uint8_t>(::casper::hsm::Tracer::ContentType::Binary) == a_record.content_type_ ) {
+                        // ... <u16 key length> <key> <u32 count> { <u16 length> <raw data> } * count, big endian ...
+                        url = &sign_;
+                        body_ += static_cast<char>((key.length() >> 8) & 0xFF);
+                        body_ += static_cast<char>(key.length() & 0xFF);
+                        body_ += key;
+                        for ( int shift = 24 ; shift >= 0 ; shift -= 8 ) {
+                            body_ += static_cast<char>((a_record.count_ >> shift) & 0xFF);
+                        }
+                        for ( uint32_t idx = 0 ; idx < a_record.count_ ; ++idx ) {
+                            Random(a_random, hash, sizeof(hash));
+                            body_ += static_cast<char>(0x00);
+                            body_ += static_cast<char>(sizeof(hash));
+                            body_.append(reinterpret_cast<const char*>(hash), sizeof(hash));
+                        }
+                        headers = "Content-Type: application/vnd.casper.hsm+octet-stream\r\n";
+                    } else {
+                        url = &sign_;
+                        body_ = "{\"key\":\"" + key + "\",\"hash\":[";
+                        for ( uint32_t idx = 0 ; idx < a_record.count_ ; ++idx ) {
+                            Random(a_random, hash, sizeof(hash));
+                            body_ += ( idx > 0 ? ",\"" : "\"" ) + ::cc::base64_rfc4648::encode(hash, sizeof(hash)) + '"';
+                        }
+                        body_ += ']';
+                        if ( 0 != ( a_record.flags_ & ::casper::hsm::Tracer::Flags::Merkle ) ) {
+                            body_ += ",\"merkle\":true";
+                        }
+                        if ( 0 != ( a_record.flags_ & ::casper::hsm::Tracer::Flags::Chain ) ) {
+                            body_ += ",\"chain\":true";
+                        }
+                        body_ += '}';
+                        headers = "Content-Type: application/json\r\n";
+                        if ( 0 != ( a_record.flags_ & ::casper::hsm::Tracer::Flags::Stream ) ) {
+                            headers += "Accept: application/x-ndjson\r\n";
+                        }
+                    }
+                    if ( 0 == url->host_.length() ) {
+                        return -1;
+                    }
+                    return Post(*url, headers, o_error);
+                }
+                
+            private: // Method(s) / Function(s)
+                
+                /**
+                 * @brief Send current body and wait for response status.
+                 *
+                 * @param a_url     Target URL.
+                 * @param a_headers Extra headers.
+                 * @param o_error   Error message, when request failed.
+                 *
+                 * @return 0 if request failed, 1 on success ( 2xx ).
+                 */
+                int Post (const URL& a_url, const std::string& a_headers, std::string& o_error)
+                {
+                    struct addrinfo  hints;
+                    struct addrinfo* info = nullptr;
+                    memset(&hints, 0, sizeof(hints));
+                    hints.ai_family   = AF_UNSPEC;
+                    hints.ai_socktype = SOCK_STREAM;
+                    const int gai = getaddrinfo(a_url.host_.c_str(), a_url.port_.c_str(), &hints, &info);
+                    if ( 0 != gai ) {
+                        o_error = gai_strerror(gai);
+                        return 0;
+                    }
+                    int fd = -1;
+                    for ( struct addrinfo* it = info ; nullptr != it && -1 == fd ; it = it->ai_next ) {
+                        fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+                        if ( -1 != fd && 0 != connect(fd, it->ai_addr, it->ai_addrlen) ) {
+                            close(fd);
+                            fd = -1;
+                        }
+                    }
+                    freeaddrinfo(info);
+                    if ( -1 == fd ) {
+                        o_error = std::string("connect: ") + strerror(errno);
+                        return 0;
+                    }
+                    const std::string request = "POST " + a_url.path_ + " HTTP/1.1\r\nHost: " + a_url.host_ + "\r\n" + a_headers
+                                              + "Content-Length: " + std::to_string(body_.length()) + "\r\nConnection: close\r\n\r\n" + body_;
+                    size_t sent = 0;
+                    while ( sent < request.length() ) {
+                        const ssize_t rv = write(fd, request.c_str() + sent, request.length() - sent);
+                        if ( rv <= 0 ) {
+                            if ( -1 == rv && EINTR == errno ) {
+                                continue;
+                            }
+                            o_error = std::string("write: ") + strerror(errno);
+                            close(fd);
+                            return 0;
+                        }
+                        sent += static_cast<size_t>(rv);
+                    }
+                    // ... read whole response, only status line matters ...
+                    std::string response;
+                    char        buffer[16384];
+                    while ( true ) {
+                        const ssize_t rv = read(fd, buffer, sizeof(buffer));
+                        if ( rv > 0 ) {
+                            if ( response.length() < 64 ) {
+                                response.append(buffer, static_cast<size_t>(rv));
+                            }
+                        } else if ( -1 == rv && EINTR == errno ) {
+                            continue;
+                        } else {
+                            break;
+                        }
+                    }
+                    close(fd);
+                    if ( response.length() < 12 || 0 != strncmp(response.c_str(), "HTTP/1.", 7) ) {
+                        o_error = "invalid response";
+                        return 0;
+                    }
+                    if ( '2' != response[9] ) {
+                        o_error = "HTTP " + response.substr(9, 3);
+                        return 0;
+                    }
+                    return 1;
+                }
+                
+            }; // end of class 'HTTPTarget'
+            
+            /**
+             * @brief Parse an http:// URL.
+             *
+             * @param a_value URL.
+             * @param o_url   Host, port and path.
+             *
+             * @return True on success.
+             */
+            static bool Parse (const char* const a_value, HTTPTarget::URL& o_url)
+            {
+                const std::string value = a_value;
+                if ( 0 != value.compare(0, 7, "http://") ) {
+                    return false;
+                }
+                const size_t slash = value.find('/', 7);
+                const std::string authority = value.substr(7, std::string::npos == slash ? std::string::npos : slash - 7);
+                const size_t colon = authority.rfind(':');
+                o_url.host_ = authority.substr(0, colon);
+                o_url.port_ = ( std::string::npos == colon ? "80" : authority.substr(colon + 1) );
+                o_url.path_ = ( std::string::npos == slash ? "/" : value.substr(slash) );
+                return ( o_url.host_.length() > 0 );
+            }
+            
+            /**
+             * @return Percentile of a sorted vector.
+             */
+            static uint64_t Percentile (const std::vector<uint64_t>& a_sorted, const size_t a_percentile)
+            {
+                if ( 0 == a_sorted.size() ) {
+                    return 0;
+                }
+                return a_sorted[std::min(a_sorted.size() - 1, ( a_sorted.size() * a_percentile + 99 ) / 100 - ( a_percentile > 0 ? 1 : 0 ))];
+            }
+            
+        } // end of namespace 'replay'
+        
+    } // end of namespace 'hsm'
+    
+} // end of namespace 'casper'
+
+#ifdef __APPLE__
+#pragma mark - Main
+#endif
+
+int main (int a_argc, char** a_argv)
+{
+    double                                 speed       = 1.0;
+    size_t                                 concurrency = 8;
+    ::casper::hsm::replay::HTTPTarget::URL sign, raw, verify, cms;
+    std::string                            share_dir;
+    int                                    opt;
+    while ( -1 != ( opt = getopt(a_argc, a_argv, "s:c:u:r:v:m:a:") ) ) {
+        switch (opt) {
+            case 's':
+                speed = strtod(optarg, nullptr);
+                break;
+            case 'c':
+                concurrency = std::max(static_cast<size_t>(1), static_cast<size_t>(strtoul(optarg, nullptr, 10)));
+                break;
+            case 'u':
+            case 'r':
+            case 'v':
+            case 'm':
+                if ( false == ::casper::hsm::replay::Parse(optarg, 'u' == opt ? sign : ( 'r' == opt ? raw : ( 'v' == opt ? verify : cms ) )) ) {
+                    fprintf(stderr, "Invalid URL '%s'!\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'a':
+                share_dir = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s <speed>] [-c <concurrency>] { -u <url> [-r <url>] [-v <url>] [-m <url>] | -a <share dir> <backend args> } <trace> [<trace>...]\n", a_argv[0]);
+                return -1;
+        }
+    }
+    
+    // ... backend arguments follow share dir ...
+#ifdef __APPLE__
+    const int backend_args = ( share_dir.length() > 0 ? 1 : 0 );
+#else
+    const int backend_args = ( share_dir.length() > 0 ? 2 : 0 );
+#endif
+    if ( ( 0 == sign.host_.length() && 0 == raw.host_.length() && 0 == verify.host_.length() && 0 == cms.host_.length() && 0 == share_dir.length() ) || optind + backend_args >= a_argc ) {
+        fprintf(stderr, "Usage: %s [-s <speed>] [-c <concurrency>] { -u <url> [-r <url>] [-v <url>] [-m <url>] | -a <share dir> <backend args> } <trace> [<trace>...]\n", a_argv[0]);
+        return -1;
+    }
+    char** const backend = a_argv + optind;
+    
+    // ... load and merge traces ...
+    std::vector<::casper::hsm::Tracer::Record> records;
+    try {
+        std::vector<::casper::hsm::Tracer::Record> tmp;
+        for ( int idx = optind + backend_args ; idx < a_argc ; ++idx ) {
+            ::casper::hsm::Tracer::Load(a_argv[idx], tmp);
+            records.insert(records.end(), tmp.begin(), tmp.end());
+        }
+    } catch (const std::exception& a_exception) {
+        fprintf(stderr, "%s\n", a_exception.what());
+        return -1;
+    }
+    std::stable_sort(records.begin(), records.end(), [] (const ::casper::hsm::Tracer::Record& a_lhs, const ::casper::hsm::Tracer::Record& a_rhs) {
+        return a_lhs.timestamp_us_ < a_rhs.timestamp_us_;
+    });
+    if ( 0 == records.size() ) {
+        fprintf(stderr, "Nothing to replay!\n");
+        return 0;
+    }
+    
+    // ... one target per worker ...
+    std::vector<::casper::hsm::replay::Target*> targets;
+    try {
+        for ( size_t idx = 0 ; idx < concurrency ; ++idx ) {
+            if ( 0 == share_dir.length() ) {
+                targets.push_back(new ::casper::hsm::replay::HTTPTarget(sign, raw, verify, cms));
+                continue;
+            }
+#ifdef __APPLE__
+            ::casper::hsm::API* api = new ::casper::hsm::fake::API("casper-hsm-replay", backend[0]);
+#else
+            ::casper::hsm::API* api = new ::casper::hsm::safenet::API("casper-hsm-replay", static_cast<::casper::hsm::SlotID>(strtoul(backend[0], nullptr, 10)), backend[1], /* a_reuse_session */ true);
+#endif
+            try {
+                api->LoadSharedResources(share_dir);
+                api->Load();
+                api->Warm();
+            } catch (...) {
+                delete api;
+                throw;
+            }
+            targets.push_back(new ::casper::hsm::replay::APITarget(api));
+        }
+    } catch (const std::exception& a_exception) {
+        fprintf(stderr, "%s\n", a_exception.what());
+        for ( auto target : targets ) {
+            delete target;
+        }
+        return -1;
+    }
+    
+    // ... workers ...
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    std::mutex                                          mutex;
+    std::condition_variable                             cv;
+    std::deque<std::pair<size_t, TimePoint>>            queue;
+    bool                                                done = false;
+    std::atomic<uint64_t>                               succeeded { 0 }, failed { 0 }, skipped { 0 };
+    std::vector<uint64_t>                               latencies;
+    std::vector<uint64_t>                               lags;
+    std::string                                         last_error;
+    std::vector<std::thread>                            workers;
+    for ( size_t idx = 0 ; idx < concurrency ; ++idx ) {
+        workers.push_back(std::thread([&, idx] () {
+            std::mt19937          random(static_cast<std::mt19937::result_type>(idx + 1));
+            std::string           error;
+            std::vector<uint64_t> my_latencies, my_lags;
+            while ( true ) {
+                std::pair<size_t, TimePoint> job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&queue, &done] { return done || 0 != queue.size(); });
+                    if ( 0 == queue.size() ) {
+                        break;
+                    }
+                    job = queue.front();
+                    queue.pop_front();
+                }
+                const TimePoint start = std::chrono::steady_clock::now();
+                const int       rv    = targets[idx]->Run(records[job.first], random, error);
+                const TimePoint end   = std::chrono::steady_clock::now();
+                if ( -1 == rv ) {
+                    skipped++;
+                    continue;
+                }
+                my_lags.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(start - job.second).count()));
+                my_latencies.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()));
+                if ( 1 == rv ) {
+                    succeeded++;
+                } else {
+                    failed++;
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            latencies.insert(latencies.end(), my_latencies.begin(), my_latencies.end());
+            lags.insert(lags.end(), my_lags.begin(), my_lags.end());
+            if ( 0 != error.length() ) {
+                last_error = error;
+            }
+        }));
+    }
+    
+    // ... dispatch, open loop: a slow backend does not delay the schedule, it shows up as lag ...
+    const TimePoint start = std::chrono::steady_clock::now();
+    const uint64_t  first = records.front().timestamp_us_;
+    for ( size_t idx = 0 ; idx < records.size() ; ++idx ) {
+        TimePoint due = start;
+        if ( speed > 0 ) {
+            due += std::chrono::microseconds(static_cast<uint64_t>(static_cast<double>(records[idx].timestamp_us_ - first) / speed));
+            std::this_thread::sleep_until(due);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::make_pair(idx, due));
+        }
+        cv.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    cv.notify_all();
+    for ( auto& worker : workers ) {
+        worker.join();
+    }
+    const uint64_t elapsed_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    for ( auto target : targets ) {
+        delete target;
+    }
+    
+    // ... report ...
+    std::sort(latencies.begin(), latencies.end());
+    std::sort(lags.begin(), lags.end());
+    const uint64_t original_us = records.back().timestamp_us_ - first;
+    fprintf(stdout, "records    : %zu ( %.3fs traced, %.3fs replayed )\n", records.size(), static_cast<double>(original_us) / 1e6, static_cast<double>(elapsed_us) / 1e6);
+    fprintf(stdout, "requests   : %llu succeeded, %llu failed, %llu skipped\n",
+            static_cast<unsigned long long>(succeeded.load()), static_cast<unsigned long long>(failed.load()), static_cast<unsigned long long>(skipped.load()));
+    fprintf(stdout, "latency us : p50 %llu, p95 %llu, p99 %llu, max %llu\n",
+            static_cast<unsigned long long>(::casper::hsm::replay::Percentile(latencies, 50)), static_cast<unsigned long long>(::casper::hsm::replay::Percentile(latencies, 95)),
+            static_cast<unsigned long long>(::casper::hsm::replay::Percentile(latencies, 99)), static_cast<unsigned long long>(::casper::hsm::replay::Percentile(latencies, 100)));
+    fprintf(stdout, "lag us     : p50 %llu, p95 %llu, p99 %llu, max %llu\n",
+            static_cast<unsigned long long>(::casper::hsm::replay::Percentile(lags, 50)), static_cast<unsigned long long>(::casper::hsm::replay::Percentile(lags, 95)),
+            static_cast<unsigned long long>(::casper::hsm::replay::Percentile(lags, 99)), static_cast<unsigned long long>(::casper::hsm::replay::Percentile(lags, 100)));
+    if ( 0 != last_error.length() ) {
+        fprintf(stdout, "last error : %s\n", last_error.c_str());
+    }
+    
+    return ( 0 == failed.load() ? 0 : -1 );
+}
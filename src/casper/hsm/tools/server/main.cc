@@ -0,0 +1,124 @@
+/**
+ * @file main.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// Unix domain socket signing frontend, see casper/hsm/server.h for protocol.
+//
+// Usage: casper-hsm-server <socket> <share dir> <slot id> <pin>
+//        casper-hsm-server <socket> <share dir> <fake config> ( macOS )
+//
+
+#include "casper/hsm/server.h"
+#include "casper/hsm/singleton.h"
+
+#ifdef __APPLE__
+  #include "casper/hsm/fake/api.h"
+#else
+    #include "casper/hsm/safenet/api.h"
+#endif
+
+#include <signal.h> // sigaction
+#include <stdio.h>  // fprintf
+#include <stdlib.h> // strtoul
+#include <string.h> // memset
+
+#ifdef __APPLE__
+#pragma mark - Signals
+#endif
+
+static volatile sig_atomic_t s_running_ = 1;
+
+static void OnSignal (int /* a_signal */)
+{
+    s_running_ = 0;
+}
+
+#ifdef __APPLE__
+#pragma mark - Main
+#endif
+
+int main (int a_argc, char** a_argv)
+{
+#ifdef __APPLE__
+    if ( 4 != a_argc ) {
+        fprintf(stderr, "Usage: %s <socket> <share dir> <fake config>\n", a_argv[0]);
+        return -1;
+    }
+#else
+    if ( 5 != a_argc ) {
+        fprintf(stderr, "Usage: %s <socket> <share dir> <slot id> <pin>\n", a_argv[0]);
+        return -1;
+    }
+#endif
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = OnSignal;
+    sigaction(SIGINT , &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, nullptr);
+
+    int rv = 0;
+    try {
+        // ... start HSM backend, warmed up before accepting connections ...
+#ifdef __APPLE__
+        const std::string config = a_argv[3];
+        ::casper::hsm::Singleton::GetInstance().Startup(a_argv[2], {
+            /* new_   */ [config] () -> ::casper::hsm::API* {
+                return new ::casper::hsm::fake::API("casper-hsm-server", config);
+            },
+            /* clone_ */ [] (const ::casper::hsm::API* a_api) -> ::casper::hsm::API* {
+                return new ::casper::hsm::fake::API(*dynamic_cast<const ::casper::hsm::fake::API*>(a_api));
+            }
+        });
+#else
+        const ::casper::hsm::SlotID slot = static_cast<::casper::hsm::SlotID>(strtoul(a_argv[3], nullptr, 10));
+        const std::string           pin  = a_argv[4];
+        ::casper::hsm::Singleton::GetInstance().Startup(a_argv[2], {
+            /* new_   */ [slot, pin] () -> ::casper::hsm::API* {
+                return new ::casper::hsm::safenet::API("casper-hsm-server", slot, pin, /* a_reuse_session */ true);
+            },
+            /* clone_ */ [] (const ::casper::hsm::API* a_api) -> ::casper::hsm::API* {
+                return new ::casper::hsm::safenet::API(*dynamic_cast<const ::casper::hsm::safenet::API*>(a_api));
+            }
+        });
+#endif
+        ::casper::hsm::Singleton::GetInstance().Warm();
+        // ... serve ...
+        ::casper::hsm::Server server({
+            /* path_      */ a_argv[1],
+            /* backlog_   */ 128,
+            /* max_frame_ */ 1024 * 1024
+        });
+        server.Start();
+        server.Run([] () -> bool {
+            return ( 1 == s_running_ );
+        });
+    } catch (const std::exception& a_exception) {
+        fprintf(stderr, "%s\n", a_exception.what());
+        rv = -1;
+    }
+
+    ::casper::hsm::Singleton::GetInstance().Shutdown();
+
+    return rv;
+}
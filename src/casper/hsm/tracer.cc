@@ -0,0 +1,176 @@
+/**
+ * @file tracer.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/tracer.h"
+
+#include "casper/hsm/api.h" // casper::hsm::Exception
+
+#include <algorithm> // std::min
+#include <chrono>    // std::chrono
+
+#include <errno.h>
+#include <fcntl.h>     // open
+#include <stdio.h>     // fopen, fread, fclose
+#include <string.h>    // memcpy, memset, strerror
+#include <sys/stat.h>  // fstat
+#include <unistd.h>    // write, close, getpid
+
+/**
+ * @brief Default constructor, opens ( or creates ) trace file.
+ *
+ * @param a_config See \link Config \link.
+ */
+casper::hsm::Tracer::Tracer (const casper::hsm::Tracer::Config& a_config)
+    : config_(a_config), pid_(static_cast<uint32_t>(getpid())),
+      lost_(0), fd_(-1)
+{
+    // ... open file ...
+    const std::string uri = config_.path_ + '.' + std::to_string(pid_);
+    fd_ = open(uri.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+    if ( -1 == fd_ ) {
+        throw ::casper::hsm::Exception("Unable to open trace file '%s': %s!", uri.c_str(), strerror(errno));
+    }
+    // ... new file? write header ...
+    struct stat st;
+    if ( 0 == fstat(fd_, &st) && 0 == st.st_size ) {
+        Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic_, CASPER_HSM_TRACER_MAGIC, sizeof(CASPER_HSM_TRACER_MAGIC));
+        header.version_     = CASPER_HSM_TRACER_VERSION;
+        header.record_size_ = static_cast<uint32_t>(sizeof(Record));
+        if ( false == Write(&header, sizeof(header)) ) {
+            const int error = errno;
+            close(fd_);
+            throw ::casper::hsm::Exception("Unable to write trace file '%s' header: %s!", uri.c_str(), strerror(error));
+        }
+    }
+    // ... buffer, never grows ...
+    buffer_.reserve(std::max(config_.capacity_, static_cast<size_t>(1)));
+}
+
+/**
+ * @brief Destructor, pending records are written before returning.
+ */
+casper::hsm::Tracer::~Tracer ()
+{
+    Flush();
+    close(fd_);
+}
+
+/**
+ * @brief Append a request shape record - must always be called by the same thread.
+ *
+ * @param a_key          HSM private key token label.
+ * @param a_count        Number of hashes ( or items ) in request.
+ * @param a_bytes        Request body length, in bytes.
+ * @param a_content_type Request content type.
+ * @param a_flags        Request options, see \link Flags \link.
+ */
+void casper::hsm::Tracer::Append (const std::string& a_key, const size_t a_count, const size_t a_bytes, const casper::hsm::Tracer::ContentType a_content_type, const uint8_t a_flags) noexcept
+{
+    // ... full? writing is left to \link Flush \link, never done while serving a request ...
+    if ( buffer_.size() >= buffer_.capacity() ) {
+        lost_++;
+        return;
+    }
+    const uint64_t now_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    // ... capacity was reserved, no allocation here ...
+    buffer_.resize(buffer_.size() + 1);
+    Record& record = buffer_.back();
+    record.timestamp_us_ = now_us;
+    record.pid_          = pid_;
+    record.count_        = static_cast<uint32_t>(std::min(a_count, static_cast<size_t>(UINT32_MAX)));
+    record.bytes_        = static_cast<uint32_t>(std::min(a_bytes, static_cast<size_t>(UINT32_MAX)));
+    record.content_type_ = static_cast<uint8_t>(a_content_type);
+    record.flags_        = a_flags;
+    record.key_length_   = static_cast<uint8_t>(std::min(a_key.length(), sizeof(record.key_)));
+    record.reserved_     = 0;
+    memcpy(record.key_, a_key.c_str(), record.key_length_);
+    memset(record.key_ + record.key_length_, 0, sizeof(record.key_) - record.key_length_);
+}
+
+/**
+ * @brief Write all buffered records - must be called by the same thread that appends them.
+ */
+void casper::hsm::Tracer::Flush () noexcept
+{
+    if ( 0 == buffer_.size() ) {
+        return;
+    }
+    if ( false == Write(buffer_.data(), buffer_.size() * sizeof(Record)) ) {
+        lost_ += static_cast<uint64_t>(buffer_.size());
+    }
+    buffer_.clear();
+}
+
+// MARK: -
+
+/**
+ * @brief Load a trace file.
+ *
+ * @param a_uri     Trace file URI.
+ * @param o_records Records, in file order.
+ */
+void casper::hsm::Tracer::Load (const std::string& a_uri, std::vector<casper::hsm::Tracer::Record>& o_records)
+{
+    FILE* file = fopen(a_uri.c_str(), "rb");
+    if ( nullptr == file ) {
+        throw ::casper::hsm::Exception("Unable to open trace file '%s': %s!", a_uri.c_str(), strerror(errno));
+    }
+    Header header;
+    if ( 1 != fread(&header, sizeof(header), 1, file) || 0 != memcmp(header.magic_, CASPER_HSM_TRACER_MAGIC, sizeof(CASPER_HSM_TRACER_MAGIC))
+        || CASPER_HSM_TRACER_VERSION != header.version_ || sizeof(Record) != header.record_size_ ) {
+        fclose(file);
+        throw ::casper::hsm::Exception("Unable to load trace file '%s': %s!", a_uri.c_str(), "invalid header");
+    }
+    o_records.clear();
+    Record record;
+    while ( 1 == fread(&record, sizeof(record), 1, file) ) {
+        o_records.push_back(record);
+    }
+    fclose(file);
+}
+
+/**
+ * @brief Write all bytes, retrying on partial writes and interruptions.
+ *
+ * @param a_data   Data to write.
+ * @param a_length Data length, in bytes.
+ *
+ * @return True on success, false otherwise ( errno is set ).
+ */
+bool casper::hsm::Tracer::Write (const void* a_data, const size_t a_length) noexcept
+{
+    const char* ptr       = static_cast<const char*>(a_data);
+    size_t      remaining = a_length;
+    while ( remaining > 0 ) {
+        const ssize_t written = write(fd_, ptr, remaining);
+        if ( -1 == written ) {
+            if ( EINTR == errno ) {
+                continue;
+            }
+            return false;
+        }
+        ptr       += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    return true;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file tracer.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_TRACER_H_
+#define CASPER_HSM_TRACER_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <string>
+#include <vector>
+
+#include <stdint.h> // uint64_t
+
+#define CASPER_HSM_TRACER_MAGIC   "CHSMTRC"
+#define CASPER_HSM_TRACER_VERSION 1
+#define CASPER_HSM_TRACER_KEY_LEN 40
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief Request shapes trace, so production load can be replayed - no payload is ever recorded.
+         *
+         * Records are buffered by the calling thread and only written by \link Flush \link, which owner must call every
+         * \link Config::flush_ms_ \link ( e.g. from a timer ) and before exiting - appending never writes, records that
+         * don't fit in a full buffer are counted as lost. No sync - a trace is not an audit log.
+         *
+         * File is '<path>.<pid>', a \link Header \link followed by fixed size \link Record \link entries, host byte order.
+         */
+        class Tracer final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+        
+        public: // Data Type(s)
+            
+            typedef struct {
+                std::string path_;     //!< File path prefix, process ID is appended.
+                size_t      capacity_; //!< Buffer capacity, in records.
+                uint64_t    flush_ms_; //!< Interval at which owner calls \link Flush \link.
+            } Config;
+            
+            enum class ContentType : uint8_t {
+                JSON = 0,
+                Binary,
+                Raw
+            };
+            
+            enum Flags : uint8_t {
+                None   = 0x00,
+                Merkle = 0x01,
+                Stream = 0x02,
+                Chain  = 0x04,
+                Verify = 0x08,
+                CMS    = 0x10
+            };
+            
+            typedef struct {
+                char     magic_[8];    //!< CASPER_HSM_TRACER_MAGIC, '\0' terminated.
+                uint32_t version_;     //!< CASPER_HSM_TRACER_VERSION.
+                uint32_t record_size_; //!< sizeof(Record).
+            } Header;
+            
+            typedef struct {
+                uint64_t timestamp_us_;                   //!< Wall clock, microseconds since epoch.
+                uint32_t pid_;
+                uint32_t count_;                          //!< Number of hashes ( or items ) in request.
+                uint32_t bytes_;                          //!< Request body length, in bytes.
+                uint8_t  content_type_;                   //!< See \link ContentType \link.
+                uint8_t  flags_;                          //!< See \link Flags \link.
+                uint8_t  key_length_;
+                uint8_t  reserved_;
+                char     key_[CASPER_HSM_TRACER_KEY_LEN]; //!< HSM private key token label, truncated.
+            } Record;
+        
+        private: // Const Data
+            
+            const Config        config_;
+            const uint32_t      pid_;
+        
+        private: // Data
+            
+            std::vector<Record> buffer_;
+            uint64_t            lost_;
+            int                 fd_;
+        
+        public: // Constructor(s) / Destructor
+            
+            Tracer () = delete;
+            Tracer (const Config& a_config);
+            virtual ~Tracer ();
+        
+        public: // Method(s) / Function(s)
+            
+            void Append (const std::string& a_key, const size_t a_count, const size_t a_bytes, const ContentType a_content_type, const uint8_t a_flags) noexcept;
+            void Flush  () noexcept;
+        
+        public: // Inline Method(s) / Function(s)
+            
+            /**
+             * @return Number of records that could not be written.
+             */
+            inline uint64_t lost () const
+            {
+                return lost_;
+            }
+        
+        public: // Static Method(s) / Function(s)
+            
+            static void Load (const std::string& a_uri, std::vector<Record>& o_records);
+        
+        private: // Method(s) / Function(s)
+            
+            bool Write (const void* a_data, const size_t a_length) noexcept;
+        
+        }; // end of class 'Tracer'
+        
+        static_assert(64 == sizeof(Tracer::Record), "unexpected trace record size");
+    
+    } // end of namespace 'hsm'
+
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_TRACER_H_
@@ -0,0 +1,194 @@
+/**
+ * @file verifier.cc
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "casper/hsm/verifier.h"
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+#define CASPER_HSM_VERIFIER_MIN_PARALLEL_BATCH 4 // below this, helper threads are not woken up
+
+/**
+ * @brief Default constructor, parses all certificates public keys and starts helper threads.
+ *
+ * @param a_certificates Map of key name to PEM-encoded certificate, certificates that can't be parsed are ignored.
+ * @param a_threads      Number of helper threads, 0 - verify on calling thread only.
+ */
+casper::hsm::Verifier::Verifier (const std::map<std::string, std::string>& a_certificates, const size_t a_threads)
+    : stop_(false), generation_(0), active_(0), batch_(nullptr), next_(0)
+{
+    for ( auto it : a_certificates ) {
+        BIO* bio = BIO_new_mem_buf(it.second.c_str(), static_cast<int>(it.second.length()));
+        if ( nullptr == bio ) {
+            continue;
+        }
+        X509* x509 = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr);
+        if ( nullptr != x509 ) {
+            EVP_PKEY* key = X509_get_pubkey(x509);
+            if ( nullptr != key ) {
+                keys_[it.first] = key;
+            }
+            X509_free(x509);
+        }
+        BIO_free(bio);
+    }
+    ERR_clear_error();
+    // ... start helpers ...
+    for ( size_t idx = 0 ; idx < a_threads ; ++idx ) {
+        threads_.push_back(std::thread(&casper::hsm::Verifier::Loop, this));
+    }
+}
+
+/**
+ * @brief Destructor.
+ */
+casper::hsm::Verifier::~Verifier ()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for ( auto& thread : threads_ ) {
+        if ( true == thread.joinable() ) {
+            thread.join();
+        }
+    }
+    for ( auto it : keys_ ) {
+        EVP_PKEY_free(it.second);
+    }
+}
+
+/**
+ * @brief Verify a batch, one item per signature.
+ *
+ * @param a_items Items to verify, \link Item::valid_ \link is set for each one.
+ */
+void casper::hsm::Verifier::Verify (std::vector<casper::hsm::Verifier::Item>& a_items)
+{
+    // ... resolve keys once, map is read only from now on ...
+    batch_keys_.resize(a_items.size());
+    for ( size_t idx = 0 ; idx < a_items.size() ; ++idx ) {
+        const auto it = keys_.find(a_items[idx].key_);
+        batch_keys_[idx] = ( keys_.end() != it ? it->second : nullptr );
+    }
+    next_.store(0, std::memory_order_relaxed);
+    // ... small batch, not worth a context switch ...
+    if ( 0 == threads_.size() || a_items.size() < CASPER_HSM_VERIFIER_MIN_PARALLEL_BATCH ) {
+        Work(a_items);
+        return;
+    }
+    // ... wake up helpers ...
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batch_ = &a_items;
+        generation_++;
+    }
+    work_cv_.notify_all();
+    // ... and help ...
+    Work(a_items);
+    // ... wait for helpers still working on this batch ...
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return 0 == active_; });
+    batch_ = nullptr;
+}
+
+// MARK: -
+
+/**
+ * @brief Helper thread loop.
+ */
+void casper::hsm::Verifier::Loop ()
+{
+    uint64_t seen = 0;
+    while ( true ) {
+        std::vector<Item>* batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_cv_.wait(lock, [this, &seen] { return stop_ || ( nullptr != batch_ && seen != generation_ ); });
+            if ( true == stop_ ) {
+                return;
+            }
+            seen  = generation_;
+            batch = batch_;
+            active_++;
+        }
+        Work(*batch);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            active_--;
+        }
+        done_cv_.notify_all();
+    }
+}
+
+/**
+ * @brief Verify items until there's none left to claim.
+ *
+ * @param a_items Current batch.
+ */
+void casper::hsm::Verifier::Work (std::vector<casper::hsm::Verifier::Item>& a_items)
+{
+    while ( true ) {
+        const size_t idx = next_.fetch_add(1, std::memory_order_relaxed);
+        if ( idx >= a_items.size() ) {
+            return;
+        }
+        a_items[idx].valid_ = Verify(batch_keys_[idx], a_items[idx]);
+    }
+}
+
+/**
+ * @brief Verify a PKCS #1 v1.5 RSA SHA256 signature.
+ *
+ * @param a_key  Public key, nullptr if unknown.
+ * @param a_item Item to verify.
+ *
+ * @return True if signature is valid.
+ */
+bool casper::hsm::Verifier::Verify (EVP_PKEY* a_key, const casper::hsm::Verifier::Item& a_item)
+{
+    if ( nullptr == a_key || 32 != a_item.digest_.size() || 0 == a_item.signature_.size() ) {
+        return false;
+    }
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(a_key, nullptr);
+    if ( nullptr == ctx ) {
+        return false;
+    }
+    const bool valid = (
+        1 == EVP_PKEY_verify_init(ctx)
+        &&
+        1 == EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING)
+        &&
+        1 == EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha256())
+        &&
+        1 == EVP_PKEY_verify(ctx, a_item.signature_.data(), a_item.signature_.size(), a_item.digest_.data(), a_item.digest_.size())
+    );
+    EVP_PKEY_CTX_free(ctx);
+    if ( false == valid ) {
+        // ... don't leave errors behind, queue is per thread ...
+        ERR_clear_error();
+    }
+    return valid;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file verifier.h
+ *
+ * Copyright (c) 2011-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-hsm.
+ *
+ * hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CASPER_HSM_VERIFIER_H_
+#define CASPER_HSM_VERIFIER_H_
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <openssl/evp.h>
+
+namespace casper
+{
+    
+    namespace hsm
+    {
+        
+        /**
+         * @brief Local signature verification, using certificates public keys - no HSM is involved.
+         *
+         * Public keys are parsed once, batches are verified by the calling thread and a fixed set of helper threads.
+         */
+        class Verifier final : public ::cc::NonCopyable, public ::cc::NonMovable
+        {
+        
+        public: // Data Type(s)
+            
+            typedef struct {
+                std::string                key_;       //!< HSM private key token label ( certificate name ).
+                std::vector<unsigned char> digest_;    //!< SHA256 of signed data.
+                std::vector<unsigned char> signature_; //!< PKCS #1 v1.5 RSA signature.
+                bool                       valid_;     //!< Output.
+            } Item;
+        
+        private: // Data
+            
+            std::map<std::string, EVP_PKEY*> keys_;
+            std::vector<std::thread>         threads_;
+            std::mutex                       mutex_;
+            std::condition_variable          work_cv_;
+            std::condition_variable          done_cv_;
+            bool                             stop_;
+            uint64_t                         generation_;
+            size_t                           active_;
+            std::vector<Item>*               batch_;
+            std::vector<EVP_PKEY*>           batch_keys_;
+            std::atomic<size_t>              next_;
+        
+        public: // Constructor(s) / Destructor
+            
+            Verifier () = delete;
+            Verifier (const std::map<std::string, std::string>& a_certificates, const size_t a_threads);
+            virtual ~Verifier ();
+        
+        public: // Method(s) / Function(s)
+            
+            void Verify (std::vector<Item>& a_items);
+        
+        public: // Inline Method(s) / Function(s)
+            
+            /**
+             * @return True if a public key is known for the provided key.
+             */
+            inline bool Knows (const std::string& a_key) const
+            {
+                return ( keys_.end() != keys_.find(a_key) );
+            }
+        
+        private: // Method(s) / Function(s)
+            
+            void Loop ();
+            void Work (std::vector<Item>& a_items);
+        
+        private: // Static Method(s) / Function(s)
+            
+            static bool Verify (EVP_PKEY* a_key, const Item& a_item);
+        
+        }; // end of class 'Verifier'
+    
+    } // end of namespace 'hsm'
+
+} // end of namespace 'casper'
+
+#endif // CASPER_HSM_VERIFIER_H_
@@ -0,0 +1,113 @@
+/**
+ * @file binary.cc
+ *
+ * Copyright (c) 2017-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of nginx-hsm.
+ *
+ * nginx-hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nginx-hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with nginx-hsm. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ngx/casper/broker/hsm/binary.h"
+
+#include "cc/exception.h"
+
+const char* const ngx::casper::broker::hsm::Binary::sk_content_type_ = "application/vnd.casper.hsm+octet-stream";
+
+/**
+ * @brief Decode a binary request body.
+ *
+ * @param a_body  Request body.
+ * @param o_key   HSM private key token label.
+ * @param o_items Data to be signed, pointing to \link a_body \link memory - request pool allocated.
+ */
+void ngx::casper::broker::hsm::Binary::Decode (const std::string& a_body, std::string& o_key, ngx::casper::broker::hsm::PoolVector<ngx::casper::broker::hsm::Binary::Item>& o_items)
+{
+    const unsigned char*       ptr = reinterpret_cast<const unsigned char*>(a_body.data());
+    const unsigned char* const end = ptr + a_body.length();
+    // ... key ...
+    if ( end - ptr < 2 ) {
+        throw ::cc::Exception("Invalid binary body: %s!", "missing key length");
+    }
+    const size_t key_length = ( static_cast<size_t>(ptr[0]) << 8 ) | static_cast<size_t>(ptr[1]);
+    ptr += 2;
+    if ( 0 == key_length || static_cast<size_t>(end - ptr) < key_length ) {
+        throw ::cc::Exception("Invalid binary body: %s!", "invalid key length");
+    }
+    o_key.assign(reinterpret_cast<const char*>(ptr), key_length);
+    ptr += key_length;
+    // ... count ...
+    if ( end - ptr < 4 ) {
+        throw ::cc::Exception("Invalid binary body: %s!", "missing count");
+    }
+    const size_t count = ( static_cast<size_t>(ptr[0]) << 24 ) | ( static_cast<size_t>(ptr[1]) << 16 ) | ( static_cast<size_t>(ptr[2]) << 8 ) | static_cast<size_t>(ptr[3]);
+    ptr += 4;
+    // ... each entry needs at least it's length prefix ...
+    if ( 0 == count || count > static_cast<size_t>(end - ptr) / 2 ) {
+        throw ::cc::Exception("Invalid binary body: %s!", "invalid count");
+    }
+    o_items.clear();
+    o_items.reserve(count);
+    // ... items ...
+    for ( size_t idx = 0 ; idx < count ; ++idx ) {
+        if ( end - ptr < 2 ) {
+            throw ::cc::Exception("Invalid binary body: missing item #%zu length!", idx);
+        }
+        const size_t length = ( static_cast<size_t>(ptr[0]) << 8 ) | static_cast<size_t>(ptr[1]);
+        ptr += 2;
+        if ( static_cast<size_t>(end - ptr) < length ) {
+            throw ::cc::Exception("Invalid binary body: item #%zu is truncated!", idx);
+        }
+        o_items.push_back({ ptr, length });
+        ptr += length;
+    }
+    // ... trailing garbage?
+    if ( ptr != end ) {
+        throw ::cc::Exception("Invalid binary body: %s!", "unexpected trailing data");
+    }
+}
+
+/**
+ * @brief Start a binary response body.
+ *
+ * @param a_count  Number of signatures that will be appended.
+ * @param a_writer Response body writer.
+ */
+void ngx::casper::broker::hsm::Binary::Begin (const size_t a_count, ngx::casper::broker::hsm::Writer& a_writer)
+{
+    const char header[4] = {
+        static_cast<char>(( a_count >> 24 ) & 0xFF),
+        static_cast<char>(( a_count >> 16 ) & 0xFF),
+        static_cast<char>(( a_count >>  8 ) & 0xFF),
+        static_cast<char>(( a_count       ) & 0xFF)
+    };
+    a_writer.Append(header, sizeof(header));
+}
+
+/**
+ * @brief Append a signature to a binary response body.
+ *
+ * @param a_signature Signature bytes.
+ * @param a_writer    Response body writer.
+ */
+void ngx::casper::broker::hsm::Binary::Append (const std::vector<unsigned char>& a_signature, ngx::casper::broker::hsm::Writer& a_writer)
+{
+    const size_t length    = a_signature.size();
+    const char   prefix[2] = {
+        static_cast<char>(( length >> 8 ) & 0xFF),
+        static_cast<char>(( length      ) & 0xFF)
+    };
+    a_writer.Append(prefix, sizeof(prefix));
+    a_writer.Append(reinterpret_cast<const char*>(a_signature.data()), length);
+}
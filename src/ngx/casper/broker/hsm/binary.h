@@ -0,0 +1,87 @@
+/**
+ * @file binary.h
+ *
+ * Copyright (c) 2017-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of nginx-hsm.
+ *
+ * nginx-hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nginx-hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with nginx-hsm. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef NRS_NGX_CASPER_BROKER_HSM_BINARY_H_
+#define NRS_NGX_CASPER_BROKER_HSM_BINARY_H_
+
+#include "ngx/casper/broker/hsm/writer.h"
+#include "ngx/casper/broker/hsm/pool_allocator.h"
+
+#include <string>
+#include <vector>
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint*_t
+
+namespace ngx
+{
+    
+    namespace casper
+    {
+        
+        namespace broker
+        {
+            
+            namespace hsm
+            {
+                
+                //
+                // Length-prefixed binary content type, all integers are big-endian:
+                //
+                // Request : <u16 key length> <key> <u32 count> { <u16 length> <raw data> } * count
+                // Response: <u32 count> { <u16 length> <raw signature> } * count
+                //
+                class Binary final
+                {
+                    
+                public: // Data Type(s)
+                    
+                    typedef struct {
+                        const unsigned char* data_;
+                        size_t               length_;
+                    } Item;
+                    
+                public: // Static Const Data
+                    
+                    static const char* const sk_content_type_;
+                    
+                public: // Constructor(s) / Destructor
+                    
+                    Binary () = delete;
+                    
+                public: // Static Method(s) / Function(s)
+                    
+                    static void Decode (const std::string& a_body, std::string& o_key, ngx::casper::broker::hsm::PoolVector<Item>& o_items);
+                    static void Begin  (const size_t a_count, ngx::casper::broker::hsm::Writer& a_writer);
+                    static void Append (const std::vector<unsigned char>& a_signature, ngx::casper::broker::hsm::Writer& a_writer);
+                    
+                }; // end of class 'Binary'
+                
+            } // end of namespace 'hsm'
+            
+        } // end of namespace 'broker'
+        
+    } // end of namespace 'casper'
+    
+} // end of namespace 'ngx'
+
+#endif // NRS_NGX_CASPER_BROKER_HSM_BINARY_H_
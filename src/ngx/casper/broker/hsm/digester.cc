@@ -0,0 +1,507 @@
+/**
+ * @file digester.cc
+ *
+ * Copyright (c) 2017-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of nginx-hsm.
+ *
+ * nginx-hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nginx-hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with nginx-hsm. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ngx/casper/broker/hsm/digester.h"
+
+#include "ngx/casper/broker/hsm/rate_limiter.h"
+#include "ngx/casper/broker/hsm/writer.h"
+
+#include "casper/hsm/singleton.h"
+
+#include "cc/exception.h"
+#include "cc/easy/json.h"
+
+#include <chrono> // std::chrono
+#include <vector>
+
+#include <string.h>  // strlen
+#include <strings.h> // strcasecmp
+
+#define NGX_CASPER_BROKER_HSM_DIGESTER_RESPONSE_SIZE 1024
+
+/**
+ * @brief Default constructor.
+ *
+ * @param a_r        The http request.
+ * @param a_backend  HSM profile backend.
+ * @param a_loc_conf Module location configuration.
+ * @param a_key      HSM private key token label.
+ */
+ngx::casper::broker::hsm::Digester::Digester (ngx_http_request_t* a_r, ::casper::hsm::Backend& a_backend, const ngx_http_casper_broker_hsm_module_loc_conf_t& a_loc_conf, const std::string& a_key)
+    : backend_(a_backend), ngx_request_(a_r), key_(a_key), use_singleton_(1 == a_loc_conf.singleton),
+      priority_(a_loc_conf.priority), bulk_threshold_(static_cast<size_t>(a_loc_conf.bulk_threshold)),
+      key_rate_(a_loc_conf.key_rate), tenant_rate_(a_loc_conf.tenant_rate), tenant_(a_loc_conf.tenant),
+      bytes_(0), limiter_(nullptr), retry_after_(0), admitted_(false), class_(::casper::hsm::Limiter::Class::Interactive), rate_limiter_(nullptr)
+{
+    ctx_ = EVP_MD_CTX_new();
+    if ( nullptr == ctx_ || 1 != EVP_DigestInit_ex(ctx_, EVP_sha256(), nullptr) ) {
+        if ( nullptr != ctx_ ) {
+            EVP_MD_CTX_free(ctx_);
+        }
+        throw ::cc::Exception("Unable to initialize %s!", "digest context");
+    }
+    // ... same load shedding and token buckets as signing requests ...
+    const nginx_hsm_service_conf_t*         service_conf = (const nginx_hsm_service_conf_t*)ngx_http_get_module_main_conf(ngx_request_, ngx_http_casper_broker_hsm_module);
+    const nginx_hsm_service_limiter_conf_t* limiter      = ( NULL != a_loc_conf.profile_conf
+                                                             ? &a_loc_conf.profile_conf->limiter
+                                                             : ( NULL != service_conf ? &service_conf->limiter : NULL )
+    );
+    if ( NULL != limiter && NULL != limiter->zone && NULL != limiter->zone->data ) {
+        limiter_ = new ::casper::hsm::Limiter(*static_cast<::casper::hsm::Limiter::State*>(limiter->zone->data), {
+            /* min_               */ static_cast<uint32_t>(limiter->min),
+            /* max_               */ static_cast<uint32_t>(limiter->max),
+            /* target_latency_us_ */ static_cast<uint64_t>(limiter->target_latency) * 1000,
+            /* backoff_           */ 0.9,
+            /* reserved_          */ static_cast<double>(limiter->reserved) / 100.0
+        });
+        retry_after_ = limiter->retry_after;
+    }
+    if ( NULL != service_conf && NULL != service_conf->rate_limiter.zone && ( key_rate_.rate > 0 || tenant_rate_.rate > 0 ) ) {
+        rate_limiter_ = new ngx::casper::broker::hsm::RateLimiter(service_conf->rate_limiter.zone);
+    }
+}
+
+/**
+ * @brief Destructor.
+ */
+ngx::casper::broker::hsm::Digester::~Digester ()
+{
+    if ( nullptr != limiter_ ) {
+        // ... request ended without reporting it's outcome ...
+        if ( true == admitted_ ) {
+            limiter_->Cancel(class_);
+        }
+        delete limiter_;
+    }
+    if ( nullptr != rate_limiter_ ) {
+        delete rate_limiter_;
+    }
+    EVP_MD_CTX_free(ctx_);
+}
+
+// MARK: -
+
+/**
+ * @brief Content handler, starts reading request body.
+ *
+ * @param a_r The http request.
+ *
+ * @return NGX_DONE when body is being read, otherwise an HTTP status code.
+ */
+ngx_int_t ngx::casper::broker::hsm::Digester::Handler (ngx_http_request_t* a_r)
+{
+    if ( NGX_HTTP_POST != a_r->method ) {
+        return NGX_HTTP_NOT_ALLOWED;
+    }
+    
+    ngx_http_casper_broker_hsm_module_loc_conf_t* loc_conf =
+        (ngx_http_casper_broker_hsm_module_loc_conf_t*)ngx_http_get_module_loc_conf(a_r, ngx_http_casper_broker_hsm_module);
+    
+    // ... key and digest algorithm ...
+    std::string key;
+    std::string algorithm;
+    if ( false == Header(a_r, "X-Casper-HSM-Key", key) || 0 == key.length() ) {
+        return NGX_HTTP_BAD_REQUEST;
+    }
+    // ... signature is sha256WithRSAEncryption, other digests would require a different DigestInfo ...
+    if ( true == Header(a_r, "X-Casper-HSM-Digest", algorithm) && 0 != strcasecmp(algorithm.c_str(), "sha256") ) {
+        return NGX_HTTP_BAD_REQUEST;
+    }
+    if ( NULL == loc_conf ) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    
+    ::casper::hsm::Backend* backend = ::casper::hsm::Singleton::GetInstance().Find(
+        std::string(reinterpret_cast<const char*>(loc_conf->profile.data), loc_conf->profile.len)
+    );
+    if ( nullptr == backend ) {
+        // ... validated at configuration time, so not started by this worker ...
+        ngx_log_error(NGX_LOG_ERR, a_r->connection->log, 0, "hsm_module: HSM profile \"%V\" is not registered", &loc_conf->profile);
+        return NGX_HTTP_SERVICE_UNAVAILABLE;
+    }
+    
+    // ... one per request, released with request pool ...
+    ngx_pool_cleanup_t* cleanup = ngx_pool_cleanup_add(a_r->pool, 0);
+    if ( NULL == cleanup ) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    Digester* digester;
+    try {
+        digester = new Digester(a_r, *backend, *loc_conf, key);
+    } catch (...) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    cleanup->handler = Cleanup;
+    cleanup->data    = digester;
+    ngx_http_set_ctx(a_r, digester, ngx_http_casper_broker_hsm_module);
+    
+    // ... fail fast, don't read a document that can't be signed ...
+    digester->Classify();
+    time_t retry_after = 0;
+    if ( false == digester->Throttle(retry_after) ) {
+        // ... 'key' or tenant rate exceeded ...
+        return digester->Reject(NGX_HTTP_TOO_MANY_REQUESTS, "Rate limit exceeded, please retry later.", retry_after);
+    }
+    if ( false == backend->Available() ) {
+        // ... HSM link is down, don't wait for it's timeouts ...
+        return digester->Reject(NGX_HTTP_SERVICE_UNAVAILABLE, "HSM is unavailable, please retry later.", static_cast<time_t>(backend->retry_after()));
+    }
+    
+    // ... body buffers are handed over as soon as they are received and reused after being hashed ...
+    a_r->request_body_no_buffering = 1;
+    
+    const ngx_int_t rc = ngx_http_read_client_request_body(a_r, BodyHandler);
+    if ( rc >= NGX_HTTP_SPECIAL_RESPONSE ) {
+        return rc;
+    }
+    
+    return NGX_DONE;
+}
+
+// MARK: -
+
+/**
+ * @brief Hash all received body buffers, releasing them to be reused.
+ *
+ * @return NGX_OK or an HTTP status code.
+ */
+ngx_int_t ngx::casper::broker::hsm::Digester::Consume ()
+{
+    if ( NULL == ngx_request_->request_body ) {
+        return NGX_OK;
+    }
+    for ( ngx_chain_t* cl = ngx_request_->request_body->bufs ; NULL != cl ; cl = cl->next ) {
+        ngx_buf_t* b = cl->buf;
+        // ... not expected when body is not buffered ...
+        if ( 0 == ngx_buf_in_memory(b) ) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+        if ( b->last > b->pos && 1 != EVP_DigestUpdate(ctx_, b->pos, static_cast<size_t>(b->last - b->pos)) ) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+        bytes_ += static_cast<size_t>(b->last - b->pos);
+        b->pos  = b->last;
+    }
+    ngx_request_->request_body->bufs = NULL;
+    return NGX_OK;
+}
+
+/**
+ * @brief Sign final digest and send response.
+ *
+ * @return Result of sending the response.
+ */
+ngx_int_t ngx::casper::broker::hsm::Digester::Finish ()
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int  length = 0;
+    if ( 1 != EVP_DigestFinal_ex(ctx_, digest, &length) || CASPER_HSM_API_SHA256_LEN != length ) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    
+    // ... document was received, only now HSM work starts ...
+    if ( false == Admit() ) {
+        // ... too many outstanding HSM operations ...
+        return Reject(NGX_HTTP_SERVICE_UNAVAILABLE, "HSM is overloaded, please retry later.", retry_after_);
+    }
+    
+    std::vector<unsigned char> signature;
+    ::casper::hsm::API::Status status;
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        ::casper::hsm::Singleton& singleton = ::casper::hsm::Singleton::GetInstance();
+        singleton.Observe(key_, 1, bytes_, ::casper::hsm::Tracer::ContentType::Raw, ::casper::hsm::Tracer::Flags::None);
+        if ( false == use_singleton_ ) {
+            backend_.Recycle();
+        }
+        status = backend_.TrySignDigest(key_, digest, signature);
+        singleton.AuditDigest(key_, digest, Requester(), ::casper::hsm::API::Succeeded(status));
+    } catch (...) {
+        status = { "signing data", 0 };
+    }
+    Dismiss(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()),
+            false == ::casper::hsm::API::Succeeded(status));
+    
+    try {
+        // ... response is written directly to request pool buffers ...
+        ngx::casper::broker::hsm::Writer writer(ngx_request_->pool, NGX_CASPER_BROKER_HSM_DIGESTER_RESPONSE_SIZE);
+        if ( false == ::casper::hsm::API::Succeeded(status) ) {
+            // ... rare, a DOM is acceptable here ...
+            Json::Value body = Json::Value(Json::ValueType::objectValue);
+            body["error"] = ::casper::hsm::API::Describe(status);
+            Json::FastWriter fw;
+            writer.Append(fw.write(body));
+            return Send(NGX_HTTP_INTERNAL_SERVER_ERROR, writer);
+        }
+        writer.Append("{\"digest\":\"");
+        writer.AppendBase64(digest, static_cast<size_t>(length));
+        writer.Append("\",\"signature\":\"");
+        writer.AppendBase64(signature.data(), signature.size());
+        writer.Append("\"}");
+        return Send(NGX_HTTP_OK, writer);
+    } catch (...) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+}
+
+/**
+ * @brief Send a JSON response.
+ *
+ * @param a_status_code HTTP status code.
+ * @param a_writer      Writer used to produce the response body.
+ *
+ * @return Result of sending the response.
+ */
+ngx_int_t ngx::casper::broker::hsm::Digester::Send (const ngx_uint_t a_status_code, ngx::casper::broker::hsm::Writer& a_writer)
+{
+    ngx_request_->headers_out.status           = a_status_code;
+    ngx_request_->headers_out.content_length_n = static_cast<off_t>(a_writer.length());
+    ngx_str_set(&ngx_request_->headers_out.content_type, "application/json");
+    ngx_request_->headers_out.content_type_len = ngx_request_->headers_out.content_type.len;
+    
+    ngx_chain_t* chain = a_writer.Finish();
+    
+    const ngx_int_t rc = ngx_http_send_header(ngx_request_);
+    if ( NGX_ERROR == rc || rc > NGX_OK || 1 == ngx_request_->header_only ) {
+        return rc;
+    }
+    return ngx_http_output_filter(ngx_request_, chain);
+}
+
+// MARK: -
+
+/**
+ * @brief Set this request priority class, from directive or 'X-Casper-HSM-Priority' header - a document is a single signature.
+ */
+void ngx::casper::broker::hsm::Digester::Classify ()
+{
+    std::string priority;
+    switch (priority_) {
+        case NGX_HTTP_CASPER_BROKER_HSM_PRIORITY_INTERACTIVE:
+            class_ = ::casper::hsm::Limiter::Class::Interactive;
+            break;
+        case NGX_HTTP_CASPER_BROKER_HSM_PRIORITY_BULK:
+            class_ = ::casper::hsm::Limiter::Class::Bulk;
+            break;
+        default:
+            if ( true == Header(ngx_request_, "X-Casper-HSM-Priority", priority) && 0 == strcasecmp(priority.c_str(), "bulk") ) {
+                class_ = ::casper::hsm::Limiter::Class::Bulk;
+            } else if ( 0 != priority.length() && 0 == strcasecmp(priority.c_str(), "interactive") ) {
+                class_ = ::casper::hsm::Limiter::Class::Interactive;
+            } else {
+                class_ = ( 1 > bulk_threshold_ ? ::casper::hsm::Limiter::Class::Bulk : ::casper::hsm::Limiter::Class::Interactive );
+            }
+            break;
+    }
+    ngx_http_casper_broker_hsm_module_set_variable(ngx_request_, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_PRIORITY,
+                                                   ( ::casper::hsm::Limiter::Class::Bulk == class_ ? "bulk" : "interactive" ));
+}
+
+/**
+ * @brief Take one token from this request 'key' and tenant buckets.
+ *
+ * @param o_retry_after When rejected, number of seconds after which request can be retried.
+ *
+ * @return True if request can proceed, false if it must be rejected.
+ */
+bool ngx::casper::broker::hsm::Digester::Throttle (time_t& o_retry_after)
+{
+    if ( nullptr == rate_limiter_ ) {
+        return true;
+    }
+    std::vector<ngx::casper::broker::hsm::RateLimiter::Bucket> buckets;
+    if ( key_rate_.rate > 0 ) {
+        buckets.push_back({ "k:" + key_, static_cast<uint64_t>(key_rate_.rate), static_cast<uint64_t>(key_rate_.burst) });
+    }
+    ngx_str_t tenant = ngx_null_string;
+    if ( tenant_rate_.rate > 0 && nullptr != tenant_ && NGX_OK == ngx_http_complex_value(ngx_request_, tenant_, &tenant) && tenant.len > 0 ) {
+        buckets.push_back({ "t:" + std::string(reinterpret_cast<const char*>(tenant.data), tenant.len), static_cast<uint64_t>(tenant_rate_.rate), static_cast<uint64_t>(tenant_rate_.burst) });
+    }
+    return rate_limiter_->Take(buckets, 1, o_retry_after);
+}
+
+/**
+ * @brief Try to start HSM work for this request.
+ *
+ * @return True if request can proceed, false if it should be rejected.
+ */
+bool ngx::casper::broker::hsm::Digester::Admit ()
+{
+    if ( nullptr == limiter_ ) {
+        return true;
+    }
+    admitted_ = limiter_->TryAcquire(class_);
+    return admitted_;
+}
+
+/**
+ * @brief Report the outcome of HSM work for this request, so concurrency limit can be adjusted.
+ *
+ * @param a_wait_us Time spent waiting for HSM, in microseconds.
+ * @param a_failed  True if HSM work failed.
+ */
+void ngx::casper::broker::hsm::Digester::Dismiss (const uint64_t a_wait_us, const bool a_failed)
+{
+    if ( false == admitted_ ) {
+        return;
+    }
+    admitted_ = false;
+    limiter_->Release(class_, a_wait_us, a_failed);
+}
+
+/**
+ * @brief Reject this request before any HSM work, discarding what's left of request body.
+ *
+ * @param a_status_code HTTP status code.
+ * @param a_message     Error message, must not require JSON escaping.
+ * @param a_retry_after 'Retry-After' header value, in seconds.
+ *
+ * @return Result of sending the response.
+ */
+ngx_int_t ngx::casper::broker::hsm::Digester::Reject (const ngx_uint_t a_status_code, const char* const a_message, const time_t a_retry_after)
+{
+    if ( 0 == ngx_request_->reading_body && NGX_OK != ngx_http_discard_request_body(ngx_request_) ) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    ngx_table_elt_t* header = (ngx_table_elt_t*)ngx_list_push(&ngx_request_->headers_out.headers);
+    if ( NULL == header ) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    header->value.data = (u_char*)ngx_pnalloc(ngx_request_->pool, NGX_TIME_T_LEN);
+    if ( NULL == header->value.data ) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    header->hash      = 1;
+    ngx_str_set(&header->key, "Retry-After");
+    header->value.len = ngx_sprintf(header->value.data, "%T", a_retry_after) - header->value.data;
+    try {
+        ngx::casper::broker::hsm::Writer writer(ngx_request_->pool, 128);
+        writer.Append("{\"error\":\"");
+        writer.Append(a_message);
+        writer.Append("\"}");
+        return Send(a_status_code, writer);
+    } catch (...) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+}
+
+/**
+ * @return Requester identification: tenant ( if configured ) or client address.
+ */
+const std::string& ngx::casper::broker::hsm::Digester::Requester ()
+{
+    if ( 0 == requester_.length() ) {
+        ngx_str_t tenant = ngx_null_string;
+        if ( nullptr != tenant_ && NGX_OK == ngx_http_complex_value(ngx_request_, tenant_, &tenant) && tenant.len > 0 ) {
+            requester_ = std::string(reinterpret_cast<const char*>(tenant.data), tenant.len);
+        } else {
+            requester_ = std::string(reinterpret_cast<const char*>(ngx_request_->connection->addr_text.data), ngx_request_->connection->addr_text.len);
+        }
+    }
+    return requester_;
+}
+
+// MARK: -
+
+/**
+ * @brief Hash what was received so far, sign when body was fully read.
+ *
+ * @param a_r The http request.
+ */
+void ngx::casper::broker::hsm::Digester::Continue (ngx_http_request_t* a_r)
+{
+    Digester* digester = reinterpret_cast<Digester*>(ngx_http_get_module_ctx(a_r, ngx_http_casper_broker_hsm_module));
+    if ( nullptr == digester ) {
+        ngx_http_finalize_request(a_r, NGX_HTTP_INTERNAL_SERVER_ERROR);
+        return;
+    }
+    const ngx_int_t rc = digester->Consume();
+    if ( NGX_OK != rc ) {
+        ngx_http_finalize_request(a_r, rc);
+        return;
+    }
+    // ... more to come?
+    if ( 1 == a_r->reading_body ) {
+        return;
+    }
+    ngx_http_finalize_request(a_r, digester->Finish());
+}
+
+/**
+ * @brief Called by nginx when first body bytes are available.
+ *
+ * @param a_r The http request.
+ */
+void ngx::casper::broker::hsm::Digester::BodyHandler (ngx_http_request_t* a_r)
+{
+    // ... next buffers are read on demand ...
+    a_r->read_event_handler = ReadEventHandler;
+    Continue(a_r);
+}
+
+/**
+ * @brief Called by nginx when more body bytes can be read.
+ *
+ * @param a_r The http request.
+ */
+void ngx::casper::broker::hsm::Digester::ReadEventHandler (ngx_http_request_t* a_r)
+{
+    const ngx_int_t rc = ngx_http_read_unbuffered_request_body(a_r);
+    if ( rc >= NGX_HTTP_SPECIAL_RESPONSE ) {
+        ngx_http_finalize_request(a_r, rc);
+        return;
+    }
+    Continue(a_r);
+}
+
+/**
+ * @brief Request pool cleanup handler.
+ *
+ * @param a_data Digester instance.
+ */
+void ngx::casper::broker::hsm::Digester::Cleanup (void* a_data)
+{
+    delete reinterpret_cast<Digester*>(a_data);
+}
+
+/**
+ * @brief Obtain a request header value.
+ *
+ * @param a_r     The http request.
+ * @param a_name  Header name.
+ * @param o_value Header value.
+ *
+ * @return True if header is present.
+ */
+bool ngx::casper::broker::hsm::Digester::Header (ngx_http_request_t* a_r, const char* const a_name, std::string& o_value)
+{
+    const size_t length = strlen(a_name);
+    for ( ngx_list_part_t* part = &a_r->headers_in.headers.part ; NULL != part ; part = part->next ) {
+        ngx_table_elt_t* header = (ngx_table_elt_t*)part->elts;
+        for ( ngx_uint_t idx = 0 ; idx < part->nelts ; ++idx ) {
+            if ( length == header[idx].key.len && 0 == ngx_strncasecmp(header[idx].key.data, (u_char*)a_name, length) ) {
+                o_value = std::string(reinterpret_cast<const char*>(header[idx].value.data), header[idx].value.len);
+                return true;
+            }
+        }
+    }
+    return false;
+}
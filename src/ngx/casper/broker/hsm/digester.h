@@ -0,0 +1,151 @@
+/**
+ * @file digester.h
+ *
+ * Copyright (c) 2017-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of nginx-hsm.
+ *
+ * nginx-hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nginx-hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with nginx-hsm. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef NRS_NGX_CASPER_BROKER_HSM_DIGESTER_H_
+#define NRS_NGX_CASPER_BROKER_HSM_DIGESTER_H_
+
+extern "C" {
+    #include <ngx_config.h>
+    #include <ngx_core.h>
+    #include <ngx_http.h>
+}
+
+#include "ngx/casper/broker/hsm/module/ngx_http_casper_broker_hsm_module.h"
+#include "ngx/casper/broker/hsm/writer.h"
+
+#include "casper/hsm/backend.h"
+#include "casper/hsm/limiter.h"
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <string>
+
+#include <openssl/evp.h>
+
+namespace ngx
+{
+    
+    namespace casper
+    {
+        
+        namespace broker
+        {
+            
+            namespace hsm
+            {
+                
+                class RateLimiter;
+                
+                /**
+                 * @brief Signs a raw document: request body is hashed while it's received, without being buffered,
+                 *        and only the final digest is signed.
+                 *
+                 * Request:
+                 *
+                 *   Method                : POST
+                 *   X-Casper-HSM-Key      : <string>
+                 *   X-Casper-HSM-Digest   : sha256 - optional, only supported digest ( signature is sha256WithRSAEncryption )
+                 *   X-Casper-HSM-Priority : interactive | bulk - optional, see 'nginx_casper_broker_hsm_priority'
+                 *   Body                  : <raw document>
+                 *
+                 * Response:
+                 *
+                 *      400: Bad Request         - when key is missing or digest is not supported
+                 *      405: Not Allowed         - when method is not POST
+                 *      429: Too Many Requests   - when 'key' or tenant rate is exceeded, with 'Retry-After' header
+                 *      503: Service Unavailable - when HSM is overloaded or unreachable ( circuit is open ), with 'Retry-After' header
+                 *      500: Internal Server Error { "error": <string> }
+                 *      200: Ok { "digest": <string>, "signature": <string> } - signature is the same as signing 'digest' as a 'hash'
+                 */
+                class Digester final : public ::cc::NonCopyable, public ::cc::NonMovable
+                {
+                    
+                private: // Refs
+                    
+                    ::casper::hsm::Backend&   backend_;
+                    
+                private: // Const Data
+                    
+                    ngx_http_request_t* const                           ngx_request_;
+                    const std::string                                   key_;
+                    const bool                                          use_singleton_;
+                    const ngx_uint_t                                    priority_;
+                    const size_t                                        bulk_threshold_;
+                    const ngx_http_casper_broker_hsm_module_rate_conf_t key_rate_;
+                    const ngx_http_casper_broker_hsm_module_rate_conf_t tenant_rate_;
+                    ngx_http_complex_value_t* const                     tenant_;
+                    
+                private: // Data
+                    
+                    EVP_MD_CTX*                   ctx_;
+                    size_t                        bytes_;
+                    ::casper::hsm::Limiter*       limiter_;
+                    time_t                        retry_after_;
+                    bool                          admitted_;
+                    ::casper::hsm::Limiter::Class class_;
+                    RateLimiter*                  rate_limiter_;
+                    std::string                   requester_;
+                    
+                public: // Constructor(s) / Destructor
+                    
+                    Digester () = delete;
+                    Digester (ngx_http_request_t* a_r, ::casper::hsm::Backend& a_backend, const ngx_http_casper_broker_hsm_module_loc_conf_t& a_loc_conf, const std::string& a_key);
+                    virtual ~Digester ();
+                    
+                public: // Static Method(s) / Function(s)
+                    
+                    static ngx_int_t Handler (ngx_http_request_t* a_r);
+                    
+                private: // Method(s) / Function(s)
+                    
+                    ngx_int_t Consume ();
+                    ngx_int_t Finish  ();
+                    ngx_int_t Send    (const ngx_uint_t a_status_code, Writer& a_writer);
+                    
+                    void      Classify  ();
+                    bool      Throttle  (time_t& o_retry_after);
+                    bool      Admit     ();
+                    void      Dismiss   (const uint64_t a_wait_us, const bool a_failed);
+                    ngx_int_t Reject    (const ngx_uint_t a_status_code, const char* const a_message, const time_t a_retry_after);
+                    
+                    const std::string& Requester ();
+                    
+                private: // Static Method(s) / Function(s)
+                    
+                    static void Continue         (ngx_http_request_t* a_r);
+                    static void BodyHandler      (ngx_http_request_t* a_r);
+                    static void ReadEventHandler (ngx_http_request_t* a_r);
+                    static void Cleanup          (void* a_data);
+                    static bool Header           (ngx_http_request_t* a_r, const char* const a_name, std::string& o_value);
+                    
+                }; // end of class 'Digester'
+                
+            } // end of namespace 'hsm'
+            
+        } // end of namespace 'broker'
+        
+    } // end of namespace 'casper'
+    
+} // end of namespace 'ngx'
+
+#endif // NRS_NGX_CASPER_BROKER_HSM_DIGESTER_H_
@@ -22,10 +22,16 @@
 #include "ngx/casper/broker/hsm/module.h"
 
 #include "ngx/casper/broker/hsm/errors.h"
+#include "ngx/casper/broker/hsm/binary.h"
+#include "ngx/casper/broker/hsm/parser.h"
+#include "ngx/casper/broker/hsm/writer.h"
+#include "ngx/casper/broker/hsm/pool_allocator.h"
+#include "ngx/casper/broker/hsm/rate_limiter.h"
 
 #include "cc/exception.h"
 
 #include "cc/easy/json.h"
+#include "cc/b64.h"
 
 #ifdef __APPLE__
   #include "casper/hsm/fake/api.h"
@@ -34,13 +40,27 @@
 #endif
 
 #include "casper/hsm/singleton.h"
+#include "casper/hsm/batch_sha256.h"
+#include "casper/hsm/merkle.h"
 
 #include "ngx/version.h"
 
+#include <algorithm> // std::max
+#include <chrono>    // std::chrono
+
+#include <strings.h>   // strcasecmp
+
 #if defined(__APPLE__) && defined(CC_DEBUG_ON)
     #include "cc/global/initializer.h"
 #endif
 
+#define NGX_CASPER_BROKER_HSM_MODULE_WRITER_CHUNK_SIZE 16384
+#define NGX_CASPER_BROKER_HSM_MODULE_STREAM_LINE_SIZE   1024
+#define NGX_CASPER_BROKER_HSM_MODULE_SIGNATURE_RESERVE  512 // RSA 4096
+#define NGX_CASPER_BROKER_HSM_MODULE_BULK_YIELD          100 // streamed bulk signatures between yields, when 'bulk_max_batch' is unlimited
+#define NGX_CASPER_BROKER_HSM_MODULE_NDJSON_CONTENT_TYPE "application/x-ndjson"
+#define NGX_CASPER_BROKER_HSM_MODULE_CMS_CONTENT_TYPE    "application/pkcs7-signature"
+
 
 /**
  * @brief Default constructor.
@@ -49,11 +69,19 @@
  * @param a_params
  * @param a_ngx_loc_conf
  * @param a_ngx_hsm_loc_conf
+ * @param a_backend HSM profile backend, see \link ::casper::hsm::Singleton::Find \link.
  */
 ngx::casper::broker::hsm::Module::Module (const ngx::casper::broker::Module::Config& a_config, const ngx::casper::broker::Module::Params& a_params,
-                                          ngx_http_casper_broker_module_loc_conf_t& a_ngx_loc_conf, ngx_http_casper_broker_hsm_module_loc_conf_t& a_ngx_hsm_loc_conf)
+                                          ngx_http_casper_broker_module_loc_conf_t& a_ngx_loc_conf, ngx_http_casper_broker_hsm_module_loc_conf_t& a_ngx_hsm_loc_conf,
+                                          ::casper::hsm::Backend& a_backend)
     : ngx::casper::broker::Module("hsm", a_config, a_params),
-      use_singleton_(1 == a_ngx_hsm_loc_conf.singleton)
+      backend_(a_backend),
+      use_singleton_(1 == a_ngx_hsm_loc_conf.singleton), ngx_request_(a_config.ngx_ptr_),
+      priority_(a_ngx_hsm_loc_conf.priority), bulk_threshold_(static_cast<size_t>(a_ngx_hsm_loc_conf.bulk_threshold)),
+      bulk_max_batch_(static_cast<size_t>(a_ngx_hsm_loc_conf.bulk_max_batch)),
+      key_rate_(a_ngx_hsm_loc_conf.key_rate), tenant_rate_(a_ngx_hsm_loc_conf.tenant_rate), tenant_(a_ngx_hsm_loc_conf.tenant),
+      verify_(1 == a_ngx_hsm_loc_conf.verify), cms_(1 == a_ngx_hsm_loc_conf.cms),
+      limiter_(nullptr), retry_after_(0), admitted_(false), class_(::casper::hsm::Limiter::Class::Interactive), rate_limiter_(nullptr)
 {
     // ...
     body_read_supported_methods_ = {
@@ -72,6 +100,35 @@ ngx::casper::broker::hsm::Module::Module (const ngx::casper::broker::Module::Con
 #else
     ctx_.log_body_ = ( 1 == a_ngx_loc_conf.cc_log.set && 1 == a_ngx_loc_conf.cc_log.write_body );
 #endif
+    // ...
+    direct_response_ = { /* status_code_ */ NGX_HTTP_OK, /* content_type_ */ "", /* chain_ */ nullptr, /* length_ */ 0, /* headers_ */ {} };
+    stream_.pending_    = false;
+    stream_.index_      = 0;
+    stream_.free_       = nullptr;
+    stream_.busy_       = nullptr;
+    stream_.sign_count_ = 0;
+    stream_.wait_us_    = 0;
+    stream_.failed_     = false;
+    // ... load shedding? each profile has it's own limit ...
+    const nginx_hsm_service_conf_t*         service_conf = (const nginx_hsm_service_conf_t*)ngx_http_get_module_main_conf(ngx_request_, ngx_http_casper_broker_hsm_module);
+    const nginx_hsm_service_limiter_conf_t* limiter      = ( NULL != a_ngx_hsm_loc_conf.profile_conf
+                                                             ? &a_ngx_hsm_loc_conf.profile_conf->limiter
+                                                             : ( NULL != service_conf ? &service_conf->limiter : NULL )
+    );
+    if ( NULL != limiter && NULL != limiter->zone && NULL != limiter->zone->data ) {
+        limiter_ = new ::casper::hsm::Limiter(*static_cast<::casper::hsm::Limiter::State*>(limiter->zone->data), {
+            /* min_               */ static_cast<uint32_t>(limiter->min),
+            /* max_               */ static_cast<uint32_t>(limiter->max),
+            /* target_latency_us_ */ static_cast<uint64_t>(limiter->target_latency) * 1000,
+            /* backoff_           */ 0.9,
+            /* reserved_          */ static_cast<double>(limiter->reserved) / 100.0
+        });
+        retry_after_ = limiter->retry_after;
+    }
+    // ... token buckets?
+    if ( NULL != service_conf && NULL != service_conf->rate_limiter.zone && ( key_rate_.rate > 0 || tenant_rate_.rate > 0 ) ) {
+        rate_limiter_ = new ngx::casper::broker::hsm::RateLimiter(service_conf->rate_limiter.zone);
+    }
 }
 
 /**
@@ -79,7 +136,16 @@ ngx::casper::broker::hsm::Module::Module (const ngx::casper::broker::Module::Con
  */
 ngx::casper::broker::hsm::Module::~Module ()
 {
-    /* empty */
+    if ( nullptr != limiter_ ) {
+        // ... request ended without reporting it's outcome ( e.g. aborted stream ) ...
+        if ( true == admitted_ ) {
+            limiter_->Cancel(class_);
+        }
+        delete limiter_;
+    }
+    if ( nullptr != rate_limiter_ ) {
+        delete rate_limiter_;
+    }
 }
 
 /**
@@ -97,14 +163,44 @@ ngx_int_t ngx::casper::broker::hsm::Module::Run ()
     //    Body       : { "key": <string>, "hash": <string> }
     //      or
     //    Body       : { "key": <string>, "hash": [<string>] }
+    //      or
+    //    Body       : { "key": <string>, "hash": [<string>], "merkle": true } - only merkle tree root is signed
+    //
+    //      "chain": true - optional, embeds 'key' certificate chain in response ( not streamed responses )
+    //
+    //   Content-Type: application/vnd.casper.hsm+octet-stream
+    //   Method      : POST
+    //    Body       : <u16 key length> <key> <u32 count> { <u16 length> <raw data> } * count
     //
     // Response:
     //
-    //      400: Bad Request - when missing or invalid body
-    //      404: Not Found   - when there is no certificate available
+    //      400: Bad Request         - when missing or invalid body
+    //      404: Not Found           - when there is no certificate available
+    //      429: Too Many Requests   - when 'key' or tenant rate is exceeded, with 'Retry-After' header
+    //      503: Service Unavailable - when HSM is overloaded or unreachable ( circuit is open ), with 'Retry-After' header
     //      200: Ok
     //              - HSM APIs   : HSM => { hsm: { "provider": "HSM", "signing": <certificate>, "intermediate": <certificate>, "root": <certificate>, "pin": <PIN> , "otp": <OTP>}}
+    //              - binary     : <u32 count> { <u16 length> <raw signature> } * count
+    //              - merkle     : { "root": <string>, "signature": <string>, "proofs": [[{ "left" | "right": <string> }]] }
+    //              - chain      : { ..., "chain": { "signing": <string>, "intermediates": [<string>], "root": <string> | null } | null } - base64 DER
+    //              - Accept: application/x-ndjson ( JSON requests only ), chunked:
+    //                  { "index": <number>, "signature": <string> }\n * count
+    //                  { "index": <number>, "error": <string> }\n - on failure, last line
+    //
+    // Verification ( 'nginx_casper_broker_hsm_verify on' ), see \link Verify \link.
     //
+    // CMS SignedData ( 'nginx_casper_broker_hsm_cms on' ), see \link SignedData \link.
+    //
+    
+    // ... no HSM operation, limits don't apply ...
+    if ( true == verify_ ) {
+        return Verify();
+    }
+    
+    // ... one HSM operation, limits apply ...
+    if ( true == cms_ ) {
+        return SignedData();
+    }
     
     // ... starts as a bad request ...
     ctx_.response_.status_code_ = NGX_HTTP_BAD_REQUEST;
@@ -112,50 +208,229 @@ ngx_int_t ngx::casper::broker::hsm::Module::Run ()
 
     ::casper::hsm::API* api = nullptr;
     
+    size_t   sign_count = 0;
+    uint64_t wait_us    = 0;
+    bool     signing    = false;
+    
     try {
 
-        std::string key;
-        Json::Value hash;
+        const bool binary = ( 0 == strcasecmp(ctx_.request_.content_type_.c_str(), ngx::casper::broker::hsm::Binary::sk_content_type_) );
+        
+        // ... per request containers are allocated from request pool, released with it ...
+        const ngx::casper::broker::hsm::PoolAllocator<unsigned char> allocator(ngx_request_->pool);
+        
+        std::string                                                                  key;
+        Json::Value                                                                  dom;
+        ngx::casper::broker::hsm::Parser::Request                                    request = {
+            /* key_    */ { nullptr, 0 },
+            /* hash_   */ ngx::casper::broker::hsm::PoolVector<ngx::casper::broker::hsm::Parser::View>(allocator),
+            /* merkle_ */ false,
+            /* chain_  */ false
+        };
+        const ngx::casper::broker::hsm::PoolVector<ngx::casper::broker::hsm::Parser::View>& hash = request.hash_;
+        bool                                                                         merkle = false;
+        bool                                                                         chain  = false;
+        ngx::casper::broker::hsm::PoolVector<ngx::casper::broker::hsm::Binary::Item> items(allocator);
         try {
             
-            const ::cc::easy::JSON<::cc::Exception> json;
-            Json::Value                             request;
+            if ( true == binary ) {
+                // ... raw data, no DOM, no base64 ...
+                ngx::casper::broker::hsm::Binary::Decode(ctx_.request_.body_, key, items);
+            } else if ( true == ngx::casper::broker::hsm::Parser::Parse(ctx_.request_.body_.c_str(), ctx_.request_.body_.length(), request) ) {
+                // ... common case, no DOM, 'hash' are views into body ...
+                key.assign(request.key_.data_, request.key_.length_);
+                merkle = request.merkle_;
+                chain  = request.chain_;
+            } else {
+                // ... outside parser subset, full DOM - which will also report errors ...
+                const ::cc::easy::JSON<::cc::Exception> json;
             
-            json.Parse(ctx_.request_.body_, request);
+                json.Parse(ctx_.request_.body_, dom);
             
-            key  = json.Get(request, "key" , Json::ValueType::stringValue, /* a_default */ nullptr).asString();
+                key  = json.Get(dom, "key" , Json::ValueType::stringValue, /* a_default */ nullptr).asString();
 
-            const Json::Value& hash_ref = json.Get(request, "hash", { Json::ValueType::stringValue, Json::ValueType::arrayValue }, &Json::Value::null);
-            if ( true == hash_ref.isString() ) {
-                hash = Json::Value(Json::ValueType::arrayValue);
-                hash.append(hash_ref);
-            } else {
-                hash = hash_ref;
+                // ... 'hash' are views into DOM strings, so it must outlive them ...
+                const Json::Value& hash_ref = json.Get(dom, "hash", { Json::ValueType::stringValue, Json::ValueType::arrayValue }, &Json::Value::null);
+                request.hash_.clear();
+                if ( true == hash_ref.isString() ) {
+                    const char* const b64 = hash_ref.asCString();
+                    request.hash_.push_back({ b64, strlen(b64) });
+                } else {
+                    request.hash_.reserve(hash_ref.size());
+                    for ( Json::ArrayIndex idx = 0 ; idx < hash_ref.size() ; ++idx ) {
+                        if ( false == hash_ref[idx].isString() ) {
+                            throw ::cc::Exception("Invalid hash #%u: %s!", static_cast<unsigned>(idx), "expecting a string");
+                        }
+                        const char* const b64 = hash_ref[idx].asCString();
+                        request.hash_.push_back({ b64, strlen(b64) });
+                    }
+                }
+                
+                const Json::Value false_default = Json::Value(false);
+                merkle = json.Get(dom, "merkle", Json::ValueType::booleanValue, &false_default).asBool();
+                chain  = json.Get(dom, "chain" , Json::ValueType::booleanValue, &false_default).asBool();
+            }
+            if ( true == merkle && 0 == hash.size() ) {
+                throw ::cc::Exception("Invalid hash: %s!", "at least one is required to build a merkle tree");
             }
-                        
+            
         } catch (const ::cc::Exception& a_cc_exception) {
             NGX_BROKER_MODULE_SET_BAD_REQUEST_EXCEPTION(ctx_, a_cc_exception);
         }
         
-        // ... continue?
+        // ... request shape only, no payload ...
+        if ( NGX_OK == ctx_.response_.return_code_ ) {
+            ::casper::hsm::Singleton::GetInstance().Observe(key, ( true == binary ? items.size() : hash.size() ), ctx_.request_.body_.length(),
+                                                            ( true == binary ? ::casper::hsm::Tracer::ContentType::Binary : ::casper::hsm::Tracer::ContentType::JSON ),
+                                                            static_cast<uint8_t>(
+                                                              ( true == merkle ? ::casper::hsm::Tracer::Flags::Merkle : 0 )
+                                                              |
+                                                              ( true == chain ? ::casper::hsm::Tracer::Flags::Chain : 0 )
+                                                              |
+                                                              ( true == Accepts(ngx_request_, NGX_CASPER_BROKER_HSM_MODULE_NDJSON_CONTENT_TYPE) ? ::casper::hsm::Tracer::Flags::Stream : 0 )
+                                                            )
+            );
+        }
+        
+        // ... merkle mode: one HSM operation, whatever the batch size ...
+        const size_t count  = ( true == merkle ? 1 : ( true == binary ? items.size() : hash.size() ) );
+        const bool   stream = ( false == binary && false == merkle && false == chain && true == Accepts(ngx_request_, NGX_CASPER_BROKER_HSM_MODULE_NDJSON_CONTENT_TYPE) );
+        
+        // ... interactive or bulk?
         if ( NGX_OK == ctx_.response_.return_code_ ) {
-            std::string signature;
+            Classify(count);
+        }
+        
+        // ... fail fast, before any HSM work ...
+        if ( NGX_OK == ctx_.response_.return_code_ && false == stream && ::casper::hsm::Limiter::Class::Bulk == class_ && bulk_max_batch_ > 0 && count > bulk_max_batch_ ) {
+            // ... opt-in: signing is synchronous, a huge batch would block all interactive requests of this worker - streamed ones yield ...
+            Fail(NGX_HTTP_REQUEST_ENTITY_TOO_LARGE, "Bulk batch is too large, please split it or request a streamed response.");
+        } else if ( NGX_OK == ctx_.response_.return_code_ && false == Throttle(key, count) ) {
+            // ... 'key' or tenant rate exceeded, already rejected ...
+        } else if ( NGX_OK == ctx_.response_.return_code_ && false == backend_.Available() ) {
+            // ... HSM link is down, don't wait for it's timeouts ...
+            Reject(NGX_HTTP_SERVICE_UNAVAILABLE, "HSM is unavailable, please retry later.",
+                   static_cast<time_t>(backend_.retry_after()));
+        } else if ( NGX_OK == ctx_.response_.return_code_ && false == Admit() ) {
+            // ... too many outstanding HSM operations ...
+            Reject(NGX_HTTP_SERVICE_UNAVAILABLE, "HSM is overloaded, please retry later.", retry_after_);
+        } else if ( NGX_OK == ctx_.response_.return_code_ && true == stream ) {
+            // ... signing will be performed while sending response, at content phase ...
+            stream_.pending_ = true;
+            stream_.key_     = key;
+            stream_.hash_.assign(hash.begin(), hash.end());
+            stream_.dom_.swap(dom);
+            ctx_.response_.status_code_ = NGX_HTTP_OK;
+        } else if ( NGX_OK == ctx_.response_.return_code_ ) {
             // ... use HSM to sign hash ...
             if ( false == use_singleton_ ) {
-                ::casper::hsm::Singleton::GetInstance().Recycle();
+                backend_.Recycle();
             }
-            // ... prepare response ...
-            Json::Value response = Json::Value(Json::ValueType::objectValue);
-            response["signatures"] = Json::Value(Json::ValueType::arrayValue);
-            // ... sign ...
-            for ( Json::ArrayIndex idx = 0 ; idx < hash.size() ; ++idx ) {
-                ::casper::hsm::Singleton::GetInstance().Sign(key, hash[idx].asString(), signature);
-                response["signatures"].append(Json::Value(signature));
+            backend_.ResetMetrics();
+            signing = true;
+            // ... binary?
+            // ... response is written directly to request pool buffers ...
+            ngx::casper::broker::hsm::Writer writer(ngx_request_->pool, NGX_CASPER_BROKER_HSM_MODULE_WRITER_CHUNK_SIZE);
+            std::vector<unsigned char>                          bytes;
+            ngx::casper::broker::hsm::PoolVector<unsigned char> digests(allocator);
+            // ... one allocation, reused by all signatures ...
+            bytes.reserve(NGX_CASPER_BROKER_HSM_MODULE_SIGNATURE_RESERVE);
+            if ( true == binary ) {
+                // ... all digests at once, before reaching HSM ...
+                ngx::casper::broker::hsm::PoolVector<::casper::hsm::BatchSHA256::Job> jobs(items.size(), ::casper::hsm::BatchSHA256::Job(), allocator);
+                digests.resize(items.size() * CASPER_HSM_BATCH_SHA256_DIGEST_LEN);
+                for ( size_t idx = 0 ; idx < items.size() ; ++idx ) {
+                    jobs[idx] = { items[idx].data_, items[idx].length_, digests.data() + idx * CASPER_HSM_BATCH_SHA256_DIGEST_LEN };
+                }
+                ::casper::hsm::BatchSHA256::Run(jobs.data(), jobs.size());
+                // ... prepare response ...
+                ngx::casper::broker::hsm::Binary::Begin(items.size(), writer);
+                // ... sign ...
+                for ( auto& job : jobs ) {
+                    const auto start = std::chrono::steady_clock::now();
+                    SignDigest(key, job.digest_, bytes);
+                    wait_us += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+                    sign_count++;
+                    ngx::casper::broker::hsm::Binary::Append(bytes, writer);
+                }
+                // ... done ...
+                SetDirectResponse(NGX_HTTP_OK, ngx::casper::broker::hsm::Binary::sk_content_type_, writer);
+            } else if ( true == merkle ) {
+                ngx::casper::broker::hsm::PoolVector<unsigned char> data(allocator);
+                ::casper::hsm::Merkle                               tree;
+                ::casper::hsm::Merkle::Proof                        proof;
+                // ... leaves ...
+                for ( const auto& b64 : hash ) {
+                    const size_t mds = ::cc::base64_rfc4648::decoded_max_size(b64.length_);
+                    data.resize(mds);
+                    data.resize(::cc::base64_rfc4648::decode(data.data(), mds, b64.data_, b64.length_));
+                    tree.Add(data.data(), data.size());
+                }
+                tree.Build();
+                // ... sign root only ...
+                const ::casper::hsm::Merkle::Hash& root = tree.root();
+                const auto start = std::chrono::steady_clock::now();
+                Sign(key, root.bytes_, sizeof(root.bytes_), bytes);
+                wait_us += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+                sign_count++;
+                // ... serialize root, signature and one inclusion proof per hash ...
+                writer.Append("{\"root\":\"");
+                writer.AppendBase64(root.bytes_, sizeof(root.bytes_));
+                writer.Append("\",\"signature\":\"");
+                writer.AppendBase64(bytes.data(), bytes.size());
+                writer.Append("\",\"proofs\":[");
+                for ( size_t idx = 0 ; idx < hash.size() ; ++idx ) {
+                    tree.Prove(idx, proof);
+                    writer.Append(0 == idx ? "[" : ",[");
+                    for ( size_t step = 0 ; step < proof.size() ; ++step ) {
+                        if ( step > 0 ) {
+                            writer.Append(',');
+                        }
+                        writer.Append(true == proof[step].left_ ? "{\"left\":\"" : "{\"right\":\"");
+                        writer.AppendBase64(proof[step].hash_.bytes_, sizeof(proof[step].hash_.bytes_));
+                        writer.Append("\"}");
+                    }
+                    writer.Append(']');
+                }
+                writer.Append(']');
+                // ... pre-serialized, just copied ...
+                if ( true == chain ) {
+                    writer.Append(",\"chain\":");
+                    writer.Append(backend_.Chain(key));
+                }
+                writer.Append('}');
+                // ... done ...
+                SetDirectResponse(NGX_HTTP_OK, ctx_.response_.content_type_, writer);
+            } else {
+                // ... all digests at once, before reaching HSM ...
+                digests.resize(hash.size() * CASPER_HSM_BATCH_SHA256_DIGEST_LEN);
+                Digest(hash.data(), hash.size(), digests.data());
+                // ... prepare response ...
+                writer.Append("{\"signatures\":[");
+                // ... sign ...
+                for ( size_t idx = 0 ; idx < hash.size() ; ++idx ) {
+                    const auto start = std::chrono::steady_clock::now();
+                    SignDigest(key, digests.data() + idx * CASPER_HSM_BATCH_SHA256_DIGEST_LEN, bytes);
+                    wait_us += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+                    sign_count++;
+                    // ... and serialize it ...
+                    if ( idx > 0 ) {
+                        writer.Append(',');
+                    }
+                    writer.Append('"');
+                    writer.AppendBase64(bytes.data(), bytes.size());
+                    writer.Append('"');
+                }
+                writer.Append(']');
+                // ... pre-serialized, just copied ...
+                if ( true == chain ) {
+                    writer.Append(",\"chain\":");
+                    writer.Append(backend_.Chain(key));
+                }
+                writer.Append('}');
+                // ... done ...
+                SetDirectResponse(NGX_HTTP_OK, ctx_.response_.content_type_, writer);
             }
-            // ... serialize response ...
-            Json::FastWriter fw; fw.omitEndingLineFeed();
-            // ... done ...
-            NGX_BROKER_MODULE_SET_RESPONSE(ctx_, NGX_HTTP_OK, ctx_.response_.content_type_, fw.write(response));
         }
     } catch (const ::cc::Exception& a_cc_exception) {
         // ... cleanup ...
@@ -177,10 +452,477 @@ ngx_int_t ngx::casper::broker::hsm::Module::Run ()
         }
     }
 
+    // ... expose timings to 'log_format' and adjust concurrency limit ...
+    if ( true == signing ) {
+        Dismiss(sign_count, wait_us, NGX_HTTP_INTERNAL_SERVER_ERROR == ctx_.response_.status_code_);
+        SetVariables(sign_count, wait_us);
+    }
+
     // ... no error, just should be scheduled ...
     return ctx_.response_.return_code_;
 }
 
+/**
+ * @brief Verify signatures locally, using loaded certificates public keys - HSM is not involved.
+ *
+ * Request:
+ *
+ *   Content-Type: application/json
+ *   Method      : POST
+ *    Body       : { "items": [{ "key": <string>, "digest": <string>, "signature": <string> }] } - digest is a base64 SHA256
+ *
+ * Response:
+ *
+ *      400: Bad Request - when missing or invalid body
+ *      200: Ok          - { "results": [<boolean>] }, one per item, in request order
+ *
+ * @return NGX_OK or NGX_ERROR.
+ */
+ngx_int_t ngx::casper::broker::hsm::Module::Verify ()
+{
+    // ... starts as a bad request ...
+    ctx_.response_.status_code_ = NGX_HTTP_BAD_REQUEST;
+    ctx_.response_.return_code_ = NGX_OK;
+    
+    try {
+        
+        std::vector<::casper::hsm::Verifier::Item> items;
+        try {
+            const ::cc::easy::JSON<::cc::Exception> json;
+            Json::Value                             request;
+            
+            json.Parse(ctx_.request_.body_, request);
+            
+            const Json::Value& array = json.Get(request, "items", Json::ValueType::arrayValue, /* a_default */ nullptr);
+            items.resize(static_cast<size_t>(array.size()));
+            for ( Json::ArrayIndex idx = 0 ; idx < array.size() ; ++idx ) {
+                const Json::Value& item = array[idx];
+                if ( false == item.isObject() ) {
+                    throw ::cc::Exception("Invalid item #%u: %s!", static_cast<unsigned>(idx), "expecting an object");
+                }
+                items[idx].key_   = json.Get(item, "key", Json::ValueType::stringValue, /* a_default */ nullptr).asString();
+                items[idx].valid_ = false;
+                // ... decode 'digest' and 'signature' from base64 ...
+                const char* const fields[2]  = { "digest", "signature" };
+                std::vector<unsigned char>* const outputs[2] = { &items[idx].digest_, &items[idx].signature_ };
+                for ( size_t field = 0 ; field < 2 ; ++field ) {
+                    const char* const b64 = json.Get(item, fields[field], Json::ValueType::stringValue, /* a_default */ nullptr).asCString();
+                    const size_t      len = strlen(b64);
+                    const size_t      mds = ::cc::base64_rfc4648::decoded_max_size(len);
+                    outputs[field]->resize(mds);
+                    outputs[field]->resize(::cc::base64_rfc4648::decode(outputs[field]->data(), mds, b64, len));
+                }
+            }
+        } catch (const ::cc::Exception& a_cc_exception) {
+            NGX_BROKER_MODULE_SET_BAD_REQUEST_EXCEPTION(ctx_, a_cc_exception);
+        }
+        
+        if ( NGX_OK == ctx_.response_.return_code_ ) {
+            // ... request shape only, keys might differ per item - first one is recorded ...
+            ::casper::hsm::Singleton::GetInstance().Observe(( 0 == items.size() ? std::string() : items[0].key_ ), items.size(), ctx_.request_.body_.length(),
+                                                            ::casper::hsm::Tracer::ContentType::JSON, ::casper::hsm::Tracer::Flags::Verify);
+            // ... verify ...
+            backend_.Verify(items);
+            // ... response is written directly to request pool buffers ...
+            ngx::casper::broker::hsm::Writer writer(ngx_request_->pool, NGX_CASPER_BROKER_HSM_MODULE_WRITER_CHUNK_SIZE);
+            writer.Append("{\"results\":[");
+            for ( size_t idx = 0 ; idx < items.size() ; ++idx ) {
+                if ( idx > 0 ) {
+                    writer.Append(',');
+                }
+                writer.Append(true == items[idx].valid_ ? "true" : "false");
+            }
+            writer.Append("]}");
+            // ... done ...
+            SetDirectResponse(NGX_HTTP_OK, ctx_.response_.content_type_, writer);
+        }
+        
+    } catch (const ::cc::Exception& a_cc_exception) {
+        NGX_BROKER_MODULE_SET_INTERNAL_SERVER_ERROR(ctx_, a_cc_exception.what());
+    } catch (...) {
+        try {
+            ::cc::Exception::Rethrow(/* a_unhandled */ false, __FILE__, __LINE__, __FUNCTION__);
+        } catch (const ::cc::Exception& a_cc_exception) {
+            NGX_BROKER_MODULE_SET_INTERNAL_SERVER_ERROR(ctx_, a_cc_exception.what());
+        }
+    }
+    
+    return ctx_.response_.return_code_;
+}
+
+/**
+ * @brief Sign a content digest and assemble a detached CMS ( PKCS #7 ) SignedData, certificate chain included.
+ *
+ * Signed attributes - content type, signing time, message digest and ESS signing certificate v2 - are built here and
+ * signed with a single HSM operation, see \link ::casper::hsm::CMS \link.
+ *
+ * Request:
+ *
+ *   Content-Type: application/json
+ *   Method      : POST
+ *    Body       : { "key": <string>, "digest": <string>, "signing_time": <boolean> } - digest is a base64 SHA256 of content,
+ *                                                                                      signing time is optional ( default true )
+ *
+ * Response:
+ *
+ *      400: Bad Request         - when missing or invalid body
+ *      404: Not Found           - when there is no certificate available for 'key'
+ *      429: Too Many Requests   - when 'key' or tenant rate is exceeded, with 'Retry-After' header
+ *      503: Service Unavailable - when HSM is overloaded or unreachable ( circuit is open ), with 'Retry-After' header
+ *      200: Ok                  - { "cms": <string> } - base64 DER ContentInfo
+ *                               - Accept: application/pkcs7-signature, DER ContentInfo
+ *
+ * @return NGX_OK or NGX_ERROR.
+ */
+ngx_int_t ngx::casper::broker::hsm::Module::SignedData ()
+{
+    // ... starts as a bad request ...
+    ctx_.response_.status_code_ = NGX_HTTP_BAD_REQUEST;
+    ctx_.response_.return_code_ = NGX_OK;
+    
+    size_t   sign_count = 0;
+    uint64_t wait_us    = 0;
+    bool     signing    = false;
+    
+    try {
+        
+        std::string                key;
+        std::vector<unsigned char> digest;
+        bool                       signing_time = true;
+        try {
+            const ::cc::easy::JSON<::cc::Exception> json;
+            Json::Value                             request;
+            
+            json.Parse(ctx_.request_.body_, request);
+            
+            key = json.Get(request, "key", Json::ValueType::stringValue, /* a_default */ nullptr).asString();
+            // ... decode 'digest' from base64 ...
+            const char* const b64 = json.Get(request, "digest", Json::ValueType::stringValue, /* a_default */ nullptr).asCString();
+            const size_t      len = strlen(b64);
+            const size_t      mds = ::cc::base64_rfc4648::decoded_max_size(len);
+            digest.resize(mds);
+            digest.resize(::cc::base64_rfc4648::decode(digest.data(), mds, b64, len));
+            if ( CASPER_HSM_API_SHA256_LEN != digest.size() ) {
+                throw ::cc::Exception("Invalid digest: %s!", "expecting a base64 SHA256");
+            }
+            
+            const Json::Value true_default = Json::Value(true);
+            signing_time = json.Get(request, "signing_time", Json::ValueType::booleanValue, &true_default).asBool();
+        } catch (const ::cc::Exception& a_cc_exception) {
+            NGX_BROKER_MODULE_SET_BAD_REQUEST_EXCEPTION(ctx_, a_cc_exception);
+        }
+        
+        // ... request shape only, no payload ...
+        if ( NGX_OK == ctx_.response_.return_code_ ) {
+            ::casper::hsm::Singleton::GetInstance().Observe(key, 1, ctx_.request_.body_.length(),
+                                                            ::casper::hsm::Tracer::ContentType::JSON, ::casper::hsm::Tracer::Flags::CMS);
+            Classify(1);
+        }
+        
+        // ... fail fast, before any HSM work ...
+        if ( NGX_OK == ctx_.response_.return_code_ && false == backend_.cms().Knows(key) ) {
+            ngx::casper::broker::hsm::Writer writer(ngx_request_->pool, 128);
+            writer.Append("{\"error\":\"No certificate available for the provided key.\"}");
+            SetDirectResponse(NGX_HTTP_NOT_FOUND, "application/json", writer);
+        } else if ( NGX_OK == ctx_.response_.return_code_ && false == Throttle(key, 1) ) {
+            // ... 'key' or tenant rate exceeded, already rejected ...
+        } else if ( NGX_OK == ctx_.response_.return_code_ && false == backend_.Available() ) {
+            // ... HSM link is down, don't wait for it's timeouts ...
+            Reject(NGX_HTTP_SERVICE_UNAVAILABLE, "HSM is unavailable, please retry later.",
+                   static_cast<time_t>(backend_.retry_after()));
+        } else if ( NGX_OK == ctx_.response_.return_code_ && false == Admit() ) {
+            // ... too many outstanding HSM operations ...
+            Reject(NGX_HTTP_SERVICE_UNAVAILABLE, "HSM is overloaded, please retry later.", retry_after_);
+        } else if ( NGX_OK == ctx_.response_.return_code_ ) {
+            if ( false == use_singleton_ ) {
+                backend_.Recycle();
+            }
+            backend_.ResetMetrics();
+            signing = true;
+            // ... signed attributes are the value actually signed ...
+            const ::casper::hsm::CMS&  cms = backend_.cms();
+            std::vector<unsigned char> attributes;
+            std::vector<unsigned char> signature;
+            std::vector<unsigned char> der;
+            cms.Attributes(key, digest.data(), ( true == signing_time ? time(nullptr) : 0 ), attributes);
+            // ... sign ...
+            const auto start = std::chrono::steady_clock::now();
+            Sign(key, attributes.data(), attributes.size(), signature);
+            wait_us += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+            sign_count++;
+            // ... assemble ...
+            cms.SignedData(key, attributes, signature, der);
+            // ... response is written directly to request pool buffers ...
+            ngx::casper::broker::hsm::Writer writer(ngx_request_->pool, NGX_CASPER_BROKER_HSM_MODULE_WRITER_CHUNK_SIZE);
+            if ( true == Accepts(ngx_request_, NGX_CASPER_BROKER_HSM_MODULE_CMS_CONTENT_TYPE) ) {
+                writer.Append(reinterpret_cast<const char*>(der.data()), der.size());
+                SetDirectResponse(NGX_HTTP_OK, NGX_CASPER_BROKER_HSM_MODULE_CMS_CONTENT_TYPE, writer);
+            } else {
+                writer.Append("{\"cms\":\"");
+                writer.AppendBase64(der.data(), der.size());
+                writer.Append("\"}");
+                SetDirectResponse(NGX_HTTP_OK, ctx_.response_.content_type_, writer);
+            }
+        }
+        
+    } catch (const ::cc::Exception& a_cc_exception) {
+        NGX_BROKER_MODULE_SET_INTERNAL_SERVER_ERROR(ctx_, a_cc_exception.what());
+    } catch (...) {
+        try {
+            ::cc::Exception::Rethrow(/* a_unhandled */ false, __FILE__, __LINE__, __FUNCTION__);
+        } catch (const ::cc::Exception& a_cc_exception) {
+            NGX_BROKER_MODULE_SET_INTERNAL_SERVER_ERROR(ctx_, a_cc_exception.what());
+        }
+    }
+    
+    // ... expose timings to 'log_format' and adjust concurrency limit ...
+    if ( true == signing ) {
+        Dismiss(sign_count, wait_us, NGX_HTTP_INTERNAL_SERVER_ERROR == ctx_.response_.status_code_);
+        SetVariables(sign_count, wait_us);
+    }
+    
+    return ctx_.response_.return_code_;
+}
+
+/**
+ * @brief Keep track of a response that was written directly to nginx buffers, it will be sent at content phase.
+ *
+ * @param a_status_code  HTTP status code.
+ * @param a_content_type Content-Type header value.
+ * @param a_writer       Writer used to produce the response body.
+ */
+void ngx::casper::broker::hsm::Module::SetDirectResponse (const ngx_int_t a_status_code, const std::string& a_content_type, ngx::casper::broker::hsm::Writer& a_writer)
+{
+    direct_response_.status_code_  = a_status_code;
+    direct_response_.content_type_ = a_content_type;
+    direct_response_.length_       = a_writer.length();
+    direct_response_.chain_        = a_writer.Finish();
+    // ... broker response is no longer an error ...
+    ctx_.response_.status_code_    = a_status_code;
+    ctx_.response_.return_code_    = NGX_OK;
+}
+
+/**
+ * @brief Set this request priority class, from directive, 'X-Casper-HSM-Priority' header or batch size.
+ *
+ * @param a_count Number of hashes to sign.
+ */
+void ngx::casper::broker::hsm::Module::Classify (const size_t a_count)
+{
+    switch (priority_) {
+        case NGX_HTTP_CASPER_BROKER_HSM_PRIORITY_INTERACTIVE:
+            class_ = ::casper::hsm::Limiter::Class::Interactive;
+            break;
+        case NGX_HTTP_CASPER_BROKER_HSM_PRIORITY_BULK:
+            class_ = ::casper::hsm::Limiter::Class::Bulk;
+            break;
+        default:
+            if ( true == HeaderEquals(ngx_request_, "X-Casper-HSM-Priority", "bulk") ) {
+                class_ = ::casper::hsm::Limiter::Class::Bulk;
+            } else if ( true == HeaderEquals(ngx_request_, "X-Casper-HSM-Priority", "interactive") ) {
+                class_ = ::casper::hsm::Limiter::Class::Interactive;
+            } else {
+                class_ = ( a_count > bulk_threshold_ ? ::casper::hsm::Limiter::Class::Bulk : ::casper::hsm::Limiter::Class::Interactive );
+            }
+            break;
+    }
+    ngx_http_casper_broker_hsm_module_set_variable(ngx_request_, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_PRIORITY,
+                                                   ( ::casper::hsm::Limiter::Class::Bulk == class_ ? "bulk" : "interactive" ));
+}
+
+/**
+ * @brief Take tokens from this request 'key' and tenant buckets, weighted by batch size.
+ *
+ * @param a_key   Signing key.
+ * @param a_count Number of hashes to sign.
+ *
+ * @return True if request can proceed, false if it was rejected.
+ */
+bool ngx::casper::broker::hsm::Module::Throttle (const std::string& a_key, const size_t a_count)
+{
+    if ( nullptr == rate_limiter_ ) {
+        return true;
+    }
+    std::vector<ngx::casper::broker::hsm::RateLimiter::Bucket> buckets;
+    if ( key_rate_.rate > 0 ) {
+        buckets.push_back({ "k:" + a_key, static_cast<uint64_t>(key_rate_.rate), static_cast<uint64_t>(key_rate_.burst) });
+    }
+    ngx_str_t tenant = ngx_null_string;
+    if ( tenant_rate_.rate > 0 && nullptr != tenant_ && NGX_OK == ngx_http_complex_value(ngx_request_, tenant_, &tenant) && tenant.len > 0 ) {
+        buckets.push_back({ "t:" + std::string(reinterpret_cast<const char*>(tenant.data), tenant.len), static_cast<uint64_t>(tenant_rate_.rate), static_cast<uint64_t>(tenant_rate_.burst) });
+    }
+    time_t retry_after = 0;
+    if ( true == rate_limiter_->Take(buckets, static_cast<uint64_t>(a_count), retry_after) ) {
+        return true;
+    }
+    Reject(NGX_HTTP_TOO_MANY_REQUESTS, "Rate limit exceeded, please retry later.", retry_after);
+    return false;
+}
+
+/**
+ * @brief Sign data and record it in audit log ( if enabled ).
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_data      Data to be signed.
+ * @param a_length    Data length, in bytes.
+ * @param o_signature Signature bytes.
+ */
+void ngx::casper::broker::hsm::Module::Sign (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature)
+{
+    // ... no exceptions on the way, error text is only produced here ...
+    const ::casper::hsm::API::Status status    = backend_.TrySign(a_key, a_data, a_length, o_signature);
+    const bool                       succeeded = ::casper::hsm::API::Succeeded(status);
+    ::casper::hsm::Singleton::GetInstance().Audit(a_key, a_data, a_length, Requester(), succeeded);
+    if ( false == succeeded ) {
+        throw ::cc::Exception("%s", ::casper::hsm::API::Describe(status).c_str());
+    }
+}
+
+/**
+ * @brief Sign a precomputed SHA256 digest and record it in audit log ( if enabled ).
+ *
+ * @param a_key       HSM private key token label.
+ * @param a_digest    SHA256 of data to be signed, CASPER_HSM_API_SHA256_LEN bytes.
+ * @param o_signature Signature bytes.
+ */
+void ngx::casper::broker::hsm::Module::SignDigest (const std::string& a_key, const unsigned char* a_digest, std::vector<unsigned char>& o_signature)
+{
+    // ... no exceptions on the way, error text is only produced here ...
+    const ::casper::hsm::API::Status status    = backend_.TrySignDigest(a_key, a_digest, o_signature);
+    const bool                       succeeded = ::casper::hsm::API::Succeeded(status);
+    ::casper::hsm::Singleton::GetInstance().AuditDigest(a_key, a_digest, Requester(), succeeded);
+    if ( false == succeeded ) {
+        throw ::cc::Exception("%s", ::casper::hsm::API::Describe(status).c_str());
+    }
+}
+
+/**
+ * @brief Decode base64 'hash' and calculate all SHA256 digests at once.
+ *
+ * @param a_hash    Base64 encoded data.
+ * @param a_count   Number of \link a_hash \link entries.
+ * @param o_digests Where to write digests, CASPER_HSM_BATCH_SHA256_DIGEST_LEN bytes per entry, back to back.
+ */
+void ngx::casper::broker::hsm::Module::Digest (const ngx::casper::broker::hsm::Parser::View* a_hash, const size_t a_count, unsigned char* o_digests)
+{
+    const ngx::casper::broker::hsm::PoolAllocator<unsigned char>          allocator(ngx_request_->pool);
+    ngx::casper::broker::hsm::PoolVector<unsigned char>                   data(allocator);
+    ngx::casper::broker::hsm::PoolVector<size_t>                          offsets(a_count + 1, 0, allocator);
+    ngx::casper::broker::hsm::PoolVector<::casper::hsm::BatchSHA256::Job> jobs(a_count, ::casper::hsm::BatchSHA256::Job(), allocator);
+    // ... decode all from base64, back to back ...
+    for ( size_t idx = 0 ; idx < a_count ; ++idx ) {
+        const size_t mds = ::cc::base64_rfc4648::decoded_max_size(a_hash[idx].length_);
+        data.resize(offsets[idx] + mds);
+        offsets[idx + 1] = offsets[idx] + ::cc::base64_rfc4648::decode(data.data() + offsets[idx], mds, a_hash[idx].data_, a_hash[idx].length_);
+    }
+    // ... pointers are only taken after last resize ...
+    for ( size_t idx = 0 ; idx < a_count ; ++idx ) {
+        jobs[idx] = { data.data() + offsets[idx], offsets[idx + 1] - offsets[idx], o_digests + idx * CASPER_HSM_BATCH_SHA256_DIGEST_LEN };
+    }
+    ::casper::hsm::BatchSHA256::Run(jobs.data(), jobs.size());
+}
+
+/**
+ * @return Requester identification: tenant ( if configured ) or client address.
+ */
+const std::string& ngx::casper::broker::hsm::Module::Requester ()
+{
+    if ( 0 == requester_.length() ) {
+        ngx_str_t tenant = ngx_null_string;
+        if ( nullptr != tenant_ && NGX_OK == ngx_http_complex_value(ngx_request_, tenant_, &tenant) && tenant.len > 0 ) {
+            requester_ = std::string(reinterpret_cast<const char*>(tenant.data), tenant.len);
+        } else {
+            requester_ = std::string(reinterpret_cast<const char*>(ngx_request_->connection->addr_text.data), ngx_request_->connection->addr_text.len);
+        }
+    }
+    return requester_;
+}
+
+/**
+ * @brief Try to start HSM work for this request.
+ *
+ * @return True if request can proceed, false if it should be rejected.
+ */
+bool ngx::casper::broker::hsm::Module::Admit ()
+{
+    if ( nullptr == limiter_ ) {
+        return true;
+    }
+    admitted_ = limiter_->TryAcquire(class_);
+    return admitted_;
+}
+
+/**
+ * @brief Report the outcome of HSM work for this request, so concurrency limit can be adjusted.
+ *
+ * @param a_count   Number of signatures performed.
+ * @param a_wait_us Time spent waiting for HSM, in microseconds.
+ * @param a_failed  True if HSM work failed.
+ */
+void ngx::casper::broker::hsm::Module::Dismiss (const size_t a_count, const uint64_t a_wait_us, const bool a_failed)
+{
+    if ( false == admitted_ ) {
+        return;
+    }
+    admitted_ = false;
+    // ... per signature latency, so batch size does not count as congestion ...
+    limiter_->Release(class_, ( a_count > 0 ? a_wait_us / a_count : 0 ), a_failed);
+}
+
+/**
+ * @brief Reject this request before any HSM work.
+ *
+ * @param a_status_code HTTP status code.
+ * @param a_message     Error message, must not require JSON escaping.
+ * @param a_retry_after 'Retry-After' header value, in seconds.
+ */
+void ngx::casper::broker::hsm::Module::Reject (const ngx_int_t a_status_code, const char* const a_message, const time_t a_retry_after)
+{
+    direct_response_.headers_["Retry-After"] = std::to_string(static_cast<long long>(a_retry_after));
+    Fail(a_status_code, a_message);
+}
+
+/**
+ * @brief Fail this request before any HSM work, retrying won't help.
+ *
+ * @param a_status_code HTTP status code.
+ * @param a_message     Error message, must not require JSON escaping.
+ */
+void ngx::casper::broker::hsm::Module::Fail (const ngx_int_t a_status_code, const char* const a_message)
+{
+    ngx::casper::broker::hsm::Writer writer(ngx_request_->pool, 128);
+    writer.Append("{\"error\":\"");
+    writer.Append(a_message);
+    writer.Append("\"}");
+    SetDirectResponse(a_status_code, "application/json", writer);
+}
+
+/**
+ * @brief Set this module per request variables, so they can be used at 'log_format'.
+ *
+ * @param a_count   Number of signatures performed.
+ * @param a_wait_us Time spent waiting for HSM, in microseconds.
+ */
+void ngx::casper::broker::hsm::Module::SetVariables (const size_t a_count, const uint64_t a_wait_us)
+{
+    const ::casper::hsm::API::Metrics& metrics = backend_.metrics();
+    
+    char buffer[32];
+    
+    snprintf(buffer, sizeof(buffer), "%zu", a_count);
+    ngx_http_casper_broker_hsm_module_set_variable(ngx_request_, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_SIGN_COUNT, buffer);
+    snprintf(buffer, sizeof(buffer), "%.3f", static_cast<double>(a_wait_us) / 1000.0);
+    ngx_http_casper_broker_hsm_module_set_variable(ngx_request_, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_WAIT_MS, buffer);
+    snprintf(buffer, sizeof(buffer), "%.3f", static_cast<double>(metrics.session_us_) / 1000.0);
+    ngx_http_casper_broker_hsm_module_set_variable(ngx_request_, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_SESSION_MS, buffer);
+    snprintf(buffer, sizeof(buffer), "%.3f", static_cast<double>(metrics.find_us_) / 1000.0);
+    ngx_http_casper_broker_hsm_module_set_variable(ngx_request_, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_FIND_MS, buffer);
+    ngx_http_casper_broker_hsm_module_set_variable(ngx_request_, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_CACHE_HIT,
+                                                   ( a_count > 0 && metrics.reused_ >= a_count ) ? "1" : "0");
+    snprintf(buffer, sizeof(buffer), "%lu", static_cast<unsigned long>(metrics.slot_));
+    ngx_http_casper_broker_hsm_module_set_variable(ngx_request_, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_SLOT, buffer);
+}
+
 // MARK: -
 
 /**
@@ -208,6 +950,18 @@ ngx_int_t ngx::casper::broker::hsm::Module::Factory (ngx_http_request_t* a_r, bo
         return NGX_ERROR;
     }
 
+    //
+    // 'PROFILE' BACKEND
+    //
+    ::casper::hsm::Backend* backend = ::casper::hsm::Singleton::GetInstance().Find(
+        std::string(reinterpret_cast<const char*>(loc_conf->profile.data), loc_conf->profile.len)
+    );
+    if ( nullptr == backend ) {
+        // ... validated at configuration time, so not started by this worker ...
+        ngx_log_error(NGX_LOG_ERR, a_r->connection->log, 0, "hsm_module: HSM profile \"%V\" is not registered", &loc_conf->profile);
+        return NGX_HTTP_SERVICE_UNAVAILABLE;
+    }
+
     //
     // 'WARM UP'
     //
@@ -219,7 +973,8 @@ ngx_int_t ngx::casper::broker::hsm::Module::Factory (ngx_http_request_t* a_r, bo
             "application/json", "application/json; charset=UTF-8",
             "application/vnd.api+json", "application/vnd.api+json;charset=utf-8'",
             "text/plain", "text/plain; charset=UTF-8",
-            "application/x-www-form-urlencoded"        
+            "application/x-www-form-urlencoded",
+            ngx::casper::broker::hsm::Binary::sk_content_type_
         }
     };
     
@@ -263,12 +1018,366 @@ ngx_int_t ngx::casper::broker::hsm::Module::Factory (ngx_http_request_t* a_r, bo
     };
     
     return ::ngx::casper::broker::Module::Initialize(config, params,
-                                                     [&config, &params, &broker_conf, &loc_conf] () -> ::ngx::casper::broker::Module* {
-                                                         return new ::ngx::casper::broker::hsm::Module(config, params, *broker_conf, *loc_conf);
+                                                     [&config, &params, &broker_conf, &loc_conf, backend] () -> ::ngx::casper::broker::Module* {
+                                                         return new ::ngx::casper::broker::hsm::Module(config, params, *broker_conf, *loc_conf, *backend);
                                                      }
     );
 }
 
+/**
+ * @brief Send a response previously written directly to nginx buffers ( if any ).
+ *
+ * @param a_r The http request.
+ *
+ * @return NGX_DECLINED if there's no such response, otherwise the nginx output filter result.
+ */
+ngx_int_t ngx::casper::broker::hsm::Module::ContentPhaseTackleDirectResponse (ngx_http_request_t* a_r)
+{
+    ngx::casper::broker::hsm::Module* module = Get(a_r);
+    if ( nullptr == module ) {
+        return NGX_DECLINED;
+    }
+    // ... streaming?
+    if ( true == module->stream_.pending_ ) {
+        return module->StartStream();
+    }
+    // ... written directly?
+    if ( nullptr == module->direct_response_.chain_ ) {
+        return NGX_DECLINED;
+    }
+    
+    const DirectResponse& response = module->direct_response_;
+    
+    // ... headers and content type must outlive module ...
+    for ( auto it : response.headers_ ) {
+        ngx_table_elt_t* header = (ngx_table_elt_t*)ngx_list_push(&a_r->headers_out.headers);
+        if ( NULL == header ) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+        header->key.data   = (u_char*)ngx_pnalloc(a_r->pool, it.first.length());
+        header->value.data = (u_char*)ngx_pnalloc(a_r->pool, it.second.length());
+        if ( NULL == header->key.data || NULL == header->value.data ) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+        header->hash      = 1;
+        header->key.len   = ngx_cpymem(header->key.data, it.first.c_str(), it.first.length()) - header->key.data;
+        header->value.len = ngx_cpymem(header->value.data, it.second.c_str(), it.second.length()) - header->value.data;
+    }
+
+    u_char* content_type = (u_char*)ngx_pnalloc(a_r->pool, response.content_type_.length());
+    if ( NULL == content_type ) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    ngx_memcpy(content_type, response.content_type_.c_str(), response.content_type_.length());
+    
+    a_r->headers_out.status            = static_cast<ngx_uint_t>(response.status_code_);
+    a_r->headers_out.content_length_n  = static_cast<off_t>(response.length_);
+    a_r->headers_out.content_type.data = content_type;
+    a_r->headers_out.content_type.len  = response.content_type_.length();
+    a_r->headers_out.content_type_len  = response.content_type_.length();
+    
+    const ngx_int_t rc = ngx_http_send_header(a_r);
+    if ( NGX_ERROR == rc || rc > NGX_OK || 1 == a_r->header_only ) {
+        return rc;
+    }
+    
+    return ngx_http_output_filter(a_r, response.chain_);
+}
+
+// MARK: - Streaming
+
+/**
+ * @brief Send streaming response headers and start signing.
+ *
+ * @return NGX_DONE when streaming started, request will be finalized when it ends, otherwise an error.
+ */
+ngx_int_t ngx::casper::broker::hsm::Module::StartStream ()
+{
+    stream_.pending_ = false;
+    
+    // ... prepare HSM ...
+    try {
+        if ( false == use_singleton_ ) {
+            backend_.Recycle();
+        }
+        backend_.ResetMetrics();
+        // ... same as non-streamed responses, all digests at once ...
+        stream_.digests_.resize(stream_.hash_.size() * CASPER_HSM_BATCH_SHA256_DIGEST_LEN);
+        Digest(stream_.hash_.data(), stream_.hash_.size(), stream_.digests_.data());
+    } catch (...) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    
+    // ... no content length, chunked transfer encoding ...
+    ngx_request_->headers_out.status           = NGX_HTTP_OK;
+    ngx_request_->headers_out.content_length_n = -1;
+    ngx_str_set(&ngx_request_->headers_out.content_type, NGX_CASPER_BROKER_HSM_MODULE_NDJSON_CONTENT_TYPE);
+    ngx_request_->headers_out.content_type_len = ngx_request_->headers_out.content_type.len;
+    
+    const ngx_int_t rc = ngx_http_send_header(ngx_request_);
+    if ( NGX_ERROR == rc || rc > NGX_OK || 1 == ngx_request_->header_only ) {
+        return rc;
+    }
+    
+    // ... keep request alive until stream ends ...
+    ngx_request_->main->count++;
+    
+    ContinueStream();
+    
+    return NGX_DONE;
+}
+
+/**
+ * @brief Sign and send one line at a time, while nginx is able to write it.
+ */
+void ngx::casper::broker::hsm::Module::ContinueStream ()
+{
+    ngx_buf_tag_t tag = (ngx_buf_tag_t) &ngx_http_casper_broker_hsm_module;
+    
+    for ( ;; ) {
+        // ... still sending previous line(s)?
+        if ( nullptr != stream_.busy_ ) {
+            ngx_event_t* wev = ngx_request_->connection->write;
+            ngx_request_->write_event_handler = StreamWriteEventHandler;
+            if ( 0 == wev->timer_set ) {
+                ngx_http_core_loc_conf_t* clcf = (ngx_http_core_loc_conf_t*)ngx_http_get_module_loc_conf(ngx_request_, ngx_http_core_module);
+                ngx_add_timer(wev, clcf->send_timeout);
+            }
+            if ( NGX_OK != ngx_handle_write_event(wev, 0) ) {
+                FinishStream(NGX_ERROR);
+            }
+            // ... wait for write event ...
+            return;
+        }
+        // ... done?
+        if ( stream_.index_ >= stream_.hash_.size() ) {
+            FinishStream(ngx_http_send_special(ngx_request_, NGX_HTTP_LAST));
+            return;
+        }
+        // ... sign next ...
+        ngx_chain_t* out = nullptr;
+        try {
+            out = NextStreamLine();
+        } catch (const ::cc::Exception& a_cc_exception) {
+            out = StreamErrorLine(a_cc_exception.what());
+        } catch (...) {
+            out = StreamErrorLine("An error occurred while signing hash!");
+        }
+        if ( nullptr == out ) {
+            FinishStream(NGX_ERROR);
+            return;
+        }
+        // ... send it ...
+        const ngx_int_t rc = ngx_http_output_filter(ngx_request_, out);
+        ngx_chain_update_chains(ngx_request_->pool, &stream_.free_, &stream_.busy_, &out, tag);
+        if ( NGX_ERROR == rc ) {
+            FinishStream(NGX_ERROR);
+            return;
+        }
+        // ... bulk? let other requests of this worker run between chunks ...
+        if ( ::casper::hsm::Limiter::Class::Bulk == class_
+            && 0 == stream_.index_ % ( bulk_max_batch_ > 0 ? bulk_max_batch_ : NGX_CASPER_BROKER_HSM_MODULE_BULK_YIELD )
+            && stream_.index_ < stream_.hash_.size() && nullptr == stream_.busy_ ) {
+            ngx_request_->write_event_handler = StreamWriteEventHandler;
+            ngx_post_event(ngx_request_->connection->write, &ngx_posted_events);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Finalize a streaming response.
+ *
+ * @param a_rc Result code to finalize request with.
+ */
+void ngx::casper::broker::hsm::Module::FinishStream (const ngx_int_t a_rc)
+{
+    ngx_http_request_t* r = ngx_request_;
+    // ... expose timings to 'log_format' and adjust concurrency limit ...
+    Dismiss(stream_.sign_count_, stream_.wait_us_, stream_.failed_);
+    SetVariables(stream_.sign_count_, stream_.wait_us_);
+    // ... module might be released after this call ...
+    ngx_http_finalize_request(r, a_rc);
+}
+
+/**
+ * @brief Sign next hash and write it's NDJSON line.
+ *
+ * @return Chain to send.
+ */
+ngx_chain_t* ngx::casper::broker::hsm::Module::NextStreamLine ()
+{
+    const size_t idx = stream_.index_++;
+    
+    // ... sign, digest was calculated when stream started ...
+    const auto start = std::chrono::steady_clock::now();
+    SignDigest(stream_.key_, stream_.digests_.data() + idx * CASPER_HSM_BATCH_SHA256_DIGEST_LEN, stream_.signature_);
+    stream_.wait_us_ += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    stream_.sign_count_++;
+    
+    // ... write line ...
+    const size_t capacity = ngx::casper::broker::hsm::Writer::Base64Length(stream_.signature_.size()) + 64;
+    ngx_chain_t* cl       = NextStreamBuffer(capacity);
+    ngx_buf_t*   b        = cl->buf;
+    b->last = ngx_sprintf(b->last, "{\"index\":%uD,\"signature\":\"", static_cast<uint32_t>(idx));
+    b->last = ngx::casper::broker::hsm::Writer::EncodeBase64(stream_.signature_.data(), stream_.signature_.size(), b->last);
+    b->last = ngx_cpymem(b->last, "\"}\n", 3);
+    
+    return cl;
+}
+
+/**
+ * @brief Write an error NDJSON line, no more lines will be written.
+ *
+ * @param a_message Error message.
+ *
+ * @return Chain to send, nullptr on failure.
+ */
+ngx_chain_t* ngx::casper::broker::hsm::Module::StreamErrorLine (const char* const a_message)
+{
+    // ... stop signing ...
+    stream_.failed_ = true;
+    const size_t idx = ( stream_.index_ > 0 ? stream_.index_ - 1 : 0 );
+    stream_.index_ = stream_.hash_.size();
+    // ... write line ...
+    const size_t length = strlen(a_message);
+    try {
+        ngx_chain_t* cl = NextStreamBuffer(ngx::casper::broker::hsm::Writer::EscapedLength(a_message, length) + 64);
+        ngx_buf_t*   b  = cl->buf;
+        b->last = ngx_sprintf(b->last, "{\"index\":%uD,\"error\":\"", static_cast<uint32_t>(idx));
+        b->last = ngx::casper::broker::hsm::Writer::EscapeJSON(a_message, length, b->last);
+        b->last = ngx_cpymem(b->last, "\"}\n", 3);
+        return cl;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+/**
+ * @brief Obtain a reusable buffer to write a stream line to.
+ *
+ * @param a_capacity Minimum number of bytes required.
+ *
+ * @return A chain link with an empty buffer.
+ */
+ngx_chain_t* ngx::casper::broker::hsm::Module::NextStreamBuffer (const size_t a_capacity)
+{
+    ngx_chain_t* cl = ngx_chain_get_free_buf(ngx_request_->pool, &stream_.free_);
+    if ( NULL == cl ) {
+        throw ::cc::Exception("Unable to allocate a stream %s!", "chain link");
+    }
+    ngx_buf_t* b = cl->buf;
+    // ... reuse memory when possible ...
+    if ( NULL == b->start || static_cast<size_t>(b->end - b->start) < a_capacity ) {
+        const size_t size = std::max(a_capacity, static_cast<size_t>(NGX_CASPER_BROKER_HSM_MODULE_STREAM_LINE_SIZE));
+        b->start = (u_char*)ngx_palloc(ngx_request_->pool, size);
+        if ( NULL == b->start ) {
+            throw ::cc::Exception("Unable to allocate a stream buffer with %zu byte(s)!", size);
+        }
+        b->end = b->start + size;
+    }
+    b->pos       = b->start;
+    b->last      = b->start;
+    b->temporary = 1;
+    b->flush     = 1;
+    b->tag       = (ngx_buf_tag_t) &ngx_http_casper_broker_hsm_module;
+    return cl;
+}
+
+/**
+ * @brief Called by nginx when a streaming response can be written again.
+ *
+ * @param a_r The http request.
+ */
+void ngx::casper::broker::hsm::Module::StreamWriteEventHandler (ngx_http_request_t* a_r)
+{
+    ngx::casper::broker::hsm::Module* module = Get(a_r);
+    if ( nullptr == module ) {
+        ngx_http_finalize_request(a_r, NGX_ERROR);
+        return;
+    }
+    ngx_event_t* wev = a_r->connection->write;
+    if ( 1 == wev->timedout ) {
+        a_r->connection->timedout = 1;
+        module->FinishStream(NGX_HTTP_REQUEST_TIME_OUT);
+        return;
+    }
+    if ( 1 == wev->timer_set ) {
+        ngx_del_timer(wev);
+    }
+    // ... flush pending data ...
+    ngx_chain_t*    out = NULL;
+    const ngx_int_t rc  = ngx_http_output_filter(a_r, NULL);
+    ngx_chain_update_chains(a_r->pool, &module->stream_.free_, &module->stream_.busy_, &out, (ngx_buf_tag_t) &ngx_http_casper_broker_hsm_module);
+    if ( NGX_ERROR == rc ) {
+        module->FinishStream(NGX_ERROR);
+        return;
+    }
+    // ... continue ...
+    module->ContinueStream();
+}
+
+// MARK: -
+
+/**
+ * @return This module instance for the provided request, nullptr if none.
+ *
+ * @param a_r The http request.
+ */
+ngx::casper::broker::hsm::Module* ngx::casper::broker::hsm::Module::Get (ngx_http_request_t* a_r)
+{
+    // ... module instance is kept by broker as this module context ...
+    return dynamic_cast<ngx::casper::broker::hsm::Module*>(
+        reinterpret_cast<ngx::casper::broker::Module*>(ngx_http_get_module_ctx(a_r, ngx_http_casper_broker_hsm_module))
+    );
+}
+
+/**
+ * @brief Check if a request 'Accept' header contains a specific content type.
+ *
+ * @param a_r            The http request.
+ * @param a_content_type Content type to search for.
+ */
+bool ngx::casper::broker::hsm::Module::Accepts (ngx_http_request_t* a_r, const char* const a_content_type)
+{
+    const size_t length = strlen(a_content_type);
+    for ( ngx_list_part_t* part = &a_r->headers_in.headers.part ; NULL != part ; part = part->next ) {
+        ngx_table_elt_t* header = (ngx_table_elt_t*)part->elts;
+        for ( ngx_uint_t idx = 0 ; idx < part->nelts ; ++idx ) {
+            if ( 6 != header[idx].key.len || 0 != ngx_strncasecmp(header[idx].key.data, (u_char*)"Accept", 6) ) {
+                continue;
+            }
+            if ( NULL != ngx_strlcasestrn(header[idx].value.data, header[idx].value.data + header[idx].value.len, (u_char*)a_content_type, length - 1) ) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Check if a request header has a specific value ( case insensitive ).
+ *
+ * @param a_r     The http request.
+ * @param a_name  Header name.
+ * @param a_value Expected value.
+ */
+bool ngx::casper::broker::hsm::Module::HeaderEquals (ngx_http_request_t* a_r, const char* const a_name, const char* const a_value)
+{
+    const size_t name_length  = strlen(a_name);
+    const size_t value_length = strlen(a_value);
+    for ( ngx_list_part_t* part = &a_r->headers_in.headers.part ; NULL != part ; part = part->next ) {
+        ngx_table_elt_t* header = (ngx_table_elt_t*)part->elts;
+        for ( ngx_uint_t idx = 0 ; idx < part->nelts ; ++idx ) {
+            if ( name_length != header[idx].key.len || 0 != ngx_strncasecmp(header[idx].key.data, (u_char*)a_name, name_length) ) {
+                continue;
+            }
+            return ( value_length == header[idx].value.len && 0 == ngx_strncasecmp(header[idx].value.data, (u_char*)a_value, value_length) );
+        }
+    }
+    return false;
+}
+
 // MARK: -
 
 /**
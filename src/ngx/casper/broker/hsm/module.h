@@ -27,6 +27,15 @@
 
 #include "ngx/casper/broker/module/ngx_http_casper_broker_module.h"
 #include "ngx/casper/broker/hsm/module/ngx_http_casper_broker_hsm_module.h"
+#include "ngx/casper/broker/hsm/parser.h"
+
+#include "casper/hsm/backend.h"
+#include "casper/hsm/limiter.h"
+
+#include "cc/easy/json.h"
+
+#include <map>
+#include <vector>
 
 namespace ngx
 {
@@ -40,16 +49,70 @@ namespace ngx
             namespace hsm
             {
 
+                class Writer;
+                class RateLimiter;
+                
                 class Module final : public ::ngx::casper::broker::Module
                 {
+                    
+                private: // Data Type(s)
+                    
+                    typedef struct {
+                        ngx_int_t                          status_code_;
+                        std::string                        content_type_;
+                        ngx_chain_t*                       chain_;
+                        size_t                             length_;
+                        std::map<std::string, std::string> headers_;
+                    } DirectResponse;
+                    
+                    typedef struct {
+                        bool                                                pending_;
+                        std::string                                         key_;
+                        std::vector<ngx::casper::broker::hsm::Parser::View> hash_;  //!< Views into request body or \link dom_ \link.
+                        Json::Value                                         dom_;
+                        size_t                                              index_;
+                        std::vector<unsigned char>                          digests_; //!< SHA256 of each \link hash_ \link, back to back.
+                        std::vector<unsigned char>                          signature_;
+                        ngx_chain_t*                                        free_;
+                        ngx_chain_t*                                        busy_;
+                        size_t                                              sign_count_;
+                        uint64_t                                            wait_us_;
+                        bool                                                failed_;
+                    } Stream;
+                    
+                private: // Refs
+                    
+                    ::casper::hsm::Backend&                             backend_;
+                    
                 private: // Const Data
                     
-                    const bool use_singleton_;
+                    const bool                                          use_singleton_;
+                    ngx_http_request_t* const                           ngx_request_;
+                    const ngx_uint_t                                    priority_;
+                    const size_t                                        bulk_threshold_;
+                    const size_t                                        bulk_max_batch_;
+                    const ngx_http_casper_broker_hsm_module_rate_conf_t key_rate_;
+                    const ngx_http_casper_broker_hsm_module_rate_conf_t tenant_rate_;
+                    ngx_http_complex_value_t* const                     tenant_;
+                    const bool                                          verify_;
+                    const bool                                          cms_;
+                    
+                private: // Data
+                    
+                    DirectResponse                direct_response_;
+                    Stream                        stream_;
+                    ::casper::hsm::Limiter*       limiter_;
+                    time_t                        retry_after_;
+                    bool                          admitted_;
+                    ::casper::hsm::Limiter::Class class_;
+                    RateLimiter*                  rate_limiter_;
+                    std::string                   requester_;
 
                 protected: // Constructor(s)
                     
                     Module (const broker::Module::Config& a_config, const broker::Module::Params& a_params,
-                            ngx_http_casper_broker_module_loc_conf_t& a_ngx_broker_loc_conf, ngx_http_casper_broker_hsm_module_loc_conf_t& a_ngx_hsm_loc_conf);
+                            ngx_http_casper_broker_module_loc_conf_t& a_ngx_broker_loc_conf, ngx_http_casper_broker_hsm_module_loc_conf_t& a_ngx_hsm_loc_conf,
+                            ::casper::hsm::Backend& a_backend);
                     
                 public: // Constructor(s) / Destructor
                     
@@ -61,10 +124,43 @@ namespace ngx
                     
                 public: // Static Method(s) / Function(s)
                     
-                    static ngx_int_t Factory (ngx_http_request_t* a_r, bool a_at_rewrite_handler);
+                    static ngx_int_t Factory                          (ngx_http_request_t* a_r, bool a_at_rewrite_handler);
+                    static ngx_int_t ContentPhaseTackleDirectResponse (ngx_http_request_t* a_r);
 
+                private: // Method(s) / Function(s)
+                    
+                    void SetVariables      (const size_t a_count, const uint64_t a_wait_us);
+                    void SetDirectResponse (const ngx_int_t a_status_code, const std::string& a_content_type, ngx::casper::broker::hsm::Writer& a_writer);
+                    
+                    void Classify (const size_t a_count);
+                    bool Throttle (const std::string& a_key, const size_t a_count);
+                    bool Admit    ();
+                    void Dismiss  (const size_t a_count, const uint64_t a_wait_us, const bool a_failed);
+                    void Reject   (const ngx_int_t a_status_code, const char* const a_message, const time_t a_retry_after);
+                    void Fail     (const ngx_int_t a_status_code, const char* const a_message);
+                    
+                    const std::string& Requester  ();
+                    void               Sign       (const std::string& a_key, const unsigned char* a_data, const size_t a_length, std::vector<unsigned char>& o_signature);
+                    void               SignDigest (const std::string& a_key, const unsigned char* a_digest, std::vector<unsigned char>& o_signature);
+                    void               Digest     (const ngx::casper::broker::hsm::Parser::View* a_hash, const size_t a_count, unsigned char* o_digests);
+                    
+                    ngx_int_t Verify     ();
+                    ngx_int_t SignedData ();
+                    
+                    ngx_int_t    StartStream      ();
+                    void         ContinueStream   ();
+                    void         FinishStream     (const ngx_int_t a_rc);
+                    ngx_chain_t* NextStreamLine   ();
+                    ngx_chain_t* StreamErrorLine  (const char* const a_message);
+                    ngx_chain_t* NextStreamBuffer (const size_t a_capacity);
+                    
                 private: // Static Method(s) / Function(s)
                     
+                    static Module* Get                     (ngx_http_request_t* a_r);
+                    static bool    Accepts                 (ngx_http_request_t* a_r, const char* const a_content_type);
+                    static bool    HeaderEquals            (ngx_http_request_t* a_r, const char* const a_name, const char* const a_value);
+                    static void    StreamWriteEventHandler (ngx_http_request_t* a_r);
+                    
                     static void ReadBodyHandler (ngx_http_request_t* a_request);
                     static void CleanupHandler  (void*);
 
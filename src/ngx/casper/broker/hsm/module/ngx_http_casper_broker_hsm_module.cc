@@ -23,8 +23,24 @@
 
 #include "ngx/casper/broker/hsm/module.h"
 
+#include "ngx/casper/broker/hsm/rate_limiter.h"
+#include "ngx/casper/broker/hsm/digester.h"
+#include "ngx/casper/broker/hsm/writer.h"
+
+#include "casper/hsm/limiter.h"
+#include "casper/hsm/statistics.h"
+#include "casper/hsm/singleton.h"
+
+#ifdef __APPLE__
+  #include "casper/hsm/fake/api.h"
+#else
+    #include "casper/hsm/safenet/api.h"
+#endif
+
 #include <sys/stat.h>
 
+#include <algorithm> // std::min, std::max
+
 #ifndef __APPLE__ // backtrace
    #include <stdio.h>
    #include <execinfo.h>
@@ -48,9 +64,30 @@ static char* ngx_http_casper_broker_hsm_module_init_main_conf      (ngx_conf_t*
 static void*     ngx_http_casper_broker_hsm_module_create_loc_conf (ngx_conf_t* a_cf);
 static char*     ngx_http_casper_broker_hsm_module_merge_loc_conf  (ngx_conf_t* a_cf, void* a_parent, void* a_child);
 
+static ngx_int_t ngx_http_casper_broker_hsm_module_limiter_init_zone (ngx_shm_zone_t* a_zone, void* a_data);
+static char*     ngx_http_casper_broker_hsm_module_set_rate_slot     (ngx_conf_t* a_cf, ngx_command_t* a_cmd, void* a_conf);
+static ngx_int_t ngx_http_casper_broker_hsm_module_statistics_init_zone (ngx_shm_zone_t* a_zone, void* a_data);
+static char*     ngx_http_casper_broker_hsm_module_set_status_slot   (ngx_conf_t* a_cf, ngx_command_t* a_cmd, void* a_conf);
+static char*     ngx_http_casper_broker_hsm_module_set_profile_slot  (ngx_conf_t* a_cf, ngx_command_t* a_cmd, void* a_conf);
+static ngx_int_t ngx_http_casper_broker_hsm_module_limiter_add_zone  (ngx_conf_t* a_cf, nginx_hsm_service_limiter_conf_t* a_limiter, const ngx_str_t* a_suffix);
+
+static ngx_int_t ngx_http_casper_broker_hsm_module_init_process      (ngx_cycle_t* a_cycle);
+static void      ngx_http_casper_broker_hsm_module_exit_process      (ngx_cycle_t* a_cycle);
+static void      ngx_http_casper_broker_hsm_module_probe_handler     (ngx_event_t* a_event);
+static void      ngx_http_casper_broker_hsm_module_trace_handler     (ngx_event_t* a_event);
+static void      ngx_http_casper_broker_hsm_module_setup_backend     (ngx_cycle_t* a_cycle, const nginx_hsm_service_conf_t* a_conf, ::casper::hsm::Backend& a_backend,
+                                                                      const char* const a_name, const ngx_str_t& a_share_dir, const ngx_uint_t a_slot_id,
+                                                                      const ngx_str_t& a_pin, const ngx_str_t& a_fake_config, const bool a_start);
+
+static ngx_int_t ngx_http_casper_broker_hsm_module_add_variables   (ngx_conf_t* a_cf);
+static ngx_int_t ngx_http_casper_broker_hsm_module_variable        (ngx_http_request_t* a_r, ngx_http_variable_value_t* a_v, uintptr_t a_data);
+
 static ngx_int_t ngx_http_casper_broker_hsm_module_filter_init     (ngx_conf_t* a_cf);
 static ngx_int_t ngx_http_casper_broker_hsm_module_content_handler (ngx_http_request_t* a_r);
 static ngx_int_t ngx_http_casper_broker_hsm_module_rewrite_handler (ngx_http_request_t* a_r);
+static bool      ngx_http_casper_broker_hsm_module_is_digest_location (ngx_http_request_t* a_r);
+static bool      ngx_http_casper_broker_hsm_module_is_status_location (ngx_http_request_t* a_r);
+static ngx_int_t ngx_http_casper_broker_hsm_module_status_handler     (ngx_http_request_t* a_r);
 
 #ifdef __APPLE__
 #pragma mark -
@@ -60,6 +97,16 @@ static ngx_int_t ngx_http_casper_broker_hsm_module_rewrite_handler (ngx_http_req
 
 NGX_BROKER_MODULE_DECLARE_MODULE_ENABLER;
 
+/**
+ * @brief 'nginx_casper_broker_hsm_priority' directive values.
+ */
+static ngx_conf_enum_t ngx_http_casper_broker_hsm_module_priorities[] = {
+    { ngx_string("auto")       , NGX_HTTP_CASPER_BROKER_HSM_PRIORITY_AUTO        },
+    { ngx_string("interactive"), NGX_HTTP_CASPER_BROKER_HSM_PRIORITY_INTERACTIVE },
+    { ngx_string("bulk")       , NGX_HTTP_CASPER_BROKER_HSM_PRIORITY_BULK        },
+    { ngx_null_string, 0 }
+};
+
 /**
  * @brief This struct defines the configuration command handlers
  */
@@ -97,6 +144,180 @@ static ngx_command_t ngx_http_casper_broker_hsm_module_commands[] = {
          offsetof(nginx_hsm_service_conf_t, fake.config),
          NULL
     },
+    {
+        ngx_string("nginx_casper_broker_hsm_share_dir"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_str_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, share_dir),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_profile"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_1MORE,
+        ngx_http_casper_broker_hsm_module_set_profile_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, profiles),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_warm"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_FLAG,
+        ngx_conf_set_flag_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, warm),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_verify_threads"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, verify_threads),
+        NULL
+    },
+    /* limiter */
+    {
+        ngx_string("nginx_casper_broker_hsm_limiter"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_FLAG,
+        ngx_conf_set_flag_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, limiter.enabled),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_limiter_min"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, limiter.min),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_limiter_max"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, limiter.max),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_limiter_target_latency"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_msec_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, limiter.target_latency),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_limiter_retry_after"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_sec_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, limiter.retry_after),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_limiter_interactive_share"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, limiter.reserved),
+        NULL
+    },
+    /* rate limiter */
+    {
+        ngx_string("nginx_casper_broker_hsm_rate_limiter_zone_size"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_size_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, rate_limiter.size),
+        NULL
+    },
+    /* circuit breaker */
+    {
+        ngx_string("nginx_casper_broker_hsm_breaker_threshold"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, breaker.threshold),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_breaker_cooldown"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_msec_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, breaker.cooldown),
+        NULL
+    },
+    /* hedging */
+    {
+        ngx_string("nginx_casper_broker_hsm_hedge_budget"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, hedge.budget),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_hedge_min_samples"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, hedge.min_samples),
+        NULL
+    },
+    /* audit */
+    {
+        ngx_string("nginx_casper_broker_hsm_audit_log"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_str_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, audit.path),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_audit_buffer"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, audit.buffer),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_audit_flush"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_msec_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, audit.flush),
+        NULL
+    },
+    /* trace */
+    {
+        ngx_string("nginx_casper_broker_hsm_trace_log"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_str_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, trace.path),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_trace_buffer"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, trace.buffer),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_trace_flush"),
+        NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_msec_slot,
+        NGX_HTTP_MAIN_CONF_OFFSET,
+        offsetof(nginx_hsm_service_conf_t, trace.flush),
+        NULL
+    },
     /* location */
     {
         ngx_string("nginx_casper_broker_hsm"),                          /* directive name */
@@ -122,15 +343,134 @@ static ngx_command_t ngx_http_casper_broker_hsm_module_commands[] = {
          offsetof(ngx_http_casper_broker_hsm_module_loc_conf_t, singleton),
          NULL
     },
+    {
+        ngx_string("nginx_casper_broker_hsm_priority"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_enum_slot,
+        NGX_HTTP_LOC_CONF_OFFSET,
+        offsetof(ngx_http_casper_broker_hsm_module_loc_conf_t, priority),
+        &ngx_http_casper_broker_hsm_module_priorities
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_bulk_threshold"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        NGX_HTTP_LOC_CONF_OFFSET,
+        offsetof(ngx_http_casper_broker_hsm_module_loc_conf_t, bulk_threshold),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_bulk_max_batch"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        NGX_HTTP_LOC_CONF_OFFSET,
+        offsetof(ngx_http_casper_broker_hsm_module_loc_conf_t, bulk_max_batch),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_key_rate"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE12,
+        ngx_http_casper_broker_hsm_module_set_rate_slot,
+        NGX_HTTP_LOC_CONF_OFFSET,
+        offsetof(ngx_http_casper_broker_hsm_module_loc_conf_t, key_rate),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_tenant_rate"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE12,
+        ngx_http_casper_broker_hsm_module_set_rate_slot,
+        NGX_HTTP_LOC_CONF_OFFSET,
+        offsetof(ngx_http_casper_broker_hsm_module_loc_conf_t, tenant_rate),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_tenant"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+        ngx_http_set_complex_value_slot,
+        NGX_HTTP_LOC_CONF_OFFSET,
+        offsetof(ngx_http_casper_broker_hsm_module_loc_conf_t, tenant),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_verify"),
+        NGX_HTTP_LOC_CONF | NGX_CONF_FLAG,
+        ngx_conf_set_flag_slot,
+        NGX_HTTP_LOC_CONF_OFFSET,
+        offsetof(ngx_http_casper_broker_hsm_module_loc_conf_t, verify),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_cms"),
+        NGX_HTTP_LOC_CONF | NGX_CONF_FLAG,
+        ngx_conf_set_flag_slot,
+        NGX_HTTP_LOC_CONF_OFFSET,
+        offsetof(ngx_http_casper_broker_hsm_module_loc_conf_t, cms),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_digest"),
+        NGX_HTTP_LOC_CONF | NGX_CONF_FLAG,
+        ngx_conf_set_flag_slot,
+        NGX_HTTP_LOC_CONF_OFFSET,
+        offsetof(ngx_http_casper_broker_hsm_module_loc_conf_t, digest),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_status"),
+        NGX_HTTP_LOC_CONF | NGX_CONF_FLAG,
+        ngx_http_casper_broker_hsm_module_set_status_slot,
+        NGX_HTTP_LOC_CONF_OFFSET,
+        offsetof(ngx_http_casper_broker_hsm_module_loc_conf_t, status),
+        NULL
+    },
+    {
+        ngx_string("nginx_casper_broker_hsm_use_profile"),
+        NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_str_slot,
+        NGX_HTTP_LOC_CONF_OFFSET,
+        offsetof(ngx_http_casper_broker_hsm_module_loc_conf_t, profile),
+        NULL
+    },
     /* */
     ngx_null_command
 };
 
+/**
+ * @brief This module variables, values are set by \link ngx_http_casper_broker_hsm_module_set_variable \link.
+ */
+static ngx_http_variable_t ngx_http_casper_broker_hsm_module_variables[] = {
+    { ngx_string("hsm_sign_count")  , NULL, ngx_http_casper_broker_hsm_module_variable, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_SIGN_COUNT, 0, 0 },
+    { ngx_string("hsm_wait_ms")     , NULL, ngx_http_casper_broker_hsm_module_variable, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_WAIT_MS   , 0, 0 },
+    { ngx_string("hsm_session_ms")  , NULL, ngx_http_casper_broker_hsm_module_variable, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_SESSION_MS, 0, 0 },
+    { ngx_string("hsm_find_ms")     , NULL, ngx_http_casper_broker_hsm_module_variable, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_FIND_MS   , 0, 0 },
+    { ngx_string("hsm_cache_hit")   , NULL, ngx_http_casper_broker_hsm_module_variable, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_CACHE_HIT , 0, 0 },
+    { ngx_string("hsm_slot")        , NULL, ngx_http_casper_broker_hsm_module_variable, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_SLOT      , 0, 0 },
+    { ngx_string("hsm_priority")    , NULL, ngx_http_casper_broker_hsm_module_variable, NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_PRIORITY  , 0, 0 },
+    { ngx_null_string, NULL, NULL, 0, 0, 0 }
+};
+
+/**
+ * @brief This module variables indexes, resolved at postconfiguration.
+ */
+static ngx_int_t ngx_http_casper_broker_hsm_module_variables_index[NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_MAX] = {
+    NGX_ERROR, NGX_ERROR, NGX_ERROR, NGX_ERROR, NGX_ERROR, NGX_ERROR, NGX_ERROR
+};
+
+/**
+ * @brief Circuit breaker background probe timer, one per worker.
+ */
+static ngx_event_t ngx_http_casper_broker_hsm_module_probe_event;
+
+/**
+ * @brief Request shapes trace flush timer, one per worker.
+ */
+static ngx_event_t ngx_http_casper_broker_hsm_module_trace_event;
+
 /**
  * @brief The nginx-hsm 'api' module context setup data.
  */
 static ngx_http_module_t ngx_http_casper_broker_hsm_module_ctx = {
-    NULL,                                               /* preconfiguration              */
+    ngx_http_casper_broker_hsm_module_add_variables,    /* preconfiguration              */
     ngx_http_casper_broker_hsm_module_filter_init,      /* postconfiguration             */
     ngx_http_casper_broker_hsm_module_create_main_conf, /* create main configuration     */
     ngx_http_casper_broker_hsm_module_init_main_conf,   /* init main configuration       */
@@ -145,16 +485,16 @@ static ngx_http_module_t ngx_http_casper_broker_hsm_module_ctx = {
  */
 ngx_module_t ngx_http_casper_broker_hsm_module = {
     NGX_MODULE_V1,
-    &ngx_http_casper_broker_hsm_module_ctx,     /* module context    */
-    ngx_http_casper_broker_hsm_module_commands, /* module directives */
-    NGX_HTTP_MODULE,                            /* module type       */
-    NULL,                                       /* init master       */
-    NULL,                                       /* init module       */
-    NULL,                                       /* init process      */
-    NULL,                                       /* init thread       */
-    NULL,                                       /* exit thread       */
-    NULL,                                       /* exit process      */
-    NULL,                                       /* exit master       */
+    &ngx_http_casper_broker_hsm_module_ctx,            /* module context    */
+    ngx_http_casper_broker_hsm_module_commands,        /* module directives */
+    NGX_HTTP_MODULE,                                   /* module type       */
+    NULL,                                              /* init master       */
+    NULL,                                              /* init module       */
+    ngx_http_casper_broker_hsm_module_init_process,    /* init process      */
+    NULL,                                              /* init thread       */
+    NULL,                                              /* exit thread       */
+    ngx_http_casper_broker_hsm_module_exit_process,    /* exit process      */
+    NULL,                                              /* exit master       */
     NGX_MODULE_V1_PADDING
 };
 
@@ -176,6 +516,41 @@ static void* ngx_http_casper_broker_hsm_module_create_main_conf(ngx_conf_t* a_cf
     conf->slot_id     = NGX_CONF_UNSET_UINT;
     conf->pin         = ngx_null_string;
     conf->fake.config = ngx_null_string;
+    conf->share_dir   = ngx_null_string;
+    conf->warm        = NGX_CONF_UNSET;
+    
+    conf->verify_threads         = NGX_CONF_UNSET_UINT;
+    
+    conf->limiter.enabled        = NGX_CONF_UNSET;
+    conf->limiter.min            = NGX_CONF_UNSET_UINT;
+    conf->limiter.max            = NGX_CONF_UNSET_UINT;
+    conf->limiter.target_latency = NGX_CONF_UNSET_MSEC;
+    conf->limiter.retry_after    = NGX_CONF_UNSET;
+    conf->limiter.reserved       = NGX_CONF_UNSET_UINT;
+    conf->limiter.zone           = NULL;
+    
+    conf->rate_limiter.used      = 0;
+    conf->rate_limiter.size      = NGX_CONF_UNSET_SIZE;
+    conf->rate_limiter.zone      = NULL;
+    
+    conf->breaker.threshold      = NGX_CONF_UNSET_UINT;
+    conf->breaker.cooldown       = NGX_CONF_UNSET_MSEC;
+    
+    conf->hedge.budget           = NGX_CONF_UNSET_UINT;
+    conf->hedge.min_samples      = NGX_CONF_UNSET_UINT;
+    
+    conf->audit.path             = ngx_null_string;
+    conf->audit.buffer           = NGX_CONF_UNSET_UINT;
+    conf->audit.flush            = NGX_CONF_UNSET_MSEC;
+    
+    conf->trace.path             = ngx_null_string;
+    conf->trace.buffer           = NGX_CONF_UNSET_UINT;
+    conf->trace.flush            = NGX_CONF_UNSET_MSEC;
+    
+    conf->statistics.used        = 0;
+    conf->statistics.zone        = NULL;
+    
+    conf->profiles               = NULL;
 
     // ... done ...
     return conf;
@@ -201,11 +576,563 @@ static char* ngx_http_casper_broker_hsm_module_init_main_conf  (ngx_conf_t* a_cf
     ngx_conf_init_uint_value(conf->slot_id    ,  3);
     nrs_conf_init_str_value (conf->pin        , "");
     nrs_conf_init_str_value (conf->fake.config, "");
+    nrs_conf_init_str_value (conf->share_dir  , "");
+    ngx_conf_init_value     (conf->warm       ,  1);  /* 1 - enabled */
+    
+    ngx_conf_init_uint_value(conf->verify_threads,   2); /* 0 - worker thread only */
+    
+    ngx_conf_init_value     (conf->limiter.enabled       ,   0); /* 0 - disabled */
+    ngx_conf_init_uint_value(conf->limiter.min           ,   1);
+    ngx_conf_init_uint_value(conf->limiter.max           ,  64);
+    ngx_conf_init_msec_value(conf->limiter.target_latency, 250);
+    ngx_conf_init_value     (conf->limiter.retry_after   ,   1);
+    ngx_conf_init_uint_value(conf->limiter.reserved      ,  20); /* % */
+    
+    if ( 1 == conf->limiter.enabled ) {
+        if ( 0 == conf->limiter.min || conf->limiter.min > conf->limiter.max || 0 == conf->limiter.target_latency || conf->limiter.reserved >= 100 ) {
+            ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "invalid nginx_casper_broker_hsm_limiter_* values");
+            return (char*) NGX_CONF_ERROR;
+        }
+        // ... limiter state is shared by all workers ...
+        if ( NGX_OK != ngx_http_casper_broker_hsm_module_limiter_add_zone(a_cf, &conf->limiter, NULL) ) {
+            return (char*) NGX_CONF_ERROR;
+        }
+    }
+    
+    // ... profiles: whatever is not set is the same as default profile, except limiter state ...
+    for ( ngx_uint_t idx = 0 ; NULL != conf->profiles && idx < conf->profiles->nelts ; ++idx ) {
+        nginx_hsm_service_profile_conf_t* profile = &((nginx_hsm_service_profile_conf_t*)conf->profiles->elts)[idx];
+        if ( NGX_CONF_UNSET_UINT == profile->slot_id ) {
+            profile->slot_id = conf->slot_id;
+        }
+        if ( 0 == profile->pin.len ) {
+            profile->pin = conf->pin;
+        }
+        if ( 0 == profile->fake.config.len ) {
+            profile->fake.config = conf->fake.config;
+        }
+        if ( 0 == profile->share_dir.len ) {
+            profile->share_dir = conf->share_dir;
+        }
+        profile->limiter      = conf->limiter;
+        profile->limiter.zone = NULL;
+        if ( NGX_CONF_UNSET_UINT != profile->limiter_max ) {
+            profile->limiter.max = profile->limiter_max;
+        }
+        if ( 1 == profile->limiter.enabled ) {
+            if ( profile->limiter.min > profile->limiter.max ) {
+                ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "invalid \"%V\" profile limiter_max value", &profile->name);
+                return (char*) NGX_CONF_ERROR;
+            }
+            if ( NGX_OK != ngx_http_casper_broker_hsm_module_limiter_add_zone(a_cf, &profile->limiter, &profile->name) ) {
+                return (char*) NGX_CONF_ERROR;
+            }
+        }
+    }
+    
+    ngx_conf_init_size_value(conf->rate_limiter.size, 1024 * 1024);
+    
+    ngx_conf_init_uint_value(conf->breaker.threshold,    5);
+    ngx_conf_init_msec_value(conf->breaker.cooldown , 5000);
+    
+    ngx_conf_init_uint_value(conf->hedge.budget     ,    0); /* % - 0 disabled */
+    ngx_conf_init_uint_value(conf->hedge.min_samples,   20);
+    
+    if ( conf->hedge.budget > 100 || conf->hedge.min_samples > CASPER_HSM_HEDGER_SAMPLES ) {
+        ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "invalid nginx_casper_broker_hsm_hedge_* values");
+        return (char*) NGX_CONF_ERROR;
+    }
+    
+    nrs_conf_init_str_value (conf->audit.path  ,   "");
+    ngx_conf_init_uint_value(conf->audit.buffer, 4096);
+    ngx_conf_init_msec_value(conf->audit.flush ,  100);
+    
+    if ( 0 == conf->audit.buffer ) {
+        ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "invalid nginx_casper_broker_hsm_audit_buffer value");
+        return (char*) NGX_CONF_ERROR;
+    }
+    
+    nrs_conf_init_str_value (conf->trace.path  ,   "");
+    ngx_conf_init_uint_value(conf->trace.buffer, 1024);
+    ngx_conf_init_msec_value(conf->trace.flush , 1000);
+    
+    if ( 0 == conf->trace.buffer ) {
+        ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "invalid nginx_casper_broker_hsm_trace_buffer value");
+        return (char*) NGX_CONF_ERROR;
+    }
+    
+    if ( 1 == conf->rate_limiter.used ) {
+        // ... token buckets are shared by all workers ...
+        ngx_str_t name = ngx_string("nginx_casper_broker_hsm_rate_limiter");
+        conf->rate_limiter.zone = ngx_shared_memory_add(a_cf, &name, conf->rate_limiter.size, &ngx_http_casper_broker_hsm_module);
+        if ( NULL == conf->rate_limiter.zone ) {
+            return (char*) NGX_CONF_ERROR;
+        }
+        conf->rate_limiter.zone->init = ngx::casper::broker::hsm::RateLimiter::InitZone;
+    }
+    
+    if ( 1 == conf->statistics.used ) {
+        // ... counters and histograms are shared by all workers ...
+        ngx_str_t name = ngx_string("nginx_casper_broker_hsm_statistics");
+        conf->statistics.zone = ngx_shared_memory_add(a_cf, &name, 8 * ngx_pagesize, &ngx_http_casper_broker_hsm_module);
+        if ( NULL == conf->statistics.zone ) {
+            return (char*) NGX_CONF_ERROR;
+        }
+        conf->statistics.zone->init = ngx_http_casper_broker_hsm_module_statistics_init_zone;
+    }
     
     // ... done ...
     return NGX_CONF_OK;
 }
 
+/**
+ * @brief Worker process initialization, hedging, circuit breaker and verification are configured, HSM backends ( default and named
+ *        profiles ) are started and warmed up ( sessions opened and logged in, keys resolved ) before any request is accepted and
+ *        breaker probe timer is started.
+ *
+ * @param a_cycle
+ */
+static ngx_int_t ngx_http_casper_broker_hsm_module_init_process (ngx_cycle_t* a_cycle)
+{
+    nginx_hsm_service_conf_t* conf = (nginx_hsm_service_conf_t*)ngx_http_cycle_get_module_main_conf(a_cycle, ngx_http_casper_broker_hsm_module);
+    if ( NULL == conf || 1 != conf->enabled ) {
+        return NGX_OK;
+    }
+    
+    // ... every signature must be recorded, a worker that can't do it must not start ...
+    if ( conf->audit.path.len > 0 ) {
+        try {
+            ::casper::hsm::Singleton::GetInstance().StartAuditor({
+                /* path_     */ std::string(reinterpret_cast<const char*>(conf->audit.path.data), conf->audit.path.len),
+                /* capacity_ */ static_cast<size_t>(conf->audit.buffer),
+                /* flush_ms_ */ static_cast<uint64_t>(conf->audit.flush)
+            });
+        } catch (const std::exception& a_exception) {
+            ngx_log_error(NGX_LOG_EMERG, a_cycle->log, 0, "hsm_module: unable to start audit log - %s", a_exception.what());
+            return NGX_ERROR;
+        }
+    }
+    
+    // ... request shapes trace is optional, a worker that can't write it still serves ...
+    if ( conf->trace.path.len > 0 ) {
+        try {
+            ::casper::hsm::Singleton::GetInstance().StartTracer({
+                /* path_     */ std::string(reinterpret_cast<const char*>(conf->trace.path.data), conf->trace.path.len),
+                /* capacity_ */ static_cast<size_t>(conf->trace.buffer),
+                /* flush_ms_ */ static_cast<uint64_t>(conf->trace.flush)
+            });
+            // ... records are written in background, never while serving a request ...
+            ngx_event_t* ev = &ngx_http_casper_broker_hsm_module_trace_event;
+            ngx_memzero(ev, sizeof(ngx_event_t));
+            ev->handler    = ngx_http_casper_broker_hsm_module_trace_handler;
+            ev->log        = a_cycle->log;
+            ev->data       = conf;
+            ev->cancelable = 1; /* must not delay shutdown, pending records are written at exit process */
+            ngx_add_timer(ev, std::max(conf->trace.flush, (ngx_msec_t) 1));
+        } catch (const std::exception& a_exception) {
+            ngx_log_error(NGX_LOG_WARN, a_cycle->log, 0, "hsm_module: unable to start trace - %s", a_exception.what());
+        }
+    }
+    
+    // ... default profile is only started here when warming up, it might be started by someone else ...
+    ngx_http_casper_broker_hsm_module_setup_backend(a_cycle, conf, ::casper::hsm::Singleton::GetInstance(), "default",
+                                                    conf->share_dir, conf->slot_id, conf->pin, conf->fake.config, /* a_start */ 1 == conf->warm);
+    
+    // ... named profiles are always started here ...
+    for ( ngx_uint_t idx = 0 ; NULL != conf->profiles && idx < conf->profiles->nelts ; ++idx ) {
+        const nginx_hsm_service_profile_conf_t* profile = &((const nginx_hsm_service_profile_conf_t*)conf->profiles->elts)[idx];
+        const std::string                       name    = std::string(reinterpret_cast<const char*>(profile->name.data), profile->name.len);
+        ::casper::hsm::Backend*                 backend;
+        try {
+            backend = &::casper::hsm::Singleton::GetInstance().Register(name);
+        } catch (const std::exception& a_exception) {
+            ngx_log_error(NGX_LOG_EMERG, a_cycle->log, 0, "hsm_module: unable to register profile - %s", a_exception.what());
+            return NGX_ERROR;
+        }
+        ngx_http_casper_broker_hsm_module_setup_backend(a_cycle, conf, *backend, name.c_str(),
+                                                        profile->share_dir, profile->slot_id, profile->pin, profile->fake.config, /* a_start */ true);
+    }
+    
+    if ( 0 == conf->breaker.threshold ) {
+        return NGX_OK;
+    }
+    
+    ngx_event_t* ev = &ngx_http_casper_broker_hsm_module_probe_event;
+    ngx_memzero(ev, sizeof(ngx_event_t));
+    ev->handler    = ngx_http_casper_broker_hsm_module_probe_handler;
+    ev->log        = a_cycle->log;
+    ev->data       = conf;
+    ev->cancelable = 1; /* must not delay shutdown */
+    
+    ngx_add_timer(ev, std::max(std::min(conf->breaker.cooldown, (ngx_msec_t) 1000), (ngx_msec_t) 1));
+    
+    return NGX_OK;
+}
+
+/**
+ * @brief Configure a profile backend and, if requested, start and warm it up.
+ *
+ * @param a_cycle       The cycle.
+ * @param a_conf        Module main configuration.
+ * @param a_backend     Profile backend.
+ * @param a_name        Profile name, for logging purposes only.
+ * @param a_share_dir   Certificates directory, empty - don't start.
+ * @param a_slot_id     HSM slot ID.
+ * @param a_pin         HSM slot PIN.
+ * @param a_fake_config Fake API configuration ( macOS ).
+ * @param a_start       True if backend should be started here, unless it's already running.
+ */
+static void ngx_http_casper_broker_hsm_module_setup_backend (ngx_cycle_t* a_cycle, const nginx_hsm_service_conf_t* a_conf, ::casper::hsm::Backend& a_backend,
+                                                             const char* const a_name, const ngx_str_t& a_share_dir, const ngx_uint_t a_slot_id,
+                                                             const ngx_str_t& a_pin, const ngx_str_t& a_fake_config, const bool a_start)
+{
+    a_backend.SetupBreaker({
+        /* threshold_   */ static_cast<size_t>(a_conf->breaker.threshold),
+        /* cooldown_ms_ */ static_cast<uint64_t>(a_conf->breaker.cooldown)
+    });
+    
+    a_backend.SetupHedging({
+        /* budget_      */ static_cast<size_t>(a_conf->hedge.budget),
+        /* min_samples_ */ static_cast<size_t>(a_conf->hedge.min_samples)
+    });
+    
+    a_backend.SetupVerifier(static_cast<size_t>(a_conf->verify_threads));
+    
+    if ( NULL != a_conf->statistics.zone ) {
+        a_backend.SetupStatistics(static_cast<::casper::hsm::Statistics::State*>(a_conf->statistics.zone->data));
+    }
+    
+    if ( false == a_start ) {
+        return;
+    }
+    
+    // ... failures are logged only, HSM might be down and circuit breaker will handle it ...
+    try {
+        // ... start backend, unless it was already started by someone else ...
+        if ( false == a_backend.initialized() && a_share_dir.len > 0 ) {
+            const std::string share_dir = std::string(reinterpret_cast<const char*>(a_share_dir.data), a_share_dir.len);
+#ifdef __APPLE__
+            const std::string config = std::string(reinterpret_cast<const char*>(a_fake_config.data), a_fake_config.len);
+            a_backend.Startup(share_dir, {
+                /* new_   */ [config] () -> ::casper::hsm::API* {
+                    return new ::casper::hsm::fake::API("nginx-hsm", config);
+                },
+                /* clone_ */ [] (const ::casper::hsm::API* a_api) -> ::casper::hsm::API* {
+                    return new ::casper::hsm::fake::API(*dynamic_cast<const ::casper::hsm::fake::API*>(a_api));
+                }
+            });
+#else
+            const ::casper::hsm::SlotID slot = static_cast<::casper::hsm::SlotID>(a_slot_id);
+            const std::string           pin  = std::string(reinterpret_cast<const char*>(a_pin.data), a_pin.len);
+            a_backend.Startup(share_dir, {
+                /* new_   */ [slot, pin] () -> ::casper::hsm::API* {
+                    return new ::casper::hsm::safenet::API("nginx-hsm", slot, pin, /* a_reuse_session */ true);
+                },
+                /* clone_ */ [] (const ::casper::hsm::API* a_api) -> ::casper::hsm::API* {
+                    return new ::casper::hsm::safenet::API(*dynamic_cast<const ::casper::hsm::safenet::API*>(a_api));
+                }
+            });
+#endif
+        }
+        // ... open and log in sessions, resolve keys ...
+        if ( 1 == a_conf->warm && true == a_backend.initialized() ) {
+            a_backend.Warm();
+        }
+    } catch (const std::exception& a_exception) {
+        ngx_log_error(NGX_LOG_ERR, a_cycle->log, 0, "hsm_module: '%s' profile warm up failed - %s", a_name, a_exception.what());
+    } catch (...) {
+        ngx_log_error(NGX_LOG_ERR, a_cycle->log, 0, "hsm_module: '%s' profile warm up failed - %s", a_name, "unknown error");
+    }
+}
+
+/**
+ * @brief Worker process exit, pending audit and trace records are written.
+ *
+ * @param a_cycle
+ */
+static void ngx_http_casper_broker_hsm_module_exit_process (ngx_cycle_t* /* a_cycle */)
+{
+    ::casper::hsm::Singleton::GetInstance().StopAuditor();
+    ::casper::hsm::Singleton::GetInstance().StopTracer();
+}
+
+/**
+ * @brief Circuit breaker probe timer handler, re-establishes HSM session in background when circuit is open.
+ *
+ * @note Only posts probes and collects their outcome, PKCS#11 calls are made by each backend probe thread.
+ *
+ * @param a_event
+ */
+static void ngx_http_casper_broker_hsm_module_probe_handler (ngx_event_t* a_event)
+{
+    if ( 1 == ngx_exiting || 1 == ngx_quit || 1 == ngx_terminate ) {
+        return;
+    }
+    
+    // ... default profile and named profiles, one can't prevent others from being probed ...
+    ::casper::hsm::Singleton& singleton = ::casper::hsm::Singleton::GetInstance();
+    std::vector<std::pair<const char*, ::casper::hsm::Backend*>> backends = { { "default", &singleton } };
+    for ( const auto& it : singleton.profiles() ) {
+        backends.push_back({ it.first.c_str(), it.second });
+    }
+    for ( auto backend : backends ) {
+        try {
+            backend.second->Probe();
+        } catch (const std::exception& a_exception) {
+            ngx_log_error(NGX_LOG_WARN, a_event->log, 0, "hsm_module: '%s' profile probe failed - %s", backend.first, a_exception.what());
+        } catch (...) {
+            ngx_log_error(NGX_LOG_WARN, a_event->log, 0, "hsm_module: '%s' profile probe failed - %s", backend.first, "unknown error");
+        }
+    }
+    
+    const nginx_hsm_service_conf_t* conf = (const nginx_hsm_service_conf_t*)a_event->data;
+    ngx_add_timer(a_event, std::max(std::min(conf->breaker.cooldown, (ngx_msec_t) 1000), (ngx_msec_t) 1));
+}
+
+/**
+ * @brief Request shapes trace flush timer handler, buffered records are written every 'nginx_casper_broker_hsm_trace_flush'.
+ *
+ * @param a_event
+ */
+static void ngx_http_casper_broker_hsm_module_trace_handler (ngx_event_t* a_event)
+{
+    ::casper::hsm::Singleton::GetInstance().FlushTracer();
+    
+    if ( 1 == ngx_exiting || 1 == ngx_quit || 1 == ngx_terminate ) {
+        return;
+    }
+    
+    const nginx_hsm_service_conf_t* conf = (const nginx_hsm_service_conf_t*)a_event->data;
+    ngx_add_timer(a_event, std::max(conf->trace.flush, (ngx_msec_t) 1));
+}
+
+/**
+ * @brief Add a limiter shared memory zone, one per profile.
+ *
+ * @param a_cf
+ * @param a_limiter Limiter configuration, zone data until it's initialized.
+ * @param a_suffix  Profile name, NULL for default profile.
+ *
+ * @return NGX_OK on success, NGX_ERROR otherwise.
+ */
+static ngx_int_t ngx_http_casper_broker_hsm_module_limiter_add_zone (ngx_conf_t* a_cf, nginx_hsm_service_limiter_conf_t* a_limiter, const ngx_str_t* a_suffix)
+{
+    ngx_str_t name = ngx_string("nginx_casper_broker_hsm_limiter");
+    if ( NULL != a_suffix ) {
+        u_char* data = (u_char*)ngx_pnalloc(a_cf->pool, name.len + 1 + a_suffix->len);
+        if ( NULL == data ) {
+            return NGX_ERROR;
+        }
+        name.len  = ngx_sprintf(data, "%V_%V", &name, a_suffix) - data;
+        name.data = data;
+    }
+    a_limiter->zone = ngx_shared_memory_add(a_cf, &name, 8 * ngx_pagesize, &ngx_http_casper_broker_hsm_module);
+    if ( NULL == a_limiter->zone ) {
+        return NGX_ERROR;
+    }
+    a_limiter->zone->init = ngx_http_casper_broker_hsm_module_limiter_init_zone;
+    a_limiter->zone->data = a_limiter;
+    return NGX_OK;
+}
+
+/**
+ * @brief Initialize limiter shared memory zone.
+ *
+ * @param a_zone The shared memory zone.
+ * @param a_data Previous zone data, when reloading.
+ */
+static ngx_int_t ngx_http_casper_broker_hsm_module_limiter_init_zone (ngx_shm_zone_t* a_zone, void* a_data)
+{
+    // ... reloading? keep current state ...
+    if ( NULL != a_data ) {
+        a_zone->data = a_data;
+        return NGX_OK;
+    }
+    
+    const nginx_hsm_service_limiter_conf_t* limiter = (const nginx_hsm_service_limiter_conf_t*)a_zone->data;
+    ngx_slab_pool_t*                        shpool  = (ngx_slab_pool_t*)a_zone->shm.addr;
+    
+    ::casper::hsm::Limiter::State* state = (::casper::hsm::Limiter::State*)ngx_slab_calloc(shpool, sizeof(::casper::hsm::Limiter::State));
+    if ( NULL == state ) {
+        return NGX_ERROR;
+    }
+    ::casper::hsm::Limiter::Initialize(*state, {
+        /* min_               */ static_cast<uint32_t>(limiter->min),
+        /* max_               */ static_cast<uint32_t>(limiter->max),
+        /* target_latency_us_ */ static_cast<uint64_t>(limiter->target_latency) * 1000,
+        /* backoff_           */ 0.9,
+        /* reserved_          */ static_cast<double>(limiter->reserved) / 100.0
+    });
+    
+    a_zone->data = state;
+    
+    return NGX_OK;
+}
+
+/**
+ * @brief Initialize statistics shared memory zone.
+ *
+ * @param a_zone The shared memory zone.
+ * @param a_data Previous zone data, when reloading.
+ */
+static ngx_int_t ngx_http_casper_broker_hsm_module_statistics_init_zone (ngx_shm_zone_t* a_zone, void* a_data)
+{
+    // ... reloading? keep counting ...
+    if ( NULL != a_data ) {
+        a_zone->data = a_data;
+        return NGX_OK;
+    }
+    
+    ngx_slab_pool_t* shpool = (ngx_slab_pool_t*)a_zone->shm.addr;
+    
+    ::casper::hsm::Statistics::State* state = (::casper::hsm::Statistics::State*)ngx_slab_calloc(shpool, sizeof(::casper::hsm::Statistics::State));
+    if ( NULL == state ) {
+        return NGX_ERROR;
+    }
+    ::casper::hsm::Statistics::Initialize(*state);
+    
+    a_zone->data = state;
+    
+    return NGX_OK;
+}
+
+/**
+ * @brief Parse 'nginx_casper_broker_hsm_status' directive, statistics shared memory zone is only required when it's enabled.
+ *
+ * @param a_cf
+ * @param a_cmd
+ * @param a_conf
+ */
+static char* ngx_http_casper_broker_hsm_module_set_status_slot (ngx_conf_t* a_cf, ngx_command_t* a_cmd, void* a_conf)
+{
+    char* rv = ngx_conf_set_flag_slot(a_cf, a_cmd, a_conf);
+    if ( NGX_CONF_OK != rv ) {
+        return rv;
+    }
+    
+    const ngx_flag_t* status = (const ngx_flag_t*)((u_char*)a_conf + a_cmd->offset);
+    if ( 1 == *status ) {
+        nginx_hsm_service_conf_t* service_conf = (nginx_hsm_service_conf_t*)ngx_http_conf_get_module_main_conf(a_cf, ngx_http_casper_broker_hsm_module);
+        service_conf->statistics.used = 1;
+    }
+    
+    return (char*) NGX_CONF_OK;
+}
+
+/**
+ * @brief Parse a 'nginx_casper_broker_hsm_profile <name> [slot_id=<number>] [pin=<string>] [fake_config=<path>] [share_dir=<path>] [limiter_max=<number>]' directive.
+ *
+ * @param a_cf
+ * @param a_cmd
+ * @param a_conf
+ */
+static char* ngx_http_casper_broker_hsm_module_set_profile_slot (ngx_conf_t* a_cf, ngx_command_t* a_cmd, void* a_conf)
+{
+    ngx_array_t** profiles = (ngx_array_t**)((u_char*)a_conf + a_cmd->offset);
+    if ( NULL == *profiles ) {
+        *profiles = ngx_array_create(a_cf->pool, 4, sizeof(nginx_hsm_service_profile_conf_t));
+        if ( NULL == *profiles ) {
+            return (char*) NGX_CONF_ERROR;
+        }
+    }
+    
+    ngx_str_t* value = (ngx_str_t*)a_cf->args->elts;
+    
+    // ... name must be unique ...
+    for ( ngx_uint_t idx = 0 ; idx < (*profiles)->nelts ; ++idx ) {
+        const nginx_hsm_service_profile_conf_t* other = &((const nginx_hsm_service_profile_conf_t*)(*profiles)->elts)[idx];
+        if ( other->name.len == value[1].len && 0 == ngx_strncmp(other->name.data, value[1].data, value[1].len) ) {
+            return (char*) "is duplicate";
+        }
+    }
+    
+    nginx_hsm_service_profile_conf_t* profile = (nginx_hsm_service_profile_conf_t*)ngx_array_push(*profiles);
+    if ( NULL == profile ) {
+        return (char*) NGX_CONF_ERROR;
+    }
+    ngx_memzero(profile, sizeof(nginx_hsm_service_profile_conf_t));
+    profile->name        = value[1];
+    profile->slot_id     = NGX_CONF_UNSET_UINT;
+    profile->limiter_max = NGX_CONF_UNSET_UINT;
+    
+    for ( ngx_uint_t idx = 2 ; idx < a_cf->args->nelts ; ++idx ) {
+        const u_char* eq = (const u_char*)ngx_strlchr(value[idx].data, value[idx].data + value[idx].len, '=');
+        if ( NULL == eq ) {
+            ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "invalid parameter \"%V\"", &value[idx]);
+            return (char*) NGX_CONF_ERROR;
+        }
+        const size_t klen = static_cast<size_t>(eq - value[idx].data);
+        ngx_str_t    v    = { value[idx].len - klen - 1, value[idx].data + klen + 1 };
+        if ( 7 == klen && 0 == ngx_strncmp(value[idx].data, "slot_id", klen) ) {
+            const ngx_int_t n = ngx_atoi(v.data, v.len);
+            if ( NGX_ERROR == n ) {
+                ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "invalid slot_id \"%V\"", &v);
+                return (char*) NGX_CONF_ERROR;
+            }
+            profile->slot_id = static_cast<ngx_uint_t>(n);
+        } else if ( 3 == klen && 0 == ngx_strncmp(value[idx].data, "pin", klen) ) {
+            profile->pin = v;
+        } else if ( 11 == klen && 0 == ngx_strncmp(value[idx].data, "fake_config", klen) ) {
+            profile->fake.config = v;
+        } else if ( 9 == klen && 0 == ngx_strncmp(value[idx].data, "share_dir", klen) ) {
+            profile->share_dir = v;
+        } else if ( 11 == klen && 0 == ngx_strncmp(value[idx].data, "limiter_max", klen) ) {
+            const ngx_int_t n = ngx_atoi(v.data, v.len);
+            if ( NGX_ERROR == n || 0 == n ) {
+                ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "invalid limiter_max \"%V\"", &v);
+                return (char*) NGX_CONF_ERROR;
+            }
+            profile->limiter_max = static_cast<ngx_uint_t>(n);
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "invalid parameter \"%V\"", &value[idx]);
+            return (char*) NGX_CONF_ERROR;
+        }
+    }
+    
+    return (char*) NGX_CONF_OK;
+}
+
+/**
+ * @brief Parse a '<rate> [burst=<number>]' directive.
+ *
+ * @param a_cf
+ * @param a_cmd
+ * @param a_conf
+ */
+static char* ngx_http_casper_broker_hsm_module_set_rate_slot (ngx_conf_t* a_cf, ngx_command_t* a_cmd, void* a_conf)
+{
+    ngx_http_casper_broker_hsm_module_rate_conf_t* rate = (ngx_http_casper_broker_hsm_module_rate_conf_t*)((u_char*)a_conf + a_cmd->offset);
+    if ( NGX_CONF_UNSET_UINT != rate->rate ) {
+        return (char*) "is duplicate";
+    }
+    
+    ngx_str_t* value = (ngx_str_t*)a_cf->args->elts;
+    
+    const ngx_int_t r = ngx_atoi(value[1].data, value[1].len);
+    if ( NGX_ERROR == r ) {
+        ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "invalid rate \"%V\"", &value[1]);
+        return (char*) NGX_CONF_ERROR;
+    }
+    ngx_int_t b = r;
+    if ( 3 == a_cf->args->nelts ) {
+        if ( value[2].len <= 6 || 0 != ngx_strncmp(value[2].data, "burst=", 6) || NGX_ERROR == ( b = ngx_atoi(value[2].data + 6, value[2].len - 6) ) ) {
+            ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "invalid burst \"%V\"", &value[2]);
+            return (char*) NGX_CONF_ERROR;
+        }
+    }
+    
+    rate->rate  = static_cast<ngx_uint_t>(r);
+    rate->burst = static_cast<ngx_uint_t>(std::max(b, static_cast<ngx_int_t>(1)));
+    
+    // ... shared memory zone is required ...
+    if ( rate->rate > 0 ) {
+        nginx_hsm_service_conf_t* service_conf = (nginx_hsm_service_conf_t*)ngx_http_conf_get_module_main_conf(a_cf, ngx_http_casper_broker_hsm_module);
+        service_conf->rate_limiter.used = 1;
+    }
+    
+    return (char*) NGX_CONF_OK;
+}
+
 /**
  * @brief Alocate the module configuration structure.
  *
@@ -219,9 +1146,21 @@ static void* ngx_http_casper_broker_hsm_module_create_loc_conf (ngx_conf_t* a_cf
         return NGX_CONF_ERROR;
     }
 
-    conf->enable      = NGX_CONF_UNSET;
-    conf->log_token   = ngx_null_string;
-    conf->singleton   = NGX_CONF_UNSET;
+    conf->enable         = NGX_CONF_UNSET;
+    conf->log_token      = ngx_null_string;
+    conf->singleton      = NGX_CONF_UNSET;
+    conf->priority       = NGX_CONF_UNSET_UINT;
+    conf->bulk_threshold = NGX_CONF_UNSET_UINT;
+    conf->bulk_max_batch = NGX_CONF_UNSET_UINT;
+    conf->key_rate       = { NGX_CONF_UNSET_UINT, NGX_CONF_UNSET_UINT };
+    conf->tenant_rate    = { NGX_CONF_UNSET_UINT, NGX_CONF_UNSET_UINT };
+    conf->tenant         = NULL;
+    conf->verify         = NGX_CONF_UNSET;
+    conf->digest         = NGX_CONF_UNSET;
+    conf->status         = NGX_CONF_UNSET;
+    conf->cms            = NGX_CONF_UNSET;
+    conf->profile        = ngx_null_string;
+    conf->profile_conf   = NULL;
 
     return conf;
 }
@@ -233,20 +1172,129 @@ static void* ngx_http_casper_broker_hsm_module_create_loc_conf (ngx_conf_t* a_cf
  * @param a_parent
  * @param a_child
  */
-static char* ngx_http_casper_broker_hsm_module_merge_loc_conf (ngx_conf_t* /* a_cf */, void* a_parent, void* a_child)
+#define nrs_conf_merge_rate_value(conf, prev) \
+    if ( NGX_CONF_UNSET_UINT == conf.rate ) { \
+        if ( NGX_CONF_UNSET_UINT == prev.rate ) { \
+            conf.rate  = 0; /* 0 - unlimited */ \
+            conf.burst = 0; \
+        } else { \
+            conf = prev; \
+        } \
+    }
+static char* ngx_http_casper_broker_hsm_module_merge_loc_conf (ngx_conf_t* a_cf, void* a_parent, void* a_child)
 {
     ngx_http_casper_broker_hsm_module_loc_conf_t* prev = (ngx_http_casper_broker_hsm_module_loc_conf_t*) a_parent;
     ngx_http_casper_broker_hsm_module_loc_conf_t* conf = (ngx_http_casper_broker_hsm_module_loc_conf_t*) a_child;
 
-    ngx_conf_merge_value     (conf->enable     , prev->enable     ,           0 ); /* 0 - disabled */
-    ngx_conf_merge_str_value (conf->log_token  , prev->log_token  , "hsm_module");
-    ngx_conf_merge_value     (conf->singleton  , prev->singleton  ,           0 ); /* 0 - not set */
+    ngx_conf_merge_value     (conf->enable        , prev->enable        ,           0 ); /* 0 - disabled */
+    ngx_conf_merge_str_value (conf->log_token     , prev->log_token     , "hsm_module");
+    ngx_conf_merge_value     (conf->singleton     , prev->singleton     ,           0 ); /* 0 - not set */
+    ngx_conf_merge_uint_value(conf->priority      , prev->priority      , (ngx_uint_t) NGX_HTTP_CASPER_BROKER_HSM_PRIORITY_AUTO);
+    ngx_conf_merge_uint_value(conf->bulk_threshold, prev->bulk_threshold,          10 );
+    ngx_conf_merge_uint_value(conf->bulk_max_batch, prev->bulk_max_batch,           0 ); /* 0 - unlimited */
+    nrs_conf_merge_rate_value(conf->key_rate      , prev->key_rate);
+    nrs_conf_merge_rate_value(conf->tenant_rate   , prev->tenant_rate);
+    ngx_conf_merge_value     (conf->verify        , prev->verify        ,           0 ); /* 0 - signing endpoint */
+    ngx_conf_merge_value     (conf->digest        , prev->digest        ,           0 ); /* 0 - body is read by broker */
+    ngx_conf_merge_value     (conf->status        , prev->status        ,           0 ); /* 0 - not a status endpoint */
+    ngx_conf_merge_value     (conf->cms           , prev->cms           ,           0 ); /* 0 - not a CMS endpoint */
+    ngx_conf_merge_str_value (conf->profile       , prev->profile       ,          "" ); /* empty - default profile */
+    
+    if ( NULL == conf->tenant ) {
+        conf->tenant = prev->tenant;
+    }
+    
+    // ... profiles are only known after 'http' block is parsed ...
+    conf->profile_conf = NULL;
+    if ( conf->profile.len > 0 ) {
+        const nginx_hsm_service_conf_t* service_conf = (const nginx_hsm_service_conf_t*)ngx_http_conf_get_module_main_conf(a_cf, ngx_http_casper_broker_hsm_module);
+        // ... named profiles are only registered by workers when module is enabled ...
+        if ( 1 != service_conf->enabled ) {
+            ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "HSM profile \"%V\" requires nginx_casper_broker_hsm_enabled", &conf->profile);
+            return (char*) NGX_CONF_ERROR;
+        }
+        for ( ngx_uint_t idx = 0 ; NULL != service_conf->profiles && idx < service_conf->profiles->nelts ; ++idx ) {
+            nginx_hsm_service_profile_conf_t* profile = &((nginx_hsm_service_profile_conf_t*)service_conf->profiles->elts)[idx];
+            if ( profile->name.len == conf->profile.len && 0 == ngx_strncmp(profile->name.data, conf->profile.data, conf->profile.len) ) {
+                conf->profile_conf = profile;
+                break;
+            }
+        }
+        if ( NULL == conf->profile_conf ) {
+            ngx_conf_log_error(NGX_LOG_EMERG, a_cf, 0, "unknown HSM profile \"%V\"", &conf->profile);
+            return (char*) NGX_CONF_ERROR;
+        }
+    }
 
     NGX_BROKER_MODULE_LOC_CONF_MERGED();
 
     return (char*) NGX_CONF_OK;
 }
 
+/**
+ * @brief Register this module variables.
+ *
+ * @param a_cf
+ */
+static ngx_int_t ngx_http_casper_broker_hsm_module_add_variables (ngx_conf_t* a_cf)
+{
+    for ( ngx_http_variable_t* v = ngx_http_casper_broker_hsm_module_variables ; 0 != v->name.len ; ++v ) {
+        ngx_http_variable_t* var = ngx_http_add_variable(a_cf, &v->name, v->flags);
+        if ( NULL == var ) {
+            return NGX_ERROR;
+        }
+        var->get_handler = v->get_handler;
+        var->data        = v->data;
+    }
+    return NGX_OK;
+}
+
+/**
+ * @brief Variable 'get' handler, only called when a value was not set for the current request.
+ *
+ * @param a_r
+ * @param a_v
+ * @param a_data
+ */
+static ngx_int_t ngx_http_casper_broker_hsm_module_variable (ngx_http_request_t* /* a_r */, ngx_http_variable_value_t* a_v, uintptr_t /* a_data */)
+{
+    a_v->not_found = 1;
+    return NGX_OK;
+}
+
+/**
+ * @brief Set a variable value for a specific request.
+ *
+ * @param a_r        The http request.
+ * @param a_variable One of \link ngx_http_casper_broker_hsm_module_variable_t \link.
+ * @param a_value    Value to set, will be copied.
+ *
+ * @return NGX_OK on success, NGX_ERROR otherwise.
+ */
+ngx_int_t ngx_http_casper_broker_hsm_module_set_variable (ngx_http_request_t* a_r, ngx_http_casper_broker_hsm_module_variable_t a_variable,
+                                                          const char* const a_value)
+{
+    if ( a_variable >= NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_MAX || NGX_ERROR == ngx_http_casper_broker_hsm_module_variables_index[a_variable] ) {
+        return NGX_ERROR;
+    }
+    const size_t len  = strlen(a_value);
+    u_char*      data = (u_char*)ngx_pnalloc(a_r->pool, len);
+    if ( NULL == data ) {
+        return NGX_ERROR;
+    }
+    ngx_memcpy(data, a_value, len);
+    
+    ngx_http_variable_value_t* v = &a_r->variables[ngx_http_casper_broker_hsm_module_variables_index[a_variable]];
+    v->data         = data;
+    v->len          = len;
+    v->valid        = 1;
+    v->no_cacheable = 0;
+    v->not_found    = 0;
+    v->escape       = 0;
+    
+    return NGX_OK;
+}
+
 /**
  * @brief Filter module boiler plate installation
  *
@@ -254,6 +1302,16 @@ static char* ngx_http_casper_broker_hsm_module_merge_loc_conf (ngx_conf_t* /* a_
  */
 static ngx_int_t ngx_http_casper_broker_hsm_module_filter_init (ngx_conf_t* a_cf)
 {
+    /*
+     * Resolve variables indexes.
+     */
+    for ( ngx_uint_t idx = 0 ; idx < NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_MAX ; ++idx ) {
+        ngx_http_casper_broker_hsm_module_variables_index[idx] = ngx_http_get_variable_index(a_cf, &ngx_http_casper_broker_hsm_module_variables[idx].name);
+        if ( NGX_ERROR == ngx_http_casper_broker_hsm_module_variables_index[idx] ) {
+            return NGX_ERROR;
+        }
+    }
+    
     /*
      * Install the rewrite handler
      */
@@ -268,6 +1326,77 @@ static ngx_int_t ngx_http_casper_broker_hsm_module_filter_init (ngx_conf_t* a_cf
     return NGX_BROKER_MODULE_INSTALL_CONTENT_HANDLER(ngx_http_casper_broker_hsm_module_content_handler);
 }
 
+/**
+ * @return True if module is enabled for the request location and it's a raw document signing endpoint.
+ *
+ * @param a_r The http request.
+ */
+static bool ngx_http_casper_broker_hsm_module_is_digest_location (ngx_http_request_t* a_r)
+{
+    const ngx_http_casper_broker_hsm_module_loc_conf_t* loc_conf =
+        (const ngx_http_casper_broker_hsm_module_loc_conf_t*)ngx_http_get_module_loc_conf(a_r, ngx_http_casper_broker_hsm_module);
+    return ( NULL != loc_conf && 1 == loc_conf->enable && 1 == loc_conf->digest );
+}
+
+/**
+ * @return True if module is enabled for the request location and it's a status endpoint.
+ *
+ * @param a_r The http request.
+ */
+static bool ngx_http_casper_broker_hsm_module_is_status_location (ngx_http_request_t* a_r)
+{
+    const ngx_http_casper_broker_hsm_module_loc_conf_t* loc_conf =
+        (const ngx_http_casper_broker_hsm_module_loc_conf_t*)ngx_http_get_module_loc_conf(a_r, ngx_http_casper_broker_hsm_module);
+    return ( NULL != loc_conf && 1 == loc_conf->enable && 1 == loc_conf->status );
+}
+
+/**
+ * @brief Status endpoint content handler, renders all workers statistics as OpenMetrics text.
+ *
+ * @param a_r The http request.
+ *
+ * @return Result of sending the response, otherwise an HTTP status code.
+ */
+static ngx_int_t ngx_http_casper_broker_hsm_module_status_handler (ngx_http_request_t* a_r)
+{
+    if ( 0 == ( a_r->method & ( NGX_HTTP_GET | NGX_HTTP_HEAD ) ) ) {
+        return NGX_HTTP_NOT_ALLOWED;
+    }
+    
+    const ngx_int_t rc = ngx_http_discard_request_body(a_r);
+    if ( NGX_OK != rc ) {
+        return rc;
+    }
+    
+    // ... zone is only attached to workers where module is enabled ...
+    const ::casper::hsm::Statistics* statistics = ::casper::hsm::Singleton::GetInstance().statistics();
+    if ( nullptr == statistics ) {
+        return NGX_HTTP_SERVICE_UNAVAILABLE;
+    }
+    
+    ngx_chain_t* chain;
+    try {
+        std::string text;
+        statistics->Render(text);
+        ngx::casper::broker::hsm::Writer writer(a_r->pool, text.length());
+        writer.Append(text);
+        a_r->headers_out.content_length_n = static_cast<off_t>(writer.length());
+        chain = writer.Finish();
+    } catch (...) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    
+    a_r->headers_out.status = NGX_HTTP_OK;
+    ngx_str_set(&a_r->headers_out.content_type, "application/openmetrics-text; version=1.0.0; charset=utf-8");
+    a_r->headers_out.content_type_len = a_r->headers_out.content_type.len;
+    
+    const ngx_int_t sh = ngx_http_send_header(a_r);
+    if ( NGX_ERROR == sh || sh > NGX_OK || 1 == a_r->header_only ) {
+        return sh;
+    }
+    return ngx_http_output_filter(a_r, chain);
+}
+
 /**
  * @brief Content phase handler, sends the stashed response or if does not exist passes to next handler
  *
@@ -278,11 +1407,30 @@ static ngx_int_t ngx_http_casper_broker_hsm_module_filter_init (ngx_conf_t* a_cf
  */
 static ngx_int_t ngx_http_casper_broker_hsm_module_content_handler (ngx_http_request_t* a_r)
 {
+    /*
+     * Raw document signing? Body is not read by broker.
+     */
+    if ( true == ngx_http_casper_broker_hsm_module_is_digest_location(a_r) ) {
+        return ngx::casper::broker::hsm::Digester::Handler(a_r);
+    }
+    /*
+     * Status endpoint? No body to read.
+     */
+    if ( true == ngx_http_casper_broker_hsm_module_is_status_location(a_r) ) {
+        return ngx_http_casper_broker_hsm_module_status_handler(a_r);
+    }
     /*
      * Check if module is enabled and the request can be handled here.
      */
     NGX_BROKER_MODULE_CONTENT_HANDLER_BARRIER(a_r, ngx_http_casper_broker_hsm_module, ngx_http_casper_broker_hsm_module_loc_conf_t,
                                               "hsm_module");
+    /*
+     * Response written directly to nginx buffers?
+     */
+    const ngx_int_t rv = ngx::casper::broker::hsm::Module::ContentPhaseTackleDirectResponse(a_r);
+    if ( NGX_DECLINED != rv ) {
+        return rv;
+    }
     /*
      * This module is enabled, handle request.
      */
@@ -296,6 +1444,18 @@ static ngx_int_t ngx_http_casper_broker_hsm_module_content_handler (ngx_http_req
  */
 static ngx_int_t ngx_http_casper_broker_hsm_module_rewrite_handler (ngx_http_request_t* a_r)
 {
+    /*
+     * Raw document signing? Body must not be buffered, it's handled at content phase.
+     */
+    if ( true == ngx_http_casper_broker_hsm_module_is_digest_location(a_r) ) {
+        return NGX_DECLINED;
+    }
+    /*
+     * Status endpoint? It's handled at content phase.
+     */
+    if ( true == ngx_http_casper_broker_hsm_module_is_status_location(a_r) ) {
+        return NGX_DECLINED;
+    }
     /*
      * Check if module is enabled and the request can be handled here.
      */
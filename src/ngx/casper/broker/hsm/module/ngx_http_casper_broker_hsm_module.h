@@ -42,18 +42,132 @@ typedef struct {
 } nginx_hsm_service_fake_conf_t;
 
 typedef struct {
-    ngx_flag_t                    enabled;
-    ngx_uint_t                    slot_id;
-    ngx_str_t                     pin;
-    nginx_hsm_service_fake_conf_t fake;
+    ngx_flag_t      enabled;        //!< flag that enables HSM load shedding
+    ngx_uint_t      min;            //!< minimum number of outstanding HSM operations
+    ngx_uint_t      max;            //!< maximum ( and initial ) number of outstanding HSM operations
+    ngx_msec_t      target_latency; //!< per signature latency above which the limit is decreased
+    time_t          retry_after;    //!< 'Retry-After' header value, in seconds
+    ngx_uint_t      reserved;       //!< percentage of the limit reserved for interactive requests
+    ngx_shm_zone_t* zone;           //!< shared by all workers
+} nginx_hsm_service_limiter_conf_t;
+
+typedef struct {
+    ngx_flag_t      used;           //!< set when a rate directive is used
+    size_t          size;           //!< shared memory zone size
+    ngx_shm_zone_t* zone;           //!< shared by all workers
+} nginx_hsm_service_rate_limiter_conf_t;
+
+typedef struct {
+    ngx_uint_t      threshold;      //!< consecutive link failures that open the circuit, 0 - disabled
+    ngx_msec_t      cooldown;       //!< time to wait before probing HSM again
+} nginx_hsm_service_breaker_conf_t;
+
+typedef struct {
+    ngx_uint_t      budget;         //!< maximum percentage of signatures that can be hedged, 0 - disabled
+    ngx_uint_t      min_samples;    //!< minimum number of samples per key before hedging it
+} nginx_hsm_service_hedge_conf_t;
+
+typedef struct {
+    ngx_str_t       path;           //!< audit file path prefix, worker process ID is appended, empty - disabled
+    ngx_uint_t      buffer;         //!< per worker ring capacity, in records
+    ngx_msec_t      flush;          //!< maximum time a record waits before being written to disk
+} nginx_hsm_service_audit_conf_t;
+
+typedef struct {
+    ngx_str_t       path;           //!< trace file path prefix, worker process ID is appended, empty - disabled
+    ngx_uint_t      buffer;         //!< per worker buffer capacity, in records
+    ngx_msec_t      flush;          //!< maximum time a record waits before being written
+} nginx_hsm_service_trace_conf_t;
+
+typedef struct {
+    ngx_flag_t      used;           //!< set when a status location is declared
+    ngx_shm_zone_t* zone;           //!< shared by all workers
+} nginx_hsm_service_statistics_conf_t;
+
+typedef struct {
+    ngx_str_t                             name;           //!< see 'nginx_casper_broker_hsm_use_profile' directive
+    ngx_uint_t                            slot_id;        //!< unset - same as default profile
+    ngx_str_t                             pin;            //!< empty - same as default profile
+    nginx_hsm_service_fake_conf_t         fake;           //!< empty - same as default profile
+    ngx_str_t                             share_dir;      //!< empty - same as default profile
+    ngx_uint_t                            limiter_max;    //!< unset - same as default profile
+    nginx_hsm_service_limiter_conf_t      limiter;        //!< default profile limiter configuration, with it's own maximum and zone
+} nginx_hsm_service_profile_conf_t;
+
+typedef struct {
+    ngx_flag_t                            enabled;
+    ngx_uint_t                            slot_id;
+    ngx_str_t                             pin;
+    nginx_hsm_service_fake_conf_t         fake;
+    ngx_str_t                             share_dir;      //!< certificates directory, used when module starts HSM backend
+    ngx_flag_t                            warm;           //!< flag that enables HSM warm up at worker process start
+    ngx_uint_t                            verify_threads; //!< per worker number of helper threads used to verify signatures
+    nginx_hsm_service_limiter_conf_t      limiter;
+    nginx_hsm_service_rate_limiter_conf_t rate_limiter;
+    nginx_hsm_service_breaker_conf_t      breaker;
+    nginx_hsm_service_hedge_conf_t        hedge;
+    nginx_hsm_service_audit_conf_t        audit;
+    nginx_hsm_service_trace_conf_t        trace;
+    nginx_hsm_service_statistics_conf_t   statistics;
+    ngx_array_t*                          profiles;       //!< named profiles, each one with it's own HSM backend - \link nginx_hsm_service_profile_conf_t \link
 } nginx_hsm_service_conf_t;
 
+/**
+ * @brief Request priority classes, see 'nginx_casper_broker_hsm_priority' directive.
+ */
+typedef enum {
+    NGX_HTTP_CASPER_BROKER_HSM_PRIORITY_AUTO = 0,    //!< from 'X-Casper-HSM-Priority' header, or batch size
+    NGX_HTTP_CASPER_BROKER_HSM_PRIORITY_INTERACTIVE,
+    NGX_HTTP_CASPER_BROKER_HSM_PRIORITY_BULK
+} ngx_http_casper_broker_hsm_module_priority_t;
+
+/**
+ * @brief Token bucket configuration, see 'nginx_casper_broker_hsm_key_rate' and 'nginx_casper_broker_hsm_tenant_rate' directives.
+ */
+typedef struct {
+    ngx_uint_t rate;  //!< signatures per second, 0 - unlimited
+    ngx_uint_t burst; //!< bucket capacity
+} ngx_http_casper_broker_hsm_module_rate_conf_t;
+
 typedef struct {
-    ngx_flag_t  enable;    //!< flag that enables the module
-    ngx_str_t   log_token; //!<
-    ngx_flag_t  singleton; //!<
+    ngx_flag_t                                    enable;         //!< flag that enables the module
+    ngx_str_t                                     log_token;      //!<
+    ngx_flag_t                                    singleton;      //!<
+    ngx_uint_t                                    priority;       //!< one of \link ngx_http_casper_broker_hsm_module_priority_t \link
+    ngx_uint_t                                    bulk_threshold; //!< when priority is 'auto', number of hashes above which a request is considered bulk
+    ngx_uint_t                                    bulk_max_batch; //!< bulk signatures per admission, 0 - unlimited: when set, larger non-streamed batches are rejected with 413, streamed ones yield every this many
+    ngx_http_casper_broker_hsm_module_rate_conf_t key_rate;       //!< per 'key' token bucket
+    ngx_http_casper_broker_hsm_module_rate_conf_t tenant_rate;    //!< per tenant token bucket
+    ngx_http_complex_value_t*                     tenant;         //!< tenant identifier, e.g. $http_x_tenant
+    ngx_flag_t                                    verify;         //!< flag that turns this location into a local signature verification endpoint
+    ngx_flag_t                                    digest;         //!< flag that turns this location into a raw document signing endpoint, body is hashed while received
+    ngx_flag_t                                    status;         //!< flag that turns this location into an OpenMetrics status endpoint
+    ngx_flag_t                                    cms;            //!< flag that turns this location into a detached CMS SignedData endpoint
+    ngx_str_t                                     profile;        //!< HSM profile name, empty - default profile
+    nginx_hsm_service_profile_conf_t*             profile_conf;   //!< resolved when merged, NULL - default profile
 } ngx_http_casper_broker_hsm_module_loc_conf_t;
 
+#ifdef __APPLE__
+#pragma mark - module variables
+#endif
+
+/**
+ * @brief Per request variables, available to 'log_format' directive.
+ */
+typedef enum {
+    NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_SIGN_COUNT = 0, //!< $hsm_sign_count - number of signatures performed
+    NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_WAIT_MS,        //!< $hsm_wait_ms    - time spent waiting for HSM, in milliseconds
+    NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_SESSION_MS,     //!< $hsm_session_ms - time spent opening and logging in sessions, in milliseconds
+    NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_FIND_MS,        //!< $hsm_find_ms    - time spent looking up private keys, in milliseconds
+    NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_CACHE_HIT,      //!< $hsm_cache_hit  - 1 if no session had to be opened, 0 otherwise
+    NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_SLOT,           //!< $hsm_slot       - slot ID in use
+    NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_PRIORITY,       //!< $hsm_priority   - 'interactive' or 'bulk'
+    NGX_HTTP_CASPER_BROKER_HSM_VARIABLE_MAX
+} ngx_http_casper_broker_hsm_module_variable_t;
+
 extern ngx_module_t ngx_http_casper_broker_hsm_module;
 
+ngx_int_t ngx_http_casper_broker_hsm_module_set_variable (ngx_http_request_t* a_r, ngx_http_casper_broker_hsm_module_variable_t a_variable,
+                                                          const char* const a_value);
+
 #endif // NRS_NGX_HTTP_CASPER_BROKER_HSM_MODULE_H_
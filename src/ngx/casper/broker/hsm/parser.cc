@@ -0,0 +1,221 @@
+/**
+ * @file parser.cc
+ *
+ * Copyright (c) 2017-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of nginx-hsm.
+ *
+ * nginx-hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nginx-hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with nginx-hsm. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ngx/casper/broker/hsm/parser.h"
+
+#include <stdint.h> // uint8_t
+#include <string.h> // memcmp
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+  #define NGX_CASPER_BROKER_HSM_PARSER_SSE2 1
+#endif
+
+/**
+ * @brief Parse a sign request.
+ *
+ * @param a_data    JSON body.
+ * @param a_length  JSON body length, in bytes.
+ * @param o_request Parsed request, all views point to \link a_data \link memory.
+ *
+ * @return True on success, false if body is not in the supported subset ( and not necessarily invalid ).
+ */
+bool ngx::casper::broker::hsm::Parser::Parse (const char* const a_data, const size_t a_length, ngx::casper::broker::hsm::Parser::Request& o_request)
+{
+    const char*       ptr  = a_data;
+    const char* const end  = a_data + a_length;
+    uint8_t           seen = 0x00;
+    
+    o_request.key_    = { nullptr, 0 };
+    o_request.merkle_ = false;
+    o_request.chain_  = false;
+    o_request.hash_.clear();
+    
+    ptr = Skip(ptr, end);
+    if ( ptr == end || '{' != *ptr ) {
+        return false;
+    }
+    ptr = Skip(ptr + 1, end);
+    // ... members ...
+    while ( true ) {
+        View name;
+        if ( nullptr == ( ptr = String(ptr, end, name) ) ) {
+            return false;
+        }
+        ptr = Skip(ptr, end);
+        if ( ptr == end || ':' != *ptr ) {
+            return false;
+        }
+        ptr = Skip(ptr + 1, end);
+        // ... known members only, once ...
+        uint8_t member;
+        if ( 3 == name.length_ && 0 == memcmp(name.data_, "key", 3) ) {
+            member = 0x01;
+            ptr = String(ptr, end, o_request.key_);
+        } else if ( 4 == name.length_ && 0 == memcmp(name.data_, "hash", 4) ) {
+            member = 0x02;
+            if ( ptr < end && '[' == *ptr ) {
+                ptr = Skip(ptr + 1, end);
+                if ( ptr < end && ']' == *ptr ) {
+                    ptr++;
+                } else {
+                    while ( nullptr != ptr ) {
+                        View hash;
+                        if ( nullptr == ( ptr = String(ptr, end, hash) ) ) {
+                            break;
+                        }
+                        o_request.hash_.push_back(hash);
+                        ptr = Skip(ptr, end);
+                        if ( ptr < end && ',' == *ptr ) {
+                            ptr = Skip(ptr + 1, end);
+                        } else if ( ptr < end && ']' == *ptr ) {
+                            ptr++;
+                            break;
+                        } else {
+                            ptr = nullptr;
+                        }
+                    }
+                }
+            } else {
+                View hash;
+                if ( nullptr != ( ptr = String(ptr, end, hash) ) ) {
+                    o_request.hash_.push_back(hash);
+                }
+            }
+        } else if ( 6 == name.length_ && 0 == memcmp(name.data_, "merkle", 6) ) {
+            member = 0x04;
+            ptr = Boolean(ptr, end, o_request.merkle_);
+        } else if ( 5 == name.length_ && 0 == memcmp(name.data_, "chain", 5) ) {
+            member = 0x08;
+            ptr = Boolean(ptr, end, o_request.chain_);
+        } else {
+            return false;
+        }
+        if ( nullptr == ptr || 0 != ( seen & member ) ) {
+            return false;
+        }
+        seen |= member;
+        // ... next?
+        ptr = Skip(ptr, end);
+        if ( ptr == end ) {
+            return false;
+        } else if ( ',' == *ptr ) {
+            ptr = Skip(ptr + 1, end);
+        } else if ( '}' == *ptr ) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    // ... 'key' is mandatory, nothing but whitespace after object ...
+    return ( 0 != ( seen & 0x01 ) && end == Skip(ptr + 1, end) );
+}
+
+// MARK: -
+
+/**
+ * @brief Skip JSON whitespace.
+ *
+ * @param a_ptr Current position.
+ * @param a_end End of data.
+ *
+ * @return First non whitespace position or \link a_end \link.
+ */
+const char* ngx::casper::broker::hsm::Parser::Skip (const char* a_ptr, const char* const a_end)
+{
+    while ( a_ptr < a_end && ( ' ' == *a_ptr || '\n' == *a_ptr || '\r' == *a_ptr || '\t' == *a_ptr ) ) {
+        a_ptr++;
+    }
+    return a_ptr;
+}
+
+/**
+ * @brief Find next string delimiter ( '"' ) or escape ( '\' ), 16 bytes at a time when SSE2 is available.
+ *
+ * @param a_ptr Current position.
+ * @param a_end End of data.
+ *
+ * @return Delimiter position or \link a_end \link.
+ */
+const char* ngx::casper::broker::hsm::Parser::Scan (const char* a_ptr, const char* const a_end)
+{
+#ifdef NGX_CASPER_BROKER_HSM_PARSER_SSE2
+    const __m128i quote     = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    while ( a_end - a_ptr >= 16 ) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_ptr));
+        const int     mask  = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+        if ( 0 != mask ) {
+            return a_ptr + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+        a_ptr += 16;
+    }
+#endif
+    // ... tail ...
+    while ( a_ptr < a_end && '"' != *a_ptr && '\\' != *a_ptr ) {
+        a_ptr++;
+    }
+    return a_ptr;
+}
+
+/**
+ * @brief Read a string without escape sequences.
+ *
+ * @param a_ptr  Current position, at opening quote.
+ * @param a_end  End of data.
+ * @param o_view String contents, without quotes.
+ *
+ * @return Position after closing quote, nullptr if not a string or if it has escape sequences.
+ */
+const char* ngx::casper::broker::hsm::Parser::String (const char* a_ptr, const char* const a_end, ngx::casper::broker::hsm::Parser::View& o_view)
+{
+    if ( a_ptr >= a_end || '"' != *a_ptr ) {
+        return nullptr;
+    }
+    const char* const start = a_ptr + 1;
+    const char* const stop  = Scan(start, a_end);
+    if ( stop == a_end || '"' != *stop ) {
+        return nullptr;
+    }
+    o_view = { start, static_cast<size_t>(stop - start) };
+    return stop + 1;
+}
+
+/**
+ * @brief Read a boolean literal.
+ *
+ * @param a_ptr   Current position.
+ * @param a_end   End of data.
+ * @param o_value Literal value.
+ *
+ * @return Position after literal, nullptr if not a boolean.
+ */
+const char* ngx::casper::broker::hsm::Parser::Boolean (const char* a_ptr, const char* const a_end, bool& o_value)
+{
+    if ( a_end - a_ptr >= 4 && 0 == memcmp(a_ptr, "true", 4) ) {
+        o_value = true;
+        return a_ptr + 4;
+    } else if ( a_end - a_ptr >= 5 && 0 == memcmp(a_ptr, "false", 5) ) {
+        o_value = false;
+        return a_ptr + 5;
+    }
+    return nullptr;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file parser.h
+ *
+ * Copyright (c) 2017-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of nginx-hsm.
+ *
+ * nginx-hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nginx-hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with nginx-hsm. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef NRS_NGX_CASPER_BROKER_HSM_PARSER_H_
+#define NRS_NGX_CASPER_BROKER_HSM_PARSER_H_
+
+#include "ngx/casper/broker/hsm/pool_allocator.h"
+
+#include <stddef.h> // size_t
+
+namespace ngx
+{
+    
+    namespace casper
+    {
+        
+        namespace broker
+        {
+            
+            namespace hsm
+            {
+                
+                //
+                // Schema specialized JSON sign request parser, no DOM and no copies:
+                //
+                // { "key": <string>, "hash": <string> | [<string>], "merkle": <bool>, "chain": <bool> }
+                //
+                // Only the common subset is handled - no escaped strings, no unknown or duplicated members - anything
+                // else is rejected so caller can fallback to a full JSON parser, which will also report errors.
+                //
+                class Parser final
+                {
+                    
+                public: // Data Type(s)
+                    
+                    typedef struct {
+                        const char* data_;
+                        size_t      length_;
+                    } View;
+                    
+                    typedef struct {
+                        View                                       key_;    //!< HSM private key token label.
+                        ngx::casper::broker::hsm::PoolVector<View> hash_;   //!< Base64 encoded data to sign.
+                        bool                                       merkle_;
+                        bool                                       chain_;
+                    } Request;
+                    
+                public: // Constructor(s) / Destructor
+                    
+                    Parser () = delete;
+                    
+                public: // Static Method(s) / Function(s)
+                    
+                    static bool Parse (const char* const a_data, const size_t a_length, Request& o_request);
+                    
+                private: // Static Method(s) / Function(s)
+                    
+                    static const char* Skip    (const char* a_ptr, const char* const a_end);
+                    static const char* Scan    (const char* a_ptr, const char* const a_end);
+                    static const char* String  (const char* a_ptr, const char* const a_end, View& o_view);
+                    static const char* Boolean (const char* a_ptr, const char* const a_end, bool& o_value);
+                    
+                }; // end of class 'Parser'
+                
+            } // end of namespace 'hsm'
+            
+        } // end of namespace 'broker'
+        
+    } // end of namespace 'casper'
+    
+} // end of namespace 'ngx'
+
+#endif // NRS_NGX_CASPER_BROKER_HSM_PARSER_H_
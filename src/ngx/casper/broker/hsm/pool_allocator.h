@@ -0,0 +1,166 @@
+/**
+ * @file pool_allocator.h
+ *
+ * Copyright (c) 2017-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of nginx-hsm.
+ *
+ * nginx-hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nginx-hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with nginx-hsm. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef NRS_NGX_CASPER_BROKER_HSM_POOL_ALLOCATOR_H_
+#define NRS_NGX_CASPER_BROKER_HSM_POOL_ALLOCATOR_H_
+
+extern "C" {
+    #include <ngx_config.h>
+    #include <ngx_core.h>
+}
+
+#include "cc/exception.h"
+
+#include <vector>
+#include <stddef.h> // size_t
+
+namespace ngx
+{
+    
+    namespace casper
+    {
+        
+        namespace broker
+        {
+            
+            namespace hsm
+            {
+                
+                /**
+                 * @brief STL allocator backed by an nginx pool, memory is released in one shot when the pool is destroyed.
+                 *
+                 * Small blocks are never given back, large ones ( above pool's max ) are freed as soon as a container grows.
+                 * Not final, STL containers derive from their allocator.
+                 */
+                template <typename T>
+                class PoolAllocator
+                {
+                    
+                    template <typename U> friend class PoolAllocator;
+                    
+                public: // Data Type(s)
+                    
+                    typedef T         value_type;
+                    typedef T*        pointer;
+                    typedef const T*  const_pointer;
+                    typedef T&        reference;
+                    typedef const T&  const_reference;
+                    typedef size_t    size_type;
+                    typedef ptrdiff_t difference_type;
+                    
+                    template <typename U> struct rebind {
+                        typedef PoolAllocator<U> other;
+                    };
+                    
+                private: // Refs
+                    
+                    ngx_pool_t* pool_;
+                    
+                public: // Constructor(s) / Destructor
+                    
+                    PoolAllocator () = delete;
+                    
+                    /**
+                     * @brief Default constructor.
+                     *
+                     * @param a_pool nginx pool, usually the request one.
+                     */
+                    PoolAllocator (ngx_pool_t* a_pool)
+                        : pool_(a_pool)
+                    {
+                        /* empty */
+                    }
+                    
+                    /**
+                     * @brief Rebind constructor.
+                     *
+                     * @param a_other Allocator to copy pool from.
+                     */
+                    template <typename U>
+                    PoolAllocator (const PoolAllocator<U>& a_other)
+                        : pool_(a_other.pool_)
+                    {
+                        /* empty */
+                    }
+                    
+                public: // Method(s) / Function(s)
+                    
+                    /**
+                     * @brief Allocate memory from pool.
+                     *
+                     * @param a_count Number of objects.
+                     *
+                     * @return Pointer to uninitialized memory.
+                     */
+                    inline T* allocate (const size_t a_count)
+                    {
+                        void* p = ngx_palloc(pool_, a_count * sizeof(T));
+                        if ( nullptr == p ) {
+                            throw ::cc::Exception("Unable to allocate %zu byte(s) from pool!", a_count * sizeof(T));
+                        }
+                        return static_cast<T*>(p);
+                    }
+                    
+                    /**
+                     * @brief Release memory, only large blocks are given back - others are kept until pool is destroyed.
+                     *
+                     * @param a_pointer Previously allocated memory.
+                     */
+                    inline void deallocate (T* a_pointer, const size_t /* a_count */)
+                    {
+                        (void)ngx_pfree(pool_, a_pointer);
+                    }
+                    
+                    /**
+                     * @return True if both allocators share the same pool.
+                     */
+                    template <typename U>
+                    inline bool operator == (const PoolAllocator<U>& a_other) const
+                    {
+                        return ( pool_ == a_other.pool_ );
+                    }
+                    
+                    /**
+                     * @return True if allocators don't share the same pool.
+                     */
+                    template <typename U>
+                    inline bool operator != (const PoolAllocator<U>& a_other) const
+                    {
+                        return ( pool_ != a_other.pool_ );
+                    }
+                    
+                }; // end of class 'PoolAllocator'
+                
+                /**
+                 * @brief Request scoped vector.
+                 */
+                template <typename T>
+                using PoolVector = std::vector<T, PoolAllocator<T>>;
+                
+            } // end of namespace 'hsm'
+            
+        } // end of namespace 'broker'
+        
+    } // end of namespace 'casper'
+    
+} // end of namespace 'ngx'
+
+#endif // NRS_NGX_CASPER_BROKER_HSM_POOL_ALLOCATOR_H_
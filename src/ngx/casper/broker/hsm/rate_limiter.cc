@@ -0,0 +1,263 @@
+/**
+ * @file rate_limiter.cc
+ *
+ * Copyright (c) 2017-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of nginx-hsm.
+ *
+ * nginx-hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nginx-hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with nginx-hsm. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ngx/casper/broker/hsm/rate_limiter.h"
+
+#include <algorithm> // std::min, std::max
+
+/**
+ * @brief Default constructor.
+ *
+ * @param a_zone Shared memory zone, initialized by \link InitZone \link.
+ */
+ngx::casper::broker::hsm::RateLimiter::RateLimiter (ngx_shm_zone_t* a_zone)
+    : zone_(a_zone)
+{
+    /* empty */
+}
+
+/**
+ * @brief Destructor.
+ */
+ngx::casper::broker::hsm::RateLimiter::~RateLimiter ()
+{
+    /* empty */
+}
+
+/**
+ * @brief Take tokens from all buckets, or from none.
+ *
+ * @param a_buckets     Buckets to take tokens from.
+ * @param a_cost        Number of tokens to take from each bucket.
+ * @param o_retry_after When rejected, number of seconds after which a retry should succeed.
+ *
+ * @return True if tokens were taken, false if request should be rejected.
+ */
+bool ngx::casper::broker::hsm::RateLimiter::Take (const std::vector<ngx::casper::broker::hsm::RateLimiter::Bucket>& a_buckets, const uint64_t a_cost,
+                                                  time_t& o_retry_after)
+{
+    o_retry_after = 0;
+    
+    ngx_slab_pool_t* pool   = (ngx_slab_pool_t*)zone_->shm.addr;
+    Shared*          shared = (Shared*)zone_->data;
+    
+    const ngx_msec_t now  = ngx_current_msec;
+    const int64_t    cost = static_cast<int64_t>(a_cost) * 1000;
+    
+    Node* nodes[2] = { nullptr, nullptr };
+    if ( a_buckets.size() > sizeof(nodes) / sizeof(nodes[0]) ) {
+        return true;
+    }
+    
+    ngx_shmtx_lock(&pool->mutex);
+    
+    bool allowed = true;
+    for ( size_t idx = 0 ; idx < a_buckets.size() ; ++idx ) {
+        const Bucket& bucket = a_buckets[idx];
+        // ... out of memory, fail open - a bucket already picked can't be released to make room for this one ...
+        Node* node = Lookup(shared, pool, bucket, now, nodes[0]);
+        if ( nullptr == node ) {
+            continue;
+        }
+        nodes[idx] = node;
+        // ... refill, 'rate' tokens per second is 'rate' milli-tokens per millisecond ...
+        const int64_t capacity = static_cast<int64_t>(bucket.burst_) * 1000;
+        node->tokens_ = std::min(capacity, node->tokens_ + static_cast<int64_t>((ngx_msec_int_t)(now - node->last_)) * static_cast<int64_t>(bucket.rate_));
+        node->last_   = now;
+        // ... a batch larger than the bucket is accepted when bucket is full, leaving it in debt ...
+        if ( node->tokens_ < cost && node->tokens_ < capacity ) {
+            const int64_t deficit = std::min(cost, capacity) - node->tokens_;
+            const int64_t rate    = std::max(static_cast<int64_t>(bucket.rate_), static_cast<int64_t>(1)) * 1000;
+            o_retry_after = std::max(o_retry_after, static_cast<time_t>(( deficit + rate - 1 ) / rate));
+            allowed       = false;
+        }
+    }
+    
+    if ( true == allowed ) {
+        for ( auto node : nodes ) {
+            if ( nullptr != node ) {
+                node->tokens_ -= cost;
+            }
+        }
+    }
+    
+    ngx_shmtx_unlock(&pool->mutex);
+    
+    return allowed;
+}
+
+// MARK: -
+
+/**
+ * @brief Initialize shared memory zone.
+ *
+ * @param a_zone The shared memory zone.
+ * @param a_data Previous zone data, when reloading.
+ */
+ngx_int_t ngx::casper::broker::hsm::RateLimiter::InitZone (ngx_shm_zone_t* a_zone, void* a_data)
+{
+    // ... reloading? keep current buckets ...
+    if ( NULL != a_data ) {
+        a_zone->data = a_data;
+        return NGX_OK;
+    }
+    
+    ngx_slab_pool_t* pool = (ngx_slab_pool_t*)a_zone->shm.addr;
+    if ( 1 == a_zone->shm.exists ) {
+        a_zone->data = pool->data;
+        return NGX_OK;
+    }
+    
+    Shared* shared = (Shared*)ngx_slab_alloc(pool, sizeof(Shared));
+    if ( NULL == shared ) {
+        return NGX_ERROR;
+    }
+    
+    pool->data = shared;
+    
+    ngx_rbtree_init(&shared->rbtree_, &shared->sentinel_, Insert);
+    ngx_queue_init(&shared->queue_);
+    
+    a_zone->data = shared;
+    
+    return NGX_OK;
+}
+
+// MARK: -
+
+/**
+ * @brief Find or create a bucket node, must be called with zone locked.
+ *
+ * @param a_shared Shared data.
+ * @param a_pool   Zone slab pool.
+ * @param a_bucket Bucket to look for.
+ * @param a_now    Current time.
+ * @param a_keep   Node in use by caller, not to be released when making room, nullptr if none.
+ *
+ * @return Bucket node, nullptr if there's no memory to create it.
+ */
+ngx::casper::broker::hsm::RateLimiter::Node* ngx::casper::broker::hsm::RateLimiter::Lookup (Shared* a_shared, ngx_slab_pool_t* a_pool,
+                                                                                            const ngx::casper::broker::hsm::RateLimiter::Bucket& a_bucket,
+                                                                                            const ngx_msec_t a_now, const ngx::casper::broker::hsm::RateLimiter::Node* a_keep)
+{
+    u_char*          id     = (u_char*)a_bucket.id_.c_str();
+    const size_t     length = a_bucket.id_.length();
+    const uint32_t   hash   = ngx_crc32_short(id, length);
+    
+    ngx_rbtree_node_t* node     = a_shared->rbtree_.root;
+    ngx_rbtree_node_t* sentinel = a_shared->rbtree_.sentinel;
+    
+    while ( node != sentinel ) {
+        if ( hash != node->key ) {
+            node = ( hash < node->key ) ? node->left : node->right;
+            continue;
+        }
+        Node* n = (Node*)node;
+        const ngx_int_t rc = ngx_memn2cmp(id, n->id_, length, n->length_);
+        if ( 0 == rc ) {
+            // ... most recently used ...
+            ngx_queue_remove(&n->queue_);
+            ngx_queue_insert_head(&a_shared->queue_, &n->queue_);
+            return n;
+        }
+        node = ( rc < 0 ) ? node->left : node->right;
+    }
+    
+    // ... new bucket, starts full ...
+    const size_t size = offsetof(Node, id_) + length;
+    Node* n = (Node*)ngx_slab_alloc_locked(a_pool, size);
+    if ( NULL == n ) {
+        Expire(a_shared, a_pool, 2, a_keep);
+        n = (Node*)ngx_slab_alloc_locked(a_pool, size);
+        if ( NULL == n ) {
+            return nullptr;
+        }
+    }
+    n->node_.key = hash;
+    n->tokens_   = static_cast<int64_t>(a_bucket.burst_) * 1000;
+    n->last_     = a_now;
+    n->length_   = length;
+    ngx_memcpy(n->id_, id, length);
+    
+    ngx_rbtree_insert(&a_shared->rbtree_, &n->node_);
+    ngx_queue_insert_head(&a_shared->queue_, &n->queue_);
+    
+    return n;
+}
+
+/**
+ * @brief Release least recently used buckets, must be called with zone locked.
+ *
+ * @param a_shared Shared data.
+ * @param a_pool   Zone slab pool.
+ * @param a_count  Maximum number of buckets to release.
+ * @param a_keep   Node in use by caller, never released, nullptr if none.
+ */
+void ngx::casper::broker::hsm::RateLimiter::Expire (Shared* a_shared, ngx_slab_pool_t* a_pool, const size_t a_count,
+                                                    const ngx::casper::broker::hsm::RateLimiter::Node* a_keep)
+{
+    ngx_queue_t* q        = ngx_queue_last(&a_shared->queue_);
+    size_t       released = 0;
+    while ( released < a_count && ngx_queue_sentinel(&a_shared->queue_) != q ) {
+        Node*        n    = ngx_queue_data(q, Node, queue_);
+        ngx_queue_t* prev = ngx_queue_prev(q);
+        if ( a_keep != n ) {
+            ngx_queue_remove(q);
+            ngx_rbtree_delete(&a_shared->rbtree_, &n->node_);
+            ngx_slab_free_locked(a_pool, n);
+            released++;
+        }
+        q = prev;
+    }
+}
+
+/**
+ * @brief Red-black tree insert function, nodes are sorted by hash and then by id.
+ *
+ * @param a_root     Tree root.
+ * @param a_node     Node to insert.
+ * @param a_sentinel Tree sentinel.
+ */
+void ngx::casper::broker::hsm::RateLimiter::Insert (ngx_rbtree_node_t* a_root, ngx_rbtree_node_t* a_node, ngx_rbtree_node_t* a_sentinel)
+{
+    ngx_rbtree_node_t*  temp = a_root;
+    ngx_rbtree_node_t** p;
+    
+    for ( ;; ) {
+        if ( a_node->key != temp->key ) {
+            p = ( a_node->key < temp->key ) ? &temp->left : &temp->right;
+        } else {
+            const Node* n = (const Node*)a_node;
+            const Node* t = (const Node*)temp;
+            p = ( ngx_memn2cmp((u_char*)n->id_, (u_char*)t->id_, n->length_, t->length_) < 0 ) ? &temp->left : &temp->right;
+        }
+        if ( *p == a_sentinel ) {
+            break;
+        }
+        temp = *p;
+    }
+    
+    *p             = a_node;
+    a_node->parent = temp;
+    a_node->left   = a_sentinel;
+    a_node->right  = a_sentinel;
+    ngx_rbt_red(a_node);
+}
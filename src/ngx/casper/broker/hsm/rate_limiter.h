@@ -0,0 +1,120 @@
+/**
+ * @file rate_limiter.h
+ *
+ * Copyright (c) 2017-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of nginx-hsm.
+ *
+ * nginx-hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nginx-hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with nginx-hsm. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef NRS_NGX_CASPER_BROKER_HSM_RATE_LIMITER_H_
+#define NRS_NGX_CASPER_BROKER_HSM_RATE_LIMITER_H_
+
+extern "C" {
+    #include <ngx_config.h>
+    #include <ngx_core.h>
+    #include <ngx_http.h>
+}
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <string>
+#include <vector>
+
+#include <stdint.h> // uint64_t
+
+namespace ngx
+{
+    
+    namespace casper
+    {
+        
+        namespace broker
+        {
+            
+            namespace hsm
+            {
+                
+                /**
+                 * @brief Token buckets kept in a shared memory zone, so limits hold across workers.
+                 */
+                class RateLimiter final : public ::cc::NonCopyable, public ::cc::NonMovable
+                {
+                    
+                public: // Data Type(s)
+                    
+                    typedef struct {
+                        std::string id_;    //!< Bucket identifier.
+                        uint64_t    rate_;  //!< Tokens per second.
+                        uint64_t    burst_; //!< Bucket capacity.
+                    } Bucket;
+                    
+                private: // Data Type(s)
+                    
+                    typedef struct {
+                        ngx_rbtree_t      rbtree_;
+                        ngx_rbtree_node_t sentinel_;
+                        ngx_queue_t       queue_;    //!< Least recently used first ( tail ).
+                    } Shared;
+                    
+                    typedef struct {
+                        ngx_rbtree_node_t node_;
+                        ngx_queue_t       queue_;
+                        int64_t           tokens_;   //!< Available tokens, in milli-units - negative after a batch larger than the bucket.
+                        ngx_msec_t        last_;     //!< Last refill.
+                        size_t            length_;
+                        u_char            id_[1];
+                    } Node;
+                    
+                private: // Const Data
+                    
+                    ngx_shm_zone_t* const zone_;
+                    
+                public: // Constructor(s) / Destructor
+                    
+                    RateLimiter () = delete;
+                    RateLimiter (ngx_shm_zone_t* a_zone);
+                    virtual ~RateLimiter ();
+                    
+                public: // Method(s) / Function(s)
+                    
+                    bool Take (const std::vector<Bucket>& a_buckets, const uint64_t a_cost, time_t& o_retry_after);
+                    
+                public: // Static Method(s) / Function(s)
+                    
+                    static ngx_int_t InitZone (ngx_shm_zone_t* a_zone, void* a_data);
+                    
+                private: // Method(s) / Function(s)
+                    
+                    Node* Lookup (Shared* a_shared, ngx_slab_pool_t* a_pool, const Bucket& a_bucket, const ngx_msec_t a_now, const Node* a_keep);
+                    void  Expire (Shared* a_shared, ngx_slab_pool_t* a_pool, const size_t a_count, const Node* a_keep);
+                    
+                private: // Static Method(s) / Function(s)
+                    
+                    static void Insert (ngx_rbtree_node_t* a_root, ngx_rbtree_node_t* a_node, ngx_rbtree_node_t* a_sentinel);
+                    
+                }; // end of class 'RateLimiter'
+                
+            } // end of namespace 'hsm'
+            
+        } // end of namespace 'broker'
+        
+    } // end of namespace 'casper'
+    
+} // end of namespace 'ngx'
+
+#endif // NRS_NGX_CASPER_BROKER_HSM_RATE_LIMITER_H_
@@ -0,0 +1,223 @@
+/**
+ * @file main.cc
+ *
+ * Copyright (c) 2017-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of nginx-hsm.
+ *
+ * nginx-hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nginx-hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with nginx-hsm. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// Zero-copy JSON sign request parser tests, checked against the DOM path ( jsoncpp ).
+//
+// Usage: nginx-casper-broker-hsm-parser-test
+//
+// Parser may reject what DOM accepts ( caller falls back to DOM ), but whatever it accepts must be read exactly as DOM
+// reads it, and nothing DOM rejects may be accepted. Exit status is 0 when all pass.
+//
+
+#include "ngx/casper/broker/hsm/parser.h"
+
+#include "json/json.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdio.h>  // fprintf
+#include <stdlib.h> // malloc, free
+
+//
+// Request pool is not needed, allocations are released at exit.
+//
+extern "C" {
+    void* ngx_palloc (ngx_pool_t* /* a_pool */, size_t a_size)
+    {
+        return malloc(a_size);
+    }
+    ngx_int_t ngx_pfree (ngx_pool_t* /* a_pool */, void* a_ptr)
+    {
+        free(a_ptr);
+        return NGX_OK;
+    }
+}
+
+#ifdef __APPLE__
+#pragma mark - Helpers
+#endif
+
+static size_t s_failures_ = 0;
+
+#define NGX_CASPER_BROKER_HSM_TEST_CHECK(a_condition, ...) \
+    do { \
+        if ( !(a_condition) ) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            s_failures_++; \
+        } \
+    } while (0)
+
+typedef struct {
+    std::string              key_;
+    std::vector<std::string> hash_;
+    bool                     merkle_;
+    bool                     chain_;
+} Expected;
+
+/**
+ * @brief Read a sign request as the DOM path does.
+ *
+ * @param a_body     Request body.
+ * @param o_expected Request members.
+ *
+ * @return False if DOM path would reject request.
+ */
+static bool DOM (const std::string& a_body, Expected& o_expected)
+{
+    Json::CharReaderBuilder builder;
+    builder["failIfExtra"] = true;
+    Json::Value                       dom;
+    std::string                       errors;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    if ( false == reader->parse(a_body.c_str(), a_body.c_str() + a_body.length(), &dom, &errors) || false == dom.isObject() ) {
+        return false;
+    }
+    if ( false == dom.isMember("key") || false == dom["key"].isString() ) {
+        return false;
+    }
+    o_expected.key_ = dom["key"].asString();
+    o_expected.hash_.clear();
+    if ( true == dom.isMember("hash") ) {
+        const Json::Value& hash = dom["hash"];
+        if ( true == hash.isString() ) {
+            o_expected.hash_.push_back(hash.asString());
+        } else if ( true == hash.isArray() ) {
+            for ( Json::ArrayIndex idx = 0 ; idx < hash.size() ; ++idx ) {
+                if ( false == hash[idx].isString() ) {
+                    return false;
+                }
+                o_expected.hash_.push_back(hash[idx].asString());
+            }
+        } else if ( false == hash.isNull() ) {
+            return false;
+        }
+    }
+    for ( auto member : { "merkle", "chain" } ) {
+        if ( true == dom.isMember(member) && false == dom[member].isBool() ) {
+            return false;
+        }
+    }
+    o_expected.merkle_ = dom.get("merkle", false).asBool();
+    o_expected.chain_  = dom.get("chain" , false).asBool();
+    return true;
+}
+
+/**
+ * @brief Parse a sign request with both paths and compare results.
+ *
+ * @param a_body   Request body.
+ * @param a_parsed True if parser is expected to handle it ( fast path ).
+ */
+static void Check (const std::string& a_body, const bool a_parsed)
+{
+    const ngx::casper::broker::hsm::PoolAllocator<unsigned char> allocator(nullptr);
+    ngx::casper::broker::hsm::Parser::Request                   request = {
+        /* key_    */ { nullptr, 0 },
+        /* hash_   */ ngx::casper::broker::hsm::PoolVector<ngx::casper::broker::hsm::Parser::View>(allocator),
+        /* merkle_ */ false,
+        /* chain_  */ false
+    };
+    // ... a copy, so a read past the end is caught by sanitizers ...
+    std::vector<char> body(a_body.begin(), a_body.end());
+    const bool        parsed = ngx::casper::broker::hsm::Parser::Parse(body.data(), body.size(), request);
+    Expected          expected;
+    const bool        dom    = DOM(a_body, expected);
+    
+    NGX_CASPER_BROKER_HSM_TEST_CHECK(a_parsed == parsed, "'%s' is%s expected to be parsed", a_body.c_str(), ( true == a_parsed ? "" : " NOT" ));
+    if ( false == parsed ) {
+        return;
+    }
+    NGX_CASPER_BROKER_HSM_TEST_CHECK(true == dom, "'%s' accepted by parser, rejected by DOM", a_body.c_str());
+    if ( false == dom ) {
+        return;
+    }
+    NGX_CASPER_BROKER_HSM_TEST_CHECK(expected.key_ == std::string(request.key_.data_, request.key_.length_), "'%s' key mismatch", a_body.c_str());
+    NGX_CASPER_BROKER_HSM_TEST_CHECK(expected.hash_.size() == request.hash_.size(), "'%s' hash count mismatch", a_body.c_str());
+    for ( size_t idx = 0 ; idx < expected.hash_.size() && idx < request.hash_.size() ; ++idx ) {
+        NGX_CASPER_BROKER_HSM_TEST_CHECK(expected.hash_[idx] == std::string(request.hash_[idx].data_, request.hash_[idx].length_),
+                                         "'%s' hash #%zu mismatch", a_body.c_str(), idx);
+    }
+    NGX_CASPER_BROKER_HSM_TEST_CHECK(expected.merkle_ == request.merkle_, "'%s' merkle mismatch", a_body.c_str());
+    NGX_CASPER_BROKER_HSM_TEST_CHECK(expected.chain_ == request.chain_, "'%s' chain mismatch", a_body.c_str());
+}
+
+#ifdef __APPLE__
+#pragma mark - Main
+#endif
+
+int main (int /* a_argc */, char** /* a_argv */)
+{
+    // ... common shapes, fast path ...
+    Check("{\"key\":\"k\",\"hash\":\"3q2+7w==\"}", true);
+    Check(" {\n\t\"key\" : \"key-1\" ,\r\n \"hash\" : [ \"AAEC\" , \"/+8=\" ] , \"merkle\": true, \"chain\":false }\n", true);
+    Check("{\"hash\":[\"a\",\"b\",\"c\"],\"chain\":true,\"key\":\"k\"}", true);
+    Check("{\"key\":\"k\",\"hash\":[]}", true);
+    Check("{\"key\":\"k\",\"merkle\":false,\"chain\":true,\"hash\":\"x\"}", true);
+    Check("{\"key\":\"\",\"hash\":\"\"}", true);
+    
+    // ... valid JSON outside parser subset, DOM path ...
+    Check("{\"key\":\"k\",\"hash\":\"a\\/b\"}", false);
+    Check("{\"key\":\"k\\u0031\",\"hash\":\"a\"}", false);
+    Check("{\"key\":\"k\",\"hash\":\"a\",\"other\":1}", false);
+    Check("{\"key\":\"k\",\"key\":\"j\",\"hash\":\"a\"}", false);
+    Check("{\"key\":\"k\",\"hash\":[\"a\",\"b\"],\"hash\":\"c\"}", false);
+    
+    // ... invalid, rejected by both ...
+    Check("", false);
+    Check("{}", false);
+    Check("[]", false);
+    Check("{\"hash\":\"a\"}", false);
+    Check("{\"key\":1,\"hash\":\"a\"}", false);
+    Check("{\"key\":\"k\",\"hash\":[\"a\",]}", false);
+    Check("{\"key\":\"k\",\"hash\":[\"a\" \"b\"]}", false);
+    Check("{\"key\":\"k\",\"hash\":[\"a\",1]}", false);
+    Check("{\"key\":\"k\",\"merkle\":truex}", false);
+    Check("{\"key\":\"k\",\"merkle\":\"true\"}", false);
+    Check("{\"key\":\"k\",\"hash\":\"a\"} x", false);
+    Check("{\"key\":\"k\",\"hash\":\"a\"", false);
+    Check("{\"key\":\"k\",\"hash\":\"a", false);
+    Check("{\"key\":\"k", false);
+    Check("{\"key\"", false);
+    
+    // ... every truncation of a valid request is rejected ( and never read past it's end ) ...
+    const std::string full = "{\"key\":\"k\",\"hash\":[\"AAEC\",\"/+8=\"],\"merkle\":true,\"chain\":false}";
+    for ( size_t length = 0 ; length < full.length() ; ++length ) {
+        Check(full.substr(0, length), false);
+    }
+    
+    // ... large batch ...
+    std::stringstream ss;
+    ss << "{\"key\":\"bulk\",\"hash\":[";
+    for ( size_t idx = 0 ; idx < 1000 ; ++idx ) {
+        ss << ( 0 == idx ? "" : "," ) << "\"" << idx << "\"";
+    }
+    ss << "]}";
+    Check(ss.str(), true);
+    
+    fprintf(stdout, "parser: %s ( %zu failure(s) )\n", 0 == s_failures_ ? "OK" : "FAILED", s_failures_);
+    return ( 0 == s_failures_ ? 0 : -1 );
+}
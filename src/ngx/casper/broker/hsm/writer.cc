@@ -0,0 +1,244 @@
+/**
+ * @file writer.cc
+ *
+ * Copyright (c) 2017-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of nginx-hsm.
+ *
+ * nginx-hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nginx-hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with nginx-hsm. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ngx/casper/broker/hsm/writer.h"
+
+#include "cc/exception.h"
+
+/**
+ * @brief Default constructor.
+ *
+ * @param a_pool       Pool to allocate buffers from, usually the request pool.
+ * @param a_chunk_size Minimum size of each allocated buffer.
+ */
+ngx::casper::broker::hsm::Writer::Writer (ngx_pool_t* a_pool, const size_t a_chunk_size)
+    : pool_(a_pool), chunk_size_(a_chunk_size)
+{
+    head_   = nullptr;
+    tail_   = nullptr;
+    length_ = 0;
+}
+
+/**
+ * @brief Destructor.
+ */
+ngx::casper::broker::hsm::Writer::~Writer ()
+{
+    /* empty - memory is owned by pool */
+}
+
+/**
+ * @brief Append raw data.
+ *
+ * @param a_data   Data to append.
+ * @param a_length Data length, in bytes.
+ */
+void ngx::casper::broker::hsm::Writer::Append (const char* const a_data, const size_t a_length)
+{
+    if ( 0 == a_length ) {
+        return;
+    }
+    ngx_memcpy(Reserve(a_length), a_data, a_length);
+}
+
+/**
+ * @brief Append base64 ( RFC 4648 ) encoded data.
+ *
+ * @param a_data   Data to encode.
+ * @param a_length Data length, in bytes.
+ */
+void ngx::casper::broker::hsm::Writer::AppendBase64 (const unsigned char* const a_data, const size_t a_length)
+{
+    if ( 0 == a_length ) {
+        return;
+    }
+    EncodeBase64(a_data, a_length, Reserve(Base64Length(a_length)));
+}
+
+/**
+ * @brief Mark the end of the body.
+ *
+ * @return The buffer chain to send, owned by pool.
+ */
+ngx_chain_t* ngx::casper::broker::hsm::Writer::Finish ()
+{
+    // ... an empty body still needs a ( special ) buffer to carry last_buf ...
+    if ( nullptr == tail_ ) {
+        ngx_buf_t* buffer = ngx_calloc_buf(pool_);
+        if ( NULL == buffer ) {
+            throw ::cc::Exception("Unable to allocate a response %s!", "buffer");
+        }
+        Link(buffer);
+    }
+    tail_->buf->last_buf      = 1;
+    tail_->buf->last_in_chain = 1;
+    return head_;
+}
+
+/**
+ * @brief Ensure there's enough space to write data to the current buffer.
+ *
+ * @param a_length Number of bytes that will be written.
+ *
+ * @return Pointer to where data should be written, buffer position is already advanced.
+ */
+u_char* ngx::casper::broker::hsm::Writer::Reserve (const size_t a_length)
+{
+    // ... current buffer can't hold it?
+    if ( nullptr == tail_ || static_cast<size_t>(tail_->buf->end - tail_->buf->last) < a_length ) {
+        ngx_buf_t* buffer = ngx_create_temp_buf(pool_, a_length > chunk_size_ ? a_length : chunk_size_);
+        if ( NULL == buffer ) {
+            throw ::cc::Exception("Unable to allocate a response buffer with %zu byte(s)!", a_length > chunk_size_ ? a_length : chunk_size_);
+        }
+        Link(buffer);
+    }
+    u_char* ptr = tail_->buf->last;
+    tail_->buf->last += a_length;
+    length_          += a_length;
+    return ptr;
+}
+
+/**
+ * @brief Append a buffer to the chain.
+ *
+ * @param a_buffer Buffer to append.
+ */
+void ngx::casper::broker::hsm::Writer::Link (ngx_buf_t* a_buffer)
+{
+    ngx_chain_t* link = ngx_alloc_chain_link(pool_);
+    if ( NULL == link ) {
+        throw ::cc::Exception("Unable to allocate a response %s!", "chain link");
+    }
+    link->buf  = a_buffer;
+    link->next = NULL;
+    if ( nullptr == tail_ ) {
+        head_ = link;
+    } else {
+        tail_->next = link;
+    }
+    tail_ = link;
+}
+
+/**
+ * @brief Base64 ( RFC 4648 ) encode data.
+ *
+ * @param a_data   Data to encode.
+ * @param a_length Data length, in bytes.
+ * @param o_out    Where to write encoded data, must have at least \link Base64Length \link bytes.
+ *
+ * @return Pointer past last written byte.
+ */
+u_char* ngx::casper::broker::hsm::Writer::EncodeBase64 (const unsigned char* const a_data, const size_t a_length, u_char* o_out)
+{
+    static const char sk_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    
+    u_char* out = o_out;
+    
+    size_t idx = 0;
+    for ( ; idx + 2 < a_length ; idx += 3 ) {
+        const uint32_t v = ( static_cast<uint32_t>(a_data[idx]) << 16 ) | ( static_cast<uint32_t>(a_data[idx + 1]) << 8 ) | static_cast<uint32_t>(a_data[idx + 2]);
+        *out++ = sk_alphabet[( v >> 18 ) & 0x3F];
+        *out++ = sk_alphabet[( v >> 12 ) & 0x3F];
+        *out++ = sk_alphabet[( v >>  6 ) & 0x3F];
+        *out++ = sk_alphabet[( v       ) & 0x3F];
+    }
+    if ( idx < a_length ) {
+        const uint32_t v = ( static_cast<uint32_t>(a_data[idx]) << 16 ) | ( idx + 1 < a_length ? static_cast<uint32_t>(a_data[idx + 1]) << 8 : 0 );
+        *out++ = sk_alphabet[( v >> 18 ) & 0x3F];
+        *out++ = sk_alphabet[( v >> 12 ) & 0x3F];
+        *out++ = ( idx + 1 < a_length ? sk_alphabet[( v >> 6 ) & 0x3F] : '=' );
+        *out++ = '=';
+    }
+    
+    return out;
+}
+
+/**
+ * @brief Calculate JSON string escaped length.
+ *
+ * @param a_data   UTF-8 string, not quoted.
+ * @param a_length String length, in bytes.
+ *
+ * @return Number of bytes required by \link EscapeJSON \link.
+ */
+size_t ngx::casper::broker::hsm::Writer::EscapedLength (const char* const a_data, const size_t a_length)
+{
+    size_t length = a_length;
+    for ( size_t idx = 0 ; idx < a_length ; ++idx ) {
+        const unsigned char c = static_cast<unsigned char>(a_data[idx]);
+        if ( '"' == c || '\\' == c || '\n' == c || '\r' == c || '\t' == c ) {
+            length += 1;
+        } else if ( c < 0x20 ) {
+            length += 5;
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief JSON string escape data, quotes are not written.
+ *
+ * @param a_data   UTF-8 string, not quoted.
+ * @param a_length String length, in bytes.
+ * @param o_out    Where to write escaped string, must have at least \link EscapedLength \link bytes.
+ *
+ * @return Pointer past last written byte.
+ */
+u_char* ngx::casper::broker::hsm::Writer::EscapeJSON (const char* const a_data, const size_t a_length, u_char* o_out)
+{
+    static const char sk_hex[] = "0123456789abcdef";
+    
+    u_char* out = o_out;
+    
+    for ( size_t idx = 0 ; idx < a_length ; ++idx ) {
+        const unsigned char c = static_cast<unsigned char>(a_data[idx]);
+        switch (c) {
+            case '"':
+            case '\\':
+                *out++ = '\\';
+                *out++ = c;
+                break;
+            case '\n':
+                *out++ = '\\';
+                *out++ = 'n';
+                break;
+            case '\r':
+                *out++ = '\\';
+                *out++ = 'r';
+                break;
+            case '\t':
+                *out++ = '\\';
+                *out++ = 't';
+                break;
+            default:
+                if ( c < 0x20 ) {
+                    out = ngx_cpymem(out, "\\u00", 4);
+                    *out++ = sk_hex[c >> 4];
+                    *out++ = sk_hex[c & 0x0F];
+                } else {
+                    *out++ = c;
+                }
+                break;
+        }
+    }
+    
+    return out;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file writer.h
+ *
+ * Copyright (c) 2017-2023 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of nginx-hsm.
+ *
+ * nginx-hsm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nginx-hsm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with nginx-hsm. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef NRS_NGX_CASPER_BROKER_HSM_WRITER_H_
+#define NRS_NGX_CASPER_BROKER_HSM_WRITER_H_
+
+extern "C" {
+    #include <ngx_config.h>
+    #include <ngx_core.h>
+    #include <ngx_http.h>
+}
+
+#include "cc/non-copyable.h"
+#include "cc/non-movable.h"
+
+#include <string>
+#include <string.h> // strlen
+
+namespace ngx
+{
+    
+    namespace casper
+    {
+        
+        namespace broker
+        {
+            
+            namespace hsm
+            {
+                
+                /**
+                 * @brief Writes a response body directly to nginx pool allocated buffers.
+                 */
+                class Writer final : public ::cc::NonCopyable, public ::cc::NonMovable
+                {
+                    
+                private: // Const Data
+                    
+                    ngx_pool_t* const pool_;
+                    const size_t      chunk_size_;
+                    
+                private: // Data
+                    
+                    ngx_chain_t*      head_;
+                    ngx_chain_t*      tail_;
+                    size_t            length_;
+                    
+                public: // Constructor(s) / Destructor
+                    
+                    Writer () = delete;
+                    Writer (ngx_pool_t* a_pool, const size_t a_chunk_size);
+                    virtual ~Writer ();
+                    
+                public: // Method(s) / Function(s)
+                    
+                    void         Append       (const char* const a_data, const size_t a_length);
+                    void         AppendBase64 (const unsigned char* const a_data, const size_t a_length);
+                    ngx_chain_t* Finish       ();
+                    
+                public: // Static Method(s) / Function(s)
+                    
+                    static u_char* EncodeBase64  (const unsigned char* const a_data, const size_t a_length, u_char* o_out);
+                    static size_t  EscapedLength (const char* const a_data, const size_t a_length);
+                    static u_char* EscapeJSON    (const char* const a_data, const size_t a_length, u_char* o_out);
+                    
+                private: // Method(s) / Function(s)
+                    
+                    u_char*      Reserve      (const size_t a_length);
+                    void         Link         (ngx_buf_t* a_buffer);
+                    
+                public: // Inline Method(s) / Function(s)
+                    
+                    /**
+                     * @brief Append a single character.
+                     *
+                     * @param a_char Character to append.
+                     */
+                    inline void Append (const char a_char)
+                    {
+                        *Reserve(1) = static_cast<u_char>(a_char);
+                    }
+                    
+                    /**
+                     * @brief Append a NULL terminated string.
+                     *
+                     * @param a_cstr String to append.
+                     */
+                    inline void Append (const char* const a_cstr)
+                    {
+                        Append(a_cstr, strlen(a_cstr));
+                    }
+                    
+                    /**
+                     * @brief Append a string.
+                     *
+                     * @param a_string String to append.
+                     */
+                    inline void Append (const std::string& a_string)
+                    {
+                        Append(a_string.c_str(), a_string.length());
+                    }
+                    
+                    /**
+                     * @return Number of bytes required to base64 encode \link a_length \link bytes.
+                     */
+                    static inline size_t Base64Length (const size_t a_length)
+                    {
+                        return ( ( a_length + 2 ) / 3 ) * 4;
+                    }
+                    
+                    /**
+                     * @return Number of bytes written so far.
+                     */
+                    inline size_t length () const
+                    {
+                        return length_;
+                    }
+                    
+                }; // end of class 'Writer'
+                
+            } // end of namespace 'hsm'
+            
+        } // end of namespace 'broker'
+        
+    } // end of namespace 'casper'
+    
+} // end of namespace 'ngx'
+
+#endif // NRS_NGX_CASPER_BROKER_HSM_WRITER_H_